@@ -9,7 +9,97 @@
 #include "stb_image.h"
 #include "stb_image_write.h"
 #include <fstream>
+#include <emmintrin.h>
 #include "Core/Paths.h"
+#include "Core/TaskQueue.h"
+#include "Core/CommandLine.h"
+#include "Core/Utils.h"
+#include "Core/MappedFile.h"
+#include "Graphics/RHI/D3D.h"
+#include "ImageCompression.h"
+
+// Bump when the encoders change to invalidate the texture cache
+static constexpr uint64 gTextureCacheVersion = 2;
+
+namespace DDS
+{
+	// .DDS subheader.
+#pragma pack(push,1)
+	struct PixelFormatHeader
+	{
+		uint32 dwSize;
+		uint32 dwFlags;
+		uint32 dwFourCC;
+		uint32 dwRGBBitCount;
+		uint32 dwRBitMask;
+		uint32 dwGBitMask;
+		uint32 dwBBitMask;
+		uint32 dwABitMask;
+	};
+#pragma pack(pop)
+
+	// .DDS header.
+#pragma pack(push,1)
+	struct FileHeader
+	{
+		uint32 dwSize;
+		uint32 dwFlags;
+		uint32 dwHeight;
+		uint32 dwWidth;
+		uint32 dwLinearSize;
+		uint32 dwDepth;
+		uint32 dwMipMapCount;
+		uint32 dwReserved1[11];
+		PixelFormatHeader ddpf;
+		uint32 dwCaps;
+		uint32 dwCaps2;
+		uint32 dwCaps3;
+		uint32 dwCaps4;
+		uint32 dwReserved2;
+	};
+#pragma pack(pop)
+
+	// .DDS 10 header.
+#pragma pack(push,1)
+	struct DX10FileHeader
+	{
+		uint32 dxgiFormat;
+		uint32 resourceDimension;
+		uint32 miscFlag;
+		uint32 arraySize;
+		uint32 reserved;
+	};
+#pragma pack(pop)
+
+	enum DDS_CAP_ATTRIBUTE
+	{
+		DDSCAPS_COMPLEX = 0x00000008U,
+		DDSCAPS_TEXTURE = 0x00001000U,
+		DDSCAPS_MIPMAP = 0x00400000U,
+		DDSCAPS2_VOLUME = 0x00200000U,
+		DDSCAPS2_CUBEMAP = 0x00000200U,
+	};
+
+	constexpr uint32 MakeFourCC(uint32 a, uint32 b, uint32 c, uint32 d) { return a | (b << 8u) | (c << 16u) | (d << 24u); }
+
+	static void ConvertDX10Format(DXGI_FORMAT format, ResourceFormat& outFormat, bool& outSRGB)
+	{
+		if (format == DXGI_FORMAT_BC1_UNORM)			{ outFormat = ResourceFormat::BC1_UNORM;			outSRGB = false;	return;		}
+		if (format == DXGI_FORMAT_BC1_UNORM_SRGB)		{ outFormat = ResourceFormat::BC1_UNORM;			outSRGB = true;		return;		}
+		if (format == DXGI_FORMAT_BC2_UNORM)			{ outFormat = ResourceFormat::BC2_UNORM;			outSRGB = false;	return;		}
+		if (format == DXGI_FORMAT_BC2_UNORM_SRGB)		{ outFormat = ResourceFormat::BC2_UNORM;			outSRGB = true;		return;		}
+		if (format == DXGI_FORMAT_BC3_UNORM)			{ outFormat = ResourceFormat::BC3_UNORM;			outSRGB = false;	return;		}
+		if (format == DXGI_FORMAT_BC4_UNORM)			{ outFormat = ResourceFormat::BC4_UNORM;			outSRGB = false;	return;		}
+		if (format == DXGI_FORMAT_BC5_UNORM)			{ outFormat = ResourceFormat::BC5_UNORM;			outSRGB = false;	return;		}
+		if (format == DXGI_FORMAT_BC6H_UF16)			{ outFormat = ResourceFormat::BC6H_UFLOAT;			outSRGB = false;	return;		}
+		if (format == DXGI_FORMAT_BC7_UNORM)			{ outFormat = ResourceFormat::BC7_UNORM;			outSRGB = false;	return;		}
+		if (format == DXGI_FORMAT_BC7_UNORM_SRGB)		{ outFormat = ResourceFormat::BC7_UNORM;			outSRGB = true;		return;		}
+		if (format == DXGI_FORMAT_R8G8B8A8_UNORM)		{ outFormat = ResourceFormat::RGBA8_UNORM;			outSRGB = false;	return;		}
+		if (format == DXGI_FORMAT_R8G8B8A8_UNORM_SRGB)	{ outFormat = ResourceFormat::RGBA8_UNORM;			outSRGB = true;		return;		}
+		if (format == DXGI_FORMAT_R32G32B32A32_FLOAT)	{ outFormat = ResourceFormat::RGBA32_FLOAT;			outSRGB = false;	return;		}
+		if (format == DXGI_FORMAT_R32G32_FLOAT)			{ outFormat = ResourceFormat::RG32_FLOAT;			outSRGB = false;	return;		}
+	}
+}
 
 Image::Image(ResourceFormat format)
 	: m_Format(format)
@@ -31,24 +121,21 @@ bool Image::Load(const char* inputStream)
 	const std::string extension = Paths::GetFileExtenstion(inputStream);
 	bool success = false;
 
-	std::ifstream s(inputStream, std::ios::binary | std::ios::ate);
-	if (s.fail())
+	std::shared_ptr<MappedFile> pFile = std::make_shared<MappedFile>();
+	if (!pFile->Open(inputStream))
 	{
 		return false;
 	}
 
-	std::vector<char> data((size_t)s.tellg());
-	s.seekg(0);
-	s.read(data.data(), data.size());
-
 	if (extension == "dds")
 	{
-		success = LoadDDS(data.data(), (uint32)data.size());
+		// The pixels are referenced straight from the mapping
+		success = LoadDDS(pFile->GetData(), (uint32)pFile->GetSize(), pFile);
 	}
 	//If not one of the above, load with Stbi by default (jpg, png, tga, bmp, ...)
 	else
 	{
-		success = LoadSTB(data.data(), (uint32)data.size());
+		success = LoadSTB(pFile->GetData(), (uint32)pFile->GetSize());
 	}
 	return success;
 }
@@ -63,22 +150,52 @@ bool Image::Load(const void* pData, size_t dataSize, const char* pFormatHint)
 }
 
 bool Image::SetSize(uint32 width, uint32 height, uint32 depth, uint32 numMips)
+{
+	SetDimensions(width, height, depth, numMips);
+	m_pMappedFile.reset();
+	m_pMappedPixels = nullptr;
+	m_Pixels.resize(GetDataSize());
+	return true;
+}
+
+void Image::SetDimensions(uint32 width, uint32 height, uint32 depth, uint32 numMips)
 {
 	m_Width = Math::Max(1u, width);
 	m_Height = Math::Max(1u, height);
 	m_Depth = Math::Max(1u, depth);
 	m_MipLevels = numMips;
-	m_Pixels.resize(RHI::GetTextureByteSize(m_Format, m_Width, m_Height, m_Depth, numMips));
-	return true;
+}
+
+void Image::SetMappedData(const std::shared_ptr<const MappedFile>& pFile, const uint8* pPixels)
+{
+	m_Pixels = {};
+	m_pMappedFile = pFile;
+	m_pMappedPixels = pPixels;
+}
+
+void Image::DetachMapping()
+{
+	if (m_pMappedPixels)
+	{
+		m_Pixels.assign(m_pMappedPixels, m_pMappedPixels + GetDataSize());
+		m_pMappedFile.reset();
+		m_pMappedPixels = nullptr;
+	}
+}
+
+uint64 Image::GetDataSize() const
+{
+	return RHI::GetTextureByteSize(m_Format, m_Width, m_Height, m_Depth, m_MipLevels);
 }
 
 bool Image::SetData(const void* pPixels)
 {
-	return SetData(pPixels, 0, (uint32)m_Pixels.size());
+	return SetData(pPixels, 0, (uint32)GetDataSize());
 }
 
 bool Image::SetData(const void* pData, uint32 offsetInBytes, uint32 sizeInBytes)
 {
+	DetachMapping();
 	check(offsetInBytes + sizeInBytes <= m_Pixels.size());
 	memcpy(m_Pixels.data() + offsetInBytes, pData, sizeInBytes);
 	return true;
@@ -88,6 +205,7 @@ bool Image::SetPixel(uint32 x, uint32 y, const Color& color)
 {
 	const FormatInfo& info = RHI::GetFormatInfo(m_Format);
 	checkf(!info.IsBC, "Can't get pixel data from block compressed texture");
+	DetachMapping();
 	if (x + y * m_Width >= (uint32)m_Pixels.size())
 	{
 		return false;
@@ -104,7 +222,8 @@ bool Image::SetPixelInt(uint32 x, uint32 y, unsigned int color)
 {
 	const FormatInfo& info = RHI::GetFormatInfo(m_Format);
 	checkf(!info.IsBC, "Can't get pixel data from block compressed texture");
-	if (x + y * m_Width >= (int)m_Pixels.size())
+	DetachMapping();
+	if (x + y * m_Width >= (uint32)m_Pixels.size())
 	{
 		return false;
 	}
@@ -121,11 +240,11 @@ Color Image::GetPixel(uint32 x, uint32 y) const
 	const FormatInfo& info = RHI::GetFormatInfo(m_Format);
 	checkf(!info.IsBC, "Can't get pixel data from block compressed texture");
 	Color c = {};
-	if (x + y * m_Width >= (int)m_Pixels.size())
+	if (x + y * m_Width >= GetDataSize())
 	{
 		return c;
 	}
-	const unsigned char* pPixel = &m_Pixels[(x + (y * m_Width)) * info.NumComponents * m_Depth];
+	const unsigned char* pPixel = GetData() + (x + (y * m_Width)) * info.NumComponents * m_Depth;
 	for (uint32 i = 0; i < info.NumComponents; ++i)
 	{
 		reinterpret_cast<float*>(&c)[i] = (float)pPixel[i] / 255.0f;
@@ -138,11 +257,11 @@ uint32 Image::GetPixelInt(uint32 x, uint32 y) const
 	const FormatInfo& info = RHI::GetFormatInfo(m_Format);
 	checkf(!info.IsBC, "Can't get pixel data from block compressed texture");
 	uint32 c = 0;
-	if (x + y * m_Width >= (uint32)m_Pixels.size())
+	if (x + y * m_Width >= GetDataSize())
 	{
 		return c;
 	}
-	const unsigned char* pPixel = &m_Pixels[(x + (y * m_Width)) * info.NumComponents * m_Depth];
+	const unsigned char* pPixel = GetData() + (x + (y * m_Width)) * info.NumComponents * m_Depth;
 	for (uint32 i = 0; i < info.NumComponents; ++i)
 	{
 		c <<= 8;
@@ -159,7 +278,7 @@ const unsigned char* Image::GetData(uint32 mipLevel) const
 	{
 		offset += RHI::GetTextureMipByteSize(m_Format, m_Width, m_Height, m_Depth, mip);
 	}
-	return m_Pixels.data() + offset;
+	return (m_pMappedPixels ? m_pMappedPixels : m_Pixels.data()) + offset;
 }
 
 bool Image::LoadSTB(const void* pBytes, uint32 numBytes)
@@ -181,6 +300,8 @@ bool Image::LoadSTB(const void* pBytes, uint32 numBytes)
 		m_Height = (uint32)height;
 		m_Depth = 1;
 		m_Format = ResourceFormat::RGBA32_FLOAT;
+		m_MipLevels = 1;
+		SetMappedData(nullptr, nullptr);
 		m_Pixels.resize(m_Width * m_Height * 4 * sizeof(float));
 		memcpy(m_Pixels.data(), pPixels, m_Pixels.size());
 		stbi_image_free(pPixels);
@@ -198,6 +319,8 @@ bool Image::LoadSTB(const void* pBytes, uint32 numBytes)
 		m_Height = (uint32)height;
 		m_Depth = 1;
 		m_Format = ResourceFormat::RGBA8_UNORM;
+		m_MipLevels = 1;
+		SetMappedData(nullptr, nullptr);
 		m_Pixels.resize(m_Width * m_Height * 4);
 		memcpy(m_Pixels.data(), pPixels, m_Pixels.size());
 		stbi_image_free(pPixels);
@@ -205,71 +328,15 @@ bool Image::LoadSTB(const void* pBytes, uint32 numBytes)
 	}
 }
 
-bool Image::LoadDDS(const void* pData, uint32 /*numBytes*/)
+bool Image::LoadDDS(const void* pData, uint32 numBytes, const std::shared_ptr<const MappedFile>& pMappedFile)
 {
-	char* pBytes = (char*)pData;
-
-	// .DDS subheader.
-#pragma pack(push,1)
-	struct PixelFormatHeader
-	{
-		uint32 dwSize;
-		uint32 dwFlags;
-		uint32 dwFourCC;
-		uint32 dwRGBBitCount;
-		uint32 dwRBitMask;
-		uint32 dwGBitMask;
-		uint32 dwBBitMask;
-		uint32 dwABitMask;
-	};
-#pragma pack(pop)
-
-	// .DDS header.
-#pragma pack(push,1)
-	struct FileHeader
-	{
-		uint32 dwSize;
-		uint32 dwFlags;
-		uint32 dwHeight;
-		uint32 dwWidth;
-		uint32 dwLinearSize;
-		uint32 dwDepth;
-		uint32 dwMipMapCount;
-		uint32 dwReserved1[11];
-		PixelFormatHeader ddpf;
-		uint32 dwCaps;
-		uint32 dwCaps2;
-		uint32 dwCaps3;
-		uint32 dwCaps4;
-		uint32 dwReserved2;
-	};
-#pragma pack(pop)
-
-	// .DDS 10 header.
-#pragma pack(push,1)
-	struct DX10FileHeader
-	{
-		uint32 dxgiFormat;
-		uint32 resourceDimension;
-		uint32 miscFlag;
-		uint32 arraySize;
-		uint32 reserved;
-	};
-#pragma pack(pop)
-
-	enum DDS_CAP_ATTRIBUTE
-	{
-		DDSCAPS_COMPLEX = 0x00000008U,
-		DDSCAPS_TEXTURE = 0x00001000U,
-		DDSCAPS_MIPMAP = 0x00400000U,
-		DDSCAPS2_VOLUME = 0x00200000U,
-		DDSCAPS2_CUBEMAP = 0x00000200U,
-	};
+	using namespace DDS;
 
-	auto MakeFourCC = [](uint32 a, uint32 b, uint32 c, uint32 d) { return a | (b << 8u) | (c << 16u) | (d << 24u); };
+	const char* pBytes = (const char*)pData;
+	const char* pEnd = pBytes + numBytes;
 
 	constexpr const char pMagic[] = "DDS ";
-	if (memcmp(pMagic, pBytes, 4) != 0)
+	if (numBytes < 4 + sizeof(FileHeader) || memcmp(pMagic, pBytes, 4) != 0)
 	{
 		return false;
 	}
@@ -290,24 +357,13 @@ bool Image::LoadDDS(const void* pData, uint32 /*numBytes*/)
 
 		if (hasDxgi)
 		{
+			if (pBytes + sizeof(DX10FileHeader) > pEnd)
+			{
+				return false;
+			}
 			pDx10Header = (DX10FileHeader*)pBytes;
 			pBytes += sizeof(DX10FileHeader);
 
-			auto ConvertDX10Format = [](DXGI_FORMAT format, ResourceFormat& outFormat, bool& outSRGB)
-			{
-				if (format == DXGI_FORMAT_BC1_UNORM)			{ outFormat = ResourceFormat::BC1_UNORM;			outSRGB = false;	return;		}
-				if (format == DXGI_FORMAT_BC1_UNORM_SRGB)		{ outFormat = ResourceFormat::BC1_UNORM;			outSRGB = true;		return;		}
-				if (format == DXGI_FORMAT_BC2_UNORM)			{ outFormat = ResourceFormat::BC2_UNORM;			outSRGB = false;	return;		}
-				if (format == DXGI_FORMAT_BC2_UNORM_SRGB)		{ outFormat = ResourceFormat::BC2_UNORM;			outSRGB = true;		return;		}
-				if (format == DXGI_FORMAT_BC3_UNORM)			{ outFormat = ResourceFormat::BC3_UNORM;			outSRGB = false;	return;		}
-				if (format == DXGI_FORMAT_BC4_UNORM)			{ outFormat = ResourceFormat::BC4_UNORM;			outSRGB = false;	return;		}
-				if (format == DXGI_FORMAT_BC5_UNORM)			{ outFormat = ResourceFormat::BC5_UNORM;			outSRGB = false;	return;		}
-				if (format == DXGI_FORMAT_BC6H_UF16)			{ outFormat = ResourceFormat::BC6H_UFLOAT;			outSRGB = false;	return;		}
-				if (format == DXGI_FORMAT_BC7_UNORM)			{ outFormat = ResourceFormat::BC7_UNORM;			outSRGB = false;	return;		}
-				if (format == DXGI_FORMAT_BC7_UNORM_SRGB)		{ outFormat = ResourceFormat::BC7_UNORM;			outSRGB = true;		return;		}
-				if (format == DXGI_FORMAT_R32G32B32A32_FLOAT)	{ outFormat = ResourceFormat::RGBA32_FLOAT;			outSRGB = false;	return;		}
-				if (format == DXGI_FORMAT_R32G32_FLOAT)			{ outFormat = ResourceFormat::RG32_FLOAT;			outSRGB = false;	return;		}
-			};
 			ConvertDX10Format((DXGI_FORMAT)pDx10Header->dxgiFormat, m_Format, m_sRgb);
 		}
 		else
@@ -366,8 +422,23 @@ bool Image::LoadDDS(const void* pData, uint32 /*numBytes*/)
 		Image* pCurrentImage = this;
 		for (uint32 imageIdx = 0; imageIdx < imageChainCount; ++imageIdx)
 		{
-			pCurrentImage->SetSize(pHeader->dwWidth, pHeader->dwHeight, pHeader->dwDepth, pHeader->dwMipMapCount);
-			pCurrentImage->SetData(pBytes);
+			pCurrentImage->SetDimensions(pHeader->dwWidth, pHeader->dwHeight, pHeader->dwDepth, Math::Max(1u, pHeader->dwMipMapCount));
+			const uint64 imageSize = pCurrentImage->GetDataSize();
+			if (pBytes + imageSize > pEnd)
+			{
+				return false;
+			}
+
+			if (pMappedFile)
+			{
+				pCurrentImage->SetMappedData(pMappedFile, (const uint8*)pBytes);
+			}
+			else
+			{
+				pCurrentImage->SetSize(pHeader->dwWidth, pHeader->dwHeight, pHeader->dwDepth, Math::Max(1u, pHeader->dwMipMapCount));
+				pCurrentImage->SetData(pBytes);
+			}
+			pBytes += imageSize;
 
 			if (imageIdx < imageChainCount - 1)
 			{
@@ -389,12 +460,475 @@ void Image::Save(const char* pFilePath)
 	std::string extension = Paths::GetFileExtenstion(pFilePath);
 	if (extension == "png")
 	{
-		int result = stbi_write_png(pFilePath, m_Width, m_Height, info.NumComponents, m_Pixels.data(), m_Width * 4);
+		int result = stbi_write_png(pFilePath, m_Width, m_Height, info.NumComponents, GetData(), m_Width * 4);
 		check(result);
 	}
 	else if (extension == "jpg")
 	{
-		int result = stbi_write_jpg(pFilePath, m_Width, m_Height, info.NumComponents, m_Pixels.data(), 70);
+		int result = stbi_write_jpg(pFilePath, m_Width, m_Height, info.NumComponents, GetData(), 70);
 		check(result);
 	}
 }
+
+bool Image::SaveDDS(const char* pFilePath) const
+{
+	using namespace DDS;
+
+	std::ofstream stream(pFilePath, std::ios::binary);
+	if (stream.fail())
+	{
+		return false;
+	}
+
+	FileHeader header{};
+	header.dwSize = sizeof(FileHeader);
+	// CAPS | HEIGHT | WIDTH | PIXELFORMAT | MIPMAPCOUNT | LINEARSIZE
+	header.dwFlags = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000;
+	header.dwWidth = m_Width;
+	header.dwHeight = m_Height;
+	header.dwDepth = m_Depth;
+	header.dwMipMapCount = m_MipLevels;
+	header.dwLinearSize = (uint32)RHI::GetTextureMipByteSize(m_Format, m_Width, m_Height, m_Depth, 0);
+	header.ddpf.dwSize = sizeof(PixelFormatHeader);
+	header.ddpf.dwFlags = 0x4; // FOURCC
+	header.ddpf.dwFourCC = MakeFourCC('D', 'X', '1', '0');
+	header.dwCaps = DDSCAPS_TEXTURE;
+	if (m_MipLevels > 1)
+	{
+		header.dwCaps |= DDSCAPS_COMPLEX | DDSCAPS_MIPMAP;
+	}
+
+	DX10FileHeader dx10Header{};
+	dx10Header.dxgiFormat = D3D::ConvertFormat(m_Format);
+	dx10Header.resourceDimension = 3; // D3D12_RESOURCE_DIMENSION_TEXTURE2D
+	dx10Header.arraySize = 1;
+
+	stream.write("DDS ", 4);
+	stream.write((const char*)&header, sizeof(FileHeader));
+	stream.write((const char*)&dx10Header, sizeof(DX10FileHeader));
+	stream.write((const char*)GetData(), GetDataSize());
+	return !stream.fail();
+}
+
+bool Image::LoadDDSMips(const char* pFilePath, uint32 firstMip, uint32 numMips)
+{
+	using namespace DDS;
+
+	std::shared_ptr<MappedFile> pFile = std::make_shared<MappedFile>();
+	constexpr uint64 headerSize = 4 + sizeof(FileHeader) + sizeof(DX10FileHeader);
+	if (!pFile->Open(pFilePath) || pFile->GetSize() < headerSize)
+	{
+		return false;
+	}
+
+	const uint8* pBytes = pFile->GetData();
+	const FileHeader& header = *(const FileHeader*)(pBytes + 4);
+	const DX10FileHeader& dx10Header = *(const DX10FileHeader*)(pBytes + 4 + sizeof(FileHeader));
+	if (memcmp(pBytes, "DDS ", 4) != 0 || header.ddpf.dwFourCC != MakeFourCC('D', 'X', '1', '0') || dx10Header.arraySize != 1)
+	{
+		return false;
+	}
+	if (firstMip + numMips > Math::Max(1u, header.dwMipMapCount))
+	{
+		return false;
+	}
+
+	m_Format = ResourceFormat::Unknown;
+	ConvertDX10Format((DXGI_FORMAT)dx10Header.dxgiFormat, m_Format, m_sRgb);
+	if (m_Format == ResourceFormat::Unknown)
+	{
+		return false;
+	}
+
+	uint64 offset = 0;
+	for (uint32 mip = 0; mip < firstMip; ++mip)
+	{
+		offset += RHI::GetTextureMipByteSize(m_Format, header.dwWidth, header.dwHeight, 1, mip);
+	}
+
+	SetDimensions(header.dwWidth >> firstMip, header.dwHeight >> firstMip, 1, numMips);
+	if (headerSize + offset + GetDataSize() > pFile->GetSize())
+	{
+		return false;
+	}
+	SetMappedData(pFile, pBytes + headerSize + offset);
+	return true;
+}
+
+bool Image::LoadCompressed(const char* pFilePath, ImageCompressionHint hint, float alphaTestReference, std::string* pOutCachePath)
+{
+	const std::string extension = Paths::GetFileExtenstion(pFilePath);
+	if (hint == ImageCompressionHint::None || extension == "dds" || CommandLine::GetBool("notexturecompression"))
+	{
+		if (pOutCachePath)
+		{
+			pOutCachePath->clear();
+		}
+		return Load(pFilePath);
+	}
+
+	// The source is only hashed and decoded, map it instead of reading it
+	MappedFile file;
+	if (!file.Open(pFilePath))
+	{
+		return false;
+	}
+	return LoadCompressed(file.GetData(), file.GetSize(), extension.c_str(), hint, alphaTestReference, pOutCachePath);
+}
+
+bool Image::LoadCompressed(const void* pData, size_t dataSize, const char* pFormatHint, ImageCompressionHint hint, float alphaTestReference, std::string* pOutCachePath)
+{
+	if (pOutCachePath)
+	{
+		pOutCachePath->clear();
+	}
+
+	// DDS files are expected to be in their final format already
+	if (hint == ImageCompressionHint::None || std::string(pFormatHint).find("dds") != std::string::npos || CommandLine::GetBool("notexturecompression"))
+	{
+		return Load(pData, dataSize, pFormatHint);
+	}
+
+	uint64 hash = Utils::HashValue(gTextureCacheVersion);
+	hash = Utils::HashValue(hint, hash);
+	hash = Utils::HashValue(alphaTestReference, hash);
+	hash = Utils::HashBytes(pData, dataSize, hash);
+	std::string cachePath = Sprintf("%s%016llx.dds", Paths::TextureCacheDir().c_str(), hash);
+	if (Paths::FileExists(cachePath.c_str()) && Load(cachePath.c_str()))
+	{
+		if (pOutCachePath)
+		{
+			*pOutCachePath = cachePath;
+		}
+		return true;
+	}
+
+	if (!Load(pData, dataSize, pFormatHint))
+	{
+		return false;
+	}
+
+	if (m_Format != ResourceFormat::RGBA8_UNORM)
+	{
+		return true;
+	}
+
+	ImageMipOptions mipOptions;
+	mipOptions.sRGB = hint == ImageCompressionHint::Color;
+	mipOptions.NormalMap = hint == ImageCompressionHint::Normal;
+	mipOptions.AlphaTestReference = alphaTestReference;
+	GenerateMips(mipOptions);
+
+	// Images that can't be block compressed are cached with just their mips
+	if (m_Width % 4 != 0 || m_Height % 4 != 0)
+	{
+		Paths::CreateDirectoryTree(Paths::TextureCacheDir());
+		if (SaveDDS(cachePath.c_str()) && pOutCachePath)
+		{
+			*pOutCachePath = cachePath;
+		}
+		return true;
+	}
+
+	ResourceFormat format = ResourceFormat::Unknown;
+	switch (hint)
+	{
+	case ImageCompressionHint::Color:
+	{
+		bool hasAlpha = false;
+		const uint64 mip0Size = RHI::GetTextureMipByteSize(m_Format, m_Width, m_Height, 1, 0);
+		for (size_t i = 3; i < mip0Size && !hasAlpha; i += 4)
+		{
+			hasAlpha = m_Pixels[i] < 255;
+		}
+		format = hasAlpha ? ResourceFormat::BC3_UNORM : ResourceFormat::BC1_UNORM;
+		break;
+	}
+	case ImageCompressionHint::Normal:			format = ResourceFormat::BC5_UNORM; break;
+	case ImageCompressionHint::Data:			format = ResourceFormat::BC7_UNORM; break;
+	case ImageCompressionHint::SingleChannel:	format = ResourceFormat::BC4_UNORM; break;
+	default: noEntry();
+	}
+
+	Image compressed;
+	if (!Compress(format, compressed))
+	{
+		return true;
+	}
+
+	Paths::CreateDirectoryTree(Paths::TextureCacheDir());
+	if (!compressed.SaveDDS(cachePath.c_str()))
+	{
+		E_LOG(Warning, "Failed to write texture cache '%s'", cachePath.c_str());
+	}
+	else if (pOutCachePath)
+	{
+		*pOutCachePath = cachePath;
+	}
+	*this = std::move(compressed);
+	return true;
+}
+
+bool Image::Compress(ResourceFormat format, Image& outImage) const
+{
+	if (m_Format != ResourceFormat::RGBA8_UNORM || m_Depth != 1 || m_Width % 4 != 0 || m_Height % 4 != 0)
+	{
+		return false;
+	}
+
+	using EncodeFn = void(*)(const uint8*, uint8*);
+	EncodeFn pEncode = nullptr;
+	switch (format)
+	{
+	case ResourceFormat::BC1_UNORM: pEncode = &ImageCompression::EncodeBlockBC1; break;
+	case ResourceFormat::BC3_UNORM: pEncode = &ImageCompression::EncodeBlockBC3; break;
+	case ResourceFormat::BC4_UNORM: pEncode = [](const uint8* pRGBA, uint8* pOutBlock) { ImageCompression::EncodeBlockBC4(pRGBA, pOutBlock); }; break;
+	case ResourceFormat::BC5_UNORM: pEncode = &ImageCompression::EncodeBlockBC5; break;
+	case ResourceFormat::BC7_UNORM: pEncode = &ImageCompression::EncodeBlockBC7; break;
+	default: return false;
+	}
+
+	outImage = Image(format);
+	outImage.m_sRgb = m_sRgb;
+	outImage.SetSize(m_Width, m_Height, 1, m_MipLevels);
+
+	const FormatInfo& info = RHI::GetFormatInfo(format);
+	for (uint32 mip = 0; mip < m_MipLevels; ++mip)
+	{
+		const uint32 width = Math::Max(1u, m_Width >> mip);
+		const uint32 height = Math::Max(1u, m_Height >> mip);
+		const uint32 blocksX = Math::DivideAndRoundUp(width, 4u);
+		const uint32 blocksY = Math::DivideAndRoundUp(height, 4u);
+		const uint8* pSource = GetData(mip);
+		uint8* pTarget = const_cast<uint8*>(outImage.GetData(mip));
+
+		// One job per row of blocks
+		TaskContext context;
+		TaskQueue::ExecuteMany([&](TaskDistributeArgs args)
+			{
+				const uint32 blockY = (uint32)args.JobIndex;
+				uint8 block[16 * 4];
+				for (uint32 blockX = 0; blockX < blocksX; ++blockX)
+				{
+					// Clamp to the edge for mips smaller than a block
+					for (uint32 y = 0; y < 4; ++y)
+					{
+						const uint32 sourceY = Math::Min(blockY * 4 + y, height - 1);
+						for (uint32 x = 0; x < 4; ++x)
+						{
+							const uint32 sourceX = Math::Min(blockX * 4 + x, width - 1);
+							memcpy(&block[(y * 4 + x) * 4], &pSource[(sourceY * width + sourceX) * 4], 4);
+						}
+					}
+					pEncode(block, &pTarget[(blockY * blocksX + blockX) * info.BytesPerBlock]);
+				}
+			}, context, blocksY, 1);
+		TaskQueue::Join(context);
+	}
+	return true;
+}
+
+namespace MipGeneration
+{
+	struct SRGBTables
+	{
+		float ToLinear[256];
+		uint8 FromLinear[4096];
+	};
+
+	static const SRGBTables& GetSRGBTables()
+	{
+		static const SRGBTables tables = []()
+		{
+			SRGBTables result;
+			for (uint32 i = 0; i < 256; ++i)
+			{
+				float v = i / 255.0f;
+				result.ToLinear[i] = v <= 0.04045f ? v / 12.92f : powf((v + 0.055f) / 1.055f, 2.4f);
+			}
+			for (uint32 i = 0; i < 4096; ++i)
+			{
+				float v = i / 4095.0f;
+				v = v <= 0.0031308f ? v * 12.92f : 1.055f * powf(v, 1.0f / 2.4f) - 0.055f;
+				result.FromLinear[i] = (uint8)(v * 255.0f + 0.5f);
+			}
+			return result;
+		}();
+		return tables;
+	}
+
+	static float ComputeAlphaCoverage(const std::vector<Vector4>& pixels, float alphaReference)
+	{
+		uint32 covered = 0;
+		for (const Vector4& pixel : pixels)
+		{
+			covered += pixel.w > alphaReference;
+		}
+		return (float)covered / pixels.size();
+	}
+
+	// Finds the alpha scale that gives the mip the same alpha test coverage as the top mip
+	static float FindAlphaScale(const std::vector<Vector4>& pixels, float alphaReference, float targetCoverage)
+	{
+		float minThreshold = 0.0f;
+		float maxThreshold = 1.0f;
+		float threshold = alphaReference;
+		for (uint32 i = 0; i < 10; ++i)
+		{
+			float coverage = ComputeAlphaCoverage(pixels, threshold);
+			if (coverage < targetCoverage)
+			{
+				maxThreshold = threshold;
+			}
+			else if (coverage > targetCoverage)
+			{
+				minThreshold = threshold;
+			}
+			else
+			{
+				break;
+			}
+			threshold = (minThreshold + maxThreshold) * 0.5f;
+		}
+		return threshold > 0 ? alphaReference / threshold : 1.0f;
+	}
+}
+
+bool Image::GenerateMips(const ImageMipOptions& options)
+{
+	using namespace MipGeneration;
+
+	if (m_Format != ResourceFormat::RGBA8_UNORM || m_Depth != 1 || m_IsCubemap || m_IsArray)
+	{
+		return false;
+	}
+
+	uint32 numMips = 1;
+	while ((m_Width >> numMips) > 0 || (m_Height >> numMips) > 0)
+	{
+		++numMips;
+	}
+	// Resizing keeps the top mip in place
+	SetSize(m_Width, m_Height, 1, numMips);
+
+	const SRGBTables& srgbTables = GetSRGBTables();
+
+	// Filtering is done on float pixels of the previous mip so rounding errors don't accumulate down the chain
+	std::vector<Vector4> source(m_Width * m_Height);
+	{
+		const uint8* pTopMip = GetData(0);
+		TaskContext context;
+		TaskQueue::ExecuteMany([&](TaskDistributeArgs args)
+			{
+				const uint32 y = (uint32)args.JobIndex;
+				for (uint32 x = 0; x < m_Width; ++x)
+				{
+					const uint8* pPixel = &pTopMip[(y * m_Width + x) * 4];
+					Vector4& target = source[y * m_Width + x];
+					if (options.sRGB)
+					{
+						target = Vector4(srgbTables.ToLinear[pPixel[0]], srgbTables.ToLinear[pPixel[1]], srgbTables.ToLinear[pPixel[2]], pPixel[3] / 255.0f);
+					}
+					else if (options.NormalMap)
+					{
+						target = Vector4(pPixel[0] / 127.5f - 1.0f, pPixel[1] / 127.5f - 1.0f, pPixel[2] / 127.5f - 1.0f, pPixel[3] / 255.0f);
+					}
+					else
+					{
+						target = Vector4(pPixel[0] / 255.0f, pPixel[1] / 255.0f, pPixel[2] / 255.0f, pPixel[3] / 255.0f);
+					}
+				}
+			}, context, m_Height);
+		TaskQueue::Join(context);
+	}
+
+	const float targetCoverage = options.AlphaTestReference > 0 ? ComputeAlphaCoverage(source, options.AlphaTestReference) : 0.0f;
+
+	std::vector<Vector4> target;
+	uint32 sourceWidth = m_Width;
+	uint32 sourceHeight = m_Height;
+	for (uint32 mip = 1; mip < numMips; ++mip)
+	{
+		const uint32 width = Math::Max(1u, m_Width >> mip);
+		const uint32 height = Math::Max(1u, m_Height >> mip);
+		target.resize(width * height);
+
+		// 2x2 box filter
+		TaskContext context;
+		TaskQueue::ExecuteMany([&](TaskDistributeArgs args)
+			{
+				const uint32 y = (uint32)args.JobIndex;
+				const Vector4* pRow0 = &source[Math::Min(y * 2, sourceHeight - 1) * sourceWidth];
+				const Vector4* pRow1 = &source[Math::Min(y * 2 + 1, sourceHeight - 1) * sourceWidth];
+				const __m128 quarter = _mm_set1_ps(0.25f);
+				const __m128 xyzMask = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+				for (uint32 x = 0; x < width; ++x)
+				{
+					const uint32 x0 = Math::Min(x * 2, sourceWidth - 1);
+					const uint32 x1 = Math::Min(x * 2 + 1, sourceWidth - 1);
+					__m128 sum = _mm_add_ps(
+						_mm_add_ps(_mm_loadu_ps(&pRow0[x0].x), _mm_loadu_ps(&pRow0[x1].x)),
+						_mm_add_ps(_mm_loadu_ps(&pRow1[x0].x), _mm_loadu_ps(&pRow1[x1].x)));
+					__m128 value = _mm_mul_ps(sum, quarter);
+
+					if (options.NormalMap)
+					{
+						__m128 squared = _mm_and_ps(_mm_mul_ps(value, value), xyzMask);
+						__m128 lengthSq = _mm_add_ps(squared, _mm_shuffle_ps(squared, squared, _MM_SHUFFLE(2, 3, 0, 1)));
+						lengthSq = _mm_add_ps(lengthSq, _mm_shuffle_ps(lengthSq, lengthSq, _MM_SHUFFLE(1, 0, 3, 2)));
+						if (_mm_cvtss_f32(lengthSq) > 1e-8f)
+						{
+							__m128 normalized = _mm_div_ps(value, _mm_sqrt_ps(lengthSq));
+							value = _mm_or_ps(_mm_and_ps(xyzMask, normalized), _mm_andnot_ps(xyzMask, value));
+						}
+					}
+					_mm_storeu_ps(&target[y * width + x].x, value);
+				}
+			}, context, height);
+		TaskQueue::Join(context);
+
+		const float alphaScale = options.AlphaTestReference > 0 ? FindAlphaScale(target, options.AlphaTestReference, targetCoverage) : 1.0f;
+
+		uint8* pMipData = const_cast<uint8*>(GetData(mip));
+		TaskQueue::ExecuteMany([&](TaskDistributeArgs args)
+			{
+				const uint32 y = (uint32)args.JobIndex;
+				const __m128 scale = options.NormalMap ? _mm_set_ps(alphaScale * 255.0f, 127.5f, 127.5f, 127.5f) : _mm_set_ps(alphaScale * 255.0f, 255.0f, 255.0f, 255.0f);
+				const __m128 bias = options.NormalMap ? _mm_set_ps(0.0f, 127.5f, 127.5f, 127.5f) : _mm_setzero_ps();
+				const __m128 zero = _mm_setzero_ps();
+				const __m128 maxValue = _mm_set1_ps(255.0f);
+				for (uint32 x = 0; x < width; ++x)
+				{
+					__m128 value = _mm_loadu_ps(&target[y * width + x].x);
+					alignas(16) int32 quantized[4];
+					if (options.sRGB)
+					{
+						// Index the linear to sRGB table with the color, quantize alpha directly
+						__m128 sRGBScale = _mm_set_ps(alphaScale * 255.0f, 4095.0f, 4095.0f, 4095.0f);
+						__m128 maxIndex = _mm_set_ps(255.0f, 4095.0f, 4095.0f, 4095.0f);
+						value = _mm_min_ps(_mm_max_ps(_mm_mul_ps(value, sRGBScale), zero), maxIndex);
+						_mm_store_si128((__m128i*)quantized, _mm_cvtps_epi32(value));
+						quantized[0] = srgbTables.FromLinear[quantized[0]];
+						quantized[1] = srgbTables.FromLinear[quantized[1]];
+						quantized[2] = srgbTables.FromLinear[quantized[2]];
+					}
+					else
+					{
+						value = _mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_mul_ps(value, scale), bias), zero), maxValue);
+						_mm_store_si128((__m128i*)quantized, _mm_cvtps_epi32(value));
+					}
+					uint8* pPixel = &pMipData[(y * width + x) * 4];
+					pPixel[0] = (uint8)quantized[0];
+					pPixel[1] = (uint8)quantized[1];
+					pPixel[2] = (uint8)quantized[2];
+					pPixel[3] = (uint8)quantized[3];
+				}
+			}, context, height);
+		TaskQueue::Join(context);
+
+		std::swap(source, target);
+		sourceWidth = width;
+		sourceHeight = height;
+	}
+	return true;
+}
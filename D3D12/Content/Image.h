@@ -1,6 +1,25 @@
 #pragma once
 #include "Graphics/RHI/RHI.h"
 
+class MappedFile;
+
+// Describes how the texture is used so a suitable block compression format can be picked
+enum class ImageCompressionHint
+{
+	None,			// Keep uncompressed
+	Color,			// BC1, or BC3 if the image has alpha
+	Normal,			// BC5, Z is reconstructed in the shader
+	Data,			// BC7, keeps channels independent enough for packed data (eg. roughness/metalness)
+	SingleChannel,	// BC4
+};
+
+struct ImageMipOptions
+{
+	bool sRGB = false;				// Filter in linear space
+	bool NormalMap = false;			// Renormalize the filtered normals
+	float AlphaTestReference = 0;	// When non zero, scale alpha so the alpha test coverage matches the top mip
+};
+
 class Image final
 {
 public:
@@ -9,6 +28,22 @@ public:
 	bool Load(const char* filePath);
 	bool Load(const void* pData, size_t dataSize, const char* pFormatHint);
 	void Save(const char* pFilePath);
+	bool SaveDDS(const char* pFilePath) const;
+
+	// Loads the image and block compresses it according to the hint.
+	// The result is cached in the texture cache keyed by the hash of the source data.
+	// pOutCachePath receives the path of the cached DDS file, or an empty string if the image isn't cached.
+	bool LoadCompressed(const char* pFilePath, ImageCompressionHint hint, float alphaTestReference = 0.0f, std::string* pOutCachePath = nullptr);
+	bool LoadCompressed(const void* pData, size_t dataSize, const char* pFormatHint, ImageCompressionHint hint, float alphaTestReference = 0.0f, std::string* pOutCachePath = nullptr);
+
+	// References only a range of mips from a DDS file written by SaveDDS. The first mip in the range becomes mip 0.
+	bool LoadDDSMips(const char* pFilePath, uint32 firstMip, uint32 numMips);
+
+	// Replaces the mips of an RGBA8 image with a full mip chain generated from the top mip
+	bool GenerateMips(const ImageMipOptions& options);
+
+	// Block compresses all mips of an RGBA8 image. Width and height must be a multiple of 4.
+	bool Compress(ResourceFormat format, Image& outImage) const;
 
 	bool SetSize(uint32 x, uint32 y, uint32 depth, uint32 numMips);
 	bool SetData(const void* pPixels);
@@ -26,15 +61,21 @@ public:
 	bool IsHDR() const { return m_IsHdr; }
 	bool IsCubemap() const { return m_IsCubemap; }
 
+	// DDS files loaded from disk are memory mapped and their pixels are referenced in place.
+	// Writing to the image makes a copy first.
 	const unsigned char* GetData(uint32 mipLevel = 0) const;
+	uint64 GetDataSize() const;
 
 	uint32 GetMipLevels() const { return m_MipLevels; }
 	ResourceFormat GetFormat() const { return m_Format; }
 	const Image* GetNextImage() const { return m_pNextImage.get(); }
 
 private:
-	bool LoadDDS(const void* pBytes, uint32 numBytes);
+	bool LoadDDS(const void* pBytes, uint32 numBytes, const std::shared_ptr<const MappedFile>& pMappedFile = nullptr);
 	bool LoadSTB(const void* pBytes, uint32 numBytes);
+	void SetDimensions(uint32 width, uint32 height, uint32 depth, uint32 numMips);
+	void SetMappedData(const std::shared_ptr<const MappedFile>& pFile, const uint8* pPixels);
+	void DetachMapping();
 
 	uint32 m_Width = 0;
 	uint32 m_Height = 0;
@@ -48,4 +89,6 @@ private:
 	ResourceFormat m_Format = ResourceFormat::Unknown;
 	std::array<uint64, D3D12_REQ_MIP_LEVELS> m_MipLevelDataOffsets{};
 	std::vector<uint8> m_Pixels;
+	std::shared_ptr<const MappedFile> m_pMappedFile;
+	const uint8* m_pMappedPixels = nullptr;
 };
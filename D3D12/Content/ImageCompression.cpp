@@ -0,0 +1,418 @@
+#include "stdafx.h"
+#include "ImageCompression.h"
+#include <emmintrin.h>
+#include <cfloat>
+
+namespace ImageCompression
+{
+	// Block pixels in SoA layout so 4 pixels can be processed at once
+	struct BlockSoA
+	{
+		alignas(16) float Channels[4][16];
+	};
+
+	static void LoadBlock(const uint8* pRGBA, BlockSoA& outBlock)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		for (uint32 i = 0; i < 16; i += 4)
+		{
+			__m128i pixels = _mm_loadu_si128((const __m128i*)(pRGBA + i * 4));
+			__m128i pixels01 = _mm_unpacklo_epi8(pixels, zero);
+			__m128i pixels23 = _mm_unpackhi_epi8(pixels, zero);
+			__m128 p0 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(pixels01, zero));
+			__m128 p1 = _mm_cvtepi32_ps(_mm_unpackhi_epi16(pixels01, zero));
+			__m128 p2 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(pixels23, zero));
+			__m128 p3 = _mm_cvtepi32_ps(_mm_unpackhi_epi16(pixels23, zero));
+			// RGBA x4 -> RRRR GGGG BBBB AAAA
+			_MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+			_mm_store_ps(&outBlock.Channels[0][i], p0);
+			_mm_store_ps(&outBlock.Channels[1][i], p1);
+			_mm_store_ps(&outBlock.Channels[2][i], p2);
+			_mm_store_ps(&outBlock.Channels[3][i], p3);
+		}
+	}
+
+	static float HorizontalSum(__m128 v)
+	{
+		alignas(16) float values[4];
+		_mm_store_ps(values, v);
+		return values[0] + values[1] + values[2] + values[3];
+	}
+
+	static float HorizontalMin(__m128 v)
+	{
+		v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+		v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+		return _mm_cvtss_f32(v);
+	}
+
+	static float HorizontalMax(__m128 v)
+	{
+		v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+		v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+		return _mm_cvtss_f32(v);
+	}
+
+	// t = dot(pixel - origin, axis) for all 16 pixels
+	static void Project(const BlockSoA& block, uint32 firstChannel, uint32 numChannels, const float* pOrigin, const float* pAxis, float* pOutT)
+	{
+		for (uint32 i = 0; i < 16; i += 4)
+		{
+			__m128 t = _mm_setzero_ps();
+			for (uint32 c = 0; c < numChannels; ++c)
+			{
+				__m128 v = _mm_sub_ps(_mm_load_ps(&block.Channels[firstChannel + c][i]), _mm_set1_ps(pOrigin[c]));
+				t = _mm_add_ps(t, _mm_mul_ps(v, _mm_set1_ps(pAxis[c])));
+			}
+			_mm_store_ps(&pOutT[i], t);
+		}
+	}
+
+	// Finds the endpoints of the line that best fits the pixels, using the principal axis of the covariance
+	static void ComputeEndpoints(const BlockSoA& block, uint32 numChannels, float* pOutStart, float* pOutEnd)
+	{
+		float mean[4]{};
+		for (uint32 c = 0; c < numChannels; ++c)
+		{
+			__m128 sum = _mm_setzero_ps();
+			for (uint32 i = 0; i < 16; i += 4)
+			{
+				sum = _mm_add_ps(sum, _mm_load_ps(&block.Channels[c][i]));
+			}
+			mean[c] = HorizontalSum(sum) / 16.0f;
+		}
+
+		float covariance[4][4]{};
+		for (uint32 i = 0; i < 16; ++i)
+		{
+			float v[4]{};
+			for (uint32 c = 0; c < numChannels; ++c)
+			{
+				v[c] = block.Channels[c][i] - mean[c];
+			}
+			for (uint32 a = 0; a < numChannels; ++a)
+			{
+				for (uint32 b = 0; b < numChannels; ++b)
+				{
+					covariance[a][b] += v[a] * v[b];
+				}
+			}
+		}
+
+		// Start the power iteration from the column of the channel with the largest variance.
+		// Starting from a fixed vector fails when it happens to be orthogonal to the principal axis.
+		uint32 maxChannel = 0;
+		for (uint32 c = 1; c < numChannels; ++c)
+		{
+			if (covariance[c][c] > covariance[maxChannel][maxChannel])
+			{
+				maxChannel = c;
+			}
+		}
+
+		float axis[4]{};
+		for (uint32 c = 0; c < numChannels; ++c)
+		{
+			axis[c] = covariance[c][maxChannel];
+		}
+
+		for (uint32 iteration = 0; iteration < 8; ++iteration)
+		{
+			float next[4]{};
+			float maxComponent = 0;
+			for (uint32 a = 0; a < numChannels; ++a)
+			{
+				for (uint32 b = 0; b < numChannels; ++b)
+				{
+					next[a] += covariance[a][b] * axis[b];
+				}
+				maxComponent = Math::Max(maxComponent, fabsf(next[a]));
+			}
+			if (maxComponent < 1e-6f)
+			{
+				break;
+			}
+			for (uint32 a = 0; a < numChannels; ++a)
+			{
+				axis[a] = next[a] / maxComponent;
+			}
+		}
+
+		float lengthSq = 0;
+		for (uint32 c = 0; c < numChannels; ++c)
+		{
+			lengthSq += axis[c] * axis[c];
+		}
+
+		// Flat block
+		if (lengthSq < 1e-6f)
+		{
+			for (uint32 c = 0; c < numChannels; ++c)
+			{
+				pOutStart[c] = mean[c];
+				pOutEnd[c] = mean[c];
+			}
+			return;
+		}
+
+		float invLength = 1.0f / sqrtf(lengthSq);
+		for (uint32 c = 0; c < numChannels; ++c)
+		{
+			axis[c] *= invLength;
+		}
+
+		alignas(16) float t[16];
+		Project(block, 0, numChannels, mean, axis, t);
+		__m128 tMin = _mm_load_ps(&t[0]);
+		__m128 tMax = tMin;
+		for (uint32 i = 4; i < 16; i += 4)
+		{
+			tMin = _mm_min_ps(tMin, _mm_load_ps(&t[i]));
+			tMax = _mm_max_ps(tMax, _mm_load_ps(&t[i]));
+		}
+		float minT = HorizontalMin(tMin);
+		float maxT = HorizontalMax(tMax);
+
+		for (uint32 c = 0; c < numChannels; ++c)
+		{
+			pOutStart[c] = Math::Clamp(mean[c] + axis[c] * minT, 0.0f, 255.0f);
+			pOutEnd[c] = Math::Clamp(mean[c] + axis[c] * maxT, 0.0f, 255.0f);
+		}
+	}
+
+	// Quantizes the position of each pixel on the line start -> end to 'numLevels' steps
+	static void ComputeIndices(const BlockSoA& block, uint32 firstChannel, uint32 numChannels, const float* pStart, const float* pEnd, uint32 numLevels, uint8* pOutIndices)
+	{
+		float axis[4]{};
+		float lengthSq = 0;
+		for (uint32 c = 0; c < numChannels; ++c)
+		{
+			axis[c] = pEnd[c] - pStart[c];
+			lengthSq += axis[c] * axis[c];
+		}
+
+		if (lengthSq < 1e-6f)
+		{
+			memset(pOutIndices, 0, 16);
+			return;
+		}
+
+		float scale = (numLevels - 1) / lengthSq;
+		for (uint32 c = 0; c < numChannels; ++c)
+		{
+			axis[c] *= scale;
+		}
+
+		alignas(16) float t[16];
+		Project(block, firstChannel, numChannels, pStart, axis, t);
+
+		const __m128 minLevel = _mm_setzero_ps();
+		const __m128 maxLevel = _mm_set1_ps((float)(numLevels - 1));
+		__m128i indices[4];
+		for (uint32 i = 0; i < 4; ++i)
+		{
+			__m128 level = _mm_min_ps(_mm_max_ps(_mm_load_ps(&t[i * 4]), minLevel), maxLevel);
+			indices[i] = _mm_cvtps_epi32(level);
+		}
+		__m128i packed = _mm_packus_epi16(_mm_packs_epi32(indices[0], indices[1]), _mm_packs_epi32(indices[2], indices[3]));
+		_mm_storeu_si128((__m128i*)pOutIndices, packed);
+	}
+
+	static uint16 Pack565(const float* pColor)
+	{
+		uint32 r = (uint32)(pColor[0] * 31.0f / 255.0f + 0.5f);
+		uint32 g = (uint32)(pColor[1] * 63.0f / 255.0f + 0.5f);
+		uint32 b = (uint32)(pColor[2] * 31.0f / 255.0f + 0.5f);
+		return (uint16)((r << 11) | (g << 5) | b);
+	}
+
+	static void Unpack565(uint16 color, float* pOutColor)
+	{
+		uint32 r = (color >> 11) & 0x1F;
+		uint32 g = (color >> 5) & 0x3F;
+		uint32 b = color & 0x1F;
+		pOutColor[0] = (float)((r << 3) | (r >> 2));
+		pOutColor[1] = (float)((g << 2) | (g >> 4));
+		pOutColor[2] = (float)((b << 3) | (b >> 2));
+	}
+
+	// 8 byte BC1 color block, always in 4 color mode
+	static void EncodeColorBlock(const BlockSoA& block, uint8* pOutBlock)
+	{
+		float start[3], end[3];
+		ComputeEndpoints(block, 3, start, end);
+
+		uint16 color0 = Pack565(end);
+		uint16 color1 = Pack565(start);
+		if (color0 < color1)
+		{
+			std::swap(color0, color1);
+		}
+
+		uint32 indexBits = 0;
+		if (color0 != color1)
+		{
+			float endpoint0[3], endpoint1[3];
+			Unpack565(color0, endpoint0);
+			Unpack565(color1, endpoint1);
+
+			uint8 indices[16];
+			ComputeIndices(block, 0, 3, endpoint0, endpoint1, 4, indices);
+
+			// Palette order is color0, color1, 2/3 color0 + 1/3 color1, 1/3 color0 + 2/3 color1
+			constexpr uint8 remap[4] = { 0, 2, 3, 1 };
+			for (uint32 i = 0; i < 16; ++i)
+			{
+				indexBits |= remap[indices[i]] << (i * 2);
+			}
+		}
+
+		memcpy(pOutBlock + 0, &color0, sizeof(uint16));
+		memcpy(pOutBlock + 2, &color1, sizeof(uint16));
+		memcpy(pOutBlock + 4, &indexBits, sizeof(uint32));
+	}
+
+	// 8 byte BC4 block of a single channel, always in 8 value mode
+	static void EncodeChannelBlock(const BlockSoA& block, uint32 channel, uint8* pOutBlock)
+	{
+		__m128 minValue = _mm_load_ps(&block.Channels[channel][0]);
+		__m128 maxValue = minValue;
+		for (uint32 i = 4; i < 16; i += 4)
+		{
+			minValue = _mm_min_ps(minValue, _mm_load_ps(&block.Channels[channel][i]));
+			maxValue = _mm_max_ps(maxValue, _mm_load_ps(&block.Channels[channel][i]));
+		}
+		uint8 value0 = (uint8)(HorizontalMax(maxValue) + 0.5f);
+		uint8 value1 = (uint8)(HorizontalMin(minValue) + 0.5f);
+
+		uint64 indexBits = 0;
+		if (value0 > value1)
+		{
+			float endpoint0 = value0;
+			float endpoint1 = value1;
+			uint8 indices[16];
+			ComputeIndices(block, channel, 1, &endpoint0, &endpoint1, 8, indices);
+
+			// Palette order is value0, value1, then the 6 interpolated values from value0 to value1
+			constexpr uint8 remap[8] = { 0, 2, 3, 4, 5, 6, 7, 1 };
+			for (uint32 i = 0; i < 16; ++i)
+			{
+				indexBits |= (uint64)remap[indices[i]] << (i * 3);
+			}
+		}
+
+		pOutBlock[0] = value0;
+		pOutBlock[1] = value1;
+		memcpy(pOutBlock + 2, &indexBits, 6);
+	}
+
+	void EncodeBlockBC1(const uint8* pRGBA, uint8* pOutBlock)
+	{
+		BlockSoA block;
+		LoadBlock(pRGBA, block);
+		EncodeColorBlock(block, pOutBlock);
+	}
+
+	void EncodeBlockBC3(const uint8* pRGBA, uint8* pOutBlock)
+	{
+		BlockSoA block;
+		LoadBlock(pRGBA, block);
+		EncodeChannelBlock(block, 3, pOutBlock);
+		EncodeColorBlock(block, pOutBlock + 8);
+	}
+
+	void EncodeBlockBC4(const uint8* pRGBA, uint8* pOutBlock, uint32 channel)
+	{
+		BlockSoA block;
+		LoadBlock(pRGBA, block);
+		EncodeChannelBlock(block, channel, pOutBlock);
+	}
+
+	void EncodeBlockBC5(const uint8* pRGBA, uint8* pOutBlock)
+	{
+		BlockSoA block;
+		LoadBlock(pRGBA, block);
+		EncodeChannelBlock(block, 0, pOutBlock);
+		EncodeChannelBlock(block, 1, pOutBlock + 8);
+	}
+
+	void EncodeBlockBC7(const uint8* pRGBA, uint8* pOutBlock)
+	{
+		BlockSoA block;
+		LoadBlock(pRGBA, block);
+
+		float endpoints[2][4];
+		ComputeEndpoints(block, 4, endpoints[0], endpoints[1]);
+
+		// Mode 6 endpoints are RGBA 7 bits with a unique p-bit per endpoint as LSB
+		uint32 quantized[2][4];
+		uint32 pBits[2];
+		float decoded[2][4];
+		for (uint32 e = 0; e < 2; ++e)
+		{
+			float bestError = FLT_MAX;
+			for (uint32 pBit = 0; pBit < 2; ++pBit)
+			{
+				uint32 values[4];
+				float error = 0;
+				for (uint32 c = 0; c < 4; ++c)
+				{
+					values[c] = (uint32)Math::Clamp((int)((endpoints[e][c] - pBit) * 0.5f + 0.5f), 0, 127);
+					float difference = (float)((values[c] << 1) | pBit) - endpoints[e][c];
+					error += difference * difference;
+				}
+				if (error < bestError)
+				{
+					bestError = error;
+					pBits[e] = pBit;
+					for (uint32 c = 0; c < 4; ++c)
+					{
+						quantized[e][c] = values[c];
+						decoded[e][c] = (float)((values[c] << 1) | pBit);
+					}
+				}
+			}
+		}
+
+		uint8 indices[16];
+		ComputeIndices(block, 0, 4, decoded[0], decoded[1], 16, indices);
+
+		// The MSB of the anchor index is implicitly 0, swap the endpoints if needed
+		if (indices[0] & 0x8)
+		{
+			std::swap(quantized[0], quantized[1]);
+			std::swap(pBits[0], pBits[1]);
+			for (uint8& index : indices)
+			{
+				index = 15 - index;
+			}
+		}
+
+		uint8 data[16]{};
+		uint32 bitOffset = 0;
+		auto WriteBits = [&](uint32 value, uint32 numBits)
+		{
+			for (uint32 i = 0; i < numBits; ++i, ++bitOffset)
+			{
+				data[bitOffset >> 3] |= (uint8)(((value >> i) & 1) << (bitOffset & 7));
+			}
+		};
+
+		WriteBits(1 << 6, 7);
+		for (uint32 c = 0; c < 4; ++c)
+		{
+			WriteBits(quantized[0][c], 7);
+			WriteBits(quantized[1][c], 7);
+		}
+		WriteBits(pBits[0], 1);
+		WriteBits(pBits[1], 1);
+		WriteBits(indices[0], 3);
+		for (uint32 i = 1; i < 16; ++i)
+		{
+			WriteBits(indices[i], 4);
+		}
+		check(bitOffset == 128);
+
+		memcpy(pOutBlock, data, sizeof(data));
+	}
+}
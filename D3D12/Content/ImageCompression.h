@@ -0,0 +1,16 @@
+#pragma once
+
+/*
+	Block compression encoders.
+	Each encoder takes a 4x4 block of RGBA8 pixels (row major, 64 bytes) and writes one compressed block.
+	Endpoints are found with PCA and indices by projecting on the endpoint axis, which is fast and
+	good enough for import time compression. BC7 only uses mode 6 (single subset RGBA).
+*/
+namespace ImageCompression
+{
+	void EncodeBlockBC1(const uint8* pRGBA, uint8* pOutBlock);
+	void EncodeBlockBC3(const uint8* pRGBA, uint8* pOutBlock);
+	void EncodeBlockBC4(const uint8* pRGBA, uint8* pOutBlock, uint32 channel = 0);
+	void EncodeBlockBC5(const uint8* pRGBA, uint8* pOutBlock);
+	void EncodeBlockBC7(const uint8* pRGBA, uint8* pOutBlock);
+}
@@ -0,0 +1,118 @@
+#include "stdafx.h"
+#include "DynamicBitField.h"
+#include "ConsoleVariables.h"
+#include <chrono>
+
+namespace Tweakables
+{
+	ConsoleCommand<int> gBenchmarkBitField("BenchmarkBitField", [](int numBits) { DynamicBitField::Benchmark(numBits); });
+}
+
+void DynamicBitField::Benchmark(uint32 numBits, uint32 iterations)
+{
+	using Clock = std::chrono::high_resolution_clock;
+
+	numBits = Math::Max(numBits, 1u);
+	iterations = Math::Max(iterations, 1u);
+
+	// A third of the bits of 'a' and half of the bits of 'b' are set
+	DynamicBitField a(numBits);
+	DynamicBitField b(numBits);
+	std::vector<bool> referenceA(numBits);
+	std::vector<bool> referenceB(numBits);
+	for (uint32 i = 0; i < numBits; ++i)
+	{
+		referenceA[i] = Math::RandomRange(0, 2) == 0;
+		referenceB[i] = Math::RandomRange(0, 1) == 0;
+		a.AssignBit(i, referenceA[i]);
+		b.AssignBit(i, referenceB[i]);
+	}
+
+	bool isValid = true;
+	auto Check = [&](bool condition, const char* pOperation)
+	{
+		if (!condition)
+		{
+			E_LOG(Error, "DynamicBitField: %s doesn't match std::vector<bool>", pOperation);
+			isValid = false;
+		}
+	};
+
+	auto Time = [&](const char* pName, const auto& operation)
+	{
+		const Clock::time_point start = Clock::now();
+		for (uint32 i = 0; i < iterations; ++i)
+		{
+			operation();
+		}
+		const float microseconds = std::chrono::duration<float, std::micro>(Clock::now() - start).count() / iterations;
+		E_LOG(Info, "\t%-20s %9.2f us", pName, microseconds);
+	};
+
+	E_LOG(Info, "DynamicBitField: %d bits, %d iterations", numBits, iterations);
+
+	DynamicBitField result(numBits);
+	Time("SetAll", [&]() { result.SetAll(); });
+	Check(result.CountSetBits() == numBits, "SetAll");
+	Time("ClearAll", [&]() { result.ClearAll(); });
+	Check(result.HasNoBitSet(), "ClearAll");
+
+	Time("&= (with copy)", [&]() { result = a; result &= b; });
+	uint32 expectedAnd = 0;
+	bool expectedIntersects = false;
+	for (uint32 i = 0; i < numBits; ++i)
+	{
+		const bool bit = referenceA[i] && referenceB[i];
+		expectedAnd += bit;
+		expectedIntersects |= bit;
+		Check(result.GetBit(i) == bit, "&=");
+	}
+
+	Time("|= (with copy)", [&]() { result = a; result |= b; });
+	for (uint32 i = 0; i < numBits; ++i)
+	{
+		Check(result.GetBit(i) == (referenceA[i] || referenceB[i]), "|=");
+	}
+
+	Time("AndNot (with copy)", [&]() { result = a; result.AndNot(b); });
+	for (uint32 i = 0; i < numBits; ++i)
+	{
+		Check(result.GetBit(i) == (referenceA[i] && !referenceB[i]), "AndNot");
+	}
+
+	bool intersects = false;
+	Time("Intersects", [&]() { intersects = a.Intersects(b); });
+	Check(intersects == expectedIntersects, "Intersects");
+
+	uint32 count = 0;
+	Time("CountSetBits", [&]() { count = a.CountSetBits(); });
+	Check(count == (uint32)std::count(referenceA.begin(), referenceA.end(), true), "CountSetBits");
+
+	result = a;
+	result &= b;
+	Check(result.CountSetBits() == expectedAnd, "CountSetBits of &=");
+
+	uint32 numIterated = 0;
+	uint32 lastBit = 0;
+	bool isOrdered = true;
+	Time("Iterate set bits", [&]()
+		{
+			numIterated = 0;
+			for (uint32 bit : a)
+			{
+				isOrdered &= numIterated == 0 || bit > lastBit;
+				lastBit = bit;
+				++numIterated;
+			}
+		});
+	for (uint32 bit : a)
+	{
+		isOrdered &= referenceA[bit];
+	}
+	Check(isOrdered && numIterated == count, "Set bit iteration");
+
+	if (isValid)
+	{
+		E_LOG(Info, "\tAll results match std::vector<bool>");
+	}
+}
@@ -0,0 +1,311 @@
+#pragma once
+#include <emmintrin.h>
+#include <immintrin.h>
+
+/*
+	Bit field with a size set at runtime.
+	The storage is 64-byte aligned and padded to a multiple of 512 bits so bulk operations work on
+	whole cache lines with SSE2. Padding bits are always kept cleared.
+*/
+class DynamicBitField
+{
+public:
+	class SetBitsIterator
+	{
+	public:
+		SetBitsIterator(const DynamicBitField* pBitField, uint32 wordIndex)
+			: m_pBitField(pBitField), m_WordIndex(wordIndex)
+		{
+			if (m_WordIndex < m_pBitField->m_NumWords)
+			{
+				m_Word = m_pBitField->m_pData[m_WordIndex];
+				SkipEmptyWords();
+			}
+		}
+
+		void operator++()
+		{
+			// Clear the lowest set bit
+			m_Word &= m_Word - 1;
+			SkipEmptyWords();
+		}
+
+		bool operator!=(const SetBitsIterator& other) const
+		{
+			return m_WordIndex != other.m_WordIndex || m_Word != other.m_Word;
+		}
+
+		uint32 operator*() const
+		{
+			return m_WordIndex * BitsPerWord + (uint32)_tzcnt_u64(m_Word);
+		}
+
+	private:
+		void SkipEmptyWords()
+		{
+			while (m_Word == 0 && ++m_WordIndex < m_pBitField->m_NumWords)
+			{
+				m_Word = m_pBitField->m_pData[m_WordIndex];
+			}
+			if (m_WordIndex >= m_pBitField->m_NumWords)
+			{
+				m_WordIndex = m_pBitField->m_NumWords;
+				m_Word = 0;
+			}
+		}
+
+		const DynamicBitField* m_pBitField;
+		uint32 m_WordIndex;
+		uint64 m_Word = 0;
+	};
+
+	DynamicBitField() = default;
+
+	explicit DynamicBitField(uint32 size, bool set = false)
+	{
+		Resize(size);
+		if (set)
+		{
+			SetAll();
+		}
+	}
+
+	DynamicBitField(const DynamicBitField& other)
+	{
+		*this = other;
+	}
+
+	DynamicBitField(DynamicBitField&& other) noexcept
+	{
+		*this = std::move(other);
+	}
+
+	~DynamicBitField()
+	{
+		_aligned_free(m_pData);
+	}
+
+	DynamicBitField& operator=(const DynamicBitField& other)
+	{
+		if (this != &other)
+		{
+			Allocate(other.m_Size);
+			memcpy(m_pData, other.m_pData, m_NumWords * sizeof(uint64));
+		}
+		return *this;
+	}
+
+	DynamicBitField& operator=(DynamicBitField&& other) noexcept
+	{
+		std::swap(m_pData, other.m_pData);
+		std::swap(m_Size, other.m_Size);
+		std::swap(m_NumWords, other.m_NumWords);
+		return *this;
+	}
+
+	// Keeps the existing bits, added bits are cleared
+	void Resize(uint32 size)
+	{
+		uint32 numWords = GetNumWords(size);
+		if (numWords != m_NumWords)
+		{
+			uint64* pData = (uint64*)_aligned_malloc(numWords * sizeof(uint64), Alignment);
+			uint32 numCopied = numWords < m_NumWords ? numWords : m_NumWords;
+			memcpy(pData, m_pData, numCopied * sizeof(uint64));
+			memset(pData + numCopied, 0, (numWords - numCopied) * sizeof(uint64));
+			_aligned_free(m_pData);
+			m_pData = pData;
+			m_NumWords = numWords;
+		}
+		m_Size = size;
+		ClearPadding();
+	}
+
+	void ClearAll()
+	{
+		const __m128i zero = _mm_setzero_si128();
+		for (uint32 i = 0; i < m_NumWords; i += 2)
+		{
+			_mm_store_si128((__m128i*)&m_pData[i], zero);
+		}
+	}
+
+	void SetAll()
+	{
+		const __m128i ones = _mm_set1_epi32(-1);
+		for (uint32 i = 0; i < m_NumWords; i += 2)
+		{
+			_mm_store_si128((__m128i*)&m_pData[i], ones);
+		}
+		ClearPadding();
+	}
+
+	inline void SetBit(uint32 bit)
+	{
+		check(bit < m_Size);
+		m_pData[bit / BitsPerWord] |= 1ull << (bit % BitsPerWord);
+	}
+
+	inline void ClearBit(uint32 bit)
+	{
+		check(bit < m_Size);
+		m_pData[bit / BitsPerWord] &= ~(1ull << (bit % BitsPerWord));
+	}
+
+	inline bool GetBit(uint32 bit) const
+	{
+		check(bit < m_Size);
+		return (m_pData[bit / BitsPerWord] >> (bit % BitsPerWord)) & 1;
+	}
+
+	inline void AssignBit(uint32 bit, bool set)
+	{
+		check(bit < m_Size);
+		uint64& word = m_pData[bit / BitsPerWord];
+		const uint64 mask = 1ull << (bit % BitsPerWord);
+		word = (word & ~mask) | ((uint64)set << (bit % BitsPerWord));
+	}
+
+	bool HasAnyBitSet() const
+	{
+		__m128i accumulated = _mm_setzero_si128();
+		for (uint32 i = 0; i < m_NumWords; i += 2)
+		{
+			accumulated = _mm_or_si128(accumulated, _mm_load_si128((const __m128i*)&m_pData[i]));
+		}
+		return _mm_movemask_epi8(_mm_cmpeq_epi8(accumulated, _mm_setzero_si128())) != 0xFFFF;
+	}
+
+	bool HasNoBitSet() const
+	{
+		return !HasAnyBitSet();
+	}
+
+	// True if any bit is set in both bit fields
+	bool Intersects(const DynamicBitField& other) const
+	{
+		check(m_Size == other.m_Size);
+		__m128i accumulated = _mm_setzero_si128();
+		for (uint32 i = 0; i < m_NumWords; i += 2)
+		{
+			accumulated = _mm_or_si128(accumulated, _mm_and_si128(_mm_load_si128((const __m128i*)&m_pData[i]), _mm_load_si128((const __m128i*)&other.m_pData[i])));
+		}
+		return _mm_movemask_epi8(_mm_cmpeq_epi8(accumulated, _mm_setzero_si128())) != 0xFFFF;
+	}
+
+	uint32 CountSetBits() const
+	{
+		uint64 count = 0;
+		for (uint32 i = 0; i < m_NumWords; ++i)
+		{
+			count += __popcnt64(m_pData[i]);
+		}
+		return (uint32)count;
+	}
+
+	DynamicBitField& operator&=(const DynamicBitField& other)
+	{
+		check(m_Size == other.m_Size);
+		for (uint32 i = 0; i < m_NumWords; i += 2)
+		{
+			__m128i* pTarget = (__m128i*)&m_pData[i];
+			_mm_store_si128(pTarget, _mm_and_si128(_mm_load_si128(pTarget), _mm_load_si128((const __m128i*)&other.m_pData[i])));
+		}
+		return *this;
+	}
+
+	DynamicBitField& operator|=(const DynamicBitField& other)
+	{
+		check(m_Size == other.m_Size);
+		for (uint32 i = 0; i < m_NumWords; i += 2)
+		{
+			__m128i* pTarget = (__m128i*)&m_pData[i];
+			_mm_store_si128(pTarget, _mm_or_si128(_mm_load_si128(pTarget), _mm_load_si128((const __m128i*)&other.m_pData[i])));
+		}
+		return *this;
+	}
+
+	// Clears the bits which are set in 'other'
+	DynamicBitField& AndNot(const DynamicBitField& other)
+	{
+		check(m_Size == other.m_Size);
+		for (uint32 i = 0; i < m_NumWords; i += 2)
+		{
+			__m128i* pTarget = (__m128i*)&m_pData[i];
+			_mm_store_si128(pTarget, _mm_andnot_si128(_mm_load_si128((const __m128i*)&other.m_pData[i]), _mm_load_si128(pTarget)));
+		}
+		return *this;
+	}
+
+	DynamicBitField operator&(const DynamicBitField& other) const
+	{
+		DynamicBitField out = *this;
+		out &= other;
+		return out;
+	}
+
+	DynamicBitField operator|(const DynamicBitField& other) const
+	{
+		DynamicBitField out = *this;
+		out |= other;
+		return out;
+	}
+
+	SetBitsIterator begin() const
+	{
+		return SetBitsIterator(this, 0);
+	}
+
+	SetBitsIterator end() const
+	{
+		return SetBitsIterator(this, m_NumWords);
+	}
+
+	bool operator[](uint32 index) const
+	{
+		return GetBit(index);
+	}
+
+	uint32 Size() const
+	{
+		return m_Size;
+	}
+
+	// Times the bulk operations on random bits and checks their results against std::vector<bool>
+	static void Benchmark(uint32 numBits, uint32 iterations = 100);
+
+private:
+	static constexpr uint32 BitsPerWord = 64;
+	static constexpr uint32 Alignment = 64;
+	static constexpr uint32 WordsPerAlignment = Alignment / sizeof(uint64);
+
+	static uint32 GetNumWords(uint32 size)
+	{
+		uint32 numWords = (size + BitsPerWord - 1) / BitsPerWord;
+		return (numWords + WordsPerAlignment - 1) / WordsPerAlignment * WordsPerAlignment;
+	}
+
+	void Allocate(uint32 size)
+	{
+		uint32 numWords = GetNumWords(size);
+		if (numWords != m_NumWords)
+		{
+			_aligned_free(m_pData);
+			m_pData = numWords > 0 ? (uint64*)_aligned_malloc(numWords * sizeof(uint64), Alignment) : nullptr;
+			m_NumWords = numWords;
+		}
+		m_Size = size;
+	}
+
+	void ClearPadding()
+	{
+		for (uint32 bit = m_Size; bit < m_NumWords * BitsPerWord; bit = (bit / BitsPerWord + 1) * BitsPerWord)
+		{
+			m_pData[bit / BitsPerWord] &= (1ull << (bit % BitsPerWord)) - 1;
+		}
+	}
+
+	uint64* m_pData = nullptr;
+	uint32 m_Size = 0;
+	uint32 m_NumWords = 0;
+};
@@ -2,10 +2,84 @@
 #include "FileWatcher.h"
 #include "Core/Paths.h"
 
-FileWatcher::FileWatcher()
+#if PLATFORM_LINUX
+#include <filesystem>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#endif
+
+FileWatcher::FileWatcher(float debounceTime)
+	: m_DebounceTime(std::chrono::duration_cast<Clock::duration>(std::chrono::duration<float>(debounceTime)))
+{
+}
+
+bool FileWatcher::GetChanges(std::vector<FileEvent>& outChanges)
+{
+	std::scoped_lock<std::mutex> lock(m_Mutex);
+	if (m_PendingChanges.empty())
+	{
+		return false;
+	}
+
+	// Wait until the burst is over, but don't starve if changes keep coming in
+	Clock::time_point currentTime = Clock::now();
+	if (currentTime - m_LastEventTime < m_DebounceTime && currentTime - m_FirstEventTime < 10 * m_DebounceTime)
+	{
+		return false;
+	}
+
+	outChanges.swap(m_PendingChanges);
+	m_PendingChanges.clear();
+	m_PendingChangeMap.clear();
+	return true;
+}
+
+void FileWatcher::AddEvent(FileEvent::Type eventType, const std::string& path)
 {
+	Clock::time_point currentTime = Clock::now();
+	if (m_PendingChanges.empty())
+	{
+		m_FirstEventTime = currentTime;
+	}
+	m_LastEventTime = currentTime;
+
+	auto it = m_PendingChangeMap.find(path);
+	if (it == m_PendingChangeMap.end())
+	{
+		m_PendingChangeMap[path] = (uint32)m_PendingChanges.size();
+		m_PendingChanges.push_back(FileEvent{ eventType, path, currentTime });
+		return;
+	}
+
+	// Merge with the pending event of the same file
+	FileEvent& pendingEvent = m_PendingChanges[it->second];
+	pendingEvent.Time = currentTime;
+	switch (eventType)
+	{
+	case FileEvent::Type::Modified:
+		// Added + Modified is still a new file
+		if (pendingEvent.EventType == FileEvent::Type::Removed)
+		{
+			pendingEvent.EventType = FileEvent::Type::Modified;
+		}
+		break;
+	case FileEvent::Type::Added:
+		// Removed + Added happens when saving through a temporary file
+		if (pendingEvent.EventType == FileEvent::Type::Removed)
+		{
+			pendingEvent.EventType = FileEvent::Type::Modified;
+		}
+		break;
+	case FileEvent::Type::Removed:
+		pendingEvent.EventType = FileEvent::Type::Removed;
+		break;
+	}
 }
 
+#if PLATFORM_WINDOWS
+
 FileWatcher::~FileWatcher()
 {
 	m_Exiting = true;
@@ -19,8 +93,6 @@ FileWatcher::~FileWatcher()
 
 bool FileWatcher::StartWatching(const char* pPath, const bool recursiveWatch /*= true*/)
 {
-	QueryPerformanceFrequency(&m_TimeFrequency);
-
 	if (!Paths::DirectoryExists(pPath))
 	{
 		E_LOG(Warning, "FileWatch failed: Directory '%s' does not exist", pPath);
@@ -63,27 +135,6 @@ bool FileWatcher::StartWatching(const char* pPath, const bool recursiveWatch /*=
 	return true;
 }
 
-bool FileWatcher::GetNextChange(FileEvent& fileEvent)
-{
-	std::scoped_lock<std::mutex> lock(m_Mutex);
-	for (auto& pWatch : m_Watches)
-	{
-		if (pWatch->Changes.size() > 0)
-		{
-			fileEvent = pWatch->Changes[0];
-			LARGE_INTEGER currentTime;
-			QueryPerformanceCounter(&currentTime);
-			float timeDiff = ((float)currentTime.QuadPart - fileEvent.Time.QuadPart) / m_TimeFrequency.QuadPart;
-			if (timeDiff > 0.02f)
-			{
-				pWatch->Changes.pop_front();
-				return true;
-			}
-		}
-	}
-	return false;
-}
-
 int FileWatcher::ThreadFunction()
 {
 	const uint32 fileNotifyFlags =
@@ -153,34 +204,16 @@ int FileWatcher::ThreadFunction()
 
 				outString[length] = '\0';
 
-				FileEvent newEvent;
-				newEvent.Path = Paths::Combine(pWatch->DirectoryPath, outString);
-				Paths::NormalizeInline(newEvent.Path);
+				std::string path = Paths::Combine(pWatch->DirectoryPath, outString);
+				Paths::NormalizeInline(path);
 
 				switch (pRecord->Action)
 				{
-				case FILE_ACTION_MODIFIED: newEvent.EventType = FileEvent::Type::Modified; break;
-				case FILE_ACTION_REMOVED: newEvent.EventType = FileEvent::Type::Removed; break;
-				case FILE_ACTION_ADDED: newEvent.EventType = FileEvent::Type::Added; break;
-				case FILE_ACTION_RENAMED_NEW_NAME: newEvent.EventType = FileEvent::Type::Added; break;
-				case FILE_ACTION_RENAMED_OLD_NAME: newEvent.EventType = FileEvent::Type::Removed; break;
-				}
-
-				QueryPerformanceCounter(&newEvent.Time);
-
-				bool add = true;
-
-				//Some events are duplicates
-				if (pWatch->Changes.size() > 0)
-				{
-					const FileEvent& prevEvent = pWatch->Changes.front();
-					add = prevEvent.Path != newEvent.Path ||
-						prevEvent.EventType != newEvent.EventType;
-				}
-
-				if (add)
-				{
-					pWatch->Changes.push_back(newEvent);
+				case FILE_ACTION_MODIFIED: AddEvent(FileEvent::Type::Modified, path); break;
+				case FILE_ACTION_REMOVED: AddEvent(FileEvent::Type::Removed, path); break;
+				case FILE_ACTION_ADDED: AddEvent(FileEvent::Type::Added, path); break;
+				case FILE_ACTION_RENAMED_NEW_NAME: AddEvent(FileEvent::Type::Added, path); break;
+				case FILE_ACTION_RENAMED_OLD_NAME: AddEvent(FileEvent::Type::Removed, path); break;
 				}
 
 				if (!pRecord->NextEntryOffset)
@@ -218,3 +251,166 @@ FileWatcher::DirectoryWatch::~DirectoryWatch()
 		FileHandle = nullptr;
 	}
 }
+
+#elif PLATFORM_LINUX
+
+FileWatcher::~FileWatcher()
+{
+	m_Exiting = true;
+	if (m_WakeEvent >= 0)
+	{
+		uint64 value = 1;
+		write(m_WakeEvent, &value, sizeof(value));
+	}
+	if (m_Thread.joinable())
+	{
+		m_Thread.join();
+	}
+	if (m_Inotify >= 0)
+	{
+		close(m_Inotify);
+	}
+	if (m_WakeEvent >= 0)
+	{
+		close(m_WakeEvent);
+	}
+}
+
+bool FileWatcher::StartWatching(const char* pPath, const bool recursiveWatch /*= true*/)
+{
+	if (!Paths::DirectoryExists(pPath))
+	{
+		E_LOG(Warning, "FileWatch failed: Directory '%s' does not exist", pPath);
+		return false;
+	}
+
+	std::scoped_lock<std::mutex> lock(m_Mutex);
+	if (m_Inotify < 0)
+	{
+		m_Inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		m_WakeEvent = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (m_Inotify < 0 || m_WakeEvent < 0)
+		{
+			E_LOG(Warning, "FileWatch failed: Could not initialize inotify");
+			return false;
+		}
+	}
+
+	if (!AddWatch(pPath, recursiveWatch))
+	{
+		return false;
+	}
+
+	if (!m_Thread.joinable())
+	{
+		m_Thread = std::thread([this]() { ThreadFunction(); });
+	}
+	return true;
+}
+
+bool FileWatcher::AddWatch(const std::string& directoryPath, bool recursive)
+{
+	// Only the final write is interesting, IN_MODIFY would fire for every write call
+	const uint32 fileNotifyFlags =
+		IN_CLOSE_WRITE |
+		IN_CREATE |
+		IN_DELETE |
+		IN_MOVED_FROM |
+		IN_MOVED_TO;
+
+	int watchDescriptor = inotify_add_watch(m_Inotify, directoryPath.c_str(), fileNotifyFlags);
+	if (watchDescriptor < 0)
+	{
+		return false;
+	}
+	m_Watches[watchDescriptor] = DirectoryWatch{ recursive, directoryPath };
+
+	// inotify is not recursive, each subdirectory needs its own watch
+	if (recursive)
+	{
+		std::error_code error;
+		for (const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator(directoryPath, error))
+		{
+			if (entry.is_directory(error))
+			{
+				AddWatch(Paths::Combine(directoryPath, entry.path().filename().string()), true);
+			}
+		}
+	}
+	return true;
+}
+
+int FileWatcher::ThreadFunction()
+{
+	pollfd fileDescriptors[] = {
+		{ m_Inotify, POLLIN, 0 },
+		{ m_WakeEvent, POLLIN, 0 },
+	};
+	alignas(inotify_event) char buffer[1 << 16];
+
+	while (!m_Exiting)
+	{
+		if (poll(fileDescriptors, (nfds_t)std::size(fileDescriptors), -1) <= 0)
+		{
+			continue;
+		}
+		if (fileDescriptors[1].revents & POLLIN)
+		{
+			break;
+		}
+
+		ssize_t numBytes = read(m_Inotify, buffer, sizeof(buffer));
+		if (numBytes <= 0)
+		{
+			continue;
+		}
+
+		std::scoped_lock<std::mutex> lock(m_Mutex);
+		for (ssize_t offset = 0; offset < numBytes;)
+		{
+			const inotify_event* pEvent = (const inotify_event*)&buffer[offset];
+			offset += sizeof(inotify_event) + pEvent->len;
+
+			if (pEvent->mask & IN_IGNORED)
+			{
+				m_Watches.erase(pEvent->wd);
+				continue;
+			}
+
+			auto it = m_Watches.find(pEvent->wd);
+			if (it == m_Watches.end() || pEvent->len == 0)
+			{
+				continue;
+			}
+
+			std::string path = Paths::Combine(it->second.DirectoryPath, pEvent->name);
+			Paths::NormalizeInline(path);
+
+			if (pEvent->mask & IN_ISDIR)
+			{
+				if (it->second.Recursive && (pEvent->mask & (IN_CREATE | IN_MOVED_TO)))
+				{
+					AddWatch(path, true);
+				}
+				continue;
+			}
+
+			if (pEvent->mask & (IN_CREATE | IN_MOVED_TO))
+			{
+				AddEvent(FileEvent::Type::Added, path);
+			}
+			else if (pEvent->mask & (IN_DELETE | IN_MOVED_FROM))
+			{
+				AddEvent(FileEvent::Type::Removed, path);
+			}
+			else if (pEvent->mask & IN_CLOSE_WRITE)
+			{
+				AddEvent(FileEvent::Type::Modified, path);
+			}
+		}
+	}
+
+	return 0;
+}
+
+#endif
@@ -1,5 +1,10 @@
 #pragma once
 #include "Thread.h"
+#include <chrono>
+
+#if PLATFORM_LINUX
+#include <thread>
+#endif
 
 struct FileEvent
 {
@@ -11,19 +16,44 @@ struct FileEvent
 	};
 	Type EventType;
 	std::string Path;
-	LARGE_INTEGER Time;
+	std::chrono::steady_clock::time_point Time;
 };
 
+/*
+	Watches directories for file changes.
+	Editors often emit a burst of events for a single save (truncate, write, rename, ...).
+	Events are coalesced per file and only handed out as one change set
+	once no new event has come in for the debounce time.
+*/
 class FileWatcher
 {
 public:
-	FileWatcher();
+	FileWatcher(float debounceTime = 0.1f);
 	~FileWatcher();
 
 	bool StartWatching(const char* pPath, const bool recursiveWatch = true);
-	bool GetNextChange(FileEvent& fileFileEvent);
+
+	// Returns the coalesced changes of the last burst. Returns false while events are still coming in.
+	bool GetChanges(std::vector<FileEvent>& outChanges);
 
 private:
+	using Clock = std::chrono::steady_clock;
+
+	// Must be called with m_Mutex locked
+	void AddEvent(FileEvent::Type eventType, const std::string& path);
+
+	int ThreadFunction();
+
+	std::mutex m_Mutex;
+	std::atomic<bool> m_Exiting = false;
+
+	std::vector<FileEvent> m_PendingChanges;
+	std::unordered_map<std::string, uint32> m_PendingChangeMap;
+	Clock::time_point m_FirstEventTime;
+	Clock::time_point m_LastEventTime;
+	Clock::duration m_DebounceTime;
+
+#if PLATFORM_WINDOWS
 	struct DirectoryWatch
 	{
 		~DirectoryWatch();
@@ -31,17 +61,25 @@ private:
 		bool Recursive;
 		HANDLE FileHandle;
 		OVERLAPPED Overlapped{};
-		std::deque<FileEvent> Changes;
 		std::array<char, 1 << 16> Buffer{};
 		std::string DirectoryPath;
 	};
 
-	int ThreadFunction();
-
 	HANDLE m_IOCP = nullptr;
-	bool m_Exiting = false;
-	std::mutex m_Mutex;
-	LARGE_INTEGER m_TimeFrequency{};
 	Thread m_Thread;
 	std::vector<std::unique_ptr<DirectoryWatch>> m_Watches;
+#elif PLATFORM_LINUX
+	struct DirectoryWatch
+	{
+		bool Recursive;
+		std::string DirectoryPath;
+	};
+
+	bool AddWatch(const std::string& directoryPath, bool recursive);
+
+	int m_Inotify = -1;
+	int m_WakeEvent = -1;
+	std::thread m_Thread;
+	std::unordered_map<int, DirectoryWatch> m_Watches;
+#endif
 };
@@ -0,0 +1,113 @@
+#include "stdafx.h"
+#include "MappedFile.h"
+
+#if PLATFORM_LINUX
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+#if PLATFORM_WINDOWS
+
+bool MappedFile::Open(const char* pFilePath)
+{
+	Close();
+
+	m_FileHandle = CreateFileA(pFilePath, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (m_FileHandle == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(m_FileHandle, &size) || size.QuadPart == 0)
+	{
+		Close();
+		return false;
+	}
+
+	m_MappingHandle = CreateFileMappingA(m_FileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!m_MappingHandle)
+	{
+		Close();
+		return false;
+	}
+
+	m_pData = (const uint8*)MapViewOfFile(m_MappingHandle, FILE_MAP_READ, 0, 0, 0);
+	if (!m_pData)
+	{
+		Close();
+		return false;
+	}
+	m_Size = (uint64)size.QuadPart;
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (m_pData)
+	{
+		UnmapViewOfFile(m_pData);
+		m_pData = nullptr;
+	}
+	if (m_MappingHandle)
+	{
+		CloseHandle(m_MappingHandle);
+		m_MappingHandle = nullptr;
+	}
+	if (m_FileHandle != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(m_FileHandle);
+		m_FileHandle = INVALID_HANDLE_VALUE;
+	}
+	m_Size = 0;
+}
+
+#elif PLATFORM_LINUX
+
+bool MappedFile::Open(const char* pFilePath)
+{
+	Close();
+
+	int file = open(pFilePath, O_RDONLY);
+	if (file < 0)
+	{
+		return false;
+	}
+
+	struct stat fileStat;
+	if (fstat(file, &fileStat) != 0 || fileStat.st_size == 0)
+	{
+		close(file);
+		return false;
+	}
+
+	// The mapping stays valid after the descriptor is closed
+	void* pData = mmap(nullptr, (size_t)fileStat.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+	close(file);
+	if (pData == MAP_FAILED)
+	{
+		return false;
+	}
+	m_pData = (const uint8*)pData;
+	m_Size = (uint64)fileStat.st_size;
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (m_pData)
+	{
+		munmap((void*)m_pData, (size_t)m_Size);
+		m_pData = nullptr;
+	}
+	m_Size = 0;
+}
+
+#endif
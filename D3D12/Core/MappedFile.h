@@ -0,0 +1,31 @@
+#pragma once
+
+/*
+	Read-only view of a whole file mapped into memory.
+	Pages are read in by the OS on first access, no copy of the file is made.
+*/
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool Open(const char* pFilePath);
+	void Close();
+
+	const uint8* GetData() const { return m_pData; }
+	uint64 GetSize() const { return m_Size; }
+	bool IsOpen() const { return m_pData != nullptr; }
+
+private:
+	const uint8* m_pData = nullptr;
+	uint64 m_Size = 0;
+
+#if PLATFORM_WINDOWS
+	HANDLE m_FileHandle = INVALID_HANDLE_VALUE;
+	HANDLE m_MappingHandle = nullptr;
+#endif
+};
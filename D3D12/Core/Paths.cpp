@@ -195,6 +195,16 @@ namespace Paths
 		return SavedDir() + "ShaderCache/";
 	}
 
+	std::string TextureCacheDir()
+	{
+		return SavedDir() + "TextureCache/";
+	}
+
+	std::string MeshCacheDir()
+	{
+		return SavedDir() + "MeshCache/";
+	}
+
 	std::string ShadersDir()
 	{
 		return ResourcesDir() + "Shaders/";
@@ -48,6 +48,8 @@ namespace Paths
 	std::string ResourcesDir();
 	std::string ConfigDir();
 	std::string ShaderCacheDir();
+	std::string TextureCacheDir();
+	std::string MeshCacheDir();
 	std::string ShadersDir();
 
 	std::string GameIniFile();
@@ -0,0 +1,74 @@
+#pragma once
+
+// Handle to a slot of a SlotAllocator.
+// The generation tells apart handles to a slot that was released and allocated again.
+struct SlotHandle
+{
+	uint32 Index = ~0u;
+	uint32 Generation = 0;
+
+	bool operator==(const SlotHandle& rhs) const { return Index == rhs.Index && Generation == rhs.Generation; }
+	bool operator!=(const SlotHandle& rhs) const { return !operator==(rhs); }
+};
+
+// Hands out slot indices which stay stable for as long as they're allocated.
+// Released slots are reused through a free list so both allocating and releasing are O(1).
+// The generation of a slot is odd while it's allocated and even while it's free.
+class SlotAllocator
+{
+public:
+	SlotHandle Allocate()
+	{
+		uint32 index;
+		if (!m_FreeList.empty())
+		{
+			index = m_FreeList.back();
+			m_FreeList.pop_back();
+		}
+		else
+		{
+			index = (uint32)m_Generations.size();
+			m_Generations.push_back(0);
+		}
+		++m_Generations[index];
+		return SlotHandle{ index, m_Generations[index] };
+	}
+
+	void Release(const SlotHandle& handle)
+	{
+		checkf(IsValid(handle), "Slot %d is not allocated or the handle is stale", handle.Index);
+		++m_Generations[handle.Index];
+		m_FreeList.push_back(handle.Index);
+	}
+
+	// Releases all slots, handles given out before stay invalid
+	void ReleaseAll()
+	{
+		m_FreeList.clear();
+		for (uint32 i = (uint32)m_Generations.size(); i > 0; --i)
+		{
+			uint32& generation = m_Generations[i - 1];
+			if (generation & 1)
+				++generation;
+			m_FreeList.push_back(i - 1);
+		}
+	}
+
+	bool IsValid(const SlotHandle& handle) const
+	{
+		return handle.Index < m_Generations.size() && m_Generations[handle.Index] == handle.Generation && (handle.Generation & 1) != 0;
+	}
+
+	bool IsAllocated(uint32 index) const
+	{
+		return index < m_Generations.size() && (m_Generations[index] & 1) != 0;
+	}
+
+	// Upper bound of all slot indices handed out so far
+	uint32 GetCapacity() const { return (uint32)m_Generations.size(); }
+	uint32 GetNumAllocated() const { return (uint32)(m_Generations.size() - m_FreeList.size()); }
+
+private:
+	std::vector<uint32> m_Generations;
+	std::vector<uint32> m_FreeList;
+};
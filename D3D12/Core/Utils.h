@@ -10,4 +10,70 @@ namespace Utils
 			time.wYear, time.wMonth, time.wDay,
 			time.wHour, time.wMinute, time.wSecond, time.wMilliseconds);
 	}
+
+	// 64-bit FNV-1a. Pass the previous result as 'hash' to chain multiple blocks.
+	inline uint64 HashBytes(const void* pData, size_t size, uint64 hash = 0xcbf29ce484222325ull)
+	{
+		const uint8* pBytes = static_cast<const uint8*>(pData);
+		for (size_t i = 0; i < size; ++i)
+		{
+			hash ^= pBytes[i];
+			hash *= 0x100000001b3ull;
+		}
+		return hash;
+	}
+
+	template<typename T>
+	inline uint64 HashValue(const T& value, uint64 hash = 0xcbf29ce484222325ull)
+	{
+		static_assert(std::is_trivially_copyable_v<T>);
+		return HashBytes(&value, sizeof(T), hash);
+	}
+
+	// LSD radix sort on 8-bit digits. 'pScratch' needs room for 'count' keys.
+	// Passes over a digit which is the same for all keys are skipped.
+	inline void RadixSort(uint64* pKeys, uint64* pScratch, uint32 count)
+	{
+		if (count == 0)
+			return;
+
+		uint32 histograms[8][256] = {};
+		for (uint32 i = 0; i < count; ++i)
+		{
+			uint64 key = pKeys[i];
+			for (uint32 digit = 0; digit < 8; ++digit)
+			{
+				++histograms[digit][(key >> (digit * 8)) & 0xFF];
+			}
+		}
+
+		uint64* pSource = pKeys;
+		uint64* pTarget = pScratch;
+		for (uint32 digit = 0; digit < 8; ++digit)
+		{
+			const uint32 shift = digit * 8;
+			uint32* pHistogram = histograms[digit];
+			if (pHistogram[(pSource[0] >> shift) & 0xFF] == count)
+				continue;
+
+			uint32 offset = 0;
+			for (uint32 bucket = 0; bucket < 256; ++bucket)
+			{
+				uint32 bucketSize = pHistogram[bucket];
+				pHistogram[bucket] = offset;
+				offset += bucketSize;
+			}
+			for (uint32 i = 0; i < count; ++i)
+			{
+				uint64 key = pSource[i];
+				pTarget[pHistogram[(key >> shift) & 0xFF]++] = key;
+			}
+			std::swap(pSource, pTarget);
+		}
+
+		if (pSource != pKeys)
+		{
+			memcpy(pKeys, pSource, count * sizeof(uint64));
+		}
+	}
 }
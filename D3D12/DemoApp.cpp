@@ -26,6 +26,10 @@
 #include "Graphics/Techniques/ShaderDebugRenderer.h"
 #include "Graphics/Techniques/GPUDrivenRenderer.h"
 #include "Graphics/Techniques/VisualizeTexture.h"
+#include "Graphics/TextureStreaming.h"
+#include "Graphics/MeshletCulling.h"
+#include "Graphics/RayQuery.h"
+#include "Graphics/BLASPool.h"
 #include "Graphics/ImGuiRenderer.h"
 #include "Core/TaskQueue.h"
 #include "Core/CommandLine.h"
@@ -127,6 +131,7 @@ namespace Tweakables
 	ConsoleVariable g_VisualizeShadowCascades("vis.ShadowCascades", false);
 	ConsoleVariable g_ShadowCascades("r.Shadows.CascadeCount", 4);
 	ConsoleVariable g_PSSMFactor("r.Shadow.PSSMFactor", 0.85f);
+	ConsoleVariable g_ShadowCaching("r.Shadows.Cache", true);
 
 	// Bloom
 	ConsoleVariable g_Bloom("r.Bloom", true);
@@ -149,6 +154,9 @@ namespace Tweakables
 	ConsoleVariable g_TLASBoundsThreshold("r.Raytracing.TLASBoundsThreshold", 1.0f * Math::DegreesToRadians);
 	ConsoleVariable g_SsrSamples("r.SSRSamples", 8);
 	ConsoleVariable g_RenderTerrain("r.Terrain", false);
+	ConsoleVariable g_LODErrorThreshold("r.LOD.ErrorThreshold", 1.0f);
+	// Every cluster of a mesh becomes a candidate, large scenes can run out of the MAX_NUM_MESHLETS candidate slots
+	ConsoleVariable g_ClusterLOD("r.LOD.ClusterHierarchy", false);
 
 	// Misc
 	ConsoleVariable CullDebugStats("r.CullingStats", false);
@@ -157,6 +165,12 @@ namespace Tweakables
 	ConsoleCommand<> gDumpRenderGraph("DumpRenderGraph", []() { g_DumpRenderGraph = true; });
 	bool g_Screenshot = false;
 	ConsoleCommand<> gScreenshot("Screenshot", []() { g_Screenshot = true; });
+	bool g_BenchmarkMeshletCulling = false;
+	ConsoleCommand<> gBenchmarkMeshletCulling("BenchmarkMeshletCulling", []() { g_BenchmarkMeshletCulling = true; });
+	bool g_BenchmarkRayQuery = false;
+	ConsoleCommand<> gBenchmarkRayQuery("BenchmarkRayQuery", []() { g_BenchmarkRayQuery = true; });
+	int g_ValidateBLASPoolFrames = 0;
+	ConsoleCommand<int> gValidateBLASPool("r.Raytracing.ValidateBLASPool", [](int numFrames) { g_ValidateBLASPoolFrames = numFrames; });
 
 	std::string VisualizeTextureName = "";
 	ConsoleCommand<const char*> gVisualizeTexture("vis", [](const char* pName) { VisualizeTextureName = pName; });
@@ -203,6 +217,7 @@ DemoApp::DemoApp(WindowHandle window, const Vector2i& windowRect)
 	m_pPathTracing = std::make_unique<PathTracing>(m_pDevice);
 	m_pCBTTessellation = std::make_unique<CBTTessellation>(m_pDevice);
 	m_pVisualizeTexture = std::make_unique<VisualizeTexture>(m_pDevice);
+	m_pTextureStreamer = std::make_unique<TextureStreamer>(m_pDevice);
 
 	FontCreateSettings fontSettings;
 	fontSettings.pName = "Verdana";
@@ -285,7 +300,7 @@ void DemoApp::Update()
 	Profiler::Get()->Resolve(pContext);
 
 	{
-		GPU_PROFILE_SCOPE("Update", pContext);
+		GPU_PROFILE_BEGIN("Update", pContext);
 		m_pDevice->GetShaderManager()->ConditionallyReloadShaders();
 		ImGuiRenderer::NewFrame();
 		UpdateImGui();
@@ -328,10 +343,29 @@ void DemoApp::Update()
 			}
 		}
 
+		if (Input::Instance().IsMousePressed(VK_LBUTTON) && !ImGui::GetIO().WantCaptureMouse)
+		{
+			RayQuery::Hit hit = RayQuery::Intersect(m_SceneData, m_pCamera->GetMouseRay());
+			m_PickedInstance = hit.InstanceID;
+			if (hit.IsHit())
+			{
+				E_LOG(Info, "Picked instance %d, triangle %d at distance %.2f", hit.InstanceID, hit.PrimitiveID, hit.Distance);
+			}
+		}
+
+		for (const Batch& b : m_SceneData.Batches)
+		{
+			if (b.InstanceID == m_PickedInstance)
+			{
+				DebugRenderer::Get()->AddBoundingBox(b.Bounds, Color(0.9f, 0.6f, 0.1f, 1.0f));
+			}
+		}
+
 		Light& sun = m_World.Lights.front();
 		sun.Rotation = Quaternion::CreateFromYawPitchRoll(-Tweakables::g_SunOrientation, Tweakables::g_SunInclination * Math::PI_DIV_2, 0);
 		sun.Colour = Math::MakeFromColorTemperature(Tweakables::g_SunTemperature);
 		sun.Intensity = Tweakables::g_SunIntensity;
+		sun.IsDirty = true;
 
 		if (Tweakables::g_VisualizeLights)
 		{
@@ -345,50 +379,34 @@ void DemoApp::Update()
 		m_SceneData.View = m_pCamera->GetViewTransform();
 		m_SceneData.FrameIndex = m_Frame;
 
-		bool boundsSet = false;
-		for (const Batch& b : m_SceneData.Batches)
+		if (Tweakables::g_BenchmarkMeshletCulling)
 		{
-			if (boundsSet)
-			{
-				BoundingBox::CreateMerged(m_SceneData.SceneAABB, m_SceneData.SceneAABB, b.Bounds);
-			}
-			else
-			{
-				m_SceneData.SceneAABB = b.Bounds;
-				boundsSet = true;
-			}
+			Tweakables::g_BenchmarkMeshletCulling = false;
+			MeshletCulling::Benchmark(m_SceneData);
 		}
 
-		if (m_World.DDGIVolumes.size() > 0)
+		if (Tweakables::g_BenchmarkRayQuery)
 		{
-			DDGIVolume& volume = m_World.DDGIVolumes[0];
-			volume.Origin = m_SceneData.SceneAABB.Center;
-			volume.Extents = 1.1f * Vector3(m_SceneData.SceneAABB.Extents);
+			Tweakables::g_BenchmarkRayQuery = false;
+			RayQuery::Benchmark(m_SceneData);
 		}
 
-		m_SceneData.VisibilityMask.SetAll();
-		for (ShadowView& shadowView : m_SceneData.ShadowViews)
+		if (Tweakables::g_ValidateBLASPoolFrames > 0)
 		{
-			shadowView.Visibility.SetAll();
+			check(BLASPool::Validate(m_pDevice, Tweakables::g_ValidateBLASPoolFrames));
+			Tweakables::g_ValidateBLASPoolFrames = 0;
 		}
 
+		if (!m_SceneData.BVH.IsEmpty())
 		{
-			PROFILE_SCOPE("Frustum Culling");
-			{
-				BoundingFrustum frustum = m_pCamera->GetFrustum();
-				for (const Batch& b : m_SceneData.Batches)
-				{
-					m_SceneData.VisibilityMask.AssignBit(b.InstanceID, frustum.Contains(b.Bounds));
-				}
-			}
+			m_SceneData.SceneAABB = m_SceneData.BVH.GetBounds();
+		}
 
-			for (ShadowView& shadowView : m_SceneData.ShadowViews)
-			{
-				for (const Batch& b : m_SceneData.Batches)
-				{
-					shadowView.Visibility.AssignBit(b.InstanceID, shadowView.IsPerspective ? shadowView.PerspectiveFrustum.Contains(b.Bounds) : shadowView.OrtographicFrustum.Contains(b.Bounds));
-				}
-			}
+		if (m_World.DDGIVolumes.size() > 0)
+		{
+			DDGIVolume& volume = m_World.DDGIVolumes[0];
+			volume.Origin = m_SceneData.SceneAABB.Center;
+			volume.Extents = 1.1f * Vector3(m_SceneData.SceneAABB.Extents);
 		}
 
 		{
@@ -445,11 +463,56 @@ void DemoApp::Update()
 			}
 		}
 
+		for (std::unique_ptr<Mesh>& pMesh : m_World.Meshes)
+		{
+			pMesh->UpdateTextureLoads(*pContext, m_pTextureStreamer.get());
+		}
+		m_pTextureStreamer->Update(*pContext, m_SceneData);
+
 		const SceneView* pView = &m_SceneData;
 		//const World* pWorld = &m_World;
 		SceneView* pViewMut = &m_SceneData;
 		World* pWorldMut = &m_World;
 
+		// Culls against the batches of the current scene upload, the cached shadow maps are drawn with these masks
+		auto CullViews = [&]()
+		{
+			PROFILE_SCOPE("Frustum Culling");
+
+			const uint32 numInstances = m_World.InstanceSlots.GetCapacity();
+			m_SceneData.VisibilityMask.Resize(numInstances);
+			m_SceneData.VisibilityMask.ClearAll();
+			for (ShadowView& shadowView : m_SceneData.ShadowViews)
+			{
+				shadowView.Visibility.Resize(numInstances);
+				shadowView.Visibility.ClearAll();
+			}
+
+			{
+				BoundingFrustum frustum = m_pCamera->GetFrustum();
+				m_SceneData.BVH.Cull(frustum, [&](uint32 batchIndex)
+					{
+						m_SceneData.VisibilityMask.SetBit(m_SceneData.Batches[batchIndex].InstanceID);
+					});
+			}
+
+			for (ShadowView& shadowView : m_SceneData.ShadowViews)
+			{
+				auto SetVisible = [&](uint32 batchIndex)
+				{
+					shadowView.Visibility.SetBit(m_SceneData.Batches[batchIndex].InstanceID);
+				};
+				if (shadowView.IsPerspective)
+				{
+					m_SceneData.BVH.Cull(shadowView.PerspectiveFrustum, SetVisible);
+				}
+				else
+				{
+					m_SceneData.BVH.Cull(shadowView.OrtographicFrustum, SetVisible);
+				}
+			}
+		};
+
 		{
 			// Other queues are super slow on CPU with debug layer for some reason
 			const bool asyncCompute = false;
@@ -463,6 +526,7 @@ void DemoApp::Update()
 
 				CommandContext* pCopyContext = m_pDevice->AllocateCommandContext(D3D12_COMMAND_LIST_TYPE_COPY);
 				Renderer::UploadSceneData(*pCopyContext, pViewMut, pWorldMut);
+				CullViews();
 
 				pCopyContext->Execute(false);
 				pComputeQueue->InsertWait(pCopyQueue);
@@ -475,10 +539,22 @@ void DemoApp::Update()
 			else
 			{
 				Renderer::UploadSceneData(*pContext, pViewMut, pWorldMut);
+				CullViews();
 				pViewMut->AccelerationStructure.Build(*pContext, *pView);
 			}
 		}
 
+		// The shadow depths are recorded in parallel in their own contexts,
+		// which are submitted in order between the scene upload and the render graph.
+		std::vector<CommandContext*> contexts = { pContext };
+		if (m_RenderPath != RenderPath::PathTracing)
+		{
+			RecordShadowDepths(pView, contexts);
+		}
+		GPU_PROFILE_END();
+		CommandContext::Execute(contexts, false);
+		pContext = m_pDevice->AllocateCommandContext();
+
 		RGGraph graph(*m_RenderGraphPool);
 
 		const Vector2u viewDimensions = m_SceneData.GetDimensions();
@@ -516,38 +592,6 @@ void DemoApp::Update()
 		RasterResult rasterResult;
 		if (m_RenderPath != RenderPath::PathTracing)
 		{
-			{
-				RG_GRAPH_SCOPE("Shadow Depths", graph);
-				for (uint32 i = 0; i < (uint32)pView->ShadowViews.size(); ++i)
-				{
-					RGTexture* pShadowmap = graph.TryImport(pView->ShadowViews[i].pDepthTexture);
-					graph.AddPass(Sprintf("View %d", i).c_str(), RGPassFlag::Raster)
-						.DepthStencil(pShadowmap, RenderTargetLoadAction::Clear, true)
-						.Bind([=](CommandContext& context)
-							{
-								context.SetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-								context.SetGraphicsRootSignature(m_pCommonRS);
-
-								// hack - copy the main viewport and then just modify the viewproj
-								SceneView view = *pView;
-								const ShadowView& shadowView = view.ShadowViews[i];
-								view.View.ViewProjection = shadowView.ViewProjection;
-								context.SetRootCBV(1, Renderer::GetViewUniforms(&view, pShadowmap->Get()));
-
-								{
-									GPU_PROFILE_SCOPE("Opaque", &context);
-									context.SetPipelineState(m_pShadowsOpaquePSO);
-									Renderer::DrawScene(context, &view, shadowView.Visibility, Batch::Blending::Opaque);
-								}
-								{
-									GPU_PROFILE_SCOPE("Masked", &context);
-									context.SetPipelineState(m_pShadowsAlphaMaskPSO);
-									Renderer::DrawScene(context, &view, shadowView.Visibility, Batch::Blending::AlphaMask | Batch::Blending::AlphaBlend);
-								}
-							});
-				}
-			}
-
 			const bool doPrepass = true;
 			const bool needVisibilityBuffer = m_RenderPath == RenderPath::Visibility;
 
@@ -1333,7 +1377,7 @@ void DemoApp::UpdateImGui()
 
 				if (GetOpenFileNameA(&ofn) == TRUE)
 				{
-					m_World.Meshes.clear();
+					m_World.ClearMeshes();
 					CommandContext* pContext = m_pDevice->AllocateCommandContext();
 					LoadMesh(ofn.lpstrFile, *pContext, m_World);
 					pContext->Execute(true);
@@ -1536,6 +1580,15 @@ void DemoApp::UpdateImGui()
 		{
 			ImGui::SliderInt("Shadow Cascades", &Tweakables::g_ShadowCascades.Get(), 1, 4);
 			ImGui::Checkbox("SDSM", &Tweakables::g_SDSM.Get());
+			ImGui::Checkbox("Cache Shadows", &Tweakables::g_ShadowCaching.Get());
+			if (m_PickedInstance != ~0u && m_World.InstanceSlots.IsAllocated(m_PickedInstance))
+			{
+				bool isDynamic = m_World.Instances[m_PickedInstance].IsDynamic;
+				if (ImGui::Checkbox("Picked Instance Is Dynamic", &isDynamic))
+				{
+					m_World.SetDynamic(m_PickedInstance, isDynamic);
+				}
+			}
 			ImGui::SliderFloat("PSSM Factor", &Tweakables::g_PSSMFactor.Get(), 0, 1);
 			ImGui::Checkbox("Visualize Cascades", &Tweakables::g_VisualizeShadowCascades.Get());
 		}
@@ -1580,6 +1633,8 @@ void DemoApp::UpdateImGui()
 			ImGui::Checkbox("Debug Render Lights", &Tweakables::g_VisualizeLights.Get());
 			ImGui::Checkbox("Visualize Light Density", &Tweakables::g_VisualizeLightDensity.Get());
 			ImGui::SliderInt("SSR Samples", &Tweakables::g_SsrSamples.Get(), 0, 32);
+			ImGui::SliderFloat("LOD Error Threshold", &Tweakables::g_LODErrorThreshold.Get(), 0.0f, 16.0f);
+			ImGui::Checkbox("Cluster Hierarchy LOD", &Tweakables::g_ClusterLOD.Get());
 			ImGui::Checkbox("Object Bounds", &Tweakables::g_RenderObjectBounds.Get());
 			ImGui::Checkbox("Render Terrain", &Tweakables::g_RenderTerrain.Get());
 		}
@@ -1605,7 +1660,159 @@ void DemoApp::LoadMesh(const std::string& filePath, CommandContext& context, Wor
 {
 	std::unique_ptr<Mesh> pMesh = std::make_unique<Mesh>();
 	pMesh->Load(filePath.c_str(), m_pDevice, &context, 1.0f);
-	world.Meshes.push_back(std::move(pMesh));
+	world.AddMesh(std::move(pMesh));
+}
+
+void DemoApp::RecordShadowDepths(const SceneView* pView, std::vector<CommandContext*>& outContexts)
+{
+	PROFILE_SCOPE("Shadow Depths");
+
+	/*
+		Spot and point light shadow maps are cached.
+		Static casters stay in the shadow map until the light moves or static geometry in its frustum changes.
+		When dynamic casters are in view, the static casters are kept in a separate depth layer which is
+		copied into the shadow map every frame before drawing the dynamic casters on top.
+	*/
+	struct ShadowViewUpdate
+	{
+		uint32 ViewIndex;
+		Texture* pStaticTarget = nullptr;		// Target to draw the static casters to
+		Texture* pStaticSource = nullptr;		// Cached static casters to copy into the shadow map
+		bool DrawDynamic = false;
+		bool DrawAll = false;
+	};
+	std::vector<ShadowViewUpdate> updates;
+
+	m_ShadowCaches.resize(pView->ShadowViews.size());
+	for (uint32 i = 0; i < (uint32)pView->ShadowViews.size(); ++i)
+	{
+		const ShadowView& shadowView = pView->ShadowViews[i];
+		ShadowCache& cache = m_ShadowCaches[i];
+
+		ShadowViewUpdate update;
+		update.ViewIndex = i;
+		if (!Tweakables::g_ShadowCaching || !shadowView.IsPerspective)
+		{
+			cache.StaticDepthValid = false;
+			cache.ShadowMapStatic = false;
+			update.DrawAll = true;
+			updates.push_back(update);
+			continue;
+		}
+
+		bool isValid = cache.ViewProjection == shadowView.ViewProjection;
+		for (uint32 j = 0; j < (uint32)pView->StaticChanges.size() && isValid; ++j)
+		{
+			isValid = !shadowView.PerspectiveFrustum.Intersects(pView->StaticChanges[j]);
+		}
+		if (!isValid)
+		{
+			cache.ViewProjection = shadowView.ViewProjection;
+			cache.StaticDepthValid = false;
+			cache.ShadowMapStatic = false;
+		}
+
+		if (!shadowView.Visibility.Intersects(pView->DynamicInstances))
+		{
+			if (cache.ShadowMapStatic)
+				continue;
+
+			if (cache.StaticDepthValid)
+				update.pStaticSource = cache.pStaticDepth;
+			else
+				update.pStaticTarget = shadowView.pDepthTexture;
+			cache.ShadowMapStatic = true;
+		}
+		else
+		{
+			if (!cache.pStaticDepth)
+			{
+				cache.pStaticDepth = m_pDevice->CreateTexture(shadowView.pDepthTexture->GetDesc(), Sprintf("Static Shadow Map %d", i).c_str());
+			}
+			if (!cache.StaticDepthValid)
+			{
+				update.pStaticTarget = cache.pStaticDepth;
+				cache.StaticDepthValid = true;
+			}
+			update.pStaticSource = cache.pStaticDepth;
+			update.DrawDynamic = true;
+			cache.ShadowMapStatic = false;
+		}
+		updates.push_back(update);
+	}
+
+	const uint32 numUpdates = (uint32)updates.size();
+	if (numUpdates == 0)
+		return;
+
+	auto DrawDepth = [&](CommandContext& context, Texture* pTarget, const ShadowView& shadowView, const VisibilityMask& visibility, RenderPassAccess access)
+	{
+		context.InsertResourceBarrier(pTarget, D3D12_RESOURCE_STATE_DEPTH_WRITE);
+		context.BeginRenderPass(RenderPassInfo::DepthOnly(pTarget, access));
+
+		context.SetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+		context.SetGraphicsRootSignature(m_pCommonRS);
+
+		ShaderInterop::ViewUniforms viewUniforms = Renderer::GetViewUniforms(pView, pTarget);
+		viewUniforms.ViewProjection = shadowView.ViewProjection;
+		context.SetRootCBV(1, viewUniforms);
+
+		// The LODs are selected for the shadow map, the camera's LODs would change the static shadow maps as the camera moves
+		context.SetPipelineState(m_pShadowsOpaquePSO);
+		Renderer::DrawScene(context, pView, visibility, Batch::Blending::Opaque, &shadowView.View);
+		context.SetPipelineState(m_pShadowsAlphaMaskPSO);
+		Renderer::DrawScene(context, pView, visibility, Batch::Blending::AlphaMask | Batch::Blending::AlphaBlend, &shadowView.View);
+
+		context.EndRenderPass();
+	};
+
+	// Each context records a contiguous range of views so submitting the contexts in order keeps the view order
+	const uint32 numContexts = Math::Min(numUpdates, Math::Max(1u, TaskQueue::ThreadCount()));
+	const uint32 firstContext = (uint32)outContexts.size();
+	for (uint32 i = 0; i < numContexts; ++i)
+	{
+		outContexts.push_back(m_pDevice->AllocateCommandContext());
+	}
+
+	TaskContext taskContext;
+	TaskQueue::ExecuteMany([&](TaskDistributeArgs args)
+		{
+			CommandContext& context = *outContexts[firstContext + args.JobIndex];
+			const uint32 firstUpdate = numUpdates * args.JobIndex / numContexts;
+			const uint32 lastUpdate = numUpdates * (args.JobIndex + 1) / numContexts;
+			for (uint32 i = firstUpdate; i < lastUpdate; ++i)
+			{
+				const ShadowViewUpdate& update = updates[i];
+				const ShadowView& shadowView = pView->ShadowViews[update.ViewIndex];
+				Texture* pShadowmap = shadowView.pDepthTexture;
+
+				if (update.DrawAll)
+				{
+					DrawDepth(context, pShadowmap, shadowView, shadowView.Visibility, RenderPassAccess::Clear_Store);
+				}
+				else
+				{
+					if (update.pStaticTarget)
+					{
+						VisibilityMask staticVisibility = shadowView.Visibility;
+						staticVisibility.AndNot(pView->DynamicInstances);
+						DrawDepth(context, update.pStaticTarget, shadowView, staticVisibility, RenderPassAccess::Clear_Store);
+					}
+					if (update.pStaticSource)
+					{
+						context.InsertResourceBarrier(update.pStaticSource, D3D12_RESOURCE_STATE_COPY_SOURCE);
+						context.InsertResourceBarrier(pShadowmap, D3D12_RESOURCE_STATE_COPY_DEST);
+						context.CopyResource(update.pStaticSource, pShadowmap);
+					}
+					if (update.DrawDynamic)
+					{
+						DrawDepth(context, pShadowmap, shadowView, shadowView.Visibility & pView->DynamicInstances, RenderPassAccess::Load_Store);
+					}
+				}
+				context.InsertResourceBarrier(pShadowmap, D3D12_RESOURCE_STATE_ALL_SHADER_RESOURCE);
+			}
+		}, taskContext, numContexts, 1);
+	TaskQueue::Join(taskContext);
 }
 
 void DemoApp::CreateShadowViews(SceneView& view, World& world)
@@ -1666,6 +1873,7 @@ void DemoApp::CreateShadowViews(SceneView& view, World& world)
 		light.ShadowMaps[shadowMapLightIndex] = pTarget;
 		light.ShadowMapSize = resolution;
 		shadowView.pDepthTexture = pTarget;
+		shadowView.View.Viewport = FloatRect(0, 0, (float)resolution, (float)resolution);
 		view.ShadowViews.push_back(shadowView);
 		shadowIndex++;
 	};
@@ -1678,7 +1886,9 @@ void DemoApp::CreateShadowViews(SceneView& view, World& world)
 		{
 			continue;
 		}
+		// Shadow maps are assigned every frame
 		light.ShadowMaps.clear();
+		light.IsDirty = true;
 		if (light.Type == LightType::Directional)
 		{
 			// Frustum corners in world space
@@ -1746,6 +1956,8 @@ void DemoApp::CreateShadowViews(SceneView& view, World& world)
 				ShadowView shadowView;
 				shadowView.IsPerspective = false;
 				shadowView.ViewProjection = lightView * projectionMatrix;
+				shadowView.View.Projection = projectionMatrix;
+				shadowView.View.Perspective = false;
 				shadowView.OrtographicFrustum.Center = center;
 				shadowView.OrtographicFrustum.Extents = maxExtents - minExtents;
 				shadowView.OrtographicFrustum.Extents.z *= 10;
@@ -1767,6 +1979,9 @@ void DemoApp::CreateShadowViews(SceneView& view, World& world)
 			shadowView.IsPerspective = true;
 			shadowView.ViewProjection = lightView * projection;
 			shadowView.PerspectiveFrustum = Math::CreateBoundingFrustum(projection, lightView);
+			shadowView.View.Projection = projection;
+			shadowView.View.Position = light.Position;
+			shadowView.View.NearPlane = 0.01f;
 			AddShadowView(light, shadowView, 512, 0);
 		}
 		else if (light.Type == LightType::Point)
@@ -1791,6 +2006,9 @@ void DemoApp::CreateShadowViews(SceneView& view, World& world)
 				shadowView.IsPerspective = true;
 				shadowView.ViewProjection = viewMatrices[i] * projection;
 				shadowView.PerspectiveFrustum = Math::CreateBoundingFrustum(projection, viewMatrices[i]);
+				shadowView.View.Projection = projection;
+				shadowView.View.Position = light.Position;
+				shadowView.View.NearPlane = 0.01f;
 				AddShadowView(light, shadowView, 512, i);
 			}
 		}
@@ -25,6 +25,7 @@ class ShaderDebugRenderer;
 class GPUDrivenRenderer;
 class DDGI;
 class VisualizeTexture;
+class TextureStreamer;
 struct SubMesh;
 struct Material;
 
@@ -56,6 +57,7 @@ private:
 
 	void LoadMesh(const std::string& filePath, CommandContext& context, World& world);
 	void CreateShadowViews(SceneView& view, World& world);
+	void RecordShadowDepths(const SceneView* pView, std::vector<CommandContext*>& outContexts);
 	
 	RefCountPtr<GraphicsDevice> m_pDevice;
 	RefCountPtr<SwapChain> m_pSwapchain;
@@ -69,6 +71,16 @@ private:
 	RefCountPtr<Texture> m_pColorOutput;
 	std::vector<RefCountPtr<Texture>> m_ShadowMaps;
 
+	// Static casters of a shadow map, kept while its view and the static geometry in it don't change
+	struct ShadowCache
+	{
+		Matrix ViewProjection;
+		RefCountPtr<Texture> pStaticDepth;	// Static casters only, composited under the dynamic casters
+		bool StaticDepthValid = false;
+		bool ShadowMapStatic = false;		// The shadow map holds exactly the cached static casters
+	};
+	std::vector<ShadowCache> m_ShadowCaches;
+
 	std::unique_ptr<ClusteredForward> m_pClusteredForward;
 	std::unique_ptr<TiledForward> m_pTiledForward;
 	std::unique_ptr<RTAO> m_pRTAO;
@@ -82,6 +94,7 @@ private:
 	std::unique_ptr<GPUDrivenRenderer> m_pGPUDrivenRenderer;
 	std::unique_ptr<DDGI> m_pDDGI;
 	std::unique_ptr<VisualizeTexture> m_pVisualizeTexture;
+	std::unique_ptr<TextureStreamer> m_pTextureStreamer;
 
 	LightCull2DData m_LightCull2DData;
 	LightCull3DData m_LightCull3DData;
@@ -103,6 +116,8 @@ private:
 
 	World m_World;
 	SceneView m_SceneData;
+	// Instance ID of the last instance clicked on
+	uint32 m_PickedInstance = ~0u;
 
 	RefCountPtr<RootSignature> m_pCommonRS;
 
@@ -1,6 +1,9 @@
 #include "LDraw.h"
 
 #include <assert.h>
+#include <algorithm>
+
+#include "meshoptimizer.h"
 
 constexpr uint32 MATERIAL_CODE_INHERIT = 16;
 constexpr uint32 MATERIAL_CODE_COMPLEMENT = 24;
@@ -24,28 +27,6 @@ namespace Util
 	template<typename T, size_t N>
 	constexpr size_t SizeOf(T(&arr)[N]) { return N; }
 
-	static void MurmurHash(uint32& h, const void* pData, size_t len)
-	{
-		assert(len % 4 == 0); // Assume 4 byte alignment as we're leaving off the last part of the algorithm
-		const uint32 m = 0x5bd1e995;
-		const uint32 r = 24;
-		const char* pKey = (char*)pData;
-		while (len >= 4)
-		{
-			uint32 k = *(uint32*)(pData);
-
-			k *= m;
-			k ^= k >> r;
-			k *= m;
-
-			h *= m;
-			h ^= k;
-
-			pKey += 4;
-			len -= 4;
-		}
-	}
-
 	struct FileReader
 	{
 		bool Open(const char* pPath)
@@ -105,6 +86,169 @@ namespace Util
 	};
 }
 
+/*
+	Library cache.
+	A binary file with the flattened, smoothed and indexed library parts:
+	FileHeader followed by NumParts of PartHeader, Vertices, Normals, Colors and Indices.
+*/
+namespace Cache
+{
+	constexpr uint32 MAGIC = 'L' | 'D' << 8 | 'R' << 16 | 'C' << 24;
+	constexpr uint32 VERSION = 1;
+
+	struct FileHeader
+	{
+		uint32 Magic;
+		uint32 Version;
+		uint32 ConfigHash;
+		uint32 NumParts;
+	};
+
+	struct PartHeader
+	{
+		LdrName Name;
+		uint32 IsMultiMaterial;
+		uint32 NumVertices;
+		uint32 NumIndices;
+	};
+
+	// The geometry of a part depends on the quality and the replacements
+	static uint32 GetConfigHash(const LdrConfig& config)
+	{
+		uint32 hash = LdrName::Hasher::val_const;
+		hash = (hash ^ (uint32)config.Quality) * LdrName::Hasher::prime_const;
+		for (const std::pair<const char*, const char*>& replacement : config.ReplacementMap)
+		{
+			hash = LdrName::Hasher::Hash_Internal(replacement.first, hash);
+			hash = LdrName::Hasher::Hash_Internal(replacement.second ? replacement.second : "", hash);
+		}
+		return hash;
+	}
+
+	static size_t GetPartSize(const PartHeader& header)
+	{
+		return sizeof(PartHeader) + header.NumVertices * (2 * sizeof(LdrVector) + sizeof(uint32)) + header.NumIndices * sizeof(uint32);
+	}
+
+	static bool Load(LdrState* pData)
+	{
+		pData->CacheData.clear();
+		pData->CacheMap.clear();
+
+		FILE* pFile = nullptr;
+		fopen_s(&pFile, pData->Config.pCachePath, "rb");
+		if (!pFile)
+			return false;
+		fseek(pFile, 0, SEEK_END);
+		size_t size = ftell(pFile);
+		fseek(pFile, 0, SEEK_SET);
+		pData->CacheData.resize(size);
+		size_t read = fread(pData->CacheData.data(), sizeof(char), size, pFile);
+		fclose(pFile);
+
+		const FileHeader* pHeader = (const FileHeader*)pData->CacheData.data();
+		bool valid = read == size && size >= sizeof(FileHeader) &&
+			pHeader->Magic == MAGIC && pHeader->Version == VERSION && pHeader->ConfigHash == GetConfigHash(pData->Config);
+
+		size_t offset = sizeof(FileHeader);
+		for (uint32 i = 0; valid && i < pHeader->NumParts; ++i)
+		{
+			const PartHeader* pPart = (const PartHeader*)(pData->CacheData.data() + offset);
+			valid = offset + sizeof(PartHeader) <= size && offset + GetPartSize(*pPart) <= size;
+			if (valid)
+			{
+				pData->CacheMap[pPart->Name] = offset;
+				offset += GetPartSize(*pPart);
+			}
+		}
+
+		if (!valid)
+		{
+			pData->CacheData.clear();
+			pData->CacheMap.clear();
+		}
+		return valid;
+	}
+
+	static std::unique_ptr<LdrPart> ReadPart(const LdrState* pData, size_t offset)
+	{
+		const char* pCurrent = pData->CacheData.data() + offset;
+		const PartHeader& header = *(const PartHeader*)pCurrent;
+		pCurrent += sizeof(PartHeader);
+
+		auto ReadArray = [&](auto& outArray, uint32 count)
+		{
+			outArray.resize(count);
+			memcpy(outArray.data(), pCurrent, count * sizeof(outArray[0]));
+			pCurrent += count * sizeof(outArray[0]);
+		};
+
+		std::unique_ptr<LdrPart> pPart = std::make_unique<LdrPart>();
+		pPart->Name = header.Name;
+		pPart->PartType = LdrPart::Type::Part;
+		pPart->IsMultiMaterial = header.IsMultiMaterial != 0;
+		ReadArray(pPart->Vertices, header.NumVertices);
+		ReadArray(pPart->Normals, header.NumVertices);
+		ReadArray(pPart->Colors, header.NumVertices);
+		ReadArray(pPart->Indices, header.NumIndices);
+		return pPart;
+	}
+
+	// Appends the parts to the cache and writes it
+	static bool Save(LdrState* pData, const std::vector<const LdrPart*>& parts)
+	{
+		std::vector<char> data = pData->CacheData;
+		auto WriteData = [&](const void* pSource, size_t size)
+		{
+			data.insert(data.end(), (const char*)pSource, (const char*)pSource + size);
+		};
+
+		if (data.empty())
+		{
+			FileHeader header;
+			header.Magic = MAGIC;
+			header.Version = VERSION;
+			header.ConfigHash = GetConfigHash(pData->Config);
+			header.NumParts = 0;
+			WriteData(&header, sizeof(FileHeader));
+		}
+
+		std::vector<std::pair<LdrName, size_t>> newEntries;
+		for (const LdrPart* pPart : parts)
+		{
+			PartHeader header;
+			header.Name = pPart->Name;
+			header.IsMultiMaterial = pPart->IsMultiMaterial ? 1 : 0;
+			header.NumVertices = (uint32)pPart->Vertices.size();
+			header.NumIndices = (uint32)pPart->Indices.size();
+			newEntries.push_back({ pPart->Name, data.size() });
+
+			WriteData(&header, sizeof(PartHeader));
+			WriteData(pPart->Vertices.data(), pPart->Vertices.size() * sizeof(LdrVector));
+			WriteData(pPart->Normals.data(), pPart->Normals.size() * sizeof(LdrVector));
+			WriteData(pPart->Colors.data(), pPart->Colors.size() * sizeof(uint32));
+			WriteData(pPart->Indices.data(), pPart->Indices.size() * sizeof(uint32));
+		}
+		((FileHeader*)data.data())->NumParts += (uint32)parts.size();
+
+		FILE* pFile = nullptr;
+		fopen_s(&pFile, pData->Config.pCachePath, "wb");
+		if (!pFile)
+			return false;
+		size_t written = fwrite(data.data(), sizeof(char), data.size(), pFile);
+		fclose(pFile);
+		if (written != data.size())
+			return false;
+
+		pData->CacheData.swap(data);
+		for (const std::pair<LdrName, size_t>& entry : newEntries)
+		{
+			pData->CacheMap[entry.first] = entry.second;
+		}
+		return true;
+	}
+}
+
 LdrResult LdrInit(const LdrConfig* pConfig, LdrState* pData)
 {
 	pData->Config = *pConfig;
@@ -113,6 +257,9 @@ LdrResult LdrInit(const LdrConfig* pConfig, LdrState* pData)
 	pData->PartMap.clear();
 	pData->Parts.clear();
 
+	if (pConfig->pCachePath)
+		Cache::Load(pData);
+
 	if (pConfig->Quality == LdrQuality::High)
 		pData->DatabaseLocations.push_back({ "p/48/" , LdrPart::Type::Primitive });
 	else if(pConfig->Quality == LdrQuality::Low)
@@ -405,23 +552,35 @@ LdrResult ParseLDraw(const char* pPartName, LdrState* pData, std::vector<std::un
 	return LdrResult::Success;
 }
 
-LdrPart* GetPart(const char* pName, LdrState* pData)
+// Returns nullptr when the part is replaced by nothing
+const char* ResolvePartName(const char* pName, const LdrState* pData)
 {
 	for (const std::pair<const char*, const char*>& replacement : pData->Config.ReplacementMap)
 	{
 		if (strcmp(pName, replacement.first) == 0)
 		{
-			if (replacement.second)
-			{
-				pName = replacement.second;
-				break;
-			}
-			else
-			{
-				return nullptr;
-			}
+			return replacement.second;
 		}
 	}
+	return pName;
+}
+
+// Finds an already loaded part. Doesn't modify the state so it can be used from multiple threads.
+LdrPart* FindPart(const char* pName, const LdrState* pData)
+{
+	pName = ResolvePartName(pName, pData);
+	if (!pName)
+		return nullptr;
+
+	auto it = pData->PartMap.find(pName);
+	return it != pData->PartMap.end() ? pData->Parts[it->second].get() : nullptr;
+}
+
+LdrPart* GetPart(const char* pName, LdrState* pData)
+{
+	pName = ResolvePartName(pName, pData);
+	if (!pName)
+		return nullptr;
 
 	auto it = pData->PartMap.find(pName);
 	if (it != pData->PartMap.end())
@@ -429,6 +588,14 @@ LdrPart* GetPart(const char* pName, LdrState* pData)
 		return pData->Parts[it->second].get();
 	}
 
+	auto cacheIt = pData->CacheMap.find(pName);
+	if (cacheIt != pData->CacheMap.end())
+	{
+		pData->PartMap[pName] = (uint32)pData->Parts.size();
+		pData->Parts.push_back(Cache::ReadPart(pData, cacheIt->second));
+		return pData->Parts.back().get();
+	}
+
 	std::vector<std::unique_ptr<LdrPart>> parts;
 	if (ParseLDraw(pName, pData, parts) == LdrResult::Success)
 	{
@@ -480,11 +647,30 @@ uint32 ResolveTriangleColor(uint32 triangleColor, uint32 parentColor)
 	return triangleColor == MATERIAL_CODE_INHERIT ? parentColor : triangleColor;
 }
 
-void FlattenPart(LdrPart* pPart, LdrState* pData, const LdrMatrix& currentLdrMatrix = LdrMatrix(), bool invert = false, uint32 color = MATERIAL_CODE_INHERIT)
+// Loads all parts the part is built from and returns the depth of its subfile tree
+uint32 LoadSubparts(LdrPart* pPart, LdrState* pData, std::unordered_map<LdrPart*, uint32>& partDepths)
 {
+	auto it = partDepths.find(pPart);
+	if (it != partDepths.end())
+		return it->second;
+
+	uint32 depth = 0;
 	for (const LdrSubfile& subfile : pPart->Subfiles)
 	{
 		LdrPart* pSubpart = GetPart(subfile.Name.c_str(), pData);
+		if (pSubpart)
+			depth = std::max(depth, LoadSubparts(pSubpart, pData, partDepths) + 1);
+	}
+	partDepths[pPart] = depth;
+	return depth;
+}
+
+// All subparts must be flattened already
+void FlattenPart(LdrPart* pPart, const LdrState* pData)
+{
+	for (const LdrSubfile& subfile : pPart->Subfiles)
+	{
+		const LdrPart* pSubpart = FindPart(subfile.Name.c_str(), pData);
 		if (!pSubpart)
 			continue;
 
@@ -492,19 +678,26 @@ void FlattenPart(LdrPart* pPart, LdrState* pData, const LdrMatrix& currentLdrMat
 		float det = subfile.Transform.Determinant3x3();
 		inv ^= (det < 0);
 
-		FlattenPart(pSubpart, pData, subfile.Transform * currentLdrMatrix, invert ^ inv, ResolveTriangleColor(subfile.Color, color));
-
 		pPart->IsMultiMaterial |= pSubpart->IsMultiMaterial;
 
-		for (uint32 i = 0; i < pSubpart->Vertices.size(); i += 3)
+		// Parts from the cache are already indexed
+		const bool indexed = !pSubpart->Indices.empty();
+		const uint32 numVertices = (uint32)(indexed ? pSubpart->Indices.size() : pSubpart->Vertices.size());
+		auto GetVertex = [&](uint32 i) { return indexed ? pSubpart->Indices[i] : i; };
+
+		for (uint32 i = 0; i < numVertices; i += 3)
 		{
-			pPart->Vertices.push_back(pSubpart->Vertices[i + (inv ? 2u : 0u)].Transform(subfile.Transform));
-			pPart->Vertices.push_back(pSubpart->Vertices[i + (inv ? 1u : 1u)].Transform(subfile.Transform));
-			pPart->Vertices.push_back(pSubpart->Vertices[i + (inv ? 0u : 2u)].Transform(subfile.Transform));
+			uint32 v0 = GetVertex(i + (inv ? 2u : 0u));
+			uint32 v1 = GetVertex(i + (inv ? 1u : 1u));
+			uint32 v2 = GetVertex(i + (inv ? 0u : 2u));
+
+			pPart->Vertices.push_back(pSubpart->Vertices[v0].Transform(subfile.Transform));
+			pPart->Vertices.push_back(pSubpart->Vertices[v1].Transform(subfile.Transform));
+			pPart->Vertices.push_back(pSubpart->Vertices[v2].Transform(subfile.Transform));
 
-			pPart->Colors.push_back(ResolveTriangleColor(pSubpart->Colors[i + (inv ? 2u : 0u)], subfile.Color));
-			pPart->Colors.push_back(ResolveTriangleColor(pSubpart->Colors[i + (inv ? 1u : 1u)], subfile.Color));
-			pPart->Colors.push_back(ResolveTriangleColor(pSubpart->Colors[i + (inv ? 0u : 2u)], subfile.Color));
+			pPart->Colors.push_back(ResolveTriangleColor(pSubpart->Colors[v0], subfile.Color));
+			pPart->Colors.push_back(ResolveTriangleColor(pSubpart->Colors[v1], subfile.Color));
+			pPart->Colors.push_back(ResolveTriangleColor(pSubpart->Colors[v2], subfile.Color));
 		}
 	}
 	pPart->Subfiles.clear();
@@ -514,8 +707,9 @@ void ComputePartNormals(LdrPart* pPart)
 {
 	if (pPart->Normals.empty())
 	{
-		pPart->Normals.resize(pPart->Vertices.size());
-		for (size_t i = 0; i < pPart->Vertices.size(); i += 3)
+		const uint32 numVertices = (uint32)pPart->Vertices.size();
+		pPart->Normals.resize(numVertices);
+		for (size_t i = 0; i < numVertices; i += 3)
 		{
 			LdrVector n0 = pPart->Vertices[i + 1] - pPart->Vertices[i + 0];
 			LdrVector n1 = pPart->Vertices[i + 2] - pPart->Vertices[i + 0];
@@ -525,40 +719,43 @@ void ComputePartNormals(LdrPart* pPart)
 			pPart->Normals[i + 2] = normal;
 		}
 
-		struct VectorHasher
-		{
-			size_t operator()(const LdrVector& v) const
-			{
-				uint32 h = 0;
-				Util::MurmurHash(h, &v, sizeof(LdrVector));
-				return h;
-			}
-		};
+		// Weld the positions and gather the vertices of each position with a counting sort
+		std::vector<uint32> positionRemap(numVertices);
+		const uint32 numPositions = (uint32)meshopt_generateVertexRemap(positionRemap.data(), nullptr, numVertices, pPart->Vertices.data(), numVertices, sizeof(LdrVector));
 
-		std::unordered_map<LdrVector, std::vector<uint32>, VectorHasher> vertexMap;
-		for (size_t i = 0; i < pPart->Vertices.size(); ++i)
+		std::vector<uint32> positionOffsets(numPositions + 1);
+		for (uint32 i = 0; i < numVertices; ++i)
 		{
-			vertexMap[pPart->Vertices[i]].push_back((uint32)i);
+			++positionOffsets[positionRemap[i] + 1];
+		}
+		for (uint32 i = 0; i < numPositions; ++i)
+		{
+			positionOffsets[i + 1] += positionOffsets[i];
+		}
+		std::vector<uint32> positionVertices(numVertices);
+		std::vector<uint32> positionCursors(positionOffsets.begin(), positionOffsets.end() - 1);
+		for (uint32 i = 0; i < numVertices; ++i)
+		{
+			positionVertices[positionCursors[positionRemap[i]]++] = i;
 		}
 
 		const float minAngleCos = cos(3.141592f / 4.0f);
 
-		std::vector<LdrVector> newNormals(pPart->Normals.size());
-		for (size_t i = 0; i < pPart->Vertices.size(); ++i)
+		std::vector<LdrVector> newNormals(numVertices);
+		for (uint32 i = 0; i < numVertices; ++i)
 		{
-			const std::vector<uint32>& identicalVertices = vertexMap[pPart->Vertices[i]];
+			const uint32 position = positionRemap[i];
 			LdrVector vertexNormal = pPart->Normals[i];
 			LdrVector smoothNormal;
-			for (uint32 vertexIndex : identicalVertices)
+			for (uint32 j = positionOffsets[position]; j < positionOffsets[position + 1]; ++j)
 			{
-				const LdrVector& otherNormal = pPart->Normals[vertexIndex];
+				const LdrVector& otherNormal = pPart->Normals[positionVertices[j]];
 				if (vertexNormal.Dot(otherNormal) > minAngleCos)
 				{
 					smoothNormal = smoothNormal + otherNormal;
 				}
 			}
-			smoothNormal.Normalize();
-			newNormals[i] = smoothNormal;
+			newNormals[i] = smoothNormal.Normalize();
 		}
 		pPart->Normals.swap(newNormals);
 	}
@@ -566,75 +763,21 @@ void ComputePartNormals(LdrPart* pPart)
 
 void ComputePartIndices(LdrPart* pPart)
 {
-	// Inspired by MeshOptimized by zeux
-
 	if (pPart->Indices.empty())
 	{
-		struct HashedVertex
-		{
-			HashedVertex(const LdrPart* pPart, uint32 vertex)
-				: pPart(pPart), Vertex(vertex)
-			{}
-			const LdrPart* pPart;
-			uint32 Vertex;
-
-			struct Hasher
-			{
-				size_t operator()(const HashedVertex& v) const
-				{
-					uint32 h = 0;
-					Util::MurmurHash(h, v.pPart->Vertices.data() + v.Vertex, sizeof(LdrVector));
-					Util::MurmurHash(h, v.pPart->Normals.data() + v.Vertex, sizeof(LdrVector));
-					Util::MurmurHash(h, v.pPart->Colors.data() + v.Vertex, sizeof(uint32));
-					return h;
-				}
-			};
-
-			bool operator==(const HashedVertex& rhs) const
-			{
-				return pPart->Colors[Vertex] == rhs.pPart->Colors[rhs.Vertex] &&
-					pPart->Normals[Vertex] == rhs.pPart->Normals[rhs.Vertex] &&
-					pPart->Vertices[Vertex] == rhs.pPart->Vertices[rhs.Vertex];
-			}
+		const uint32 numVertices = (uint32)pPart->Vertices.size();
+		const meshopt_Stream streams[] = {
+			{ pPart->Vertices.data(), sizeof(LdrVector), sizeof(LdrVector) },
+			{ pPart->Normals.data(), sizeof(LdrVector), sizeof(LdrVector) },
+			{ pPart->Colors.data(), sizeof(uint32), sizeof(uint32) },
 		};
 
-		std::unordered_map<HashedVertex, uint32, HashedVertex::Hasher> buckets;
-		std::vector<uint32> remap(pPart->Vertices.size(), ~0u);
+		std::vector<uint32> remap(numVertices);
+		const uint32 indexCount = (uint32)meshopt_generateVertexRemapMulti(remap.data(), nullptr, numVertices, numVertices, streams, Util::SizeOf(streams));
 
-		uint32 indexCount = 0;
-		for (size_t i = 0; i < pPart->Vertices.size(); ++i)
-		{
-			if (remap[i] == ~0u)
-			{
-				HashedVertex v(pPart, (uint32)i);
-				auto it = buckets.find(v);
-				if (it == buckets.end())
-				{
-					buckets[v] = (uint32)i;
-					remap[i] = indexCount++;
-				}
-				else
-				{
-					remap[i] = remap[it->second];
-				}
-			}
-		}
-
-		auto remapBuffer = [](void* pData, uint32* remap, uint32 numElements, uint32 elementSize)
-		{
-			// Make a copy
-			char* pCopy = new char[numElements * elementSize];
-			memcpy(pCopy, pData, numElements * elementSize);
-			for (uint32 i = 0; i < numElements; ++i)
-			{
-				memcpy((char*)pData + remap[i] * elementSize, pCopy + i * elementSize, elementSize);
-			}
-			delete[] pCopy;
-		};
-
-		remapBuffer(pPart->Vertices.data(), remap.data(), (uint32)pPart->Vertices.size(), sizeof(LdrVector));
-		remapBuffer(pPart->Normals.data(), remap.data(), (uint32)pPart->Normals.size(), sizeof(LdrVector));
-		remapBuffer(pPart->Colors.data(), remap.data(), (uint32)pPart->Colors.size(), sizeof(uint32));
+		meshopt_remapVertexBuffer(pPart->Vertices.data(), pPart->Vertices.data(), numVertices, sizeof(LdrVector), remap.data());
+		meshopt_remapVertexBuffer(pPart->Normals.data(), pPart->Normals.data(), numVertices, sizeof(LdrVector), remap.data());
+		meshopt_remapVertexBuffer(pPart->Colors.data(), pPart->Colors.data(), numVertices, sizeof(uint32), remap.data());
 
 		pPart->Vertices.resize(indexCount);
 		pPart->Normals.resize(indexCount);
@@ -646,9 +789,10 @@ void ComputePartIndices(LdrPart* pPart)
 /*
 	Model Loading happens in several stages:
 	1. Gather all geometry instances at "Part" granularity with recursion.
-	2. Flatten the geometry of each part with recursion.
+	2. Load all subparts and flatten the geometry of each part, bottom up.
 	3. Compute smooth vertex normals.
 	4. Generate index buffer to deduplicate verticee.
+	Parts found in the library cache skip all stages. Stage 2-4 run in parallel per part.
 */
 
 LdrResult LdrLoadModel(const char* pFile, LdrState* pData, LdrModel& outModel)
@@ -666,16 +810,53 @@ LdrResult LdrLoadModel(const char* pFile, LdrState* pData, LdrModel& outModel)
 
 	ResolveModelParts(pMainPart, pData, outModel, LdrMatrix::CreateScale(lduScale, -lduScale, lduScale));
 
+	auto ParallelFor = [pData](uint32 count, const std::function<void(uint32 index)>& function)
+	{
+		if (pData->Config.ParallelFor)
+		{
+			pData->Config.ParallelFor(count, function);
+		}
+		else
+		{
+			for (uint32 i = 0; i < count; ++i)
+				function(i);
+		}
+	};
+
+	// Parts only read subparts of a lower depth, so all parts of the same depth can be flattened in parallel
+	std::unordered_map<LdrPart*, uint32> partDepths;
+	uint32 maxDepth = 0;
 	for (LdrPart* pPart : outModel.Parts)
 	{
-		FlattenPart(pPart, pData);
-		ComputePartNormals(pPart);
+		maxDepth = std::max(maxDepth, LoadSubparts(pPart, pData, partDepths));
 	}
 
-	// Generate indices in a separate loop because part flattening needs unindexed vertices and inner parts may be re-used
-	for (LdrPart* pPart : outModel.Parts)
+	std::vector<std::vector<LdrPart*>> depthParts(maxDepth + 1);
+	for (const std::pair<LdrPart* const, uint32>& partDepth : partDepths)
 	{
-		ComputePartIndices(pPart);
+		depthParts[partDepth.second].push_back(partDepth.first);
+	}
+
+	for (const std::vector<LdrPart*>& parts : depthParts)
+	{
+		ParallelFor((uint32)parts.size(), [&](uint32 index) { FlattenPart(parts[index], pData); });
+	}
+
+	ParallelFor((uint32)outModel.Parts.size(), [&](uint32 index) { ComputePartNormals(outModel.Parts[index]); });
+
+	// Generate indices in a separate pass because part flattening needs unindexed vertices and inner parts may be re-used
+	ParallelFor((uint32)outModel.Parts.size(), [&](uint32 index) { ComputePartIndices(outModel.Parts[index]); });
+
+	if (pData->Config.pCachePath)
+	{
+		std::vector<const LdrPart*> newParts;
+		for (const LdrPart* pPart : outModel.Parts)
+		{
+			if (pPart->PartType == LdrPart::Type::Part && pData->CacheMap.find(pPart->Name) == pData->CacheMap.end())
+				newParts.push_back(pPart);
+		}
+		if (!newParts.empty())
+			Cache::Save(pData, newParts);
 	}
 
 	return LdrResult::Success;
@@ -3,6 +3,7 @@
 #include <vector>
 #include <unordered_map>
 #include <memory>
+#include <functional>
 
 using uint32 = unsigned int;
 using uint8 = unsigned char;
@@ -252,6 +253,13 @@ struct LdrConfig
 	const char* pDatabasePath;
 	LdrQuality Quality = LdrQuality::Normal;
 	std::vector<std::pair<const char*, const char*>> ReplacementMap;
+
+	// Binary file with the fully processed library parts. Parts found in it skip parsing and processing.
+	// Delete the file when the parts library changes.
+	const char* pCachePath = nullptr;
+
+	// Runs 'function' for [0, count) and returns when all are done. Part processing is serial when not set.
+	std::function<void(uint32 count, const std::function<void(uint32 index)>& function)> ParallelFor;
 };
 
 struct LdrState
@@ -270,6 +278,9 @@ struct LdrState
 	};
 
 	std::vector<DatabaseLocation> DatabaseLocations;
+
+	std::vector<char> CacheData;
+	std::unordered_map<LdrName, size_t, LdrName::Hasher> CacheMap;	// Offset of each part in CacheData
 };
 
 LdrResult LdrInit(const LdrConfig* pConfig, LdrState* pData);
@@ -10,18 +10,173 @@
 #include "Core/ConsoleVariables.h"
 #include "RHI/PipelineState.h"
 #include "RHI/RootSignature.h"
+#include <chrono>
+#include <random>
 
 namespace Tweakables
 {
 	static const uint32 gMaxNumBLASVerticesPerFrame = 100'000;
 	static const uint32 gMaxNumCompactionsPerFrame = 32;
+	static const uint64 gBLASPoolPageSize = 32 << 20;
+	static const uint64 gBLASScratchAlignment = 1 << 20;
+	static const float gTLASMaxDrift = 0.25f;
+	static const uint32 gTLASMaxRefits = 120;
 
 	extern ConsoleVariable<float> g_TLASBoundsThreshold;
+
+	ConsoleCommand<int, int> gSimulateTLASUpdates("r.Raytracing.SimulateTLAS", [](int numInstances, int numMoving) { TLASUpdatePolicy::Simulate(numInstances, numMoving, 2000); });
 }
 
 static GlobalResource<RootSignature> gCommonRS;
 static GlobalResource<PipelineState> gUpdateTLASPSO;
 
+// Written to the slot of the instance desc by UpdateTLAS.hlsl
+struct BLASInstance
+{
+	uint64 GPUAddress;
+	uint32 InstanceID;
+	uint32 Flags;
+	uint32 Slot;
+	uint32 Padding;
+};
+
+TLASUpdatePolicy::UpdateMode TLASUpdatePolicy::Update(const Span<Instance>& instances, float maxDrift, uint32 maxRefits, std::vector<uint32>& outDirtySlots)
+{
+	outDirtySlots.clear();
+	const uint32 numInstances = instances.GetSize();
+
+	auto IsSameDesc = [](const Instance& a, const Instance& b)
+	{
+		return a.BLASAddress == b.BLASAddress && a.InstanceID == b.InstanceID && a.Flags == b.Flags;
+	};
+
+	bool canRefit = m_IsValid && numInstances == (uint32)m_Instances.size();
+	for (uint32 i = 0; canRefit && i < numInstances; ++i)
+	{
+		canRefit = IsSameDesc(instances[i], m_Instances[i]);
+	}
+
+	if (canRefit)
+	{
+		for (uint32 i = 0; i < numInstances; ++i)
+		{
+			const Instance& instance = instances[i];
+			if (instance.WorldMatrix != m_Instances[i].WorldMatrix)
+			{
+				outDirtySlots.push_back(i);
+				m_Instances[i] = instance;
+
+				// Both translation and rotation grow the nodes of the tree
+				const BoundingBox& buildBounds = m_BuildBounds[i];
+				const float radius = Math::Max(Vector3(buildBounds.Extents).Length(), FLT_EPSILON);
+				const float drift = (Vector3::Distance(instance.Bounds.Center, buildBounds.Center) + Vector3::Distance(instance.Bounds.Extents, buildBounds.Extents)) / radius;
+				m_TotalDrift += drift - m_Drift[i];
+				m_Drift[i] = drift;
+			}
+		}
+
+		if (outDirtySlots.empty())
+			return UpdateMode::None;
+
+		if (m_NumRefits < maxRefits && m_TotalDrift <= maxDrift * numInstances)
+		{
+			++m_NumRefits;
+			return UpdateMode::Refit;
+		}
+	}
+	else
+	{
+		// Slots that hold the same instance as before keep their desc
+		for (uint32 i = 0; i < numInstances; ++i)
+		{
+			if (i >= (uint32)m_Instances.size() || !IsSameDesc(instances[i], m_Instances[i]) || instances[i].WorldMatrix != m_Instances[i].WorldMatrix)
+			{
+				outDirtySlots.push_back(i);
+			}
+		}
+		m_Instances.assign(instances.begin(), instances.end());
+	}
+
+	m_BuildBounds.resize(numInstances);
+	for (uint32 i = 0; i < numInstances; ++i)
+	{
+		m_BuildBounds[i] = instances[i].Bounds;
+	}
+	m_Drift.assign(numInstances, 0.0f);
+	m_TotalDrift = 0;
+	m_NumRefits = 0;
+	m_IsValid = true;
+	return UpdateMode::Rebuild;
+}
+
+void TLASUpdatePolicy::Simulate(uint32 numInstances, uint32 numMoving, uint32 numFrames)
+{
+	// Instances are scattered in a box, the moving ones go around in circles.
+	// An instance is added every few hundred frames to change the set of instances.
+	std::mt19937 random(0);
+	std::uniform_real_distribution<float> positionDistribution(-500.0f, 500.0f);
+	std::uniform_real_distribution<float> sizeDistribution(1.0f, 10.0f);
+
+	struct SimulatedInstance
+	{
+		Vector3 Position;
+		float Size;
+	};
+	std::vector<SimulatedInstance> scene;
+	auto AddInstance = [&]()
+	{
+		scene.push_back({ Vector3(positionDistribution(random), positionDistribution(random), positionDistribution(random)), sizeDistribution(random) });
+	};
+	for (uint32 i = 0; i < numInstances; ++i)
+	{
+		AddInstance();
+	}
+
+	TLASUpdatePolicy policy;
+	std::vector<Instance> instances;
+	std::vector<uint32> dirtySlots;
+	uint32 numUpdates[3]{};
+	uint64 numDescWrites = 0;
+	uint64 numFullDescWrites = 0;
+	float maxDrift = 0;
+
+	for (uint32 frame = 0; frame < numFrames; ++frame)
+	{
+		if (frame > 0 && frame % 500 == 0)
+		{
+			AddInstance();
+		}
+
+		instances.resize(scene.size());
+		for (uint32 i = 0; i < (uint32)scene.size(); ++i)
+		{
+			Vector3 position = scene[i].Position;
+			if (i < numMoving)
+			{
+				const float angle = frame * 0.02f + i;
+				position += Vector3(cosf(angle), 0, sinf(angle)) * 4.0f * scene[i].Size;
+			}
+			Instance& instance = instances[i];
+			instance.BLASAddress = (i + 1) * 0x10000ull;
+			instance.InstanceID = i;
+			instance.Flags = 0;
+			instance.WorldMatrix = Matrix::CreateScale(scene[i].Size) * Matrix::CreateTranslation(position);
+			instance.Bounds = BoundingBox(position, Vector3(scene[i].Size));
+		}
+
+		maxDrift = Math::Max(maxDrift, policy.GetDrift() / Math::Max(1u, policy.GetNumInstances()));
+		UpdateMode mode = policy.Update(instances, Tweakables::gTLASMaxDrift, Tweakables::gTLASMaxRefits, dirtySlots);
+		++numUpdates[(int)mode];
+		numDescWrites += dirtySlots.size();
+		numFullDescWrites += instances.size();
+	}
+
+	E_LOG(Info, "TLAS update simulation: %d instances, %d moving, %d frames", numInstances, numMoving, numFrames);
+	E_LOG(Info, "	Rebuilds: %d, refits: %d, unchanged: %d", numUpdates[(int)UpdateMode::Rebuild], numUpdates[(int)UpdateMode::Refit], numUpdates[(int)UpdateMode::None]);
+	E_LOG(Info, "	Instance descs written: %.1f per frame, %.1f%% of a full upload. Max drift per instance: %.3f",
+		(float)numDescWrites / numFrames, 100.0f * numDescWrites / Math::Max<uint64>(1, numFullDescWrites), maxDrift);
+}
+
 void AccelerationStructure::Build(CommandContext& context, const SceneView& view)
 {
 	if (!gCommonRS)
@@ -43,136 +198,127 @@ void AccelerationStructure::Build(CommandContext& context, const SceneView& view
 
 		ID3D12GraphicsCommandList4* pCmd = context.GetRaytracingCommandList();
 
-		D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAGS buildFlags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_TRACE;
+		D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAGS buildFlags =
+			D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_TRACE
+			| D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_UPDATE;
 
-		uint32 numBLASBuiltVertices = 0;
-		uint32 numBuiltBLAS = 0;
+		{
+			GPU_PROFILE_SCOPE("Build BLAS", &context);
+			BuildBLAS(context, view);
+		}
 
-		struct BLASInstance
+		// Cull objects that are small to the viewer - Deligiannis2019
+		auto IsSmall = [&](float radius, float distance)
 		{
-			uint64 GPUAddress;
-			uint32 WorldMatrix;
-			uint32 Flags;
+			return tanf(radius / distance) < Tweakables::g_TLASBoundsThreshold && distance > radius;
 		};
-		std::vector<BLASInstance> blasInstances;
-		blasInstances.reserve(view.Batches.size());
 
-		for (const Batch& batch : view.Batches)
+		// Nothing inside a box is closer than the box itself so whole subtrees of the BVH can be rejected.
+		// This is conservative for the batches themselves, they get the exact test when visited.
+		auto TestSize = [&](const BoundingBox& bounds, float maxRadius)
 		{
-			SubMesh* pMesh = batch.pMesh;
-			Mesh* pParentMesh = pMesh->pParent;
-
-			if (!pMesh->pBLAS && numBLASBuiltVertices < Tweakables::gMaxNumBLASVerticesPerFrame)
-			{
-				numBLASBuiltVertices += pMesh->PositionStreamLocation.Elements;
-				++numBuiltBLAS;
-
-				const Material& material = pParentMesh->GetMaterial(pMesh->MaterialId);
-				D3D12_RAYTRACING_GEOMETRY_DESC geometryDesc{};
-				geometryDesc.Type = D3D12_RAYTRACING_GEOMETRY_TYPE_TRIANGLES;
-				geometryDesc.Flags = D3D12_RAYTRACING_GEOMETRY_FLAG_NONE;
-				if (material.AlphaMode == MaterialAlphaMode::Opaque)
-				{
-					geometryDesc.Flags |= D3D12_RAYTRACING_GEOMETRY_FLAG_OPAQUE;
-				}
-				geometryDesc.Triangles.IndexBuffer = pMesh->IndicesLocation.Location;
-				geometryDesc.Triangles.IndexCount = pMesh->IndicesLocation.Elements;
-				geometryDesc.Triangles.IndexFormat = D3D::ConvertFormat(pMesh->IndicesLocation.Format);
-				geometryDesc.Triangles.Transform3x4 = 0;
-				geometryDesc.Triangles.VertexBuffer.StartAddress = pMesh->PositionStreamLocation.Location;
-				geometryDesc.Triangles.VertexBuffer.StrideInBytes = pMesh->PositionStreamLocation.Stride;
-				geometryDesc.Triangles.VertexCount = pMesh->PositionStreamLocation.Elements;
-				geometryDesc.Triangles.VertexFormat = D3D::ConvertFormat(pMesh->PositionsFormat);
-
-				D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS prebuildInfo{};
-				prebuildInfo.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL;
-				prebuildInfo.Flags =
-					D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_TRACE
-					| D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_COMPACTION;
-				prebuildInfo.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
-				prebuildInfo.NumDescs = 1;
-				prebuildInfo.pGeometryDescs = &geometryDesc;
-
-				D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO info{};
-				pDevice->GetRaytracingDevice()->GetRaytracingAccelerationStructurePrebuildInfo(&prebuildInfo, &info);
-
-				RefCountPtr<Buffer> pBLASScratch = pDevice->CreateBuffer(BufferDesc::CreateByteAddress(Math::AlignUp<uint64>(info.ScratchDataSizeInBytes, D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT), BufferFlag::UnorderedAccess | BufferFlag::NoBindless), "BLAS.ScratchBuffer");
-				RefCountPtr<Buffer> pBLAS = pDevice->CreateBuffer(BufferDesc::CreateBLAS(Math::AlignUp<uint64>(info.ResultDataMaxSizeInBytes, D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT)), "BLAS.Buffer");
-
-				D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC asDesc{};
-				asDesc.Inputs = prebuildInfo;
-				asDesc.DestAccelerationStructureData = pBLAS->GetGpuHandle();
-				asDesc.ScratchAccelerationStructureData = pBLASScratch->GetGpuHandle();
-				asDesc.SourceAccelerationStructureData = 0;
-
-				pCmd->BuildRaytracingAccelerationStructure(&asDesc, 0, nullptr);
-
-				pMesh->pBLAS = pBLAS;
-				m_QueuedRequests.push_back(&pMesh->pBLAS);
-			}
+			Vector3 offset = Vector3(bounds.Center) - view.View.Position;
+			Vector3 outside(
+				Math::Max(0.0f, fabsf(offset.x) - bounds.Extents.x),
+				Math::Max(0.0f, fabsf(offset.y) - bounds.Extents.y),
+				Math::Max(0.0f, fabsf(offset.z) - bounds.Extents.z));
+			return IsSmall(maxRadius, outside.Length()) ? DirectX::DISJOINT : DirectX::INTERSECTS;
+		};
 
-			if (pMesh->pBLAS)
+		m_TLASInstances.clear();
+		view.BVH.Query(TestSize, [&](uint32 batchIndex)
 			{
-				//if (m_RenderPath != RenderPath::PathTracing)
-				{
-					// Cull object that are small to the viewer - Deligiannis2019
-					Vector3 cameraVec = (batch.Bounds.Center - view.View.Position);
-					float angle = tanf(batch.Radius / cameraVec.Length());
-					if (angle < Tweakables::g_TLASBoundsThreshold && cameraVec.Length() > batch.Radius)
-					{
-						continue;
-					}
-				}
-
-				BLASInstance& blasInstance = blasInstances.emplace_back();
-				blasInstance.GPUAddress = pMesh->pBLAS->GetGpuHandle();
-				blasInstance.Flags = D3D12_RAYTRACING_INSTANCE_FLAG_NONE;
-				blasInstance.WorldMatrix = batch.InstanceID;
+				const Batch& batch = view.Batches[batchIndex];
+				if (!batch.pMesh->pBLAS || IsSmall(batch.Radius, Vector3::Distance(batch.Bounds.Center, view.View.Position)))
+					return;
+
+				TLASUpdatePolicy::Instance& instance = m_TLASInstances.emplace_back();
+				instance.BLASAddress = batch.pMesh->pBLAS->GetGpuHandle();
+				// The BLAS can be shared by instances with a different material
+				instance.Flags = batch.pMaterial->AlphaMode == MaterialAlphaMode::Opaque ? D3D12_RAYTRACING_INSTANCE_FLAG_FORCE_OPAQUE : D3D12_RAYTRACING_INSTANCE_FLAG_FORCE_NON_OPAQUE;
+				instance.InstanceID = batch.InstanceID;
 				if (batch.WorldMatrix.Determinant() < 0)
 				{
-					blasInstance.Flags |= D3D12_RAYTRACING_INSTANCE_FLAG_TRIANGLE_FRONT_COUNTERCLOCKWISE;
+					instance.Flags |= D3D12_RAYTRACING_INSTANCE_FLAG_TRIANGLE_FRONT_COUNTERCLOCKWISE;
 				}
-			}
+				instance.WorldMatrix = batch.WorldMatrix;
+				instance.Bounds = batch.Bounds;
+			});
+
+		{
+			GPU_PROFILE_SCOPE("BLAS Compaction", &context);
+			ProcessCompaction(context);
 		}
 
-		if (numBuiltBLAS > 0)
+		if (m_BLASReport.NumBLAS > 0 && m_BLASRequests.empty() && m_QueuedRequests.empty() && m_ActiveRequests.empty())
 		{
-			//E_LOG(Info, "Built %d BLAS instances. %d vertices", numBuiltBLAS, numBLASBuiltVertices);
+			const BLASPool::Stats& poolStats = m_pBLASPool->GetStats();
+			E_LOG(Info, "Built %d BLAS (%d vertices) over %d frames. Worst frame: %d BLAS, %d vertices, %.2f ms CPU",
+				m_BLASReport.NumBLAS, m_BLASReport.NumVertices, m_BLASReport.NumFrames, m_BLASReport.MaxFrameBLAS, m_BLASReport.MaxFrameVertices, m_BLASReport.MaxFrameTime);
+			E_LOG(Info, "\tBLAS memory: %s in %d BLAS, %s reserved in %d pages. Scratch: %s",
+				Math::PrettyPrintDataSize(poolStats.UsedBytes).c_str(), poolStats.NumAllocations,
+				Math::PrettyPrintDataSize(poolStats.ReservedBytes).c_str(), poolStats.NumPages,
+				Math::PrettyPrintDataSize(m_pBLASScratch->GetSize()).c_str());
+			m_BLASReport = {};
 		}
 
+		if (!m_pTLAS)
 		{
-			GPU_PROFILE_SCOPE("BLAS Compaction", &context);
-			ProcessCompaction(context);
+			m_TLASPolicy.Invalidate();
 		}
+		const TLASUpdatePolicy::UpdateMode updateMode = m_TLASPolicy.Update(m_TLASInstances, Tweakables::gTLASMaxDrift, Tweakables::gTLASMaxRefits, m_DirtyTLASSlots);
+		if (updateMode == TLASUpdatePolicy::UpdateMode::None)
+			return;
 
-		if(!blasInstances.empty() || !m_pTLAS)
+		const uint32 numInstances = (uint32)m_TLASInstances.size();
 		{
 			GPU_PROFILE_SCOPE("TLAS Data Generation", &context);
 
-			D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS prebuildInfo{};
-			prebuildInfo.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL;
-			prebuildInfo.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
-			prebuildInfo.Flags = buildFlags;
-			prebuildInfo.NumDescs = (uint32)blasInstances.size();
+			if (updateMode == TLASUpdatePolicy::UpdateMode::Rebuild)
+			{
+				D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS prebuildInfo{};
+				prebuildInfo.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL;
+				prebuildInfo.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
+				prebuildInfo.Flags = buildFlags;
+				prebuildInfo.NumDescs = numInstances;
 
-			D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO info{};
-			pDevice->GetRaytracingDevice()->GetRaytracingAccelerationStructurePrebuildInfo(&prebuildInfo, &info);
+				D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO info{};
+				pDevice->GetRaytracingDevice()->GetRaytracingAccelerationStructurePrebuildInfo(&prebuildInfo, &info);
 
-			if (!m_pTLAS || m_pTLAS->GetSize() < info.ResultDataMaxSizeInBytes)
-			{
-				m_pScratch = pDevice->CreateBuffer(BufferDesc::CreateByteAddress(Math::AlignUp<uint64>(info.ScratchDataSizeInBytes, D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT)), "TLAS.ScratchBuffer");
-				m_pTLAS = pDevice->CreateBuffer(BufferDesc::CreateTLAS(Math::AlignUp<uint64>(info.ResultDataMaxSizeInBytes, D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT)), "TLAS.Buffer");
-			}
+				// Refits of the same instances use the same buffers so they only need to be sized on rebuilds
+				const uint64 scratchSize = Math::Max(info.ScratchDataSizeInBytes, info.UpdateScratchDataSizeInBytes);
+				if (!m_pScratch || m_pScratch->GetSize() < scratchSize)
+				{
+					m_pScratch = pDevice->CreateBuffer(BufferDesc::CreateByteAddress(Math::AlignUp<uint64>(scratchSize, D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT)), "TLAS.ScratchBuffer");
+				}
+				if (!m_pTLAS || m_pTLAS->GetSize() < info.ResultDataMaxSizeInBytes)
+				{
+					m_pTLAS = pDevice->CreateBuffer(BufferDesc::CreateTLAS(Math::AlignUp<uint64>(info.ResultDataMaxSizeInBytes, D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT)), "TLAS.Buffer");
+				}
 
-			uint32 numInstances = Math::AlignUp(Math::Max(1u, (uint32)blasInstances.size()), 128u);
-			if (!m_pBLASInstancesSourceBuffer || m_pBLASInstancesSourceBuffer->GetNumElements() < numInstances)
-			{
-				m_pBLASInstancesSourceBuffer = pDevice->CreateBuffer(BufferDesc::CreateStructured(numInstances, sizeof(D3D12_RAYTRACING_INSTANCE_DESC)), "TLAS.BLASInstanceTargetDescs");
-				m_pBLASInstancesTargetBuffer = pDevice->CreateBuffer(BufferDesc::CreateStructured(numInstances, sizeof(D3D12_RAYTRACING_INSTANCE_DESC)), "TLAS.BLASInstanceTargetDescs");
+				const uint32 instanceCapacity = Math::AlignUp(Math::Max(1u, numInstances), 128u);
+				if (!m_pBLASInstancesTargetBuffer || m_pBLASInstancesTargetBuffer->GetNumElements() < instanceCapacity)
+				{
+					m_pBLASInstancesSourceBuffer = pDevice->CreateBuffer(BufferDesc::CreateStructured(instanceCapacity, sizeof(BLASInstance)), "TLAS.BLASInstanceSourceDescs");
+					m_pBLASInstancesTargetBuffer = pDevice->CreateBuffer(BufferDesc::CreateStructured(instanceCapacity, sizeof(D3D12_RAYTRACING_INSTANCE_DESC)), "TLAS.BLASInstanceTargetDescs");
+
+					// The descs of the previous buffer are lost
+					m_DirtyTLASSlots.resize(numInstances);
+					std::iota(m_DirtyTLASSlots.begin(), m_DirtyTLASSlots.end(), 0);
+				}
 			}
-			
-			if (!blasInstances.empty())
+
+			// Only the descs of the instances that changed are written, the others are still there from previous frames
+			if (!m_DirtyTLASSlots.empty())
 			{
+				std::vector<BLASInstance> blasInstances;
+				blasInstances.reserve(m_DirtyTLASSlots.size());
+				for (uint32 slot : m_DirtyTLASSlots)
+				{
+					const TLASUpdatePolicy::Instance& instance = m_TLASPolicy.GetInstance(slot);
+					blasInstances.push_back({ instance.BLASAddress, instance.InstanceID, instance.Flags, slot });
+				}
+
 				context.InsertResourceBarrier(m_pBLASInstancesSourceBuffer, D3D12_RESOURCE_STATE_COPY_DEST);
 				context.WriteBuffer(m_pBLASInstancesSourceBuffer, blasInstances.data(), sizeof(BLASInstance) * blasInstances.size());
 				context.InsertResourceBarrier(m_pBLASInstancesSourceBuffer, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
@@ -191,7 +337,7 @@ void AccelerationStructure::Build(CommandContext& context, const SceneView& view
 		}
 
 		{
-			GPU_PROFILE_SCOPE("Build TLAS", &context);
+			GPU_PROFILE_SCOPE(updateMode == TLASUpdatePolicy::UpdateMode::Refit ? "Refit TLAS" : "Build TLAS", &context);
 
 			D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC asDesc{};
 			asDesc.DestAccelerationStructureData = m_pTLAS->GetGpuHandle();
@@ -200,8 +346,14 @@ void AccelerationStructure::Build(CommandContext& context, const SceneView& view
 			asDesc.Inputs.Flags = buildFlags;
 			asDesc.Inputs.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
 			asDesc.Inputs.InstanceDescs = m_pBLASInstancesTargetBuffer->GetGpuHandle();
-			asDesc.Inputs.NumDescs = (uint32)blasInstances.size();
+			asDesc.Inputs.NumDescs = numInstances;
 			asDesc.SourceAccelerationStructureData = 0;
+			if (updateMode == TLASUpdatePolicy::UpdateMode::Refit)
+			{
+				// Updated in place
+				asDesc.Inputs.Flags |= D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PERFORM_UPDATE;
+				asDesc.SourceAccelerationStructureData = m_pTLAS->GetGpuHandle();
+			}
 
 			pCmd->BuildRaytracingAccelerationStructure(&asDesc, 0, nullptr);
 			context.InsertUavBarrier(m_pTLAS);
@@ -209,6 +361,147 @@ void AccelerationStructure::Build(CommandContext& context, const SceneView& view
 	}
 }
 
+void AccelerationStructure::BuildBLAS(CommandContext& context, const SceneView& view)
+{
+	using Clock = std::chrono::high_resolution_clock;
+	const Clock::time_point start = Clock::now();
+
+	GraphicsDevice* pDevice = context.GetParent();
+	if (!m_pBLASPool)
+	{
+		m_pBLASPool = new BLASPool(pDevice, Tweakables::gBLASPoolPageSize);
+	}
+
+	// Submeshes without a BLAS, visible ones first and then by how large they appear
+	m_BLASRequests.clear();
+	for (const Batch& batch : view.Batches)
+	{
+		if (batch.pMesh->pBLAS)
+			continue;
+
+		const float distance = Vector3::Distance(batch.Bounds.Center, view.View.Position);
+		float priority = batch.Radius / Math::Max(distance, batch.Radius);
+		if (batch.InstanceID < view.VisibilityMask.Size() && view.VisibilityMask.GetBit(batch.InstanceID))
+		{
+			priority += 1.0f;
+		}
+		m_BLASRequests.push_back({ batch.pMesh, priority });
+	}
+	if (m_BLASRequests.empty())
+		return;
+
+	// Instances share the BLAS of their submesh, keep the highest priority of each
+	std::sort(m_BLASRequests.begin(), m_BLASRequests.end(), [](const BLASRequest& a, const BLASRequest& b)
+		{
+			return a.pMesh != b.pMesh ? a.pMesh < b.pMesh : a.Priority > b.Priority;
+		});
+	m_BLASRequests.erase(std::unique(m_BLASRequests.begin(), m_BLASRequests.end(), [](const BLASRequest& a, const BLASRequest& b)
+		{
+			return a.pMesh == b.pMesh;
+		}), m_BLASRequests.end());
+	std::sort(m_BLASRequests.begin(), m_BLASRequests.end(), [](const BLASRequest& a, const BLASRequest& b)
+		{
+			return a.Priority > b.Priority;
+		});
+
+	struct BLASBuild
+	{
+		SubMesh* pMesh;
+		D3D12_RAYTRACING_GEOMETRY_DESC Geometry;
+		D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS Inputs;
+		RefCountPtr<BLASAllocation> pBLAS;
+		uint64 ScratchOffset;
+	};
+	std::vector<BLASBuild> builds;
+
+	// All builds of the frame get their own range of the shared scratch buffer so they can run without barriers in between
+	uint32 numVertices = 0;
+	uint64 scratchSize = 0;
+	for (const BLASRequest& request : m_BLASRequests)
+	{
+		if (numVertices >= Tweakables::gMaxNumBLASVerticesPerFrame)
+			break;
+
+		SubMesh* pMesh = request.pMesh;
+		Mesh* pParentMesh = pMesh->pParent;
+		numVertices += pMesh->PositionStreamLocation.Elements;
+
+		BLASBuild& build = builds.emplace_back();
+		build.pMesh = pMesh;
+
+		const Material& material = pParentMesh->GetMaterial(pMesh->MaterialId);
+		D3D12_RAYTRACING_GEOMETRY_DESC& geometryDesc = build.Geometry;
+		geometryDesc = {};
+		geometryDesc.Type = D3D12_RAYTRACING_GEOMETRY_TYPE_TRIANGLES;
+		geometryDesc.Flags = D3D12_RAYTRACING_GEOMETRY_FLAG_NONE;
+		if (material.AlphaMode == MaterialAlphaMode::Opaque)
+		{
+			geometryDesc.Flags |= D3D12_RAYTRACING_GEOMETRY_FLAG_OPAQUE;
+		}
+		geometryDesc.Triangles.IndexBuffer = pMesh->IndicesLocation.Location;
+		geometryDesc.Triangles.IndexCount = pMesh->IndicesLocation.Elements;
+		geometryDesc.Triangles.IndexFormat = D3D::ConvertFormat(pMesh->IndicesLocation.Format);
+		geometryDesc.Triangles.Transform3x4 = pParentMesh->GetData()->GetGpuHandle() + pMesh->PositionTransformLocation;
+		geometryDesc.Triangles.VertexBuffer.StartAddress = pMesh->PositionStreamLocation.Location;
+		geometryDesc.Triangles.VertexBuffer.StrideInBytes = pMesh->PositionStreamLocation.Stride;
+		geometryDesc.Triangles.VertexCount = pMesh->PositionStreamLocation.Elements;
+		geometryDesc.Triangles.VertexFormat = D3D::ConvertFormat(pMesh->PositionsFormat);
+
+		D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS& prebuildInfo = build.Inputs;
+		prebuildInfo = {};
+		prebuildInfo.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL;
+		prebuildInfo.Flags =
+			D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_TRACE
+			| D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_COMPACTION;
+		prebuildInfo.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
+		prebuildInfo.NumDescs = 1;
+		prebuildInfo.pGeometryDescs = &geometryDesc;
+
+		D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO info{};
+		pDevice->GetRaytracingDevice()->GetRaytracingAccelerationStructurePrebuildInfo(&prebuildInfo, &info);
+
+		build.pBLAS = m_pBLASPool->Allocate(info.ResultDataMaxSizeInBytes);
+		build.ScratchOffset = scratchSize;
+		scratchSize += Math::AlignUp<uint64>(info.ScratchDataSizeInBytes, D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT);
+	}
+
+	if (!m_pBLASScratch || m_pBLASScratch->GetSize() < scratchSize)
+	{
+		m_pBLASScratch = pDevice->CreateBuffer(BufferDesc::CreateByteAddress(Math::AlignUp<uint64>(scratchSize, Tweakables::gBLASScratchAlignment), BufferFlag::UnorderedAccess | BufferFlag::NoBindless), "BLAS.ScratchBuffer");
+	}
+
+	ID3D12GraphicsCommandList4* pCmd = context.GetRaytracingCommandList();
+	for (BLASBuild& build : builds)
+	{
+		// The geometry desc moved when 'builds' grew
+		build.Inputs.pGeometryDescs = &build.Geometry;
+
+		D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC asDesc{};
+		asDesc.Inputs = build.Inputs;
+		asDesc.DestAccelerationStructureData = build.pBLAS->GetGpuHandle();
+		asDesc.ScratchAccelerationStructureData = m_pBLASScratch->GetGpuHandle() + build.ScratchOffset;
+		asDesc.SourceAccelerationStructureData = 0;
+
+		pCmd->BuildRaytracingAccelerationStructure(&asDesc, 0, nullptr);
+
+		build.pMesh->pBLAS = build.pBLAS;
+		m_QueuedRequests.push_back(&build.pMesh->pBLAS);
+	}
+
+	// The BLASes are read by the compaction and the TLAS build, and the scratch is reused next frame
+	context.InsertUavBarrier();
+	context.FlushResourceBarriers();
+
+	const float milliseconds = std::chrono::duration<float, std::milli>(Clock::now() - start).count();
+	m_BLASReport.NumBLAS += (uint32)builds.size();
+	m_BLASReport.NumVertices += numVertices;
+	++m_BLASReport.NumFrames;
+	m_BLASReport.MaxFrameBLAS = Math::Max(m_BLASReport.MaxFrameBLAS, (uint32)builds.size());
+	m_BLASReport.MaxFrameVertices = Math::Max(m_BLASReport.MaxFrameVertices, numVertices);
+	m_BLASReport.MaxFrameTime = Math::Max(m_BLASReport.MaxFrameTime, milliseconds);
+	m_BLASRequests.erase(m_BLASRequests.begin(), m_BLASRequests.begin() + builds.size());
+}
+
 ShaderResourceView* AccelerationStructure::GetSRV() const
 {
 	if (m_pTLAS)
@@ -228,10 +521,10 @@ void AccelerationStructure::ProcessCompaction(CommandContext& context)
 		}
 
 		const uint64* pPostCompactSizes = static_cast<uint64*>(m_pPostBuildInfoReadbackBuffer->GetMappedData());
-		for (RefCountPtr<Buffer>* pSourceBLAS: m_ActiveRequests)
+		for (RefCountPtr<BLASAllocation>* pSourceBLAS: m_ActiveRequests)
 		{
 			uint64 size = *pPostCompactSizes++;
-			RefCountPtr<Buffer> pTargetBLAS = context.GetParent()->CreateBuffer(BufferDesc::CreateBLAS(size), "BLAS.Compacted");
+			RefCountPtr<BLASAllocation> pTargetBLAS = m_pBLASPool->Allocate(size);
 			context.GetRaytracingCommandList()->CopyRaytracingAccelerationStructure(pTargetBLAS->GetGpuHandle(), (*pSourceBLAS)->GetGpuHandle(), D3D12_RAYTRACING_ACCELERATION_STRUCTURE_COPY_MODE_COMPACT);
 			*pSourceBLAS = pTargetBLAS;
 		}
@@ -239,7 +532,7 @@ void AccelerationStructure::ProcessCompaction(CommandContext& context)
 		m_ActiveRequests.clear();
 	}
 
-	for (RefCountPtr<Buffer>* pSourceBLAS : m_QueuedRequests)
+	for (RefCountPtr<BLASAllocation>* pSourceBLAS : m_QueuedRequests)
 	{
 		m_ActiveRequests.push_back(pSourceBLAS);
 		if (m_ActiveRequests.size() >= Tweakables::gMaxNumCompactionsPerFrame)
@@ -261,7 +554,7 @@ void AccelerationStructure::ProcessCompaction(CommandContext& context)
 
 		std::vector<D3D12_GPU_VIRTUAL_ADDRESS> blasAddresses;
 		blasAddresses.reserve(m_ActiveRequests.size());
-		for (RefCountPtr<Buffer>* pSourceBLAS : m_ActiveRequests)
+		for (RefCountPtr<BLASAllocation>* pSourceBLAS : m_ActiveRequests)
 		{
 			blasAddresses.push_back((*pSourceBLAS)->GetGpuHandle());
 		}
@@ -1,11 +1,65 @@
 #pragma once
 #include "RHI/Fence.h"
+#include "BLASPool.h"
 class Buffer;
 class CommandContext;
 class ShaderResourceView;
 struct SceneView;
 struct SubMesh;
 
+/*
+	Decides how the TLAS is updated by comparing the instances of the frame with the previous ones.
+	When only transforms changed the TLAS is refit, which is much cheaper than a build but keeps the tree of the last build.
+	The tree degrades as instances move away from where they were when it was built,
+	so the TLAS is rebuilt once they moved too far in total or after a number of refits.
+	Only the instance descs of the slots that changed need to be rewritten.
+	Contains no GPU code so it can be simulated on the CPU.
+*/
+class TLASUpdatePolicy
+{
+public:
+	struct Instance
+	{
+		uint64 BLASAddress;
+		uint32 InstanceID;
+		uint32 Flags;
+		Matrix WorldMatrix;
+		BoundingBox Bounds;
+	};
+
+	enum class UpdateMode
+	{
+		None,
+		Refit,
+		Rebuild,
+	};
+
+	// Returns how the TLAS should be updated and the slots (indices in 'instances') of which the instance desc must be written.
+	// A refit is only possible when the instances are the same as last time, in the same order, with the same BLAS and flags.
+	// 'maxDrift' is the distance instances may move in total since the last build, in units of their radius per instance.
+	UpdateMode Update(const Span<Instance>& instances, float maxDrift, uint32 maxRefits, std::vector<uint32>& outDirtySlots);
+
+	// Makes the next update a rebuild
+	void Invalidate() { m_Instances.clear(); m_IsValid = false; }
+
+	const Instance& GetInstance(uint32 slot) const { return m_Instances[slot]; }
+	uint32 GetNumInstances() const { return (uint32)m_Instances.size(); }
+	uint32 GetNumRefits() const { return m_NumRefits; }
+	float GetDrift() const { return m_TotalDrift; }
+
+	// Runs the policy on a synthetic scene with moving instances and logs the TLAS work it results in
+	static void Simulate(uint32 numInstances, uint32 numMoving, uint32 numFrames);
+
+private:
+	std::vector<Instance> m_Instances;
+	// Bounds of the instances when the TLAS was built and how far they moved from it, relative to their radius
+	std::vector<BoundingBox> m_BuildBounds;
+	std::vector<float> m_Drift;
+	float m_TotalDrift = 0;
+	uint32 m_NumRefits = 0;
+	bool m_IsValid = false;
+};
+
 class AccelerationStructure
 {
 public:
@@ -13,6 +67,9 @@ public:
 	ShaderResourceView* GetSRV() const;
 
 private:
+	// Builds the BLAS of the submeshes which don't have one yet, within a per frame budget.
+	// Submeshes with visible instances are built first, then the ones that appear largest on screen.
+	void BuildBLAS(CommandContext& context, const SceneView& view);
 	void ProcessCompaction(CommandContext& context);
 
 	RefCountPtr<Buffer> m_pTLAS;
@@ -20,10 +77,36 @@ private:
 	RefCountPtr<Buffer> m_pBLASInstancesTargetBuffer;
 	RefCountPtr<Buffer> m_pBLASInstancesSourceBuffer;
 
+	// TLAS updating
+	TLASUpdatePolicy m_TLASPolicy;
+	std::vector<TLASUpdatePolicy::Instance> m_TLASInstances;
+	std::vector<uint32> m_DirtyTLASSlots;
+
+	// BLAS building
+	struct BLASRequest
+	{
+		SubMesh* pMesh;
+		float Priority;
+	};
+	std::vector<BLASRequest> m_BLASRequests;
+	RefCountPtr<BLASPool> m_pBLASPool;
+	RefCountPtr<Buffer> m_pBLASScratch;
+
+	// Builds since the BLAS queue was last empty, logged once it is empty again
+	struct BLASReport
+	{
+		uint32 NumBLAS = 0;
+		uint32 NumVertices = 0;
+		uint32 NumFrames = 0;
+		uint32 MaxFrameBLAS = 0;
+		uint32 MaxFrameVertices = 0;
+		float MaxFrameTime = 0;		// CPU time in ms
+	} m_BLASReport;
+
 	// Compaction
 	RefCountPtr<Buffer> m_pPostBuildInfoBuffer;
 	RefCountPtr<Buffer> m_pPostBuildInfoReadbackBuffer;
 	SyncPoint m_PostBuildInfoFence;
-	std::vector<RefCountPtr<Buffer>*> m_QueuedRequests;
-	std::vector<RefCountPtr<Buffer>*> m_ActiveRequests;
+	std::vector<RefCountPtr<BLASAllocation>*> m_QueuedRequests;
+	std::vector<RefCountPtr<BLASAllocation>*> m_ActiveRequests;
 };
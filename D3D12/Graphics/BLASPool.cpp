@@ -0,0 +1,227 @@
+#include "stdafx.h"
+#include "BLASPool.h"
+#include "RHI/Graphics.h"
+#include "RHI/Buffer.h"
+#include "RHI/Fence.h"
+
+BLASAllocation::BLASAllocation(BLASPool* pPool, uint32 page, uint64 offset, uint64 size)
+	: GraphicsObject(pPool->GetParent()), m_pPool(pPool), m_Page(page), m_Offset(offset), m_Size(size)
+{
+	m_Address = GetBuffer()->GetGpuHandle() + offset;
+}
+
+BLASAllocation::~BLASAllocation()
+{
+	m_pPool->ReleaseRange(m_Page, m_Offset, m_Size);
+}
+
+Buffer* BLASAllocation::GetBuffer() const
+{
+	return m_pPool->m_Pages[m_Page].pBuffer;
+}
+
+BLASPool::BLASPool(GraphicsDevice* pParent, uint64 pageSize, Fence* pFence)
+	: GraphicsObject(pParent), m_pFence(pFence ? pFence : pParent->GetFrameFence()), m_PageSize(Math::AlignUp<uint64>(pageSize, D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT))
+{
+}
+
+RefCountPtr<BLASAllocation> BLASPool::Allocate(uint64 size)
+{
+	std::scoped_lock<std::mutex> lock(m_Lock);
+	ProcessPendingReleases();
+
+	size = Math::AlignUp<uint64>(size, D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT);
+	++m_Stats.NumAllocations;
+	m_Stats.UsedBytes += size;
+
+	if (size <= m_PageSize)
+	{
+		for (uint32 pageIndex = 0; pageIndex < (uint32)m_Pages.size(); ++pageIndex)
+		{
+			Page& page = m_Pages[pageIndex];
+			for (auto it = page.FreeRanges.begin(); it != page.FreeRanges.end(); ++it)
+			{
+				if (it->Size >= size)
+				{
+					uint64 offset = it->Offset;
+					it->Offset += size;
+					it->Size -= size;
+					if (it->Size == 0)
+						page.FreeRanges.erase(it);
+					return new BLASAllocation(this, pageIndex, offset, size);
+				}
+			}
+		}
+	}
+
+	uint32 pageIndex;
+	if (!m_FreePageSlots.empty())
+	{
+		pageIndex = m_FreePageSlots.back();
+		m_FreePageSlots.pop_back();
+	}
+	else
+	{
+		pageIndex = (uint32)m_Pages.size();
+		m_Pages.emplace_back();
+	}
+
+	const uint64 pageSize = Math::Max(m_PageSize, size);
+	Page& page = m_Pages[pageIndex];
+	page.pBuffer = GetParent()->CreateBuffer(BufferDesc::CreateBLAS(pageSize), "BLAS.Pool");
+	page.FreeRanges.clear();
+	if (pageSize > size)
+	{
+		page.FreeRanges.push_back({ size, pageSize - size });
+	}
+	++m_Stats.NumPages;
+	m_Stats.ReservedBytes += pageSize;
+
+	return new BLASAllocation(this, pageIndex, 0, size);
+}
+
+void BLASPool::ReleaseRange(uint32 page, uint64 offset, uint64 size)
+{
+	std::scoped_lock<std::mutex> lock(m_Lock);
+	--m_Stats.NumAllocations;
+	m_Stats.UsedBytes -= size;
+	m_PendingReleases.push_back({ page, { offset, size }, m_pFence->GetCurrentValue() });
+}
+
+void BLASPool::ProcessPendingReleases()
+{
+	for (uint32 i = 0; i < (uint32)m_PendingReleases.size();)
+	{
+		const PendingRelease& release = m_PendingReleases[i];
+		if (m_pFence->IsComplete(release.FenceValue))
+		{
+			FreeRange(release.Page, release.Released);
+			std::swap(m_PendingReleases[i], m_PendingReleases.back());
+			m_PendingReleases.pop_back();
+		}
+		else
+		{
+			++i;
+		}
+	}
+}
+
+void BLASPool::FreeRange(uint32 pageIndex, const Range& range)
+{
+	Page& page = m_Pages[pageIndex];
+	std::vector<Range>& ranges = page.FreeRanges;
+	auto it = std::lower_bound(ranges.begin(), ranges.end(), range.Offset, [](const Range& r, uint64 offset) { return r.Offset < offset; });
+	it = ranges.insert(it, range);
+
+	// Merge with the next and previous range
+	if (it + 1 != ranges.end() && it->Offset + it->Size == (it + 1)->Offset)
+	{
+		it->Size += (it + 1)->Size;
+		ranges.erase(it + 1);
+	}
+	if (it != ranges.begin() && (it - 1)->Offset + (it - 1)->Size == it->Offset)
+	{
+		(it - 1)->Size += it->Size;
+		it = ranges.erase(it) - 1;
+	}
+
+	// Pages bigger than the page size only exist for a single BLAS
+	const uint64 pageSize = page.pBuffer->GetSize();
+	if (pageSize > m_PageSize && it->Offset == 0 && it->Size == pageSize)
+	{
+		--m_Stats.NumPages;
+		m_Stats.ReservedBytes -= pageSize;
+		page.pBuffer = nullptr;
+		page.FreeRanges.clear();
+		m_FreePageSlots.push_back(pageIndex);
+	}
+}
+
+bool BLASPool::Validate(GraphicsDevice* pDevice, uint32 numFrames)
+{
+	// Small pages so pages fill up, with the occasional BLAS that needs a page of its own
+	constexpr uint64 pageSize = 1 << 20;
+	constexpr uint32 numAllocationsPerFrame = 5;
+
+	// The fence is only signaled from the CPU to end the simulated frames, the buffers are never used by the GPU
+	RefCountPtr<Fence> pFence = new Fence(pDevice, "BLASPool Validation");
+	RefCountPtr<BLASPool> pPool = new BLASPool(pDevice, pageSize, pFence);
+
+	bool isValid = true;
+	auto Check = [&](bool condition, uint32 frame, const char* pError)
+	{
+		if (!condition && isValid)
+		{
+			E_LOG(Error, "BLASPool: %s (frame %d)", pError, frame);
+			isValid = false;
+		}
+	};
+
+	struct LiveRange
+	{
+		D3D12_GPU_VIRTUAL_ADDRESS Address;
+		uint64 Size;
+	};
+	std::vector<RefCountPtr<BLASAllocation>> allocations;
+	std::vector<LiveRange> liveRanges;
+
+	for (uint32 frame = 0; frame < numFrames && isValid; ++frame)
+	{
+		for (uint32 i = 0; i < numAllocationsPerFrame; ++i)
+		{
+			const bool oversized = Math::RandomRange(0, 49) == 0;
+			const uint64 size = oversized ? 2 * pageSize + Math::RandomRange(1, 100'000) : Math::RandomRange(1, 200'000);
+			allocations.push_back(pPool->Allocate(size));
+			Check(allocations.back()->GetSize() >= size, frame, "Allocation is smaller than requested");
+		}
+
+		// Fill the pool over the first third of the frames, keep it steady over the second and drain it over the last
+		uint32 numReleases = numAllocationsPerFrame;
+		if (frame < numFrames / 3)
+			numReleases -= 2;
+		else if (frame >= numFrames * 2 / 3)
+			numReleases *= 2;
+		for (uint32 i = 0; i < numReleases && !allocations.empty(); ++i)
+		{
+			std::swap(allocations[Math::RandomRange(0, (int)allocations.size() - 1)], allocations.back());
+			allocations.pop_back();
+		}
+
+		// Pages are separate buffers, so overlapping addresses mean overlapping ranges
+		liveRanges.clear();
+		uint64 usedBytes = 0;
+		for (const RefCountPtr<BLASAllocation>& pAllocation : allocations)
+		{
+			liveRanges.push_back({ pAllocation->GetGpuHandle(), pAllocation->GetSize() });
+			usedBytes += pAllocation->GetSize();
+			Check(pAllocation->GetGpuHandle() % D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT == 0, frame, "Allocation is not aligned");
+		}
+		std::sort(liveRanges.begin(), liveRanges.end(), [](const LiveRange& a, const LiveRange& b) { return a.Address < b.Address; });
+		for (uint32 i = 1; i < (uint32)liveRanges.size(); ++i)
+		{
+			Check(liveRanges[i - 1].Address + liveRanges[i - 1].Size <= liveRanges[i].Address, frame, "Allocations overlap");
+		}
+
+		const Stats& stats = pPool->GetStats();
+		Check(stats.NumAllocations == (uint32)allocations.size(), frame, "Number of allocations doesn't match the stats");
+		Check(stats.UsedBytes == usedBytes, frame, "Used bytes don't match the stats");
+		Check(stats.UsedBytes <= stats.ReservedBytes, frame, "More bytes used than reserved");
+
+		pFence->Signal(pFence->GetCurrentValue());
+	}
+
+	// Once everything is released, an allocation processes the releases and all oversized pages are gone
+	allocations.clear();
+	pFence->Signal(pFence->GetCurrentValue());
+	RefCountPtr<BLASAllocation> pLast = pPool->Allocate(1);
+	const Stats& stats = pPool->GetStats();
+	Check(stats.NumAllocations == 1, numFrames, "Allocations left after releasing all");
+	Check(stats.ReservedBytes == stats.NumPages * pageSize, numFrames, "Oversized pages left after releasing all");
+	E_LOG(Info, "BLASPool: %d frames, %d pages (%s) left after releasing all", numFrames, stats.NumPages, Math::PrettyPrintDataSize(stats.ReservedBytes).c_str());
+
+	if (isValid)
+	{
+		E_LOG(Info, "BLASPool: All allocations valid");
+	}
+	return isValid;
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include "RHI/GraphicsResource.h"
+
+class Buffer;
+class Fence;
+class BLASPool;
+
+// Range of a pool page holding a single BLAS.
+// The range goes back to the pool when the last reference is released, once the GPU is done with it.
+class BLASAllocation : public GraphicsObject
+{
+public:
+	BLASAllocation(BLASPool* pPool, uint32 page, uint64 offset, uint64 size);
+	~BLASAllocation();
+
+	D3D12_GPU_VIRTUAL_ADDRESS GetGpuHandle() const { return m_Address; }
+	uint64 GetSize() const { return m_Size; }
+	Buffer* GetBuffer() const;
+
+private:
+	RefCountPtr<BLASPool> m_pPool;
+	uint32 m_Page;
+	uint64 m_Offset;
+	uint64 m_Size;
+	D3D12_GPU_VIRTUAL_ADDRESS m_Address;
+};
+
+/*
+	Packs BLASes into a few large buffers instead of creating a committed resource for each.
+	Pages are sub-allocated first fit. Ranges larger than a page get a page of their own which is freed when empty.
+*/
+class BLASPool : public GraphicsObject
+{
+public:
+	struct Stats
+	{
+		uint32 NumPages = 0;
+		uint32 NumAllocations = 0;
+		uint64 ReservedBytes = 0;
+		uint64 UsedBytes = 0;
+	};
+
+	// Released ranges are reused once 'pFence' passes the value it was at when they were released. Uses the frame fence when null.
+	BLASPool(GraphicsDevice* pParent, uint64 pageSize, Fence* pFence = nullptr);
+
+	RefCountPtr<BLASAllocation> Allocate(uint64 size);
+	const Stats& GetStats() const { return m_Stats; }
+
+	// Runs random allocations and releases over a number of simulated frames on a pool with its own fence.
+	// Checks that live allocations never overlap, are aligned, match the stats and that oversized pages are freed.
+	static bool Validate(GraphicsDevice* pDevice, uint32 numFrames);
+
+private:
+	friend class BLASAllocation;
+
+	struct Range
+	{
+		uint64 Offset;
+		uint64 Size;
+	};
+
+	struct Page
+	{
+		RefCountPtr<Buffer> pBuffer;
+		// Sorted by offset, adjacent ranges are merged
+		std::vector<Range> FreeRanges;
+	};
+
+	struct PendingRelease
+	{
+		uint32 Page;
+		Range Released;
+		uint64 FenceValue;
+	};
+
+	// Ranges released by an allocation are only reused when the frame that last used them is done on the GPU
+	void ReleaseRange(uint32 page, uint64 offset, uint64 size);
+	void ProcessPendingReleases();
+	void FreeRange(uint32 page, const Range& range);
+
+	std::mutex m_Lock;
+	Fence* m_pFence;
+	uint64 m_PageSize;
+	std::vector<Page> m_Pages;
+	std::vector<uint32> m_FreePageSlots;
+	std::vector<PendingRelease> m_PendingReleases;
+	Stats m_Stats;
+};
@@ -0,0 +1,274 @@
+#include "stdafx.h"
+#include "ClusterLOD.h"
+#include "SceneView.h"
+
+#include "meshoptimizer.h"
+
+namespace ClusterLOD
+{
+	static void MergeSphere(Vector3& center, float& radius, const Vector3& otherCenter, float otherRadius)
+	{
+		Vector3 delta = otherCenter - center;
+		float distance = delta.Length();
+		if (distance + otherRadius <= radius)
+			return;
+		if (distance + radius <= otherRadius)
+		{
+			center = otherCenter;
+			radius = otherRadius;
+			return;
+		}
+		float newRadius = (distance + radius + otherRadius) * 0.5f;
+		center += delta * ((newRadius - radius) / distance);
+		radius = newRadius;
+	}
+
+	static float GetMaxScale(const Matrix& m)
+	{
+		return sqrtf(Math::Max(Vector3(m._11, m._12, m._13).LengthSquared(), Math::Max(Vector3(m._21, m._22, m._23).LengthSquared(), Vector3(m._31, m._32, m._33).LengthSquared())));
+	}
+
+	// Greedily groups clusters with the neighbours they share the most vertices with
+	static std::vector<std::vector<uint32>> GroupClusters(const std::vector<Cluster>& clusters, const std::vector<uint32>& levelClusters, const std::vector<uint32>& positionRemap, uint32 groupSize)
+	{
+		const uint32 numClusters = (uint32)levelClusters.size();
+
+		std::unordered_map<uint32, std::vector<uint32>> vertexToClusters;
+		for (uint32 i = 0; i < numClusters; ++i)
+		{
+			for (uint32 index : clusters[levelClusters[i]].Indices)
+			{
+				std::vector<uint32>& vertexClusters = vertexToClusters[positionRemap[index]];
+				if (vertexClusters.empty() || vertexClusters.back() != i)
+					vertexClusters.push_back(i);
+			}
+		}
+
+		std::vector<std::unordered_map<uint32, uint32>> adjacency(numClusters);
+		for (const auto& vertexClusters : vertexToClusters)
+		{
+			for (uint32 a : vertexClusters.second)
+			{
+				for (uint32 b : vertexClusters.second)
+				{
+					if (a != b)
+						++adjacency[a][b];
+				}
+			}
+		}
+
+		std::vector<std::vector<uint32>> groups;
+		std::vector<bool> grouped(numClusters);
+		for (uint32 seed = 0; seed < numClusters; ++seed)
+		{
+			if (grouped[seed])
+				continue;
+
+			std::vector<uint32> group = { seed };
+			grouped[seed] = true;
+			while (group.size() < groupSize)
+			{
+				uint32 best = ~0u;
+				uint32 bestShared = 0;
+				for (uint32 member : group)
+				{
+					for (const auto& neighbour : adjacency[member])
+					{
+						if (!grouped[neighbour.first] && neighbour.second > bestShared)
+						{
+							best = neighbour.first;
+							bestShared = neighbour.second;
+						}
+					}
+				}
+				if (best == ~0u)
+					break;
+				grouped[best] = true;
+				group.push_back(best);
+			}
+
+			for (uint32& member : group)
+				member = levelClusters[member];
+			groups.push_back(std::move(group));
+		}
+		return groups;
+	}
+
+	uint32 BuildHierarchy(std::vector<Cluster>& clusters, const Vector3* pPositions, uint32 numVertices, const BuildSettings& settings)
+	{
+		const size_t maxVertices = ShaderInterop::MESHLET_MAX_VERTICES;
+		const size_t maxTriangles = ShaderInterop::MESHLET_MAX_TRIANGLES;
+		const float errorScale = meshopt_simplifyScale(&pPositions[0].x, numVertices, sizeof(Vector3));
+
+		// Vertices split on attribute seams still connect clusters
+		std::vector<uint32> positionRemap(numVertices);
+		meshopt_generateVertexRemap(positionRemap.data(), nullptr, numVertices, pPositions, numVertices, sizeof(Vector3));
+
+		std::vector<uint32> levelClusters(clusters.size());
+		for (uint32 i = 0; i < (uint32)clusters.size(); ++i)
+		{
+			Cluster& cluster = clusters[i];
+			meshopt_Bounds bounds = meshopt_computeClusterBounds(cluster.Indices.data(), cluster.Indices.size(), &pPositions[0].x, numVertices, sizeof(Vector3));
+			cluster.Level = 0;
+			cluster.LODBounds.Center = Vector3(bounds.center);
+			cluster.LODBounds.Radius = bounds.radius;
+			cluster.LODBounds.Error = 0.0f;
+			cluster.LODBounds.ParentCenter = cluster.LODBounds.Center;
+			cluster.LODBounds.ParentRadius = cluster.LODBounds.Radius;
+			cluster.LODBounds.ParentError = FLT_MAX;
+			levelClusters[i] = i;
+		}
+
+		uint32 numLevels = 1;
+		std::vector<uint32> groupIndices;
+		std::vector<uint32> simplifiedIndices;
+		std::vector<meshopt_Meshlet> meshlets;
+		std::vector<uint32> meshletVertices;
+		std::vector<unsigned char> meshletTriangles;
+
+		while (levelClusters.size() > 1 && numLevels < settings.MaxLevels)
+		{
+			std::vector<uint32> nextLevelClusters;
+			for (const std::vector<uint32>& group : GroupClusters(clusters, levelClusters, positionRemap, settings.GroupSize))
+			{
+				groupIndices.clear();
+				for (uint32 clusterIndex : group)
+				{
+					const std::vector<uint32>& indices = clusters[clusterIndex].Indices;
+					groupIndices.insert(groupIndices.end(), indices.begin(), indices.end());
+				}
+
+				// Locking the group border keeps it identical to the neighbouring groups at any LOD
+				size_t targetIndexCount = (size_t)(groupIndices.size() * settings.Reduction) / 3 * 3;
+				float simplifyError = 0;
+				simplifiedIndices.resize(groupIndices.size());
+				size_t numIndices = meshopt_simplify(simplifiedIndices.data(), groupIndices.data(), groupIndices.size(), &pPositions[0].x, numVertices, sizeof(Vector3),
+					targetIndexCount, FLT_MAX, meshopt_SimplifyLockBorder, &simplifyError);
+
+				// Groups that can't be simplified further stay roots of the hierarchy
+				if (numIndices == 0 || numIndices > groupIndices.size() * 0.85f)
+					continue;
+
+				Vector3 groupCenter = clusters[group[0]].LODBounds.Center;
+				float groupRadius = clusters[group[0]].LODBounds.Radius;
+				float groupError = 0;
+				for (uint32 clusterIndex : group)
+				{
+					const ShaderInterop::Meshlet::LODBounds& childBounds = clusters[clusterIndex].LODBounds;
+					MergeSphere(groupCenter, groupRadius, childBounds.Center, childBounds.Radius);
+					groupError = Math::Max(groupError, childBounds.Error);
+				}
+				// The simplification error is relative to the children, so accumulate it to stay conservative
+				groupError += simplifyError * errorScale;
+
+				for (uint32 clusterIndex : group)
+				{
+					ShaderInterop::Meshlet::LODBounds& childBounds = clusters[clusterIndex].LODBounds;
+					childBounds.ParentCenter = groupCenter;
+					childBounds.ParentRadius = groupRadius;
+					childBounds.ParentError = groupError;
+				}
+
+				const size_t maxMeshlets = meshopt_buildMeshletsBound(numIndices, maxVertices, maxTriangles);
+				meshlets.resize(maxMeshlets);
+				meshletVertices.resize(maxMeshlets * maxVertices);
+				meshletTriangles.resize(maxMeshlets * maxTriangles * 3);
+				size_t meshletCount = meshopt_buildMeshlets(meshlets.data(), meshletVertices.data(), meshletTriangles.data(),
+					simplifiedIndices.data(), numIndices, &pPositions[0].x, numVertices, sizeof(Vector3), maxVertices, maxTriangles, 0);
+
+				for (size_t i = 0; i < meshletCount; ++i)
+				{
+					const meshopt_Meshlet& meshlet = meshlets[i];
+					nextLevelClusters.push_back((uint32)clusters.size());
+					Cluster& cluster = clusters.emplace_back();
+					cluster.Level = numLevels;
+					cluster.Indices.resize(meshlet.triangle_count * 3);
+					for (uint32 k = 0; k < meshlet.triangle_count * 3; ++k)
+					{
+						cluster.Indices[k] = meshletVertices[meshlet.vertex_offset + meshletTriangles[meshlet.triangle_offset + k]];
+					}
+					cluster.LODBounds.Center = groupCenter;
+					cluster.LODBounds.Radius = groupRadius;
+					cluster.LODBounds.Error = groupError;
+					cluster.LODBounds.ParentCenter = groupCenter;
+					cluster.LODBounds.ParentRadius = groupRadius;
+					cluster.LODBounds.ParentError = FLT_MAX;
+				}
+			}
+
+			if (nextLevelClusters.empty())
+				break;
+			levelClusters.swap(nextLevelClusters);
+			++numLevels;
+		}
+		return numLevels;
+	}
+
+	bool Validate(const std::vector<Cluster>& clusters)
+	{
+		constexpr float epsilon = 1.0e-4f;
+		for (uint32 i = 0; i < (uint32)clusters.size(); ++i)
+		{
+			const ShaderInterop::Meshlet::LODBounds& bounds = clusters[i].LODBounds;
+			if (bounds.ParentError < bounds.Error)
+			{
+				E_LOG(Warning, "Cluster %d: parent error %f is smaller than its error %f", i, bounds.ParentError, bounds.Error);
+				return false;
+			}
+			if (bounds.ParentError != FLT_MAX)
+			{
+				float distance = Vector3::Distance(bounds.Center, bounds.ParentCenter);
+				if (distance + bounds.Radius > bounds.ParentRadius * (1.0f + epsilon) + epsilon)
+				{
+					E_LOG(Warning, "Cluster %d: parent bounds don't contain its bounds", i);
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	CutParams CreateCutParams(const ViewTransform& view, float errorThreshold)
+	{
+		CutParams params;
+		params.ViewLocation = view.Position;
+		params.ProjectionScale = view.Viewport.GetHeight() * 0.5f * view.Projection._22;
+		params.NearZ = view.NearPlane;
+		params.Perspective = view.Perspective;
+		params.ErrorThreshold = errorThreshold;
+		return params;
+	}
+
+	float ProjectError(const Vector3& center, float radius, float error, const Matrix& localToWorld, float scale, const CutParams& params)
+	{
+		if (error == FLT_MAX)
+			return FLT_MAX;
+
+		float projectedError = error * scale * params.ProjectionScale;
+		if (params.Perspective)
+		{
+			Vector3 centerWS = Vector3::Transform(center, localToWorld);
+			projectedError /= Math::Max(Vector3::Distance(centerWS, params.ViewLocation) - radius * scale, params.NearZ);
+		}
+		return projectedError;
+	}
+
+	bool IsInCut(const ShaderInterop::Meshlet::LODBounds& bounds, const Matrix& localToWorld, const CutParams& params)
+	{
+		float scale = GetMaxScale(localToWorld);
+		float error = ProjectError(bounds.Center, bounds.Radius, bounds.Error, localToWorld, scale, params);
+		float parentError = ProjectError(bounds.ParentCenter, bounds.ParentRadius, bounds.ParentError, localToWorld, scale, params);
+		return error <= params.ErrorThreshold && parentError > params.ErrorThreshold;
+	}
+
+	void SelectCut(Span<ShaderInterop::Meshlet::LODBounds> bounds, const Matrix& localToWorld, const CutParams& params, std::vector<uint32>& outClusters)
+	{
+		for (uint32 i = 0; i < bounds.GetSize(); ++i)
+		{
+			if (IsInCut(bounds[i], localToWorld, params))
+			{
+				outClusters.push_back(i);
+			}
+		}
+	}
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include "ShaderInterop.h"
+
+struct ViewTransform;
+
+/*
+	Cluster hierarchy for continuous LOD.
+	Clusters are grouped with their neighbours, each group is simplified with its border locked
+	and re-clustered into half as many clusters. Repeating this gives a DAG of cluster groups where
+	the error only grows towards the root, so a cut through it can be selected per cluster
+	without cracks between neighbouring groups.
+	Contains no GPU code so the hierarchy and the cut can be verified on the CPU.
+*/
+namespace ClusterLOD
+{
+	struct Cluster
+	{
+		std::vector<uint32> Indices;	// Triangle list indexing the mesh vertices
+		ShaderInterop::Meshlet::LODBounds LODBounds;
+		uint32 Level = 0;
+	};
+
+	struct BuildSettings
+	{
+		uint32 GroupSize = 4;			// Clusters per group
+		float Reduction = 0.5f;			// Triangle ratio each group is simplified to
+		uint32 MaxLevels = 16;
+	};
+
+	// Takes the level 0 clusters in 'clusters', appends the simplified levels and fills in the LOD bounds of all.
+	// Returns the number of levels.
+	uint32 BuildHierarchy(std::vector<Cluster>& clusters, const Vector3* pPositions, uint32 numVertices, const BuildSettings& settings = BuildSettings());
+
+	// Returns false when an error or bound of the hierarchy isn't monotonic
+	bool Validate(const std::vector<Cluster>& clusters);
+
+	struct CutParams
+	{
+		Vector3 ViewLocation;
+		float ProjectionScale;		// Pixels per unit at distance 1
+		float NearZ;
+		bool Perspective;
+		float ErrorThreshold;		// In pixels
+	};
+
+	CutParams CreateCutParams(const ViewTransform& view, float errorThreshold);
+
+	// Returns the size in pixels of an object space error, seen from the closest point of the sphere
+	float ProjectError(const Vector3& center, float radius, float error, const Matrix& localToWorld, float scale, const CutParams& params);
+
+	// Must match IsInClusterCut in MeshletCull.hlsl
+	bool IsInCut(const ShaderInterop::Meshlet::LODBounds& bounds, const Matrix& localToWorld, const CutParams& params);
+
+	// Returns the indices of the clusters in the cut
+	void SelectCut(Span<ShaderInterop::Meshlet::LODBounds> bounds, const Matrix& localToWorld, const CutParams& params, std::vector<uint32>& outClusters);
+}
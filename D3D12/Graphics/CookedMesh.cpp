@@ -0,0 +1,340 @@
+#include "stdafx.h"
+#include "CookedMesh.h"
+#include "Mesh.h"
+#include "Core/TaskQueue.h"
+#include "Graphics/RHI/Buffer.h"
+
+#include "meshoptimizer.h"
+
+#include <chrono>
+#include <fstream>
+
+namespace CookedMesh
+{
+	static constexpr uint32 gMagic = 'C' | 'M' << 8 | 'S' << 16 | 'H' << 24;
+	// Bump when the layout or the contents of the geometry buffer or of this file change
+	static constexpr uint32 gVersion = 3;
+
+	struct FileHeader
+	{
+		uint32 Magic;
+		uint32 Version;
+		uint64 GeometrySize;
+		uint64 EncodedSize;
+		uint32 NumStreams;
+		uint32 NumSubMeshes;
+		uint32 NumLODs;
+		uint32 Padding;
+	};
+
+	struct StreamHeader
+	{
+		uint64 Offset;			// Offset in the geometry buffer
+		uint64 DataOffset;		// Offset of the encoded data in the file
+		uint64 DataSize;
+		uint32 Count;
+		uint32 Stride;
+		StreamCodec Codec;
+		uint32 Padding;
+	};
+
+	// Buffer view offsets are ~0u for streams the submesh doesn't have
+	struct SubMeshHeader
+	{
+		int32 MaterialId;
+		uint32 PositionsFormat;
+		uint32 PositionsOffset;
+		uint32 NumPositions;
+		uint32 PositionsStride;
+		uint32 UVsOffset;
+		uint32 NumUVs;
+		uint32 UVsStride;
+		uint32 NormalsOffset;
+		uint32 NumNormals;
+		uint32 NormalsStride;
+		uint32 ColorsOffset;
+		uint32 NumColors;
+		uint32 ColorsStride;
+		uint32 IndexFormat;
+		uint32 MeshletsLocation;
+		uint32 MeshletVerticesLocation;
+		uint32 MeshletTrianglesLocation;
+		uint32 MeshletBoundsLocation;
+		uint32 ClusterLODBoundsLocation;
+		uint32 PositionTransformLocation;
+		uint32 NumMeshlets;
+		uint32 NumClusters;
+		uint32 NumMeshletBounds;
+		uint32 FirstLOD;
+		uint32 NumLODs;
+		Vector3 BoundsCenter;
+		Vector3 BoundsExtents;
+		Vector2 UVOffset;
+		Vector2 UVScale;
+	};
+
+	struct LODHeader
+	{
+		uint32 IndicesOffset;
+		uint32 NumIndices;
+		uint32 MeshletStart;
+		uint32 NumMeshlets;
+		float Error;
+	};
+
+	bool Save(const char* pFilePath, const void* pGeometryData, uint64 geometrySize, Span<Stream> streams, Span<SubMesh> subMeshes)
+	{
+		// Encode all streams in parallel
+		std::vector<std::vector<unsigned char>> encodedStreams(streams.GetSize());
+		std::atomic<bool> success = true;
+		TaskContext context;
+		TaskQueue::ExecuteMany([&](TaskDistributeArgs args)
+			{
+				const Stream& stream = streams[args.JobIndex];
+				const unsigned char* pSource = static_cast<const unsigned char*>(pGeometryData) + stream.Offset;
+				std::vector<unsigned char>& encoded = encodedStreams[args.JobIndex];
+				size_t encodedSize = 0;
+				if (stream.Codec == StreamCodec::Index)
+				{
+					const size_t maxVertices = stream.Stride == sizeof(uint16) ? std::numeric_limits<uint16>::max() : std::numeric_limits<uint32>::max();
+					encoded.resize(meshopt_encodeIndexBufferBound(stream.Count, maxVertices));
+					if (stream.Stride == sizeof(uint16))
+						encodedSize = meshopt_encodeIndexBuffer(encoded.data(), encoded.size(), reinterpret_cast<const uint16*>(pSource), stream.Count);
+					else
+						encodedSize = meshopt_encodeIndexBuffer(encoded.data(), encoded.size(), reinterpret_cast<const uint32*>(pSource), stream.Count);
+				}
+				else
+				{
+					encoded.resize(meshopt_encodeVertexBufferBound(stream.Count, stream.Stride));
+					encodedSize = meshopt_encodeVertexBuffer(encoded.data(), encoded.size(), pSource, stream.Count, stream.Stride);
+				}
+				if (encodedSize == 0 && stream.Count > 0)
+					success = false;
+				encoded.resize(encodedSize);
+			}, context, streams.GetSize(), 1);
+		TaskQueue::Join(context);
+
+		if (!success)
+		{
+			E_LOG(Warning, "Failed to encode cooked mesh '%s'", pFilePath);
+			return false;
+		}
+
+		std::vector<SubMeshHeader> subMeshHeaders;
+		std::vector<LODHeader> lodHeaders;
+		for (const SubMesh& subMesh : subMeshes)
+		{
+			SubMeshHeader& header = subMeshHeaders.emplace_back();
+			header.MaterialId = subMesh.MaterialId;
+			header.PositionsFormat = (uint32)subMesh.PositionsFormat;
+			header.PositionsOffset = subMesh.PositionStreamLocation.OffsetFromStart;
+			header.NumPositions = subMesh.PositionStreamLocation.Elements;
+			header.PositionsStride = subMesh.PositionStreamLocation.Stride;
+			header.UVsOffset = subMesh.UVStreamLocation.OffsetFromStart;
+			header.NumUVs = subMesh.UVStreamLocation.Elements;
+			header.UVsStride = subMesh.UVStreamLocation.Stride;
+			header.NormalsOffset = subMesh.NormalStreamLocation.OffsetFromStart;
+			header.NumNormals = subMesh.NormalStreamLocation.Elements;
+			header.NormalsStride = subMesh.NormalStreamLocation.Stride;
+			header.ColorsOffset = subMesh.ColorsStreamLocation.OffsetFromStart;
+			header.NumColors = subMesh.ColorsStreamLocation.Elements;
+			header.ColorsStride = subMesh.ColorsStreamLocation.Stride;
+			header.IndexFormat = (uint32)subMesh.IndicesLocation.Format;
+			header.MeshletsLocation = subMesh.MeshletsLocation;
+			header.MeshletVerticesLocation = subMesh.MeshletVerticesLocation;
+			header.MeshletTrianglesLocation = subMesh.MeshletTrianglesLocation;
+			header.MeshletBoundsLocation = subMesh.MeshletBoundsLocation;
+			header.ClusterLODBoundsLocation = subMesh.ClusterLODBoundsLocation;
+			header.PositionTransformLocation = subMesh.PositionTransformLocation;
+			header.NumMeshlets = subMesh.NumMeshlets;
+			header.NumClusters = subMesh.NumClusters;
+			header.NumMeshletBounds = (uint32)subMesh.MeshletBounds.size();
+			header.FirstLOD = (uint32)lodHeaders.size();
+			header.NumLODs = (uint32)subMesh.LODs.size();
+			header.BoundsCenter = subMesh.Bounds.Center;
+			header.BoundsExtents = subMesh.Bounds.Extents;
+			header.UVOffset = subMesh.UVOffset;
+			header.UVScale = subMesh.UVScale;
+
+			for (const SubMeshLOD& lod : subMesh.LODs)
+			{
+				LODHeader& lodHeader = lodHeaders.emplace_back();
+				lodHeader.IndicesOffset = lod.IndicesLocation.OffsetFromStart;
+				lodHeader.NumIndices = lod.IndicesLocation.Elements;
+				lodHeader.MeshletStart = lod.MeshletStart;
+				lodHeader.NumMeshlets = lod.NumMeshlets;
+				lodHeader.Error = lod.Error;
+			}
+		}
+
+		FileHeader header{};
+		header.Magic = gMagic;
+		header.Version = gVersion;
+		header.GeometrySize = geometrySize;
+		header.NumStreams = streams.GetSize();
+		header.NumSubMeshes = (uint32)subMeshHeaders.size();
+		header.NumLODs = (uint32)lodHeaders.size();
+
+		std::vector<StreamHeader> streamHeaders(streams.GetSize());
+		uint64 dataOffset = sizeof(FileHeader) + streamHeaders.size() * sizeof(StreamHeader) + subMeshHeaders.size() * sizeof(SubMeshHeader) + lodHeaders.size() * sizeof(LODHeader);
+		for (uint32 i = 0; i < streams.GetSize(); ++i)
+		{
+			StreamHeader& streamHeader = streamHeaders[i];
+			streamHeader.Offset = streams[i].Offset;
+			streamHeader.DataOffset = dataOffset;
+			streamHeader.DataSize = encodedStreams[i].size();
+			streamHeader.Count = streams[i].Count;
+			streamHeader.Stride = streams[i].Stride;
+			streamHeader.Codec = streams[i].Codec;
+			dataOffset += streamHeader.DataSize;
+			header.EncodedSize += streamHeader.DataSize;
+		}
+
+		std::ofstream stream(pFilePath, std::ios::binary);
+		if (stream.fail())
+		{
+			return false;
+		}
+		stream.write((const char*)&header, sizeof(FileHeader));
+		stream.write((const char*)streamHeaders.data(), streamHeaders.size() * sizeof(StreamHeader));
+		stream.write((const char*)subMeshHeaders.data(), subMeshHeaders.size() * sizeof(SubMeshHeader));
+		stream.write((const char*)lodHeaders.data(), lodHeaders.size() * sizeof(LODHeader));
+		for (const std::vector<unsigned char>& encoded : encodedStreams)
+		{
+			stream.write((const char*)encoded.data(), encoded.size());
+		}
+		if (stream.fail())
+		{
+			return false;
+		}
+
+		E_LOG(Info, "Cooked mesh '%s': %s encoded to %s", pFilePath, Math::PrettyPrintDataSize(geometrySize).c_str(), Math::PrettyPrintDataSize(header.EncodedSize).c_str());
+		return true;
+	}
+
+	bool Reader::Open(const char* pFilePath)
+	{
+		if (!m_File.Open(pFilePath))
+		{
+			return false;
+		}
+
+		const uint8* pData = m_File.GetData();
+		const uint64 fileSize = m_File.GetSize();
+		if (fileSize < sizeof(FileHeader))
+		{
+			return false;
+		}
+
+		m_pHeader = reinterpret_cast<const FileHeader*>(pData);
+		if (m_pHeader->Magic != gMagic || m_pHeader->Version != gVersion)
+		{
+			return false;
+		}
+
+		uint64 headersSize = sizeof(FileHeader) + (uint64)m_pHeader->NumStreams * sizeof(StreamHeader) + (uint64)m_pHeader->NumSubMeshes * sizeof(SubMeshHeader) + (uint64)m_pHeader->NumLODs * sizeof(LODHeader);
+		if (fileSize < headersSize + m_pHeader->EncodedSize)
+		{
+			E_LOG(Warning, "Cooked mesh '%s' is truncated", pFilePath);
+			return false;
+		}
+
+		m_pStreams = reinterpret_cast<const StreamHeader*>(pData + sizeof(FileHeader));
+		m_pSubMeshes = reinterpret_cast<const SubMeshHeader*>(m_pStreams + m_pHeader->NumStreams);
+		m_pLODs = reinterpret_cast<const LODHeader*>(m_pSubMeshes + m_pHeader->NumSubMeshes);
+
+		for (uint32 i = 0; i < m_pHeader->NumStreams; ++i)
+		{
+			const StreamHeader& stream = m_pStreams[i];
+			if (stream.DataOffset + stream.DataSize > fileSize || stream.Offset + (uint64)stream.Count * stream.Stride > m_pHeader->GeometrySize)
+			{
+				E_LOG(Warning, "Cooked mesh '%s' has an invalid stream", pFilePath);
+				return false;
+			}
+		}
+		return true;
+	}
+
+	uint64 Reader::GetGeometrySize() const
+	{
+		return m_pHeader->GeometrySize;
+	}
+
+	bool Reader::Decode(void* pGeometryData) const
+	{
+		using Clock = std::chrono::high_resolution_clock;
+		const Clock::time_point start = Clock::now();
+
+		std::atomic<bool> success = true;
+		TaskContext context;
+		TaskQueue::ExecuteMany([&](TaskDistributeArgs args)
+			{
+				const StreamHeader& stream = m_pStreams[args.JobIndex];
+				unsigned char* pTarget = static_cast<unsigned char*>(pGeometryData) + stream.Offset;
+				const unsigned char* pSource = m_File.GetData() + stream.DataOffset;
+				int result = stream.Codec == StreamCodec::Index ?
+					meshopt_decodeIndexBuffer(pTarget, stream.Count, stream.Stride, pSource, stream.DataSize) :
+					meshopt_decodeVertexBuffer(pTarget, stream.Count, stream.Stride, pSource, stream.DataSize);
+				if (result != 0)
+					success = false;
+			}, context, m_pHeader->NumStreams, 1);
+		TaskQueue::Join(context);
+
+		const float milliseconds = std::chrono::duration<float, std::milli>(Clock::now() - start).count();
+		E_LOG(Info, "Decoded %s of geometry from %s in %.2f ms (%.0f MB/s)",
+			Math::PrettyPrintDataSize(m_pHeader->GeometrySize).c_str(),
+			Math::PrettyPrintDataSize(m_pHeader->EncodedSize).c_str(),
+			milliseconds,
+			m_pHeader->GeometrySize / (1024.0f * 1024.0f) / Math::Max(milliseconds / 1000.0f, 1.0e-6f));
+		return success;
+	}
+
+	void Reader::CreateSubMeshes(const void* pGeometryData, uint64 gpuAddress, std::vector<SubMesh>& outMeshes) const
+	{
+		const char* pData = static_cast<const char*>(pGeometryData);
+		auto CreateVertexView = [gpuAddress](uint32 offset, uint32 elements, uint32 stride)
+		{
+			return offset == ~0u ? VertexBufferView() : VertexBufferView(gpuAddress + offset, elements, stride, offset);
+		};
+
+		for (uint32 i = 0; i < m_pHeader->NumSubMeshes; ++i)
+		{
+			const SubMeshHeader& header = m_pSubMeshes[i];
+			SubMesh& subMesh = outMeshes.emplace_back();
+			subMesh.MaterialId = header.MaterialId;
+			subMesh.PositionsFormat = (ResourceFormat)header.PositionsFormat;
+			subMesh.PositionStreamLocation = CreateVertexView(header.PositionsOffset, header.NumPositions, header.PositionsStride);
+			subMesh.UVStreamLocation = CreateVertexView(header.UVsOffset, header.NumUVs, header.UVsStride);
+			subMesh.NormalStreamLocation = CreateVertexView(header.NormalsOffset, header.NumNormals, header.NormalsStride);
+			subMesh.ColorsStreamLocation = CreateVertexView(header.ColorsOffset, header.NumColors, header.ColorsStride);
+			subMesh.MeshletsLocation = header.MeshletsLocation;
+			subMesh.MeshletVerticesLocation = header.MeshletVerticesLocation;
+			subMesh.MeshletTrianglesLocation = header.MeshletTrianglesLocation;
+			subMesh.MeshletBoundsLocation = header.MeshletBoundsLocation;
+			subMesh.ClusterLODBoundsLocation = header.ClusterLODBoundsLocation;
+			subMesh.PositionTransformLocation = header.PositionTransformLocation;
+			subMesh.NumMeshlets = header.NumMeshlets;
+			subMesh.NumClusters = header.NumClusters;
+			subMesh.Bounds = BoundingBox(header.BoundsCenter, header.BoundsExtents);
+			subMesh.UVOffset = header.UVOffset;
+			subMesh.UVScale = header.UVScale;
+
+			for (uint32 lodIndex = 0; lodIndex < header.NumLODs; ++lodIndex)
+			{
+				const LODHeader& lodHeader = m_pLODs[header.FirstLOD + lodIndex];
+				SubMeshLOD& lod = subMesh.LODs.emplace_back();
+				lod.IndicesLocation = IndexBufferView(gpuAddress + lodHeader.IndicesOffset, lodHeader.NumIndices, (ResourceFormat)header.IndexFormat, lodHeader.IndicesOffset);
+				lod.MeshletStart = lodHeader.MeshletStart;
+				lod.NumMeshlets = lodHeader.NumMeshlets;
+				lod.Error = lodHeader.Error;
+			}
+			subMesh.IndicesLocation = subMesh.LODs[0].IndicesLocation;
+
+			// The CPU copies are read back from the decoded streams
+			const ShaderInterop::Meshlet::Bounds* pMeshletBounds = reinterpret_cast<const ShaderInterop::Meshlet::Bounds*>(pData + header.MeshletBoundsLocation);
+			subMesh.MeshletBounds.assign(pMeshletBounds, pMeshletBounds + header.NumMeshletBounds);
+			const ShaderInterop::Meshlet::LODBounds* pClusterLODBounds = reinterpret_cast<const ShaderInterop::Meshlet::LODBounds*>(pData + header.ClusterLODBoundsLocation);
+			subMesh.ClusterLODBounds.assign(pClusterLODBounds, pClusterLODBounds + header.NumClusters);
+		}
+	}
+}
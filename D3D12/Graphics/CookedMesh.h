@@ -0,0 +1,58 @@
+#pragma once
+#include "Core/MappedFile.h"
+
+struct SubMesh;
+
+/*
+	Cooked mesh format.
+	Stores the geometry buffer of a mesh in its final GPU layout, with every stream compressed
+	using the meshoptimizer vertex and index codecs, together with the description of its submeshes.
+	Loading decodes the streams in parallel straight into the upload memory of the geometry buffer,
+	skipping all mesh processing.
+*/
+namespace CookedMesh
+{
+	enum class StreamCodec : uint32
+	{
+		Vertex,
+		Index,
+	};
+
+	// A range of the geometry buffer
+	struct Stream
+	{
+		uint64 Offset;
+		uint32 Count;
+		uint32 Stride;
+		StreamCodec Codec;
+	};
+
+	struct FileHeader;
+	struct StreamHeader;
+	struct SubMeshHeader;
+	struct LODHeader;
+
+	// Encodes the streams of the geometry data and writes them together with the submeshes
+	bool Save(const char* pFilePath, const void* pGeometryData, uint64 geometrySize, Span<Stream> streams, Span<SubMesh> subMeshes);
+
+	class Reader
+	{
+	public:
+		bool Open(const char* pFilePath);
+
+		uint64 GetGeometrySize() const;
+
+		// Decodes all streams into the geometry data on the task queue
+		bool Decode(void* pGeometryData) const;
+
+		// Creates the submeshes from the decoded geometry data placed at 'gpuAddress'
+		void CreateSubMeshes(const void* pGeometryData, uint64 gpuAddress, std::vector<SubMesh>& outMeshes) const;
+
+	private:
+		MappedFile m_File;
+		const FileHeader* m_pHeader = nullptr;
+		const StreamHeader* m_pStreams = nullptr;
+		const SubMeshHeader* m_pSubMeshes = nullptr;
+		const LODHeader* m_pLODs = nullptr;
+	};
+}
@@ -25,6 +25,7 @@ struct Light
 	RefCountPtr<Texture> pLightTexture = nullptr;
 	int ShadowMapSize = 512;
 	bool CastShadows = false;
+	bool IsDirty = true;		// Added or changed since the previous scene upload
 
 	static Light Directional(const Vector3& position, const Vector3& direction, float intensity = 1.0f, const Color& color = Colors::White)
 	{
@@ -8,8 +8,10 @@
 #include "Core/Paths.h"
 #include "Content/Image.h"
 #include "Core/Utils.h"
+#include "Core/CommandLine.h"
 #include "ShaderInterop.h"
 #include "Graphics/SceneView.h"
+#include "Graphics/TextureStreaming.h"
 
 #pragma warning(push)
 #pragma warning(disable: 4996) //_CRT_SECURE_NO_WARNINGS
@@ -20,9 +22,91 @@
 #include "meshoptimizer.h"
 
 #include "LDraw.h"
+#include "ClusterLOD.h"
+#include "MeshletCulling.h"
+#include "CookedMesh.h"
+
+namespace Tweakables
+{
+	ConsoleVariable g_TextureLoadBudgetMB("r.TextureLoad.BudgetMB", 512);
+	ConsoleVariable g_TextureUploadPerFrameMB("r.TextureLoad.UploadPerFrameMB", 128);
+	ConsoleVariable g_MeshLODCount("r.Mesh.LODCount", 4);
+	ConsoleVariable g_MeshLODReduction("r.Mesh.LODReduction", 0.5f);
+	ConsoleVariable g_MeshClusterLOD("r.Mesh.ClusterLOD", true);
+}
+
+struct Mesh::PendingTexture
+{
+	enum class State
+	{
+		Queued,
+		Decoding,
+		Decoded,
+		Failed,
+	};
+
+	std::string Name;
+	std::string FilePath;			// Either loaded from a file
+	std::vector<uint8> Data;		// or from data embedded in the glTF
+	std::string MimeType;
+	bool sRGB = false;
+	ImageCompressionHint Compression = ImageCompressionHint::None;
+	float AlphaTestReference = 0.0f;
+	uint64 MemoryEstimate = 0;
+
+	// Material slots to patch once the texture is uploaded
+	std::vector<std::pair<uint32, Texture* Material::*>> Targets;
+
+	std::atomic<State> LoadState = State::Queued;
+	Image Result;
+	std::string CachePath;			// Cooked DDS the higher mips can be streamed from
+};
 
 Mesh::~Mesh()
 {
+	// Decode jobs reference the pending textures
+	TaskQueue::Join(m_TextureLoadContext);
+
+	if (m_pTextureStreamer)
+	{
+		for (uint32 handle : m_StreamingTextures)
+		{
+			m_pTextureStreamer->Unregister(handle);
+		}
+	}
+}
+
+// Builds the ray query BVHs from the CPU copy of the geometry buffer, so they see exactly what is rendered
+static void BuildRayQueryBVHs(const char* pGeometryData, std::vector<SubMesh>& meshes)
+{
+	TaskContext taskContext;
+	TaskQueue::ExecuteMany([&](TaskDistributeArgs args)
+		{
+			SubMesh& subMesh = meshes[args.JobIndex];
+			const VertexBufferView& positionStream = subMesh.PositionStreamLocation;
+			const IndexBufferView& indexStream = subMesh.LODs[0].IndicesLocation;
+			check(subMesh.PositionsFormat == ResourceFormat::RGBA16_SNORM);
+
+			const Vector3 center = subMesh.Bounds.Center;
+			const Vector3 extents = subMesh.Bounds.Extents;
+			std::vector<Vector3> positions(positionStream.Elements);
+			const Vector2u* pPositions = (const Vector2u*)(pGeometryData + positionStream.OffsetFromStart);
+			for (uint32 i = 0; i < positionStream.Elements; ++i)
+			{
+				Vector4 decoded = Math::Unpack_RGBA16_SNORM(pPositions[i]);
+				positions[i] = center + Vector3(decoded.x, decoded.y, decoded.z) * extents;
+			}
+
+			std::vector<uint32> indices(indexStream.Elements);
+			const char* pIndices = pGeometryData + indexStream.OffsetFromStart;
+			for (uint32 i = 0; i < indexStream.Elements; ++i)
+			{
+				indices[i] = indexStream.Format == ResourceFormat::R16_UINT ? ((const uint16*)pIndices)[i] : ((const uint32*)pIndices)[i];
+			}
+
+			subMesh.BVH.Build(positions, indices);
+		}, taskContext, (uint32)meshes.size(), 1);
+	TaskQueue::Join(taskContext);
 }
 
 bool Mesh::Load(const char* pFilePath, GraphicsDevice* pDevice, CommandContext* pContext, float uniformScale /*= 1.0f*/)
@@ -30,7 +114,6 @@ bool Mesh::Load(const char* pFilePath, GraphicsDevice* pDevice, CommandContext*
 	struct MeshData
 	{
 		uint32 MaterialIndex = 0;
-		float ScaleFactor = 1;
 
 		std::vector<Vector3> PositionsStream;
 		std::vector<Vector3> NormalsStream;
@@ -39,10 +122,21 @@ bool Mesh::Load(const char* pFilePath, GraphicsDevice* pDevice, CommandContext*
 		std::vector<Vector4> ColorsStream;
 		std::vector<uint32> Indices;
 
+		struct LOD
+		{
+			uint32 IndexStart;
+			uint32 IndexCount;
+			uint32 MeshletStart;
+			uint32 MeshletCount;
+			float Error;
+		};
+		std::vector<LOD> LODs;
+
 		std::vector<ShaderInterop::Meshlet> Meshlets;
 		std::vector<uint32> MeshletVertices;
 		std::vector<ShaderInterop::Meshlet::Triangle> MeshletTriangles;
 		std::vector<ShaderInterop::Meshlet::Bounds> MeshletBounds;
+		std::vector<ShaderInterop::Meshlet::LODBounds> ClusterLODBounds;
 	};
 
 	std::vector<MeshData> meshDatas;
@@ -60,6 +154,22 @@ bool Mesh::Load(const char* pFilePath, GraphicsDevice* pDevice, CommandContext*
 		// No studs
 		//config.ReplacementMap.push_back({ "stud.dat", nullptr });
 
+		const std::string partsCachePath = Paths::MeshCacheDir() + "LDrawParts.bin";
+		if (!CommandLine::GetBool("nomeshcache"))
+		{
+			Paths::CreateDirectoryTree(Paths::MeshCacheDir());
+			config.pCachePath = partsCachePath.c_str();
+		}
+		config.ParallelFor = [](uint32 count, const std::function<void(uint32)>& function)
+		{
+			TaskContext taskContext;
+			TaskQueue::ExecuteMany([&](TaskDistributeArgs args)
+				{
+					function(args.JobIndex);
+				}, taskContext, count, 1);
+			TaskQueue::Join(taskContext);
+		};
+
 		LdrState context;
 		if (LdrInit(&config, &context) != LdrResult::Success)
 			return false;
@@ -103,15 +213,11 @@ bool Mesh::Load(const char* pFilePath, GraphicsDevice* pDevice, CommandContext*
 			return mat;
 		};
 
-		struct MaterialPartCombination
-		{
-			LdrPart* pPart;
-			uint32 Color;
-			uint32 Index;
-		};
-
-		// Materials are part of the mesh so instances of the same mesh but different material have to be duplicated :(
-		std::vector<MaterialPartCombination> map;
+		// Geometry is shared by all instances of a part, the color is in the material of each instance.
+		// Vertex colors of multi-material parts depend on the instance color, so those are keyed on both.
+		std::map<std::pair<const LdrPart*, uint32>, uint32> partToMesh;
+		std::map<std::pair<uint32, bool>, uint32> colorToMaterial;
+		m_MeshInstances.reserve(mdl.Instances.size());
 
 		for (int i = 0; i < (int)mdl.Instances.size(); ++i)
 		{
@@ -120,14 +226,11 @@ bool Mesh::Load(const char* pFilePath, GraphicsDevice* pDevice, CommandContext*
 
 			SubMeshInstance inst;
 
-			auto it = std::find_if(map.begin(), map.end(), [&](const MaterialPartCombination& cm)
-				{
-					return cm.Color == instance.Color && cm.pPart == pPart;
-				});
-
-			if (it != map.end())
+			const std::pair<uint32, bool> materialKey(instance.Color, pPart->IsMultiMaterial);
+			auto materialIt = colorToMaterial.find(materialKey);
+			if (materialIt != colorToMaterial.end())
 			{
-				inst.MeshIndex = it->Index;
+				inst.MaterialId = materialIt->second;
 			}
 			else
 			{
@@ -135,8 +238,21 @@ bool Mesh::Load(const char* pFilePath, GraphicsDevice* pDevice, CommandContext*
 				if (pPart->IsMultiMaterial)
 					material.BaseColorFactor = Color(1, 1, 1, 1);
 
+				inst.MaterialId = (int)m_Materials.size();
+				colorToMaterial[materialKey] = inst.MaterialId;
+				m_Materials.push_back(material);
+			}
+
+			const std::pair<const LdrPart*, uint32> partKey(pPart, pPart->IsMultiMaterial ? instance.Color : 0);
+			auto partIt = partToMesh.find(partKey);
+			if (partIt != partToMesh.end())
+			{
+				inst.MeshIndex = partIt->second;
+			}
+			else
+			{
 				MeshData mesh;
-				mesh.MaterialIndex = (int)m_Materials.size();
+				mesh.MaterialIndex = inst.MaterialId;
 				mesh.Indices.resize(pPart->Indices.size());
 				for (int j = 0; j < (int)pPart->Indices.size(); ++j)
 				{
@@ -163,15 +279,9 @@ bool Mesh::Load(const char* pFilePath, GraphicsDevice* pDevice, CommandContext*
 					}
 				}
 
-				MaterialPartCombination combination;
-				combination.pPart = pPart;
-				combination.Color = instance.Color;
-				combination.Index = (int)meshDatas.size();
-				map.push_back(combination);
-				inst.MeshIndex = combination.Index;
-
+				inst.MeshIndex = (int)meshDatas.size();
+				partToMesh[partKey] = inst.MeshIndex;
 				meshDatas.push_back(mesh);
-				m_Materials.push_back(material);
 			}
 
 			inst.Transform = Matrix(&instance.Transform.m[0][0]);
@@ -196,7 +306,7 @@ bool Mesh::Load(const char* pFilePath, GraphicsDevice* pDevice, CommandContext*
 		}
 
 		// Load unique textures;
-		std::map<const cgltf_image*, Texture*> textureMap;
+		std::map<const cgltf_image*, PendingTexture*> textureMap;
 
 		auto MaterialIndex = [&](const cgltf_material* pMat) -> int
 		{
@@ -226,45 +336,45 @@ bool Mesh::Load(const char* pFilePath, GraphicsDevice* pDevice, CommandContext*
 			m_Materials.push_back(Material());
 			Material& material = m_Materials.back();
 
-			auto RetrieveTexture = [this, &textureMap, pContext, pFilePath](const cgltf_texture_view texture, bool srgb) -> Texture*
+			// Textures are decoded asynchronously, the material uses a default texture until then
+			auto RetrieveTexture = [this, &textureMap, pFilePath, materialIndex = (uint32)m_Materials.size() - 1](const cgltf_texture_view texture, Texture* Material::* pSlot, DefaultTexture placeholder, bool srgb, ImageCompressionHint compression, float alphaTestReference = 0.0f)
 			{
-				if (texture.texture)
+				if (!texture.texture)
 				{
-					const cgltf_image* pImage = texture.texture->image;
-					auto it = textureMap.find(pImage);
-					const char* pName = pImage->uri ? pImage->uri : "Material Texture";
-					RefCountPtr<Texture> pTex;
-					if (it == textureMap.end())
+					return;
+				}
+
+				const cgltf_image* pImage = texture.texture->image;
+				auto it = textureMap.find(pImage);
+				if (it == textureMap.end())
+				{
+					std::unique_ptr<PendingTexture> pPending = std::make_unique<PendingTexture>();
+					pPending->Name = pImage->uri ? pImage->uri : "Material Texture";
+					pPending->sRGB = srgb;
+					pPending->Compression = compression;
+					pPending->AlphaTestReference = alphaTestReference;
+					if (pImage->buffer_view)
 					{
-						if (pImage->buffer_view)
-						{
-							Image newImg;
-							if (newImg.Load((char*)pImage->buffer_view->buffer->data + pImage->buffer_view->offset, pImage->buffer_view->size, pImage->mime_type))
-							{
-								pTex = GraphicsCommon::CreateTextureFromImage(*pContext, newImg, srgb, pName);
-							}
-						}
-						else
-						{
-							pTex = GraphicsCommon::CreateTextureFromFile(*pContext, Paths::Combine(Paths::GetDirectoryPath(pFilePath), pImage->uri).c_str(), srgb, pName);
-						}
-						if (pTex.Get())
-						{
-							m_Textures.push_back(pTex);
-							textureMap[pImage] = m_Textures.back();
-							return m_Textures.back();
-						}
-						else
-						{
-							E_LOG(Warning, "GLTF - Failed to load texture '%s' for '%s'", pImage->uri, pFilePath);
-						}
+						// Copy the data, the glTF data is released before decoding is done
+						const uint8* pData = (uint8*)pImage->buffer_view->buffer->data + pImage->buffer_view->offset;
+						pPending->Data.assign(pData, pData + pImage->buffer_view->size);
+						pPending->MimeType = pImage->mime_type ? pImage->mime_type : "";
+						pPending->MemoryEstimate = pPending->Data.size();
 					}
 					else
 					{
-						return it->second;
+						pPending->FilePath = Paths::Combine(Paths::GetDirectoryPath(pFilePath), pImage->uri);
+						std::ifstream file(pPending->FilePath, std::ios::binary | std::ios::ate);
+						pPending->MemoryEstimate = file.is_open() ? (uint64)file.tellg() : 0;
 					}
+					// Decoded images are several times larger than their compressed source
+					pPending->MemoryEstimate *= 4;
+					it = textureMap.emplace(pImage, pPending.get()).first;
+					m_PendingTextures.push_back(std::move(pPending));
 				}
-				return nullptr;
+				it->second->Targets.emplace_back(materialIndex, pSlot);
+				m_Materials[materialIndex].*pSlot = GraphicsCommon::GetDefaultTexture(placeholder);
+				m_Materials[materialIndex].IsDirty = true;
 			};
 
 			auto GetAlphaMode = [](cgltf_alpha_mode mode) {
@@ -277,10 +387,13 @@ bool Mesh::Load(const char* pFilePath, GraphicsDevice* pDevice, CommandContext*
 				return MaterialAlphaMode::Opaque;
 			};
 
+			// Keep the alpha tested area of masked materials constant across mips
+			const float alphaTestReference = gltfMaterial.alpha_mode == cgltf_alpha_mode_mask ? gltfMaterial.alpha_cutoff : 0.0f;
+
 			if (gltfMaterial.has_pbr_metallic_roughness)
 			{
-				material.pDiffuseTexture = RetrieveTexture(gltfMaterial.pbr_metallic_roughness.base_color_texture, true);
-				material.pRoughnessMetalnessTexture = RetrieveTexture(gltfMaterial.pbr_metallic_roughness.metallic_roughness_texture, false);
+				RetrieveTexture(gltfMaterial.pbr_metallic_roughness.base_color_texture, &Material::pDiffuseTexture, DefaultTexture::White2D, true, ImageCompressionHint::Color, alphaTestReference);
+				RetrieveTexture(gltfMaterial.pbr_metallic_roughness.metallic_roughness_texture, &Material::pRoughnessMetalnessTexture, DefaultTexture::White2D, false, ImageCompressionHint::Data);
 				material.BaseColorFactor.x = gltfMaterial.pbr_metallic_roughness.base_color_factor[0];
 				material.BaseColorFactor.y = gltfMaterial.pbr_metallic_roughness.base_color_factor[1];
 				material.BaseColorFactor.z = gltfMaterial.pbr_metallic_roughness.base_color_factor[2];
@@ -290,7 +403,7 @@ bool Mesh::Load(const char* pFilePath, GraphicsDevice* pDevice, CommandContext*
 			}
 			else if (gltfMaterial.has_pbr_specular_glossiness)
 			{
-				material.pDiffuseTexture = RetrieveTexture(gltfMaterial.pbr_specular_glossiness.diffuse_texture, true);
+				RetrieveTexture(gltfMaterial.pbr_specular_glossiness.diffuse_texture, &Material::pDiffuseTexture, DefaultTexture::White2D, true, ImageCompressionHint::Color, alphaTestReference);
 				material.RoughnessFactor = 1.0f - gltfMaterial.pbr_specular_glossiness.glossiness_factor;
 				material.BaseColorFactor.x = gltfMaterial.pbr_specular_glossiness.diffuse_factor[0];
 				material.BaseColorFactor.y = gltfMaterial.pbr_specular_glossiness.diffuse_factor[1];
@@ -299,17 +412,20 @@ bool Mesh::Load(const char* pFilePath, GraphicsDevice* pDevice, CommandContext*
 			}
 			material.AlphaCutoff = gltfMaterial.alpha_cutoff;
 			material.AlphaMode = GetAlphaMode(gltfMaterial.alpha_mode);
-			material.pEmissiveTexture = RetrieveTexture(gltfMaterial.emissive_texture, true);
+			RetrieveTexture(gltfMaterial.emissive_texture, &Material::pEmissiveTexture, DefaultTexture::Black2D, true, ImageCompressionHint::Color);
 			material.EmissiveFactor.x = gltfMaterial.emissive_factor[0];
 			material.EmissiveFactor.y = gltfMaterial.emissive_factor[1];
 			material.EmissiveFactor.z = gltfMaterial.emissive_factor[2];
 			if (useEmissiveStrength)
 				material.EmissiveFactor *= gltfMaterial.emissive_strength.emissive_strength;
-			material.pNormalTexture = RetrieveTexture(gltfMaterial.normal_texture, false);
+			RetrieveTexture(gltfMaterial.normal_texture, &Material::pNormalTexture, DefaultTexture::Normal2D, false, ImageCompressionHint::Normal);
 			if (gltfMaterial.name)
 				material.Name = gltfMaterial.name;
 		}
 
+		// Decode while the geometry is processed
+		DispatchTextureLoads();
+
 		std::map<const cgltf_mesh*, std::vector<int>> meshToPrimitives;
 		int primitiveIndex = 0;
 
@@ -356,18 +472,6 @@ bool Mesh::Load(const char* pFilePath, GraphicsDevice* pDevice, CommandContext*
 					ReadAttributeData("TEXCOORD_0", meshData.UVsStream, 2);
 					ReadAttributeData("COLOR_0", meshData.ColorsStream, 4);
 				}
-
-				for (const Vector3& position : meshData.PositionsStream)
-				{
-					meshData.ScaleFactor = Math::Max(fabs(position.x), meshData.ScaleFactor);
-					meshData.ScaleFactor = Math::Max(fabs(position.y), meshData.ScaleFactor);
-					meshData.ScaleFactor = Math::Max(fabs(position.z), meshData.ScaleFactor);
-				}
-				for (Vector3& position : meshData.PositionsStream)
-				{
-					position /= meshData.ScaleFactor;
-					check(fabs(position.x) <= 1.0f && fabs(position.y) <= 1.0f && fabs(position.z) <= 1.0f);
-				}
 				meshDatas.push_back(meshData);
 			}
 			meshToPrimitives[&mesh] = primitives;
@@ -384,10 +488,10 @@ bool Mesh::Load(const char* pFilePath, GraphicsDevice* pDevice, CommandContext*
 
 				for (int primitive : meshToPrimitives[node.mesh])
 				{
-					const MeshData& meshData = meshDatas[primitive];
 					SubMeshInstance& newNode = m_MeshInstances.emplace_back();
 					newNode.MeshIndex = primitive;
-					newNode.Transform = Matrix::CreateScale(meshData.ScaleFactor) * localToWorld * Matrix::CreateScale(uniformScale, uniformScale, -uniformScale);
+					newNode.MaterialId = meshDatas[primitive].MaterialIndex;
+					newNode.Transform = localToWorld * Matrix::CreateScale(uniformScale, uniformScale, -uniformScale);
 				}
 			}
 		}
@@ -395,12 +499,59 @@ bool Mesh::Load(const char* pFilePath, GraphicsDevice* pDevice, CommandContext*
 		cgltf_free(pGltfData);
 	}
 
+	// The cooked mesh is keyed on the imported geometry and the settings used to process it
+	uint64 cookedHash = Utils::HashValue(Tweakables::g_MeshLODCount.Get());
+	cookedHash = Utils::HashValue(Tweakables::g_MeshLODReduction.Get(), cookedHash);
+	cookedHash = Utils::HashValue(Tweakables::g_MeshClusterLOD.Get(), cookedHash);
+	for (const MeshData& meshData : meshDatas)
+	{
+		cookedHash = Utils::HashValue(meshData.MaterialIndex, cookedHash);
+		cookedHash = Utils::HashBytes(meshData.PositionsStream.data(), meshData.PositionsStream.size() * sizeof(Vector3), cookedHash);
+		cookedHash = Utils::HashBytes(meshData.NormalsStream.data(), meshData.NormalsStream.size() * sizeof(Vector3), cookedHash);
+		cookedHash = Utils::HashBytes(meshData.TangentsStream.data(), meshData.TangentsStream.size() * sizeof(Vector4), cookedHash);
+		cookedHash = Utils::HashBytes(meshData.UVsStream.data(), meshData.UVsStream.size() * sizeof(Vector2), cookedHash);
+		cookedHash = Utils::HashBytes(meshData.ColorsStream.data(), meshData.ColorsStream.size() * sizeof(Vector4), cookedHash);
+		cookedHash = Utils::HashBytes(meshData.Indices.data(), meshData.Indices.size() * sizeof(uint32), cookedHash);
+	}
+	const std::string cookedPath = Sprintf("%s%016llx.mesh", Paths::MeshCacheDir().c_str(), cookedHash);
+	const bool useCookedMesh = !CommandLine::GetBool("nomeshcache");
+
+	if (useCookedMesh && Paths::FileExists(cookedPath.c_str()))
+	{
+		// Decode the cooked streams and skip all processing
+		CookedMesh::Reader reader;
+		if (reader.Open(cookedPath.c_str()))
+		{
+			const uint64 bufferSize = reader.GetGeometrySize();
+			m_pGeometryData = pDevice->CreateBuffer(BufferDesc::CreateBuffer(bufferSize, BufferFlag::ShaderResource | BufferFlag::ByteAddress), "Geometry Buffer");
+			// Decoded in CPU memory first, the ray query BVHs read it back and upload memory is write-combined
+			std::vector<char> geometryData(bufferSize);
+			if (reader.Decode(geometryData.data()))
+			{
+				reader.CreateSubMeshes(geometryData.data(), m_pGeometryData->GetGpuHandle(), m_Meshes);
+				for (SubMesh& subMesh : m_Meshes)
+				{
+					subMesh.pParent = this;
+				}
+				BuildRayQueryBVHs(geometryData.data(), m_Meshes);
+
+				DynamicAllocation allocation = pContext->AllocateTransientMemory(bufferSize);
+				memcpy(allocation.pMappedMemory, geometryData.data(), bufferSize);
+				pContext->CopyBuffer(allocation.pBackingResource, m_pGeometryData, bufferSize, allocation.Offset, 0);
+				return true;
+			}
+			E_LOG(Warning, "Failed to decode cooked mesh '%s'", cookedPath.c_str());
+			m_Meshes.clear();
+		}
+	}
+
 	constexpr uint64 bufferAlignment = 16;
 	uint64 bufferSize = 0;
 	using TVertexPositionStream = Vector2u;
-	using TVertexNormalStream = Vector2u;
+	using TVertexNormalStream = uint32;
 	using TVertexColorStream = uint32;
 	using TVertexUVStream = uint32;
+	using TPositionTransform = float[3][4];
 
 	for (MeshData& meshData : meshDatas)
 	{
@@ -418,91 +569,176 @@ bool Mesh::Load(const char* pFilePath, GraphicsDevice* pDevice, CommandContext*
 		if(!meshData.ColorsStream.empty())
 			meshopt_remapVertexBuffer(meshData.ColorsStream.data(), meshData.ColorsStream.data(), meshData.ColorsStream.size(), sizeof(Vector4), &remap[0]);
 
+		// LOD generation
+		// Each LOD simplifies the full detail mesh and shares its vertices. The error is stored in object space.
+		meshData.LODs.push_back({ 0, (uint32)meshData.Indices.size(), 0, 0, 0.0f });
+		const uint32 maxLODs = (uint32)Math::Clamp(Tweakables::g_MeshLODCount.Get(), 1, ShaderInterop::MESH_MAX_LODS);
+		const float lodReduction = Math::Clamp(Tweakables::g_MeshLODReduction.Get(), 0.05f, 0.95f);
+		const float lodScale = meshopt_simplifyScale(&meshData.PositionsStream[0].x, meshData.PositionsStream.size(), sizeof(Vector3));
+		const size_t numLOD0Indices = meshData.Indices.size();
+		std::vector<uint32> lodIndices(numLOD0Indices);
+		while (meshData.LODs.size() < maxLODs)
+		{
+			const MeshData::LOD prevLOD = meshData.LODs.back();
+			// A LOD smaller than a single meshlet doesn't save anything
+			if (prevLOD.IndexCount <= ShaderInterop::MESHLET_MAX_TRIANGLES * 3)
+				break;
+
+			size_t targetIndexCount = (size_t)(prevLOD.IndexCount * lodReduction) / 3 * 3;
+			float lodError = 0;
+			size_t numIndices = meshopt_simplify(lodIndices.data(), meshData.Indices.data(), numLOD0Indices, &meshData.PositionsStream[0].x, meshData.PositionsStream.size(), sizeof(Vector3),
+				targetIndexCount, FLT_MAX, 0, &lodError);
+
+			// Stop when the simplifier can't make meaningful progress anymore, usually due to attribute seams
+			if (numIndices == 0 || numIndices > prevLOD.IndexCount * 0.9f)
+				break;
+
+			meshopt_optimizeVertexCache(lodIndices.data(), lodIndices.data(), numIndices, meshData.PositionsStream.size());
+
+			MeshData::LOD& lod = meshData.LODs.emplace_back();
+			lod.IndexStart = (uint32)meshData.Indices.size();
+			lod.IndexCount = (uint32)numIndices;
+			lod.Error = Math::Max(prevLOD.Error, lodError * lodScale);
+			meshData.Indices.insert(meshData.Indices.end(), lodIndices.begin(), lodIndices.begin() + numIndices);
+		}
+
 		// Meshlet generation
+		// Meshlets of all LODs are stored in the same arrays so meshlet indices stay global
 		const size_t maxVertices = ShaderInterop::MESHLET_MAX_VERTICES;
 		const size_t maxTriangles = ShaderInterop::MESHLET_MAX_TRIANGLES;
-		const size_t maxMeshlets = meshopt_buildMeshletsBound(meshData.Indices.size(), maxVertices, maxTriangles);
 
-		meshData.Meshlets.resize(maxMeshlets);
-		meshData.MeshletVertices.resize(maxMeshlets * maxVertices);
+		// Returns the number of meshlets appended
+		auto BuildMeshlets = [&](const uint32* pIndices, uint32 numIndices) -> uint32
+		{
+			const size_t maxMeshlets = meshopt_buildMeshletsBound(numIndices, maxVertices, maxTriangles);
 
-		std::vector<unsigned char> meshletTriangles(maxMeshlets * maxTriangles * 3);
-		std::vector<meshopt_Meshlet> meshlets(maxMeshlets);
+			std::vector<uint32> meshletVertices(maxMeshlets * maxVertices);
+			std::vector<unsigned char> meshletTriangles(maxMeshlets * maxTriangles * 3);
+			std::vector<meshopt_Meshlet> meshlets(maxMeshlets);
 
-		size_t meshlet_count = meshopt_buildMeshlets(meshlets.data(), meshData.MeshletVertices.data(), meshletTriangles.data(),
-			meshData.Indices.data(), meshData.Indices.size(), &meshData.PositionsStream[0].x, meshData.PositionsStream.size(), sizeof(Vector3), maxVertices, maxTriangles, 0);
+			size_t meshlet_count = meshopt_buildMeshlets(meshlets.data(), meshletVertices.data(), meshletTriangles.data(),
+				pIndices, numIndices, &meshData.PositionsStream[0].x, meshData.PositionsStream.size(), sizeof(Vector3), maxVertices, maxTriangles, 0);
 
-		// Trimming
-		const meshopt_Meshlet& last = meshlets[meshlet_count - 1];
-		meshletTriangles.resize(last.triangle_offset + ((last.triangle_count * 3 + 3) & ~3));
-		meshlets.resize(meshlet_count);
+			// Trimming
+			const meshopt_Meshlet& last = meshlets[meshlet_count - 1];
+			const uint32 vertexOffset = (uint32)meshData.MeshletVertices.size();
+			meshData.MeshletVertices.insert(meshData.MeshletVertices.end(), meshletVertices.begin(), meshletVertices.begin() + last.vertex_offset + last.vertex_count);
 
-		meshData.MeshletVertices.resize(last.vertex_offset + last.vertex_count);
-		meshData.Meshlets.resize(meshlet_count);
-		meshData.MeshletBounds.resize(meshlet_count);
-		meshData.MeshletTriangles.resize(meshletTriangles.size() / 3);
+			for (size_t i = 0; i < meshlet_count; ++i)
+			{
+				const meshopt_Meshlet& meshlet = meshlets[i];
+
+				ShaderInterop::Meshlet::Bounds& outBounds = meshData.MeshletBounds.emplace_back();
+				MeshletCulling::ComputeBounds(&meshletVertices[meshlet.vertex_offset], &meshletTriangles[meshlet.triangle_offset], meshlet.triangle_count,
+					meshData.PositionsStream.data(), (uint32)meshData.PositionsStream.size(), outBounds);
+
+				ShaderInterop::Meshlet& outMeshlet = meshData.Meshlets.emplace_back();
+				outMeshlet.TriangleCount = meshlet.triangle_count;
+				outMeshlet.TriangleOffset = (uint32)meshData.MeshletTriangles.size();
+				outMeshlet.VertexCount = meshlet.vertex_count;
+				outMeshlet.VertexOffset = vertexOffset + meshlet.vertex_offset;
 
-		uint32 triangleOffset = 0;
-		for (size_t i = 0; i < meshlet_count; ++i)
+				// Encode triangles and get rid of 4 byte padding
+				unsigned char* pSourceTriangles = meshletTriangles.data() + meshlet.triangle_offset;
+				for (uint32 triIdx = 0; triIdx < meshlet.triangle_count; ++triIdx)
+				{
+					ShaderInterop::Meshlet::Triangle& tri = meshData.MeshletTriangles.emplace_back();
+					tri.V0 = *pSourceTriangles++;
+					tri.V1 = *pSourceTriangles++;
+					tri.V2 = *pSourceTriangles++;
+				}
+			}
+			return (uint32)meshlet_count;
+		};
+
+		MeshData::LOD& lod0 = meshData.LODs[0];
+		lod0.MeshletStart = 0;
+		lod0.MeshletCount = BuildMeshlets(&meshData.Indices[lod0.IndexStart], lod0.IndexCount);
+
+		// Cluster hierarchy
+		// The LOD 0 meshlets are the leaves, the simplified clusters follow them so the hierarchy is one contiguous meshlet range
+		if (Tweakables::g_MeshClusterLOD && lod0.MeshletCount > 1)
 		{
-			const meshopt_Meshlet& meshlet = meshlets[i];
+			std::vector<ClusterLOD::Cluster> clusters(lod0.MeshletCount);
+			for (uint32 i = 0; i < lod0.MeshletCount; ++i)
+			{
+				const ShaderInterop::Meshlet& meshlet = meshData.Meshlets[i];
+				std::vector<uint32>& indices = clusters[i].Indices;
+				indices.reserve(meshlet.TriangleCount * 3);
+				for (uint32 triIdx = 0; triIdx < meshlet.TriangleCount; ++triIdx)
+				{
+					const ShaderInterop::Meshlet::Triangle& tri = meshData.MeshletTriangles[meshlet.TriangleOffset + triIdx];
+					indices.push_back(meshData.MeshletVertices[meshlet.VertexOffset + tri.V0]);
+					indices.push_back(meshData.MeshletVertices[meshlet.VertexOffset + tri.V1]);
+					indices.push_back(meshData.MeshletVertices[meshlet.VertexOffset + tri.V2]);
+				}
+			}
 
-			Vector3 min = Vector3(FLT_MAX, FLT_MAX, FLT_MAX);
-			Vector3 max = Vector3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
-			for (uint32 k = 0; k < meshlet.triangle_count * 3; ++k)
+			ClusterLOD::BuildHierarchy(clusters, meshData.PositionsStream.data(), (uint32)meshData.PositionsStream.size());
+			if (!ClusterLOD::Validate(clusters))
 			{
-				uint32 idx = meshData.MeshletVertices[meshlet.vertex_offset + meshletTriangles[meshlet.triangle_offset + k]];
-				const Vector3& p = meshData.PositionsStream[idx];
-				max = Vector3::Max(max, p);
-				min = Vector3::Min(min, p);
+				E_LOG(Warning, "Cluster hierarchy of '%s' is not monotonic", pFilePath);
 			}
-			ShaderInterop::Meshlet::Bounds& outBounds = meshData.MeshletBounds[i];
-			outBounds.Center = (max + min) / 2;
-			outBounds.Extents = (max - min) / 2;
 
-			// Encode triangles and get rid of 4 byte padding
-			unsigned char* pSourceTriangles = meshletTriangles.data() + meshlet.triangle_offset;
-			for (uint32 triIdx = 0; triIdx < meshlet.triangle_count; ++triIdx)
+			for (uint32 i = 0; i < (uint32)clusters.size(); ++i)
 			{
-				ShaderInterop::Meshlet::Triangle& tri = meshData.MeshletTriangles[triIdx + triangleOffset];
-				tri.V0 = *pSourceTriangles++;
-				tri.V1 = *pSourceTriangles++;
-				tri.V2 = *pSourceTriangles++;
+				const ClusterLOD::Cluster& cluster = clusters[i];
+				uint32 numMeshlets = i < lod0.MeshletCount ? 1 : BuildMeshlets(cluster.Indices.data(), (uint32)cluster.Indices.size());
+				meshData.ClusterLODBounds.insert(meshData.ClusterLODBounds.end(), numMeshlets, cluster.LODBounds);
 			}
+			check(meshData.ClusterLODBounds.size() == meshData.Meshlets.size());
+		}
 
-			ShaderInterop::Meshlet& outMeshlet = meshData.Meshlets[i];
-			outMeshlet.TriangleCount = meshlet.triangle_count;
-			outMeshlet.TriangleOffset = triangleOffset;
-			outMeshlet.VertexCount = meshlet.vertex_count;
-			outMeshlet.VertexOffset = meshlet.vertex_offset;
-			triangleOffset += meshlet.triangle_count;
+		for (size_t lodIndex = 1; lodIndex < meshData.LODs.size(); ++lodIndex)
+		{
+			MeshData::LOD& lod = meshData.LODs[lodIndex];
+			lod.MeshletStart = (uint32)meshData.Meshlets.size();
+			lod.MeshletCount = BuildMeshlets(&meshData.Indices[lod.IndexStart], lod.IndexCount);
 		}
-		meshData.MeshletTriangles.resize(triangleOffset);
 
 		bufferSize += Math::AlignUp<uint64>(meshData.Indices.size() * sizeof(uint32), bufferAlignment);
 		bufferSize += Math::AlignUp<uint64>(meshData.PositionsStream.size() * sizeof(TVertexPositionStream), bufferAlignment);
 		bufferSize += Math::AlignUp<uint64>(meshData.UVsStream.size() * sizeof(TVertexUVStream), bufferAlignment);
 		bufferSize += Math::AlignUp<uint64>(meshData.NormalsStream.size() * sizeof(TVertexNormalStream), bufferAlignment);
 		bufferSize += Math::AlignUp<uint64>(meshData.ColorsStream.size() * sizeof(TVertexColorStream), bufferAlignment);
+		bufferSize += Math::AlignUp<uint64>(sizeof(TPositionTransform), bufferAlignment);
 
 		bufferSize += Math::AlignUp<uint64>(meshData.Meshlets.size() * sizeof(ShaderInterop::Meshlet), bufferAlignment);
 		bufferSize += Math::AlignUp<uint64>(meshData.MeshletVertices.size() * sizeof(uint32), bufferAlignment);
 		bufferSize += Math::AlignUp<uint64>(meshData.MeshletTriangles.size() * sizeof(ShaderInterop::Meshlet::Triangle), bufferAlignment);
 		bufferSize += Math::AlignUp<uint64>(meshData.MeshletBounds.size() * sizeof(ShaderInterop::Meshlet::Bounds), bufferAlignment);
+		bufferSize += Math::AlignUp<uint64>(meshData.ClusterLODBounds.size() * sizeof(ShaderInterop::Meshlet::LODBounds), bufferAlignment);
 	}
 
 	checkf(bufferSize < std::numeric_limits<uint32>::max(), "Offset stored in 32-bit int");
 	m_pGeometryData = pDevice->CreateBuffer(BufferDesc::CreateBuffer(bufferSize, BufferFlag::ShaderResource | BufferFlag::ByteAddress), "Geometry Buffer");
 	DynamicAllocation allocation = pContext->AllocateTransientMemory(bufferSize);
-	char* pMappedMemory = (char*)allocation.pMappedMemory;
+
+	// Build the geometry in CPU memory first so it can be encoded for the cooked mesh without reading back upload memory
+	std::vector<char> geometryData(bufferSize);
+	char* pGeometryData = geometryData.data();
+	std::vector<CookedMesh::Stream> cookedStreams;
 
 	uint64 dataOffset = 0;
-	auto CopyData = [&dataOffset, &allocation](const void* pSource, uint64 size)
+	auto CopyData = [&](const void* pSource, uint32 count, uint32 stride)
 	{
-		memcpy(static_cast<char*>(allocation.pMappedMemory) + dataOffset, pSource, size);
-		dataOffset = Math::AlignUp(dataOffset + size, bufferAlignment);
+		cookedStreams.push_back({ dataOffset, count, stride, CookedMesh::StreamCodec::Vertex });
+		memcpy(pGeometryData + dataOffset, pSource, (uint64)count * stride);
+		dataOffset = Math::AlignUp(dataOffset + (uint64)count * stride, bufferAlignment);
 	};
 
+	// Largest quantization error of any vertex, measured against the imported data
+	struct QuantizationError
+	{
+		float Position = 0;				// Object space
+		float PositionRelative = 0;		// Relative to the size of the bounds
+		float NormalAngle = 0;
+		float TangentAngle = 0;
+		float UV = 0;
+	} quantizationError;
+	uint64 numVertices = 0;
+	uint64 numVertexBytes = 0;
+
 	for (const MeshData& meshData : meshDatas)
 	{
 		BoundingBox bounds;
@@ -513,33 +749,76 @@ bool Mesh::Load(const char* pFilePath, GraphicsDevice* pDevice, CommandContext*
 		subMesh.MaterialId = meshData.MaterialIndex;
 		subMesh.PositionsFormat = ResourceFormat::RGBA16_SNORM;
 
+		numVertices += meshData.PositionsStream.size();
+		numVertexBytes += meshData.PositionsStream.size() * sizeof(TVertexPositionStream);
+		numVertexBytes += meshData.NormalsStream.size() * sizeof(TVertexNormalStream);
+		numVertexBytes += meshData.UVsStream.size() * sizeof(TVertexUVStream);
+		numVertexBytes += meshData.ColorsStream.size() * sizeof(TVertexColorStream);
+
+		// The tangent is stored as an angle around the decoded normal, so the normals are encoded first
+		std::vector<TVertexNormalStream> normals(meshData.NormalsStream.size());
+		std::vector<float> tangentAngles(meshData.PositionsStream.size());
+		for (size_t i = 0; i < meshData.NormalsStream.size(); ++i)
 		{
+			Vector3 normal = meshData.NormalsStream[i];
+			normal.Normalize();
+			Vector4 tangentData = meshData.TangentsStream.empty() ? Vector4(1, 0, 0, 1) : meshData.TangentsStream[i];
+			Vector3 tangent(tangentData.x, tangentData.y, tangentData.z);
+			normals[i] = Math::Pack_OCT15_SIGN(normal, tangentData.w);
+
+			float tangentSign;
+			Vector3 decodedNormal = Math::Unpack_OCT15_SIGN(normals[i], tangentSign);
+			Vector3 b1, b2;
+			Math::GetOrthonormalBasis(decodedNormal, b1, b2);
+			Vector3 projectedTangent = tangent - decodedNormal * decodedNormal.Dot(tangent);
+			tangentAngles[i] = atan2f(projectedTangent.Dot(b2), projectedTangent.Dot(b1));
+
+			float decodedAngle = Math::Decode_R16_SNORM(Math::Encode_R16_SNORM(tangentAngles[i] / Math::PI)) * Math::PI;
+			Vector3 decodedTangent = b1 * cosf(decodedAngle) + b2 * sinf(decodedAngle);
+			Vector3 orthogonalTangent = tangent - normal * normal.Dot(tangent);
+			quantizationError.NormalAngle = Math::Max(quantizationError.NormalAngle, acosf(Math::Clamp(normal.Dot(decodedNormal), -1.0f, 1.0f)));
+			if (orthogonalTangent.Length() > 1.0e-4f)
+			{
+				orthogonalTangent.Normalize();
+				quantizationError.TangentAngle = Math::Max(quantizationError.TangentAngle, acosf(Math::Clamp(orthogonalTangent.Dot(decodedTangent), -1.0f, 1.0f)));
+			}
+		}
+
+		{
+			// Positions are relative to the bounds so the full 16 bits cover the mesh
+			const Vector3 center = bounds.Center;
+			const Vector3 extents = bounds.Extents;
+			const Vector3 invExtents(extents.x > 0 ? 1.0f / extents.x : 0, extents.y > 0 ? 1.0f / extents.y : 0, extents.z > 0 ? 1.0f / extents.z : 0);
+
 			subMesh.PositionStreamLocation = VertexBufferView(m_pGeometryData->GetGpuHandle() + dataOffset, (uint32)meshData.PositionsStream.size(), sizeof(TVertexPositionStream), dataOffset);
-			TVertexPositionStream* pTarget = (TVertexPositionStream*)(pMappedMemory + dataOffset);
-			for (const Vector3& position : meshData.PositionsStream)
+			cookedStreams.push_back({ dataOffset, (uint32)meshData.PositionsStream.size(), sizeof(TVertexPositionStream), CookedMesh::StreamCodec::Vertex });
+			TVertexPositionStream* pTarget = (TVertexPositionStream*)(pGeometryData + dataOffset);
+			for (size_t i = 0; i < meshData.PositionsStream.size(); ++i)
 			{
-				*pTarget++ = { Math::Pack_RGBA16_SNORM(Vector4(position)) };
+				const Vector3& position = meshData.PositionsStream[i];
+				Vector3 quantized = (position - center) * invExtents;
+				*pTarget = Math::Pack_RGBA16_SNORM(Vector4(quantized.x, quantized.y, quantized.z, tangentAngles[i] / Math::PI));
+
+				Vector4 decoded = Math::Unpack_RGBA16_SNORM(*pTarget++);
+				Vector3 error = center + Vector3(decoded.x, decoded.y, decoded.z) * extents - position;
+				error = Vector3(fabs(error.x), fabs(error.y), fabs(error.z));
+				quantizationError.Position = Math::Max(quantizationError.Position, Math::Max(error.x, Math::Max(error.y, error.z)));
+				error *= invExtents * 0.5f;
+				quantizationError.PositionRelative = Math::Max(quantizationError.PositionRelative, Math::Max(error.x, Math::Max(error.y, error.z)));
 			}
 			dataOffset = Math::AlignUp(dataOffset + meshData.PositionsStream.size() * sizeof(TVertexPositionStream), bufferAlignment);
 		}
 
 		{
 			subMesh.NormalStreamLocation = VertexBufferView(m_pGeometryData->GetGpuHandle() + dataOffset, (uint32)meshData.NormalsStream.size(), sizeof(TVertexNormalStream), dataOffset);
-			TVertexNormalStream* pTarget = (TVertexNormalStream*)(pMappedMemory + dataOffset);
-			for (size_t i = 0; i < meshData.NormalsStream.size(); ++i)
-			{
-				*pTarget++ = {
-						Math::Pack_RGB10A2_SNORM(Vector4(meshData.NormalsStream[i])),
-						Math::Pack_RGB10A2_SNORM(meshData.TangentsStream.empty() ? Vector4(1, 0, 0, 1) : meshData.TangentsStream[i])
-				};
-			}
-			dataOffset = Math::AlignUp(dataOffset + meshData.NormalsStream.size() * sizeof(TVertexNormalStream), bufferAlignment);
+			CopyData(normals.data(), (uint32)normals.size(), sizeof(TVertexNormalStream));
 		}
 
 		if (!meshData.ColorsStream.empty())
 		{
 			subMesh.ColorsStreamLocation = VertexBufferView(m_pGeometryData->GetGpuHandle() + dataOffset, (uint32)meshData.ColorsStream.size(), sizeof(TVertexColorStream), dataOffset);
-			TVertexColorStream* pTarget = (TVertexColorStream*)(pMappedMemory + dataOffset);
+			cookedStreams.push_back({ dataOffset, (uint32)meshData.ColorsStream.size(), sizeof(TVertexColorStream), CookedMesh::StreamCodec::Vertex });
+			TVertexColorStream* pTarget = (TVertexColorStream*)(pGeometryData + dataOffset);
 			for (const Vector4& color : meshData.ColorsStream)
 			{
 				*pTarget++ = { Math::Pack_RGBA8_UNORM(color) };
@@ -549,20 +828,58 @@ bool Mesh::Load(const char* pFilePath, GraphicsDevice* pDevice, CommandContext*
 
 		if (!meshData.UVsStream.empty())
 		{
+			// UVs are relative to their range so tiled UVs keep their precision
+			Vector2 uvMin(FLT_MAX);
+			Vector2 uvMax(-FLT_MAX);
+			for (const Vector2& uv : meshData.UVsStream)
+			{
+				uvMin = Vector2::Min(uvMin, uv);
+				uvMax = Vector2::Max(uvMax, uv);
+			}
+			subMesh.UVOffset = uvMin;
+			subMesh.UVScale = uvMax - uvMin;
+			const Vector2 invScale(subMesh.UVScale.x > 0 ? 1.0f / subMesh.UVScale.x : 0, subMesh.UVScale.y > 0 ? 1.0f / subMesh.UVScale.y : 0);
+
 			subMesh.UVStreamLocation = VertexBufferView(m_pGeometryData->GetGpuHandle() + dataOffset, (uint32)meshData.UVsStream.size(), sizeof(TVertexUVStream), dataOffset);
-			TVertexUVStream* pTarget = (TVertexUVStream*)(pMappedMemory + dataOffset);
+			cookedStreams.push_back({ dataOffset, (uint32)meshData.UVsStream.size(), sizeof(TVertexUVStream), CookedMesh::StreamCodec::Vertex });
+			TVertexUVStream* pTarget = (TVertexUVStream*)(pGeometryData + dataOffset);
 			for (const Vector2& uv : meshData.UVsStream)
 			{
-				*pTarget++ = { Math::Pack_RG16_FLOAT(uv) };
+				*pTarget = Math::Pack_RG16_UNORM((uv - uvMin) * invScale);
+
+				Vector2 error = subMesh.UVOffset + Math::Unpack_RG16_UNORM(*pTarget++) * subMesh.UVScale - uv;
+				quantizationError.UV = Math::Max(quantizationError.UV, Math::Max(fabs(error.x), fabs(error.y)));
 			}
 			dataOffset = Math::AlignUp(dataOffset + meshData.UVsStream.size() * sizeof(TVertexUVStream), bufferAlignment);
 		}
 
+		{
+			// The BLAS is built from the quantized positions and transforms them back to object space
+			const TPositionTransform transform = {
+				{ bounds.Extents.x, 0, 0, bounds.Center.x },
+				{ 0, bounds.Extents.y, 0, bounds.Center.y },
+				{ 0, 0, bounds.Extents.z, bounds.Center.z },
+			};
+			subMesh.PositionTransformLocation = (uint32)dataOffset;
+			CopyData(transform, 1, sizeof(TPositionTransform));
+		}
+
 		{
 			bool smallIndices = meshData.PositionsStream.size() < std::numeric_limits<uint16>::max();
 			uint32 indexSize = smallIndices ? sizeof(uint16) : sizeof(uint32);
-			subMesh.IndicesLocation = IndexBufferView(m_pGeometryData->GetGpuHandle() + dataOffset, (uint32)meshData.Indices.size(), smallIndices ? ResourceFormat::R16_UINT : ResourceFormat::R32_UINT, dataOffset);
-			char* pTarget = (char*)(pMappedMemory + dataOffset);
+			ResourceFormat indexFormat = smallIndices ? ResourceFormat::R16_UINT : ResourceFormat::R32_UINT;
+			for (const MeshData::LOD& lod : meshData.LODs)
+			{
+				uint64 lodOffset = dataOffset + lod.IndexStart * indexSize;
+				SubMeshLOD& subMeshLOD = subMesh.LODs.emplace_back();
+				subMeshLOD.IndicesLocation = IndexBufferView(m_pGeometryData->GetGpuHandle() + lodOffset, lod.IndexCount, indexFormat, lodOffset);
+				subMeshLOD.MeshletStart = lod.MeshletStart;
+				subMeshLOD.NumMeshlets = lod.MeshletCount;
+				subMeshLOD.Error = lod.Error;
+			}
+			subMesh.IndicesLocation = subMesh.LODs[0].IndicesLocation;
+			cookedStreams.push_back({ dataOffset, (uint32)meshData.Indices.size(), indexSize, CookedMesh::StreamCodec::Index });
+			char* pTarget = (char*)(pGeometryData + dataOffset);
 			for (uint32 index : meshData.Indices)
 			{
 				memcpy(pTarget, &index, indexSize);
@@ -572,25 +889,141 @@ bool Mesh::Load(const char* pFilePath, GraphicsDevice* pDevice, CommandContext*
 		}
 
 		subMesh.MeshletsLocation = (uint32)dataOffset;
-		CopyData(meshData.Meshlets.data(), sizeof(ShaderInterop::Meshlet) * meshData.Meshlets.size());
+		CopyData(meshData.Meshlets.data(), (uint32)meshData.Meshlets.size(), sizeof(ShaderInterop::Meshlet));
 
 		subMesh.MeshletVerticesLocation = (uint32)dataOffset;
-		CopyData(meshData.MeshletVertices.data(), sizeof(uint32) * meshData.MeshletVertices.size());
+		CopyData(meshData.MeshletVertices.data(), (uint32)meshData.MeshletVertices.size(), sizeof(uint32));
 
 		subMesh.MeshletTrianglesLocation = (uint32)dataOffset;
-		CopyData(meshData.MeshletTriangles.data(), sizeof(ShaderInterop::Meshlet::Triangle) * meshData.MeshletTriangles.size());
+		CopyData(meshData.MeshletTriangles.data(), (uint32)meshData.MeshletTriangles.size(), sizeof(ShaderInterop::Meshlet::Triangle));
 
 		subMesh.MeshletBoundsLocation = (uint32)dataOffset;
-		CopyData(meshData.MeshletBounds.data(), sizeof(ShaderInterop::Meshlet::Bounds) * meshData.MeshletBounds.size());
+		CopyData(meshData.MeshletBounds.data(), (uint32)meshData.MeshletBounds.size(), sizeof(ShaderInterop::Meshlet::Bounds));
 
-		subMesh.NumMeshlets = (uint32)meshData.Meshlets.size();
+		subMesh.ClusterLODBoundsLocation = (uint32)dataOffset;
+		CopyData(meshData.ClusterLODBounds.data(), (uint32)meshData.ClusterLODBounds.size(), sizeof(ShaderInterop::Meshlet::LODBounds));
+
+		subMesh.NumMeshlets = meshData.LODs[0].MeshletCount;
+		subMesh.NumClusters = (uint32)meshData.ClusterLODBounds.size();
+		subMesh.MeshletBounds = meshData.MeshletBounds;
+		subMesh.ClusterLODBounds = meshData.ClusterLODBounds;
 
 		subMesh.pParent = this;
 		m_Meshes.push_back(subMesh);
 	}
 
+	E_LOG(Info, "Quantized %llu vertices of '%s' to %.1f bytes/vertex", numVertices, pFilePath, (float)numVertexBytes / Math::Max<uint64>(numVertices, 1));
+	E_LOG(Info, "\tMax error: position %.3g (%.3g of bounds), normal %.3f deg, tangent %.3f deg, UV %.3g",
+		quantizationError.Position, quantizationError.PositionRelative, Math::Degrees(quantizationError.NormalAngle), Math::Degrees(quantizationError.TangentAngle), quantizationError.UV);
+
+	BuildRayQueryBVHs(pGeometryData, m_Meshes);
+
+	memcpy(allocation.pMappedMemory, pGeometryData, bufferSize);
 	pContext->CopyBuffer(allocation.pBackingResource, m_pGeometryData, bufferSize, allocation.Offset, 0);
 
+	if (useCookedMesh)
+	{
+		Paths::CreateDirectoryTree(Paths::MeshCacheDir());
+		if (!CookedMesh::Save(cookedPath.c_str(), pGeometryData, bufferSize, cookedStreams, m_Meshes))
+		{
+			E_LOG(Warning, "Failed to write cooked mesh '%s'", cookedPath.c_str());
+		}
+	}
+
 	return true;
 }
 
+
+void Mesh::DispatchTextureLoads()
+{
+	const uint64 budget = (uint64)Tweakables::g_TextureLoadBudgetMB.GetInt() * 1024 * 1024;
+	for (std::unique_ptr<PendingTexture>& pPending : m_PendingTextures)
+	{
+		if (pPending->LoadState != PendingTexture::State::Queued)
+		{
+			continue;
+		}
+		// Always allow one load in flight so a texture larger than the budget can't stall loading
+		if (m_TextureLoadBytesInFlight > 0 && m_TextureLoadBytesInFlight + pPending->MemoryEstimate > budget)
+		{
+			break;
+		}
+
+		m_TextureLoadBytesInFlight += pPending->MemoryEstimate;
+		pPending->LoadState = PendingTexture::State::Decoding;
+		TaskQueue::Execute([pTexture = pPending.get()](int)
+			{
+				bool success = pTexture->FilePath.empty() ?
+					pTexture->Result.LoadCompressed(pTexture->Data.data(), pTexture->Data.size(), pTexture->MimeType.c_str(), pTexture->Compression, pTexture->AlphaTestReference, &pTexture->CachePath) :
+					pTexture->Result.LoadCompressed(pTexture->FilePath.c_str(), pTexture->Compression, pTexture->AlphaTestReference, &pTexture->CachePath);
+				pTexture->Data = {};
+				pTexture->LoadState = success ? PendingTexture::State::Decoded : PendingTexture::State::Failed;
+			}, m_TextureLoadContext);
+	}
+}
+
+void Mesh::UpdateTextureLoads(CommandContext& context, TextureStreamer* pStreamer)
+{
+	if (m_PendingTextures.empty())
+	{
+		return;
+	}
+
+	// Upload all textures that finished decoding in one batch, limited to bound the staging memory of a frame
+	const uint64 uploadLimit = (uint64)Tweakables::g_TextureUploadPerFrameMB.GetInt() * 1024 * 1024;
+	uint64 uploadedBytes = 0;
+	for (auto it = m_PendingTextures.begin(); it != m_PendingTextures.end();)
+	{
+		PendingTexture& pending = **it;
+		PendingTexture::State state = pending.LoadState;
+		if (state == PendingTexture::State::Decoded && uploadedBytes < uploadLimit)
+		{
+			const Image& image = pending.Result;
+			if (pStreamer && !pending.CachePath.empty() && image.GetMipLevels() > 1 && image.GetDepth() == 1)
+			{
+				// The streamer owns the texture and hands out a new one every time its resident mips change
+				m_pTextureStreamer = pStreamer;
+				m_StreamingTextures.push_back(pStreamer->Register(context, image, pending.CachePath, pending.sRGB, pending.Name.c_str(),
+					StreamingTextureChangedDelegate::CreateLambda([this, targets = pending.Targets](Texture* pTexture)
+						{
+							for (const auto& target : targets)
+							{
+								m_Materials[target.first].*target.second = pTexture;
+								m_Materials[target.first].IsDirty = true;
+							}
+						})));
+			}
+			else
+			{
+				RefCountPtr<Texture> pTexture = GraphicsCommon::CreateTextureFromImage(context, image, pending.sRGB, pending.Name.c_str());
+				context.InsertResourceBarrier(pTexture, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+				m_Textures.push_back(pTexture);
+				for (const auto& target : pending.Targets)
+				{
+					m_Materials[target.first].*target.second = pTexture;
+					m_Materials[target.first].IsDirty = true;
+				}
+			}
+			uploadedBytes += RHI::GetTextureByteSize(image.GetFormat(), image.GetWidth(), image.GetHeight(), image.GetDepth(), image.GetMipLevels());
+		}
+		else if (state == PendingTexture::State::Failed)
+		{
+			E_LOG(Warning, "GLTF - Failed to load texture '%s'", pending.Name.c_str());
+			for (const auto& target : pending.Targets)
+			{
+				m_Materials[target.first].*target.second = nullptr;
+				m_Materials[target.first].IsDirty = true;
+			}
+		}
+		else
+		{
+			++it;
+			continue;
+		}
+
+		m_TextureLoadBytesInFlight -= pending.MemoryEstimate;
+		it = m_PendingTextures.erase(it);
+	}
+
+	DispatchTextureLoads();
+}
@@ -1,5 +1,9 @@
 #pragma once
 #include "RHI/Buffer.h"
+#include "Core/TaskQueue.h"
+#include "ShaderInterop.h"
+#include "RayQuery.h"
+#include "BLASPool.h"
 
 class Buffer;
 class CommandContext;
@@ -7,8 +11,17 @@ class Texture;
 class CommandContext;
 class ShaderResourceView;
 class Mesh;
+class TextureStreamer;
 struct World;
 
+struct SubMeshLOD
+{
+	IndexBufferView IndicesLocation;
+	uint32 MeshletStart;
+	uint32 NumMeshlets;
+	float Error;	// Object space simplification error
+};
+
 struct SubMesh
 {
 	int MaterialId = 0;
@@ -23,17 +36,27 @@ struct SubMesh
 	uint32 MeshletVerticesLocation;
 	uint32 MeshletTrianglesLocation;
 	uint32 MeshletBoundsLocation;
-	uint32 NumMeshlets;
+	uint32 ClusterLODBoundsLocation;
+	uint32 PositionTransformLocation;	// 3x4 matrix from the quantized positions to object space, for the BLAS
+	uint32 NumMeshlets;		// Meshlets of LOD 0
+	uint32 NumClusters;		// Meshlets of the cluster hierarchy, starting at meshlet 0
+	std::vector<ShaderInterop::Meshlet::Bounds> MeshletBounds;	// CPU copy for reference culling, all LODs
+	std::vector<ShaderInterop::Meshlet::LODBounds> ClusterLODBounds;
+	std::vector<SubMeshLOD> LODs;	// LOD 0 is the full detail mesh
 
-	BoundingBox Bounds;
+	BoundingBox Bounds;		// Positions are quantized relative to the bounds
+	Vector2 UVOffset = Vector2(0, 0);
+	Vector2 UVScale = Vector2(1, 1);
 	Mesh* pParent = nullptr;
 
-	RefCountPtr<Buffer> pBLAS;
+	RefCountPtr<BLASAllocation> pBLAS;
+	RayQuery::TriangleBVH BVH;	// LOD 0 triangles for CPU ray queries
 };
 
 struct SubMeshInstance
 {
 	int MeshIndex;
+	int MaterialId;		// Instances can share the geometry of a submesh with a different material
 	Matrix Transform;
 };
 
@@ -57,6 +80,7 @@ struct Material
 	Texture* pRoughnessMetalnessTexture = nullptr;
 	Texture* pEmissiveTexture = nullptr;
 	MaterialAlphaMode AlphaMode;
+	bool IsDirty = true;		// Added or changed since the previous scene upload
 };
 
 class Mesh
@@ -67,15 +91,32 @@ public:
 	int GetMeshCount() const { return (int)m_Meshes.size(); }
 	SubMesh& GetMesh(const int index) { return m_Meshes[index]; }
 	const Material& GetMaterial(int materialId) const { return m_Materials[materialId]; }
+	Material& GetMaterial(int materialId) { return m_Materials[materialId]; }
 	Span<SubMeshInstance> GetMeshInstances() const { return m_MeshInstances; }
 	Span<SubMesh> GetMeshes() const { return m_Meshes; }
 	Span<Material> GetMaterials() { return m_Materials; }
 	Buffer* GetData() const { return m_pGeometryData; }
 
+	// Uploads textures that finished decoding and starts new decode jobs within the memory budget.
+	// Materials use default textures until their texture is uploaded.
+	// When a streamer is given, textures with a cooked mip chain are handed over to it.
+	void UpdateTextureLoads(CommandContext& context, TextureStreamer* pStreamer = nullptr);
+	bool IsLoadingTextures() const { return !m_PendingTextures.empty(); }
+
 private:
+	struct PendingTexture;
+	void DispatchTextureLoads();
+
 	std::vector<Material> m_Materials;
 	RefCountPtr<Buffer> m_pGeometryData;
 	std::vector<SubMesh> m_Meshes;
 	std::vector<SubMeshInstance> m_MeshInstances;
 	std::vector<RefCountPtr<Texture>> m_Textures;
+
+	std::vector<std::unique_ptr<PendingTexture>> m_PendingTextures;
+	uint64 m_TextureLoadBytesInFlight = 0;
+	TaskContext m_TextureLoadContext;
+
+	TextureStreamer* m_pTextureStreamer = nullptr;
+	std::vector<uint32> m_StreamingTextures;
 };
@@ -0,0 +1,523 @@
+#include "stdafx.h"
+#include "MeshletCulling.h"
+#include "Mesh.h"
+#include "SceneView.h"
+#include "ClusterLOD.h"
+#include "Core/TaskQueue.h"
+#include "Core/ConsoleVariables.h"
+#include "meshoptimizer.h"
+#include <chrono>
+
+namespace Tweakables
+{
+	extern ConsoleVariable<float> g_LODErrorThreshold;
+	extern ConsoleVariable<bool> g_ClusterLOD;
+}
+
+namespace MeshletCulling
+{
+	static int FirstBitHigh(uint32 value)
+	{
+		int bit = -1;
+		while (value)
+		{
+			value >>= 1;
+			++bit;
+		}
+		return bit;
+	}
+
+	FrustumCullData FrustumCull(const Vector3& aabbCenter, const Vector3& aabbExtents, const Matrix& worldToClip)
+	{
+		FrustumCullData data{};
+		data.IsVisible = true;
+
+		// Clip space AABB
+		Vector4 axis[3];
+		axis[0] = Vector4::Transform(Vector4(aabbExtents.x * 2, 0, 0, 0), worldToClip);
+		axis[1] = Vector4::Transform(Vector4(0, aabbExtents.y * 2, 0, 0), worldToClip);
+		axis[2] = Vector4::Transform(Vector4(0, 0, aabbExtents.z * 2, 0), worldToClip);
+
+		Vector4 corners[8];
+		corners[0] = Vector4::Transform(Vector4(aabbCenter.x - aabbExtents.x, aabbCenter.y - aabbExtents.y, aabbCenter.z - aabbExtents.z, 1), worldToClip);
+		corners[1] = corners[0] + axis[0];
+		corners[2] = corners[0] + axis[1];
+		corners[3] = corners[2] + axis[0];
+		corners[4] = corners[0] + axis[2];
+		corners[5] = corners[1] + axis[2];
+		corners[6] = corners[2] + axis[2];
+		corners[7] = corners[3] + axis[2];
+
+		float minW = FLT_MAX;
+		float maxW = -FLT_MAX;
+		bool outsidePlane[4] = { true, true, true, true };
+		data.RectMin = Vector3(1, 1, 1);
+		data.RectMax = Vector3(-1, -1, -1);
+		for (const Vector4& corner : corners)
+		{
+			minW = Math::Min(minW, corner.w);
+			maxW = Math::Max(maxW, corner.w);
+
+			// Plane inequalities
+			outsidePlane[0] &= corner.x - corner.w > 0;
+			outsidePlane[1] &= corner.y - corner.w > 0;
+			outsidePlane[2] &= -corner.x - corner.w > 0;
+			outsidePlane[3] &= -corner.y - corner.w > 0;
+
+			// Screen space AABB
+			Vector3 screenPosition(corner.x / corner.w, corner.y / corner.w, corner.z / corner.w);
+			data.RectMin = Vector3::Min(data.RectMin, screenPosition);
+			data.RectMax = Vector3::Max(data.RectMax, screenPosition);
+		}
+
+		data.IsVisible &= data.RectMax.z > 0;
+
+		if (minW <= 0 && maxW > 0)
+		{
+			data.RectMin = Vector3(-1, -1, -1);
+			data.RectMax = Vector3(1, 1, 1);
+			data.IsVisible = true;
+		}
+		else
+		{
+			data.IsVisible &= maxW > 0.0f;
+		}
+
+		data.IsVisible &= !outsidePlane[0] && !outsidePlane[1] && !outsidePlane[2] && !outsidePlane[3];
+		return data;
+	}
+
+	FrustumCullData FrustumCull(const Vector3& aabbCenter, const Vector3& aabbExtents, const Matrix& localToWorld, const Matrix& worldToClip)
+	{
+		// Transform bounds to world space
+		return FrustumCull(Vector3::Transform(aabbCenter, localToWorld), Vector3::TransformNormal(aabbExtents, localToWorld), worldToClip);
+	}
+
+	void ComputeBounds(const uint32* pMeshletVertices, const uint8* pMeshletTriangles, uint32 triangleCount, const Vector3* pPositions, uint32 numPositions, ShaderInterop::Meshlet::Bounds& outBounds)
+	{
+		Vector3 min = Vector3(FLT_MAX, FLT_MAX, FLT_MAX);
+		Vector3 max = Vector3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		for (uint32 k = 0; k < triangleCount * 3; ++k)
+		{
+			const Vector3& p = pPositions[pMeshletVertices[pMeshletTriangles[k]]];
+			max = Vector3::Max(max, p);
+			min = Vector3::Min(min, p);
+		}
+		outBounds.Center = (max + min) / 2;
+		outBounds.Extents = (max - min) / 2;
+
+		// Undo the {0, 2, 1} index swap of the glTF import. meshoptimizer expects counter clockwise triangles,
+		// on the swapped ones the cone axis points into the surface and the apex ends up on the wrong side.
+		uint8 gltfTriangles[ShaderInterop::MESHLET_MAX_TRIANGLES * 3];
+		check(triangleCount <= ShaderInterop::MESHLET_MAX_TRIANGLES);
+		for (uint32 i = 0; i < triangleCount; ++i)
+		{
+			gltfTriangles[i * 3 + 0] = pMeshletTriangles[i * 3 + 0];
+			gltfTriangles[i * 3 + 1] = pMeshletTriangles[i * 3 + 2];
+			gltfTriangles[i * 3 + 2] = pMeshletTriangles[i * 3 + 1];
+		}
+
+		meshopt_Bounds bounds = meshopt_computeMeshletBounds(pMeshletVertices, gltfTriangles, triangleCount, &pPositions[0].x, numPositions, sizeof(Vector3));
+		outBounds.SphereCenter = Vector3(bounds.center);
+		outBounds.SphereRadius = bounds.radius;
+		outBounds.ConeApex = Vector3(bounds.cone_apex);
+		// The 8 bit cone is rounded conservatively by meshoptimizer
+		outBounds.ConeAxisAndCutoff =
+			(uint32)(uint8)bounds.cone_axis_s8[0] |
+			(uint32)(uint8)bounds.cone_axis_s8[1] << 8 |
+			(uint32)(uint8)bounds.cone_axis_s8[2] << 16 |
+			(uint32)(uint8)bounds.cone_cutoff_s8 << 24;
+	}
+
+	bool IsBackfacing(const ShaderInterop::Meshlet::Bounds& bounds, const Matrix& localToWorld, const ViewTransform& view)
+	{
+		auto DecodeSNorm = [](uint32 value, uint32 shift) { return Math::Clamp((float)(int8)((value >> shift) & 0xFF) / 127.0f, -1.0f, 1.0f); };
+		const float cutoff = DecodeSNorm(bounds.ConeAxisAndCutoff, 24);
+		// A cutoff of 1 means the triangles face too many directions
+		if (cutoff >= 1.0f)
+		{
+			return false;
+		}
+
+		Vector3 axis(DecodeSNorm(bounds.ConeAxisAndCutoff, 0), DecodeSNorm(bounds.ConeAxisAndCutoff, 8), DecodeSNorm(bounds.ConeAxisAndCutoff, 16));
+		axis = Vector3::TransformNormal(axis, localToWorld);
+		axis.Normalize();
+
+		if (!view.Perspective)
+		{
+			const Vector3 viewDirection(view.ViewInverse._31, view.ViewInverse._32, view.ViewInverse._33);
+			return viewDirection.Dot(axis) >= cutoff;
+		}
+
+		// The cone is in the glTF winding while the triangles are drawn clockwise, which matches when the transform mirrors
+		// like the Z flip of the glTF import does.
+		if (localToWorld.Determinant() < 0)
+		{
+			Vector3 viewDirection = Vector3::Transform(bounds.ConeApex, localToWorld) - view.Position;
+			viewDirection.Normalize();
+			return viewDirection.Dot(axis) >= cutoff;
+		}
+
+		// Without a mirror the rasterizer keeps the other side. The apex is only valid for the cone it was computed for,
+		// so the flipped cone is tested against the bounding sphere instead.
+		axis = -axis;
+		const float scale = sqrtf(Math::Max(Vector3(localToWorld._11, localToWorld._12, localToWorld._13).LengthSquared(),
+			Math::Max(Vector3(localToWorld._21, localToWorld._22, localToWorld._23).LengthSquared(), Vector3(localToWorld._31, localToWorld._32, localToWorld._33).LengthSquared())));
+		const Vector3 toCenter = Vector3::Transform(bounds.SphereCenter, localToWorld) - view.Position;
+		return toCenter.Dot(axis) >= cutoff * toCenter.Length() + bounds.SphereRadius * scale;
+	}
+
+	bool ValidateBackfaceCulling()
+	{
+		bool isValid = true;
+
+		// Quad in the XY plane facing +Z in glTF, imported with the {0, 2, 1} index swap
+		{
+			const Vector3 positions[] = { Vector3(0, 0, 0), Vector3(1, 0, 0), Vector3(1, 1, 0), Vector3(0, 1, 0) };
+			const uint32 vertices[] = { 0, 1, 2, 3 };
+			const uint32 gltfIndices[] = { 0, 1, 2, 0, 2, 3 };
+			uint8 triangles[6];
+			for (uint32 i = 0; i < 6; i += 3)
+			{
+				triangles[i + 0] = (uint8)gltfIndices[i + 0];
+				triangles[i + 1] = (uint8)gltfIndices[i + 2];
+				triangles[i + 2] = (uint8)gltfIndices[i + 1];
+			}
+
+			ShaderInterop::Meshlet::Bounds bounds;
+			ComputeBounds(vertices, triangles, 2, positions, ARRAYSIZE(positions), bounds);
+
+			// The clockwise triangles are front facing when looked at from -Z in world space.
+			// That holds for both transforms as the quad lies in the mirror plane.
+			const Matrix transforms[] = { Matrix::CreateScale(1, 1, -1), Matrix::Identity };
+			for (const Matrix& localToWorld : transforms)
+			{
+				for (float z : { -5.0f, 5.0f })
+				{
+					ViewTransform view;
+					view.Perspective = true;
+					view.Position = Vector3(0.5f, 0.5f, z);
+					const bool isFront = z < 0;
+					if (IsBackfacing(bounds, localToWorld, view) == isFront)
+					{
+						E_LOG(Error, "Meshlet backface culling: %s facing quad seen from z = %.0f with determinant %.0f is %s", isFront ? "front" : "back", z, localToWorld.Determinant(), isFront ? "culled" : "not culled");
+						isValid = false;
+					}
+				}
+			}
+		}
+
+		// Cap of the unit sphere around +Z, facing out in glTF. Unlike the quad its cone apex sits behind the center,
+		// so a test that only flips the axis culls it while some of its triangles are still front facing.
+		{
+			constexpr uint32 gridSize = 5;
+			Vector3 positions[gridSize * gridSize];
+			uint32 vertices[gridSize * gridSize];
+			for (uint32 y = 0; y < gridSize; ++y)
+			{
+				for (uint32 x = 0; x < gridSize; ++x)
+				{
+					const float px = 0.8f * x / (gridSize - 1) - 0.4f;
+					const float py = 0.8f * y / (gridSize - 1) - 0.4f;
+					positions[x + y * gridSize] = Vector3(px, py, sqrtf(1.0f - px * px - py * py));
+					vertices[x + y * gridSize] = x + y * gridSize;
+				}
+			}
+
+			// Counter clockwise seen from +Z, swapped to the engine winding
+			uint8 triangles[(gridSize - 1) * (gridSize - 1) * 6];
+			uint32 numTriangles = 0;
+			for (uint32 y = 0; y < gridSize - 1; ++y)
+			{
+				for (uint32 x = 0; x < gridSize - 1; ++x)
+				{
+					const uint8 v0 = (uint8)(x + y * gridSize);
+					const uint8 v1 = v0 + 1;
+					const uint8 v2 = v1 + gridSize;
+					const uint8 v3 = v0 + gridSize;
+					const uint8 quad[] = { v0, v2, v1, v0, v3, v2 };
+					memcpy(&triangles[numTriangles * 3], quad, sizeof(quad));
+					numTriangles += 2;
+				}
+			}
+
+			ShaderInterop::Meshlet::Bounds bounds;
+			ComputeBounds(vertices, triangles, numTriangles, positions, ARRAYSIZE(positions), bounds);
+
+			const Matrix transforms[] = {
+				Matrix::CreateScale(1, 1, -1),
+				Matrix::Identity,
+				Matrix::CreateScale(2, 2, -2) * Matrix::CreateRotationY(Math::PI_DIV_2) * Matrix::CreateTranslation(3, 0, 1),
+				Matrix::CreateScale(2) * Matrix::CreateRotationX(Math::PI_DIV_2) * Matrix::CreateTranslation(-1, 2, 0),
+			};
+			for (const Matrix& localToWorld : transforms)
+			{
+				const Vector3 origin = Vector3::Transform(Vector3::Zero, localToWorld);
+				const float scale = Vector3::TransformNormal(Vector3(1, 0, 0), localToWorld).Length();
+				uint32 numCulled = 0;
+				for (float distance : { 0.5f, 1.5f, 4.0f, 10.0f })
+				{
+					for (uint32 theta = 0; theta <= 8; ++theta)
+					{
+						for (uint32 phi = 0; phi < 16; ++phi)
+						{
+							const float t = Math::PI * theta / 8;
+							const float p = Math::PI * 2 * phi / 16;
+							ViewTransform view;
+							view.Perspective = true;
+							view.Position = origin + scale * distance * Vector3(sinf(t) * cosf(p), sinf(t) * sinf(p), cosf(t));
+
+							// The rasterizer keeps the triangles that are clockwise on screen, which are the ones
+							// of which the normal of the engine winding points towards the view
+							bool isFront = false;
+							for (uint32 i = 0; i < numTriangles && !isFront; ++i)
+							{
+								const Vector3 p0 = Vector3::Transform(positions[triangles[i * 3 + 0]], localToWorld);
+								const Vector3 p1 = Vector3::Transform(positions[triangles[i * 3 + 1]], localToWorld);
+								const Vector3 p2 = Vector3::Transform(positions[triangles[i * 3 + 2]], localToWorld);
+								isFront = (p1 - p0).Cross(p2 - p0).Dot(view.Position - p0) > 0;
+							}
+
+							const bool isCulled = IsBackfacing(bounds, localToWorld, view);
+							numCulled += isCulled;
+							if (isFront && isCulled)
+							{
+								E_LOG(Error, "Meshlet backface culling: front facing sphere cap seen from (%.1f, %.1f, %.1f) with determinant %.0f is culled", view.Position.x, view.Position.y, view.Position.z, localToWorld.Determinant());
+								isValid = false;
+							}
+						}
+					}
+				}
+				if (numCulled == 0)
+				{
+					E_LOG(Error, "Meshlet backface culling: sphere cap with determinant %.0f is never culled", localToWorld.Determinant());
+					isValid = false;
+				}
+			}
+		}
+		return isValid;
+	}
+
+	void HZB::Build(const float* pDepth, uint32 width, uint32 height)
+	{
+		m_Dimensions.x = Math::Max(Math::NextPowerOfTwo(width) >> 1u, 1u);
+		m_Dimensions.y = Math::Max(Math::NextPowerOfTwo(height) >> 1u, 1u);
+		const uint32 numMips = Math::Max(1u, (uint32)Math::Floor(log2f((float)Math::Max(m_Dimensions.x, m_Dimensions.y))));
+		m_Mips.resize(numMips);
+
+		// Gather the 2x2 footprint of each texel center
+		std::vector<float>& mip0 = m_Mips[0];
+		mip0.resize(m_Dimensions.x * m_Dimensions.y);
+		for (uint32 y = 0; y < m_Dimensions.y; ++y)
+		{
+			const float v = (y + 0.5f) / m_Dimensions.y;
+			const int y0 = Math::Clamp((int)floorf(v * height - 0.5f), 0, (int)height - 1);
+			const int y1 = Math::Min(y0 + 1, (int)height - 1);
+			for (uint32 x = 0; x < m_Dimensions.x; ++x)
+			{
+				const float u = (x + 0.5f) / m_Dimensions.x;
+				const int x0 = Math::Clamp((int)floorf(u * width - 0.5f), 0, (int)width - 1);
+				const int x1 = Math::Min(x0 + 1, (int)width - 1);
+				mip0[x + y * m_Dimensions.x] = Math::Min(
+					Math::Min(pDepth[x0 + y0 * width], pDepth[x1 + y0 * width]),
+					Math::Min(pDepth[x0 + y1 * width], pDepth[x1 + y1 * width]));
+			}
+		}
+
+		for (uint32 mip = 1; mip < numMips; ++mip)
+		{
+			const uint32 sourceWidth = Math::Max(m_Dimensions.x >> (mip - 1), 1u);
+			const uint32 sourceHeight = Math::Max(m_Dimensions.y >> (mip - 1), 1u);
+			const uint32 mipWidth = Math::Max(m_Dimensions.x >> mip, 1u);
+			const uint32 mipHeight = Math::Max(m_Dimensions.y >> mip, 1u);
+			const std::vector<float>& source = m_Mips[mip - 1];
+			std::vector<float>& target = m_Mips[mip];
+			target.resize(mipWidth * mipHeight);
+			for (uint32 y = 0; y < mipHeight; ++y)
+			{
+				const uint32 y0 = Math::Min(y * 2, sourceHeight - 1);
+				const uint32 y1 = Math::Min(y * 2 + 1, sourceHeight - 1);
+				for (uint32 x = 0; x < mipWidth; ++x)
+				{
+					const uint32 x0 = Math::Min(x * 2, sourceWidth - 1);
+					const uint32 x1 = Math::Min(x * 2 + 1, sourceWidth - 1);
+					target[x + y * mipWidth] = Math::Min(
+						Math::Min(source[x0 + y0 * sourceWidth], source[x1 + y0 * sourceWidth]),
+						Math::Min(source[x0 + y1 * sourceWidth], source[x1 + y1 * sourceWidth]));
+				}
+			}
+		}
+	}
+
+	float HZB::Sample(uint32 mip, float u, float v) const
+	{
+		// Point clamp
+		mip = Math::Min(mip, (uint32)m_Mips.size() - 1);
+		const uint32 mipWidth = Math::Max(m_Dimensions.x >> mip, 1u);
+		const uint32 mipHeight = Math::Max(m_Dimensions.y >> mip, 1u);
+		const uint32 x = (uint32)Math::Clamp((int)floorf(u * mipWidth), 0, (int)mipWidth - 1);
+		const uint32 y = (uint32)Math::Clamp((int)floorf(v * mipHeight), 0, (int)mipHeight - 1);
+		return m_Mips[mip][x + y * mipWidth];
+	}
+
+	bool HZB::IsVisible(const FrustumCullData& cullData) const
+	{
+		constexpr int hzbTexelCoverage = 4;
+
+		// Convert NDC to UV
+		const float rect[4] = {
+			Math::Clamp(cullData.RectMin.x * 0.5f + 0.5f, 0.0f, 1.0f),
+			Math::Clamp(cullData.RectMax.y * -0.5f + 0.5f, 0.0f, 1.0f),
+			Math::Clamp(cullData.RectMax.x * 0.5f + 0.5f, 0.0f, 1.0f),
+			Math::Clamp(cullData.RectMin.y * -0.5f + 0.5f, 0.0f, 1.0f),
+		};
+
+		// Convert to texel indices. Contract bounds to only account for the area overlapping texel centres
+		int rectPixels[4] = {
+			(int)(rect[0] * m_Dimensions.x + 0.5f),
+			(int)(rect[1] * m_Dimensions.y + 0.5f),
+			(int)(rect[2] * m_Dimensions.x - 0.5f),
+			(int)(rect[3] * m_Dimensions.y - 0.5f),
+		};
+		rectPixels[2] = Math::Max(rectPixels[0], rectPixels[2]);
+		rectPixels[3] = Math::Max(rectPixels[1], rectPixels[3]);
+
+		const int mipOffset = FirstBitHigh(hzbTexelCoverage) - 1;
+		int mip = Math::Max(Math::Max(FirstBitHigh(rectPixels[2] - rectPixels[0]), FirstBitHigh(rectPixels[3] - rectPixels[1])) - mipOffset, 0);
+		if ((rectPixels[2] >> mip) - (rectPixels[0] >> mip) >= hzbTexelCoverage || (rectPixels[3] >> mip) - (rectPixels[1] >> mip) >= hzbTexelCoverage)
+		{
+			++mip;
+		}
+		for (int& pixel : rectPixels)
+		{
+			pixel >>= mip;
+		}
+
+		const float texelSizeX = (float)(1u << mip) / m_Dimensions.x;
+		const float texelSizeY = (float)(1u << mip) / m_Dimensions.y;
+		float depth = FLT_MAX;
+		for (int y = 0; y < hzbTexelCoverage; ++y)
+		{
+			const float v = (Math::Min(rectPixels[1] + y, rectPixels[3]) + 0.5f) * texelSizeY;
+			for (int x = 0; x < hzbTexelCoverage; ++x)
+			{
+				const float u = (Math::Min(rectPixels[0] + x, rectPixels[2]) + 0.5f) * texelSizeX;
+				depth = Math::Min(depth, Sample(mip, u, v));
+			}
+		}
+
+		const bool isOccluded = depth > cullData.RectMax.z;
+		return !isOccluded;
+	}
+
+	Stats& Stats::operator+=(const Stats& rhs)
+	{
+		NumInstances += rhs.NumInstances;
+		NumInstancesCulled += rhs.NumInstancesCulled;
+		NumMeshlets += rhs.NumMeshlets;
+		NumFrustumCulled += rhs.NumFrustumCulled;
+		NumBackfaceCulled += rhs.NumBackfaceCulled;
+		NumLODCulled += rhs.NumLODCulled;
+		NumOccluded += rhs.NumOccluded;
+		NumVisible += rhs.NumVisible;
+		return *this;
+	}
+
+	void CullMeshlets(const SubMesh& mesh, uint32 lodIndex, const Matrix& localToWorld, const ViewTransform& view, const HZB* pHZB, Stats& stats, std::vector<uint32>* pOutVisibleMeshlets)
+	{
+		const bool useHZB = pHZB && pHZB->IsValid();
+		const bool useClusterLOD = lodIndex == ClusterHierarchyLOD;
+		const uint32 meshletStart = useClusterLOD ? 0 : mesh.LODs[lodIndex].MeshletStart;
+		const uint32 meshletEnd = useClusterLOD ? mesh.NumClusters : meshletStart + mesh.LODs[lodIndex].NumMeshlets;
+		const ClusterLOD::CutParams cutParams = ClusterLOD::CreateCutParams(view, Tweakables::g_LODErrorThreshold);
+
+		for (uint32 i = meshletStart; i < meshletEnd; ++i)
+		{
+			const ShaderInterop::Meshlet::Bounds& bounds = mesh.MeshletBounds[i];
+			++stats.NumMeshlets;
+
+			FrustumCullData cullData = FrustumCull(bounds.Center, bounds.Extents, localToWorld, view.ViewProjection);
+			if (!cullData.IsVisible)
+			{
+				++stats.NumFrustumCulled;
+			}
+			else if (IsBackfacing(bounds, localToWorld, view))
+			{
+				++stats.NumBackfaceCulled;
+			}
+			else if (useClusterLOD && !ClusterLOD::IsInCut(mesh.ClusterLODBounds[i], localToWorld, cutParams))
+			{
+				++stats.NumLODCulled;
+			}
+			else if (useHZB && !pHZB->IsVisible(cullData))
+			{
+				++stats.NumOccluded;
+			}
+			else
+			{
+				++stats.NumVisible;
+				if (pOutVisibleMeshlets)
+				{
+					pOutVisibleMeshlets->push_back(i);
+				}
+			}
+		}
+	}
+
+	Stats CullScene(const SceneView& view, const HZB* pHZB)
+	{
+		const bool useHZB = pHZB && pHZB->IsValid();
+		std::vector<Stats> batchStats(view.Batches.size());
+
+		TaskContext context;
+		TaskQueue::ExecuteMany([&](TaskDistributeArgs args)
+			{
+				const Batch& batch = view.Batches[args.JobIndex];
+				Stats& stats = batchStats[args.JobIndex];
+				stats.NumInstances = 1;
+
+				const SubMesh& mesh = *batch.pMesh;
+				FrustumCullData cullData = FrustumCull(mesh.Bounds.Center, mesh.Bounds.Extents, batch.WorldMatrix, view.View.ViewProjection);
+				if (!cullData.IsVisible || (useHZB && !pHZB->IsVisible(cullData)))
+				{
+					stats.NumInstancesCulled = 1;
+					return;
+				}
+				const uint32 lod = Tweakables::g_ClusterLOD && mesh.NumClusters > 0 ? ClusterHierarchyLOD : batch.LOD;
+				CullMeshlets(mesh, lod, batch.WorldMatrix, view.View, pHZB, stats);
+			}, context, (uint32)view.Batches.size(), 16);
+		TaskQueue::Join(context);
+
+		Stats stats;
+		for (const Stats& batch : batchStats)
+		{
+			stats += batch;
+		}
+		return stats;
+	}
+
+	void Benchmark(const SceneView& view, const HZB* pHZB, uint32 iterations)
+	{
+		using Clock = std::chrono::high_resolution_clock;
+
+		check(ValidateBackfaceCulling());
+
+		Stats stats;
+		const Clock::time_point start = Clock::now();
+		for (uint32 i = 0; i < iterations; ++i)
+		{
+			stats = CullScene(view, pHZB);
+		}
+		const float milliseconds = std::chrono::duration<float, std::milli>(Clock::now() - start).count() / Math::Max(iterations, 1u);
+
+		auto Percentage = [](uint64 count, uint64 total) { return 100.0f * count / Math::Max<uint64>(total, 1); };
+		E_LOG(Info, "Meshlet culling: %.3f ms (%d iterations)", milliseconds, iterations);
+		E_LOG(Info, "\tInstances: %llu, culled: %llu (%.1f%%)", stats.NumInstances, stats.NumInstancesCulled, Percentage(stats.NumInstancesCulled, stats.NumInstances));
+		E_LOG(Info, "\tMeshlets: %llu", stats.NumMeshlets);
+		E_LOG(Info, "\t\tFrustum culled: %llu (%.1f%%)", stats.NumFrustumCulled, Percentage(stats.NumFrustumCulled, stats.NumMeshlets));
+		E_LOG(Info, "\t\tBackface culled: %llu (%.1f%%)", stats.NumBackfaceCulled, Percentage(stats.NumBackfaceCulled, stats.NumMeshlets));
+		E_LOG(Info, "\t\tNot in cluster LOD cut: %llu (%.1f%%)", stats.NumLODCulled, Percentage(stats.NumLODCulled, stats.NumMeshlets));
+		E_LOG(Info, "\t\tOccluded: %llu (%.1f%%)%s", stats.NumOccluded, Percentage(stats.NumOccluded, stats.NumMeshlets), pHZB && pHZB->IsValid() ? "" : " (no HZB)");
+		E_LOG(Info, "\t\tVisible: %llu (%.1f%%)", stats.NumVisible, Percentage(stats.NumVisible, stats.NumMeshlets));
+	}
+}
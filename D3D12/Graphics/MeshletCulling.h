@@ -0,0 +1,78 @@
+#pragma once
+#include "ShaderInterop.h"
+
+struct SubMesh;
+struct SceneView;
+struct ViewTransform;
+
+/*
+	CPU reference of the meshlet culling done in MeshletCull.hlsl.
+	Mirrors the GPU tests (frustum, normal cone and HZB) so cull rates on real scenes
+	can be verified and benchmarked without running the GPU pipeline.
+*/
+namespace MeshletCulling
+{
+	struct FrustumCullData
+	{
+		bool IsVisible;
+		Vector3 RectMin;
+		Vector3 RectMax;
+	};
+
+	FrustumCullData FrustumCull(const Vector3& aabbCenter, const Vector3& aabbExtents, const Matrix& worldToClip);
+	FrustumCullData FrustumCull(const Vector3& aabbCenter, const Vector3& aabbExtents, const Matrix& localToWorld, const Matrix& worldToClip);
+
+	// Computes the culling bounds of a meshlet with triangles in the engine's clockwise winding.
+	// The normal cone is computed on the original counter clockwise glTF winding so its axis points out of the surface in object space.
+	void ComputeBounds(const uint32* pMeshletVertices, const uint8* pMeshletTriangles, uint32 triangleCount, const Vector3* pPositions, uint32 numPositions, ShaderInterop::Meshlet::Bounds& outBounds);
+
+	// Returns true when all triangles of the meshlet face away from the view
+	bool IsBackfacing(const ShaderInterop::Meshlet::Bounds& bounds, const Matrix& localToWorld, const ViewTransform& view);
+
+	// Culls a quad and a curved sphere cap from many views, with and without the Z mirror of the glTF import transform.
+	// Returns false when a front facing meshlet is culled or a back facing one isn't.
+	bool ValidateBackfaceCulling();
+
+	// Min-depth hierarchy built the same way as HZB.hlsl. Depth is reversed Z.
+	class HZB
+	{
+	public:
+		void Build(const float* pDepth, uint32 width, uint32 height);
+		bool IsValid() const { return !m_Mips.empty(); }
+
+		// Returns false when the screen rect is fully behind the HZB
+		bool IsVisible(const FrustumCullData& cullData) const;
+
+	private:
+		float Sample(uint32 mip, float u, float v) const;
+
+		Vector2u m_Dimensions;
+		std::vector<std::vector<float>> m_Mips;
+	};
+
+	struct Stats
+	{
+		uint64 NumInstances = 0;
+		uint64 NumInstancesCulled = 0;
+		uint64 NumMeshlets = 0;
+		uint64 NumFrustumCulled = 0;
+		uint64 NumBackfaceCulled = 0;
+		uint64 NumLODCulled = 0;
+		uint64 NumOccluded = 0;
+		uint64 NumVisible = 0;
+
+		Stats& operator+=(const Stats& rhs);
+	};
+
+	// Pass as LOD to cull the clusters of the cluster hierarchy instead, rejecting the ones outside of the LOD cut
+	constexpr uint32 ClusterHierarchyLOD = ~0u;
+
+	// Culls the meshlets of one LOD of an instance. Optionally returns the indices of the visible meshlets.
+	void CullMeshlets(const SubMesh& mesh, uint32 lodIndex, const Matrix& localToWorld, const ViewTransform& view, const HZB* pHZB, Stats& stats, std::vector<uint32>* pOutVisibleMeshlets = nullptr);
+
+	// Culls all batches of the view, first per instance and then per meshlet
+	Stats CullScene(const SceneView& view, const HZB* pHZB = nullptr);
+
+	// Times CullScene on the current view and logs the cull rates
+	void Benchmark(const SceneView& view, const HZB* pHZB = nullptr, uint32 iterations = 10);
+}
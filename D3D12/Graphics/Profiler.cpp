@@ -149,6 +149,24 @@ void Profiler::End()
 	m_pCurrentBlock = m_pCurrentBlock->pParent;
 }
 
+void Profiler::SetCounter(const char* pName, uint64 value)
+{
+	StringHash hash(pName);
+	auto it = m_CounterMap.find(hash);
+	ProfileCounter* pCounter = nullptr;
+	if (it != m_CounterMap.end())
+	{
+		pCounter = it->second;
+	}
+	else
+	{
+		pCounter = m_Counters.emplace_back(std::make_unique<ProfileCounter>(pName)).get();
+		m_CounterMap[hash] = pCounter;
+	}
+	pCounter->Value = value;
+	pCounter->History.AddTime((float)value);
+}
+
 void Profiler::Resolve(CommandContext* pContext)
 {
 	checkf(m_pCurrentBlock == m_pRootBlock.get(), "The current block isn't the root block then something must've gone wrong!");
@@ -190,6 +208,34 @@ void Profiler::DrawImGui()
 
 		ImGui::EndTable();
 	}
+
+	if (!m_Counters.empty() && ImGui::BeginTable("Counters", 3, ImGuiTableFlags_SizingStretchProp | ImGuiTableFlags_Resizable))
+	{
+		ImGui::TableSetupColumn("Counter", ImGuiTableColumnFlags_None, 5);
+		ImGui::TableSetupColumn("History", ImGuiTableColumnFlags_None, 12);
+		ImGui::TableSetupColumn("Value", ImGuiTableColumnFlags_None, 2);
+		ImGui::TableHeadersRow();
+
+		for (const std::unique_ptr<ProfileCounter>& pCounter : m_Counters)
+		{
+			ImGui::PushID(pCounter.get());
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn();
+			ImGui::Bullet();
+			ImGui::Selectable(pCounter->pName);
+
+			ImGui::TableNextColumn();
+			const float* pData;
+			uint32 offset, count;
+			pCounter->History.GetHistory(&pData, &count, &offset);
+			ImGui::PlotLines("", pData, count, offset, 0, 0.0f, FLT_MAX, ImVec2(ImGui::GetColumnWidth(), 0));
+
+			ImGui::TableNextColumn();
+			ImGui::Text("%llu", pCounter->Value);
+			ImGui::PopID();
+		}
+		ImGui::EndTable();
+	}
 	ImGui::Separator();
 }
 
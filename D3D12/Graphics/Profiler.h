@@ -15,6 +15,8 @@ class GraphicsDevice;
 
 #define GPU_PROFILE_SCOPE(name, cmdlist) ScopeProfiler MACRO_CONCAT(profiler,__COUNTER__)(name, cmdlist, true)
 #define PROFILE_SCOPE(name) ScopeProfiler MACRO_CONCAT(profiler,__COUNTER__)(name, nullptr, true)
+
+#define PROFILE_COUNTER(name, value) Profiler::Get()->SetCounter(name, value)
 #else
 #define GPU_PROFILE_BEGIN(name, cmdlist)
 #define GPU_PROFILE_END()
@@ -25,6 +27,8 @@ class GraphicsDevice;
 #define GPU_PROFILE_SCOPE(name, cmdlist)
 #define GPU_PROFILE_SCOPE_CONDITIONAL(name, cmdlist, condition)
 #define PROFILE_SCOPE(name)
+
+#define PROFILE_COUNTER(name, value)
 #endif
 
 template<typename T, uint32 SIZE>
@@ -89,6 +93,18 @@ struct ProfileNode
 	std::unordered_map<StringHash, ProfileNode*> Map;
 };
 
+struct ProfileCounter
+{
+	ProfileCounter(const char* pInName)
+	{
+		strcpy_s(pName, pInName);
+	}
+
+	uint64 Value = 0;
+	TimeHistory<float, 128> History;
+	char pName[128];
+};
+
 class Profiler
 {
 public:
@@ -104,6 +120,9 @@ public:
 	void Begin(const char* pName, CommandContext* pContext = nullptr);
 	void End();
 
+	// Records a per-frame value, shown with its history below the timings
+	void SetCounter(const char* pName, uint64 value);
+
 	void Resolve(CommandContext* pContext);
 
 	int32 GetNextTimerIndex();
@@ -127,6 +146,9 @@ private:
 	std::unique_ptr<ProfileNode> m_pRootBlock;
 	ProfileNode* m_pCurrentBlock = nullptr;
 	ProfileNode* m_pPreviousBlock = nullptr;
+
+	std::vector<std::unique_ptr<ProfileCounter>> m_Counters;
+	std::unordered_map<StringHash, ProfileCounter*> m_CounterMap;
 };
 
 struct ScopeProfiler
@@ -6,6 +6,7 @@
 #include "GraphicsResource.h"
 #include "RootSignature.h"
 #include "PipelineState.h"
+#include "PipelineStateCache.h"
 #include "Shader.h"
 #include "DynamicResourceAllocator.h"
 #include "Texture.h"
@@ -427,11 +428,14 @@ GraphicsDevice::GraphicsDevice(GraphicsDeviceOptions options)
 	E_LOG(Info, "Shader Model %d.%d", smMaj, smMin);
 	m_pShaderManager = std::make_unique<ShaderManager>(smMaj, smMin);
 	m_pShaderManager->AddIncludeDir("Resources/Shaders/");
+
+	m_pPipelineStateCache = std::make_unique<PipelineStateCache>(this);
 }
 
 GraphicsDevice::~GraphicsDevice()
 {
 	IdleGPU();
+	m_pPipelineStateCache.reset();
 }
 
 CommandQueue* GraphicsDevice::GetCommandQueue(D3D12_COMMAND_LIST_TYPE type) const
@@ -812,9 +816,7 @@ RefCountPtr<PipelineState> GraphicsDevice::CreateComputePipeline(RootSignature*
 
 RefCountPtr<PipelineState> GraphicsDevice::CreatePipeline(const PipelineStateInitializer& psoDesc)
 {
-	PipelineState* pPipeline = new PipelineState(this);
-	pPipeline->Create(psoDesc);
-	return pPipeline;
+	return m_pPipelineStateCache->GetOrCreate(psoDesc);
 }
 
 RefCountPtr<StateObject> GraphicsDevice::CreateStateObject(const StateObjectInitializer& stateDesc)
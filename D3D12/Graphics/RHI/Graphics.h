@@ -17,6 +17,7 @@ class PipelineState;
 class Buffer;
 class ShaderManager;
 class PipelineStateInitializer;
+class PipelineStateCache;
 class StateObject;
 class StateObjectInitializer;
 class GPUDescriptorHeap;
@@ -179,6 +180,7 @@ public:
 	ID3D12Device* GetDevice() const { return m_pDevice.Get(); }
 	ID3D12Device5* GetRaytracingDevice() const { return m_pRaytracingDevice.Get(); }
 	ShaderManager* GetShaderManager() const { return m_pShaderManager.get(); }
+	PipelineStateCache* GetPipelineStateCache() const { return m_pPipelineStateCache.get(); }
 	const GraphicsCapabilities& GetCapabilities() const { return m_Capabilities; }
 	Fence* GetFrameFence() const { return m_pFrameFence; }
 	IDXGIFactory6* GetFactory() const { return m_pFactory; }
@@ -247,4 +249,6 @@ private:
 	std::vector<RefCountPtr<GraphicsObject>> m_GlobalResources;
 
 	std::mutex m_ContextAllocationMutex;
+
+	std::unique_ptr<PipelineStateCache> m_pPipelineStateCache;
 };
@@ -3,6 +3,7 @@
 #include "Shader.h"
 #include "Graphics.h"
 #include "RootSignature.h"
+#include "PipelineStateCache.h"
 
 PipelineStateInitializer::PipelineStateInitializer()
 {
@@ -218,6 +219,7 @@ void PipelineStateInitializer::SetPrimitiveTopology(D3D12_PRIMITIVE_TOPOLOGY_TYP
 void PipelineStateInitializer::SetRootSignature(RootSignature* pRootSignature)
 {
 	GetSubobject<D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_ROOT_SIGNATURE>() = pRootSignature->GetRootSignature();
+	m_RootSignatureHash = pRootSignature->GetHash();
 }
 
 void PipelineStateInitializer::SetVertexShader(const char* pShaderPath, const char* entryPoint, const Span<ShaderDefine>& defines)
@@ -302,6 +304,93 @@ D3D12_PIPELINE_STATE_STREAM_DESC PipelineStateInitializer::GetDesc(GraphicsDevic
 	return streamDesc;
 }
 
+uint64 PipelineStateInitializer::GetHash() const
+{
+	uint64 hash = Utils::HashValue(m_Type);
+
+	// Hash state by value, field by field for structs with padding, so the hash only depends on the actual state.
+	// Subobjects are visited in type order, the order in which they were set doesn't matter.
+	auto HashPOD = [&](auto* pValue) {
+		if (pValue)
+		{
+			hash = Utils::HashValue(*pValue, hash);
+		}
+	};
+
+	hash = Utils::HashValue(m_RootSignatureHash, hash);
+
+	for (uint32 i = 0; i < (int)ShaderType::MAX; ++i)
+	{
+		const Shader* pShader = m_Shaders[i];
+		checkf(pShader || m_ShaderDescs[i].Path.empty(), "Shaders need to be resolved with GetDesc before hashing");
+		hash = Utils::HashValue(pShader ? pShader->ByteCodeHash : 0ull, hash);
+	}
+
+	if (const D3D12_INPUT_LAYOUT_DESC* pIlDesc = FindSubobject<D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_INPUT_LAYOUT>())
+	{
+		hash = Utils::HashValue(pIlDesc->NumElements, hash);
+		for (const D3D12_INPUT_ELEMENT_DESC& element : m_IlDesc)
+		{
+			hash = Utils::HashBytes(element.SemanticName, strlen(element.SemanticName), hash);
+			hash = Utils::HashValue(element.SemanticIndex, hash);
+			hash = Utils::HashValue(element.Format, hash);
+			hash = Utils::HashValue(element.InputSlot, hash);
+			hash = Utils::HashValue(element.AlignedByteOffset, hash);
+			hash = Utils::HashValue(element.InputSlotClass, hash);
+			hash = Utils::HashValue(element.InstanceDataStepRate, hash);
+		}
+	}
+
+	if (const D3D12_BLEND_DESC* pBlend = FindSubobject<D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_BLEND>())
+	{
+		hash = Utils::HashValue(pBlend->AlphaToCoverageEnable, hash);
+		hash = Utils::HashValue(pBlend->IndependentBlendEnable, hash);
+		for (const D3D12_RENDER_TARGET_BLEND_DESC& rt : pBlend->RenderTarget)
+		{
+			hash = Utils::HashValue(rt.BlendEnable, hash);
+			hash = Utils::HashValue(rt.LogicOpEnable, hash);
+			hash = Utils::HashValue(rt.SrcBlend, hash);
+			hash = Utils::HashValue(rt.DestBlend, hash);
+			hash = Utils::HashValue(rt.BlendOp, hash);
+			hash = Utils::HashValue(rt.SrcBlendAlpha, hash);
+			hash = Utils::HashValue(rt.DestBlendAlpha, hash);
+			hash = Utils::HashValue(rt.BlendOpAlpha, hash);
+			hash = Utils::HashValue(rt.LogicOp, hash);
+			hash = Utils::HashValue(rt.RenderTargetWriteMask, hash);
+		}
+	}
+
+	if (const D3D12_DEPTH_STENCIL_DESC1* pDepthStencil = FindSubobject<D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_DEPTH_STENCIL1>())
+	{
+		hash = Utils::HashValue(pDepthStencil->DepthEnable, hash);
+		hash = Utils::HashValue(pDepthStencil->DepthWriteMask, hash);
+		hash = Utils::HashValue(pDepthStencil->DepthFunc, hash);
+		hash = Utils::HashValue(pDepthStencil->StencilEnable, hash);
+		hash = Utils::HashValue(pDepthStencil->StencilReadMask, hash);
+		hash = Utils::HashValue(pDepthStencil->StencilWriteMask, hash);
+		hash = Utils::HashValue(pDepthStencil->FrontFace, hash);
+		hash = Utils::HashValue(pDepthStencil->BackFace, hash);
+		hash = Utils::HashValue(pDepthStencil->DepthBoundsTestEnable, hash);
+	}
+
+	HashPOD(FindSubobject<D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_FLAGS>());
+	HashPOD(FindSubobject<D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_NODE_MASK>());
+	HashPOD(FindSubobject<D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_IB_STRIP_CUT_VALUE>());
+	HashPOD(FindSubobject<D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_PRIMITIVE_TOPOLOGY>());
+	HashPOD(FindSubobject<D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_DEPTH_STENCIL_FORMAT>());
+	HashPOD(FindSubobject<D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_RASTERIZER>());
+	HashPOD(FindSubobject<D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_SAMPLE_DESC>());
+	HashPOD(FindSubobject<D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_SAMPLE_MASK>());
+
+	if (const D3D12_RT_FORMAT_ARRAY* pFormats = FindSubobject<D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_RENDER_TARGET_FORMATS>())
+	{
+		hash = Utils::HashValue(pFormats->NumRenderTargets, hash);
+		hash = Utils::HashBytes(pFormats->RTFormats, sizeof(DXGI_FORMAT) * pFormats->NumRenderTargets, hash);
+	}
+
+	return hash;
+}
+
 PipelineState::PipelineState(GraphicsDevice* pParent)
 	: GraphicsObject(pParent)
 {
@@ -329,7 +418,11 @@ void PipelineState::Create(const PipelineStateInitializer& initializer)
 	}
 
 	D3D12_PIPELINE_STATE_STREAM_DESC streamDesc = m_Desc.GetDesc(GetParent());
-	VERIFY_HR_EX(pDevice2->CreatePipelineState(&streamDesc, IID_PPV_ARGS(m_pPipelineState.ReleaseAndGetAddressOf())), GetParent()->GetDevice());
+	m_Hash = m_Desc.GetHash();
+	if (!GetParent()->GetPipelineStateCache()->LoadPipeline(m_Hash, streamDesc, m_pPipelineState.ReleaseAndGetAddressOf()))
+	{
+		VERIFY_HR_EX(pDevice2->CreatePipelineState(&streamDesc, IID_PPV_ARGS(m_pPipelineState.ReleaseAndGetAddressOf())), GetParent()->GetDevice());
+	}
 	D3D::SetObjectName(m_pPipelineState.Get(), m_Desc.m_Name.c_str());
 }
 
@@ -118,7 +118,31 @@ public:
 
 	D3D12_PIPELINE_STATE_STREAM_DESC GetDesc(GraphicsDevice* pDevice);
 
+	// Canonical hash of the pipeline state. States are hashed by value and shaders by their bytecode,
+	// so it is stable across runs. Shaders are resolved in GetDesc so it must be called first.
+	uint64 GetHash() const;
+
+	const char* GetName() const { return m_Name.c_str(); }
+
 private:
+	template<D3D12_PIPELINE_STATE_SUBOBJECT_TYPE ObjectType>
+	const typename CD3DX12_PIPELINE_STATE_SUBOJECT_TYPE_TRAITS<ObjectType>::Type* FindSubobject() const
+	{
+		using InnerType = typename CD3DX12_PIPELINE_STATE_SUBOJECT_TYPE_TRAITS<ObjectType>::Type;
+		struct SubobjectType
+		{
+			D3D12_PIPELINE_STATE_SUBOBJECT_TYPE ObjType;
+			InnerType ObjectData;
+		};
+		int offset = m_pSubobjectLocations[ObjectType];
+		if (offset < 0)
+		{
+			return nullptr;
+		}
+		const SubobjectType* pObj = (const SubobjectType*)&m_pSubobjectData[offset];
+		return &pObj->ObjectData;
+	}
+
 	template<D3D12_PIPELINE_STATE_SUBOBJECT_TYPE ObjectType>
 	typename CD3DX12_PIPELINE_STATE_SUBOJECT_TYPE_TRAITS<ObjectType>::Type& GetSubobject()
 	{
@@ -143,6 +167,7 @@ private:
 	}
 
 	std::string m_Name;
+	uint64 m_RootSignatureHash = 0;
 	std::vector<D3D12_INPUT_ELEMENT_DESC> m_IlDesc;
 	PipelineStateType m_Type = PipelineStateType::MAX;
 	std::array<Shader*, (int)ShaderType::MAX> m_Shaders{};
@@ -165,10 +190,13 @@ public:
 	void Create(const PipelineStateInitializer& initializer);
 	void ConditionallyReload();
 	PipelineStateType GetType() const { return m_Desc.m_Type; }
+	uint64 GetHash() const { return m_Hash; }
+	const char* GetName() const { return m_Desc.GetName(); }
 
 private:
 	void OnShaderReloaded(Shader* pOldShader, Shader* pNewShader);
 	RefCountPtr<ID3D12PipelineState> m_pPipelineState;
+	uint64 m_Hash = 0;
 
 	PipelineStateInitializer m_Desc;
 	DelegateHandle m_ReloadHandle;
@@ -0,0 +1,196 @@
+#include "stdafx.h"
+#include "PipelineStateCache.h"
+#include "PipelineState.h"
+#include "Graphics.h"
+#include "Core/Paths.h"
+#include "Core/CommandLine.h"
+
+static void GetLibraryKey(uint64 hash, wchar_t(&outKey)[17])
+{
+	swprintf_s(outKey, L"%016llx", hash);
+}
+
+PipelineStateCache::PipelineStateCache(GraphicsDevice* pDevice)
+	: m_pDevice(pDevice)
+{
+	if (CommandLine::GetBool("nopsolibrary"))
+	{
+		return;
+	}
+
+	D3D12_FEATURE_DATA_SHADER_CACHE shaderCache{};
+	if (FAILED(pDevice->GetDevice()->CheckFeatureSupport(D3D12_FEATURE_SHADER_CACHE, &shaderCache, sizeof(shaderCache))) ||
+		!EnumHasAnyFlags(shaderCache.SupportFlags, D3D12_SHADER_CACHE_SUPPORT_LIBRARY))
+	{
+		E_LOG(Warning, "Pipeline libraries are not supported");
+		return;
+	}
+
+	RefCountPtr<ID3D12Device1> pDevice1;
+	if (FAILED(pDevice->GetDevice()->QueryInterface(IID_PPV_ARGS(pDevice1.GetAddressOf()))))
+	{
+		return;
+	}
+
+	// The manifest holds the keys of all pipelines in the library.
+	// Loading a key that doesn't exist is an error, so only keys in the manifest are looked up.
+	std::ifstream manifest(GetManifestPath());
+	std::ifstream library(GetLibraryPath(), std::ios::binary | std::ios::ate);
+	if (manifest.is_open() && library.is_open())
+	{
+		m_LibraryData.resize((size_t)library.tellg());
+		library.seekg(0);
+		library.read(m_LibraryData.data(), m_LibraryData.size());
+
+		std::string line;
+		while (std::getline(manifest, line))
+		{
+			uint64 key = 0;
+			if (sscanf_s(line.c_str(), "%llx", &key) == 1)
+			{
+				m_LibraryKeys.insert(key);
+			}
+		}
+	}
+
+	// The library data must stay alive for as long as the library is in use.
+	HRESULT hr = m_LibraryData.empty() ? E_FAIL : pDevice1->CreatePipelineLibrary(m_LibraryData.data(), m_LibraryData.size(), IID_PPV_ARGS(m_pLibrary.GetAddressOf()));
+	if (FAILED(hr))
+	{
+		if (!m_LibraryData.empty())
+		{
+			// The driver or adapter changed, the library is stale.
+			E_LOG(Warning, "Pipeline library '%s' could not be loaded, pipelines will be recompiled", GetLibraryPath().c_str());
+		}
+		m_LibraryData.clear();
+		m_LibraryKeys.clear();
+		VERIFY_HR_EX(pDevice1->CreatePipelineLibrary(nullptr, 0, IID_PPV_ARGS(m_pLibrary.ReleaseAndGetAddressOf())), pDevice->GetDevice());
+	}
+	else
+	{
+		E_LOG(Info, "Loaded pipeline library with %d pipelines", (uint32)m_LibraryKeys.size());
+	}
+}
+
+PipelineStateCache::~PipelineStateCache()
+{
+	Save();
+	E_LOG(Info, "Pipeline cache: %d hits, %d misses. Pipeline library: %d hits, %d misses",
+		m_Stats.Hits, m_Stats.Misses, m_Stats.LibraryHits, m_Stats.LibraryMisses);
+}
+
+RefCountPtr<PipelineState> PipelineStateCache::GetOrCreate(const PipelineStateInitializer& initializer)
+{
+	// Resolve the shaders on a copy to compute the hash
+	PipelineStateInitializer desc = initializer;
+	desc.GetDesc(m_pDevice);
+	uint64 hash = desc.GetHash();
+
+	{
+		std::scoped_lock lock(m_CacheMutex);
+		auto it = m_Pipelines.find(hash);
+		// A pipeline that was reloaded since is keyed by a hash it no longer has
+		if (it != m_Pipelines.end() && it->second->GetHash() == hash)
+		{
+			++m_Stats.Hits;
+			return it->second;
+		}
+	}
+
+	// Create outside the lock, compilation can take a while
+	RefCountPtr<PipelineState> pPipeline = new PipelineState(m_pDevice);
+	pPipeline->Create(initializer);
+
+	std::scoped_lock lock(m_CacheMutex);
+	++m_Stats.Misses;
+	RefCountPtr<PipelineState>& pEntry = m_Pipelines[pPipeline->GetHash()];
+	if (!pEntry || pEntry->GetHash() != pPipeline->GetHash())
+	{
+		pEntry = pPipeline;
+	}
+	return pEntry;
+}
+
+bool PipelineStateCache::LoadPipeline(uint64 hash, const D3D12_PIPELINE_STATE_STREAM_DESC& desc, ID3D12PipelineState** ppPipelineState)
+{
+	if (!m_pLibrary)
+	{
+		return false;
+	}
+
+	std::scoped_lock lock(m_CacheMutex);
+	if (m_LibraryKeys.find(hash) != m_LibraryKeys.end())
+	{
+		wchar_t key[17];
+		GetLibraryKey(hash, key);
+		if (SUCCEEDED(m_pLibrary->LoadPipeline(key, &desc, IID_PPV_ARGS(ppPipelineState))))
+		{
+			++m_Stats.LibraryHits;
+			return true;
+		}
+	}
+	++m_Stats.LibraryMisses;
+	return false;
+}
+
+void PipelineStateCache::Save()
+{
+	if (!m_pLibrary)
+	{
+		return;
+	}
+
+	std::scoped_lock lock(m_CacheMutex);
+
+	// Write a new library with only the pipelines in use so stale pipelines don't accumulate
+	RefCountPtr<ID3D12Device1> pDevice1;
+	VERIFY_HR(m_pDevice->GetDevice()->QueryInterface(IID_PPV_ARGS(pDevice1.GetAddressOf())));
+	RefCountPtr<ID3D12PipelineLibrary1> pLibrary;
+	VERIFY_HR_EX(pDevice1->CreatePipelineLibrary(nullptr, 0, IID_PPV_ARGS(pLibrary.GetAddressOf())), m_pDevice->GetDevice());
+
+	std::unordered_set<uint64> keys;
+	std::string manifest;
+	for (auto& entry : m_Pipelines)
+	{
+		const PipelineState* pPipeline = entry.second;
+		if (!pPipeline->GetPipelineState() || !keys.insert(pPipeline->GetHash()).second)
+		{
+			continue;
+		}
+
+		wchar_t key[17];
+		GetLibraryKey(pPipeline->GetHash(), key);
+		if (SUCCEEDED(pLibrary->StorePipeline(key, pPipeline->GetPipelineState())))
+		{
+			manifest += Sprintf("%016llx %s\n", pPipeline->GetHash(), pPipeline->GetName());
+		}
+		else
+		{
+			E_LOG(Warning, "Failed to store pipeline '%s' in pipeline library", pPipeline->GetName());
+		}
+	}
+
+	std::vector<char> data(pLibrary->GetSerializedSize());
+	if (FAILED(pLibrary->Serialize(data.data(), data.size())))
+	{
+		E_LOG(Warning, "Failed to serialize pipeline library");
+		return;
+	}
+
+	Paths::CreateDirectoryTree(Paths::ShaderCacheDir());
+	std::ofstream libraryStream(GetLibraryPath(), std::ios::binary);
+	libraryStream.write(data.data(), data.size());
+	std::ofstream manifestStream(GetManifestPath());
+	manifestStream << manifest;
+	E_LOG(Info, "Saved pipeline library with %d pipelines (%s)", (uint32)keys.size(), Math::PrettyPrintDataSize(data.size()).c_str());
+}
+
+std::string PipelineStateCache::GetLibraryPath()
+{
+	return Paths::ShaderCacheDir() + "PipelineLibrary.bin";
+}
+
+std::string PipelineStateCache::GetManifestPath()
+{
+	return Paths::ShaderCacheDir() + "PipelineLibrary.txt";
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+class GraphicsDevice;
+class PipelineState;
+class PipelineStateInitializer;
+
+/*
+	Deduplicates pipeline states by the canonical hash of their initializer.
+	Identical requests share the same PipelineState object.
+	Pipelines are persisted in a D3D12 pipeline library together with a manifest of their keys,
+	so the next launch can load them from the driver cache instead of compiling them.
+*/
+class PipelineStateCache
+{
+public:
+	struct Stats
+	{
+		uint32 Hits = 0;
+		uint32 Misses = 0;
+		uint32 LibraryHits = 0;
+		uint32 LibraryMisses = 0;
+	};
+
+	PipelineStateCache(GraphicsDevice* pDevice);
+	~PipelineStateCache();
+
+	RefCountPtr<PipelineState> GetOrCreate(const PipelineStateInitializer& initializer);
+
+	// Loads a pipeline from the persistent library if it was stored by a previous run
+	bool LoadPipeline(uint64 hash, const D3D12_PIPELINE_STATE_STREAM_DESC& desc, ID3D12PipelineState** ppPipelineState);
+
+	void Save();
+
+	const Stats& GetStats() const { return m_Stats; }
+
+private:
+	static std::string GetLibraryPath();
+	static std::string GetManifestPath();
+
+	GraphicsDevice* m_pDevice;
+
+	std::mutex m_CacheMutex;
+	std::unordered_map<uint64, RefCountPtr<PipelineState>> m_Pipelines;
+
+	RefCountPtr<ID3D12PipelineLibrary1> m_pLibrary;
+	std::vector<char> m_LibraryData;
+	std::unordered_set<uint64> m_LibraryKeys;
+
+	Stats m_Stats;
+};
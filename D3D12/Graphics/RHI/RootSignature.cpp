@@ -177,6 +177,7 @@ void RootSignature::Finalize(const char* pName, D3D12_ROOT_SIGNATURE_FLAGS flags
 		E_LOG(Error, "RootSignature serialization error: %s", pError);
 		return;
 	}
+	m_Hash = Utils::HashBytes(pDataBlob->GetBufferPointer(), pDataBlob->GetBufferSize());
 	VERIFY_HR_EX(GetParent()->GetDevice()->CreateRootSignature(0, pDataBlob->GetBufferPointer(), pDataBlob->GetBufferSize(), IID_PPV_ARGS(m_pRootSignature.ReleaseAndGetAddressOf())), GetParent()->GetDevice());
 	D3D::SetObjectName(m_pRootSignature.Get(), pName);
 }
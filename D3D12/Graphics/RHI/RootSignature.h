@@ -37,6 +37,7 @@ public:
 	void Finalize(const char* pName, D3D12_ROOT_SIGNATURE_FLAGS flags = D3D12_ROOT_SIGNATURE_FLAG_NONE);
 
 	ID3D12RootSignature* GetRootSignature() const { return m_pRootSignature.Get(); }
+	uint64 GetHash() const { return m_Hash; }
 
 	const RootSignatureMask& GetSamplerTableMask() const { return m_SamplerMask; }
 	const RootSignatureMask& GetDescriptorTableMask() const { return m_DescriptorTableMask; }
@@ -73,4 +74,5 @@ private:
 	uint32 m_NumParameters;
 	uint32 m_BindlessViewsIndex;
 	uint32 m_BindlessSamplersIndex;
+	uint64 m_Hash = 0;
 };
@@ -3,6 +3,7 @@
 #include "Core/Paths.h"
 #include "Core/CommandLine.h"
 #include "Core/FileWatcher.h"
+#include "Core/TaskQueue.h"
 #include "dxc/dxcapi.h"
 #include "dxc/d3d12shader.h"
 #include "D3D.h"
@@ -12,10 +13,13 @@ namespace ShaderCompiler
 	constexpr const char* pCompilerPath = "dxcompiler.dll";
 	constexpr const char* pShaderSymbolsPath = "Saved/ShaderSymbols/";
 
-	static RefCountPtr<IDxcUtils> pUtils;
-	static RefCountPtr<IDxcCompiler3> pCompiler3;
-	static RefCountPtr<IDxcValidator> pValidator;
-	static RefCountPtr<IDxcIncludeHandler> pDefaultIncludeHandler;
+	// DXC instances are not thread-safe. Each thread that compiles gets its own set.
+	static thread_local RefCountPtr<IDxcUtils> pUtils;
+	static thread_local RefCountPtr<IDxcCompiler3> pCompiler3;
+	static thread_local RefCountPtr<IDxcValidator> pValidator;
+	static thread_local RefCountPtr<IDxcIncludeHandler> pDefaultIncludeHandler;
+
+	FN_PROC(DxcCreateInstance);
 
 	struct CompileJob
 	{
@@ -52,17 +56,23 @@ namespace ShaderCompiler
 		}
 	}
 
-	void LoadDXC()
+	void CreateThreadInstances()
 	{
-		FN_PROC(DxcCreateInstance);
+		if (!pCompiler3)
+		{
+			VERIFY_HR(DxcCreateInstanceFn(CLSID_DxcUtils, IID_PPV_ARGS(pUtils.GetAddressOf())));
+			VERIFY_HR(DxcCreateInstanceFn(CLSID_DxcCompiler, IID_PPV_ARGS(pCompiler3.GetAddressOf())));
+			VERIFY_HR(DxcCreateInstanceFn(CLSID_DxcValidator, IID_PPV_ARGS(pValidator.GetAddressOf())));
+			VERIFY_HR(pUtils->CreateDefaultIncludeHandler(pDefaultIncludeHandler.GetAddressOf()));
+		}
+	}
 
+	void LoadDXC()
+	{
 		HMODULE lib = LoadLibraryA(pCompilerPath);
 		DxcCreateInstanceFn.Load(lib);
 
-		VERIFY_HR(DxcCreateInstanceFn(CLSID_DxcUtils, IID_PPV_ARGS(pUtils.GetAddressOf())));
-		VERIFY_HR(DxcCreateInstanceFn(CLSID_DxcCompiler, IID_PPV_ARGS(pCompiler3.GetAddressOf())));
-		VERIFY_HR(DxcCreateInstanceFn(CLSID_DxcValidator, IID_PPV_ARGS(pValidator.GetAddressOf())));
-		VERIFY_HR(pUtils->CreateDefaultIncludeHandler(pDefaultIncludeHandler.GetAddressOf()));
+		CreateThreadInstances();
 		E_LOG(Info, "Loaded %s", pCompilerPath);
 	}
 
@@ -85,6 +95,8 @@ namespace ShaderCompiler
 
 	CompileResult Compile(const CompileJob& compileJob)
 	{
+		CreateThreadInstances();
+
 		CompileResult result;
 
 		RefCountPtr<IDxcBlobEncoding> pSource;
@@ -414,49 +426,100 @@ ShaderManager::ShaderStringHash ShaderManager::GetEntryPointHash(const char* pEn
 	return hash;
 }
 
-void ShaderManager::RecompileFromFileChange(const std::string& filePath)
+void ShaderManager::RecompileFromFileChanges(const std::vector<std::string>& filePaths)
 {
-	auto it = m_IncludeDependencyMap.find(ShaderStringHash(filePath));
-	if (it != m_IncludeDependencyMap.end())
+	// Gather the files depending on any of the changes, so a file that includes multiple changed files compiles only once
+	std::unordered_set<std::string> dependencies;
+	for (const std::string& filePath : filePaths)
 	{
-		E_LOG(Info, "Modified \"%s\". Recompiling dependencies...", filePath.c_str());
-		const std::unordered_set<std::string>& dependencies = it->second;
-		for (const std::string& dependency : dependencies)
+		auto it = m_IncludeDependencyMap.find(ShaderStringHash(filePath));
+		if (it != m_IncludeDependencyMap.end())
 		{
-			auto objectMapIt = m_FilepathToObjectMap.find(ShaderStringHash(dependency));
-			if (objectMapIt != m_FilepathToObjectMap.end())
+			E_LOG(Info, "Modified \"%s\". Recompiling dependencies...", filePath.c_str());
+			dependencies.insert(it->second.begin(), it->second.end());
+		}
+	}
+
+	struct ReloadJob
+	{
+		std::string Path;
+		Shader* pOldShader = nullptr;
+		ShaderLibrary* pOldLibrary = nullptr;
+		Shader* pNewShader = nullptr;
+		ShaderLibrary* pNewLibrary = nullptr;
+	};
+
+	std::vector<ReloadJob> jobs;
+	for (const std::string& dependency : dependencies)
+	{
+		auto objectMapIt = m_FilepathToObjectMap.find(ShaderStringHash(dependency));
+		if (objectMapIt != m_FilepathToObjectMap.end())
+		{
+			for (auto shader : objectMapIt->second.Shaders)
 			{
-				ShadersInFileMap objectMap = objectMapIt->second;
-				for (auto shader : objectMap.Shaders)
-				{
-					Shader* pOldShader = shader.second;
-					Shader* pNewShader = GetShader(dependency.c_str(), pOldShader->Type, pOldShader->EntryPoint.c_str(), pOldShader->Defines, true);
-					if (pNewShader)
-					{
-						E_LOG(Info, "Reloaded shader: \"%s - %s\"", dependency.c_str(), pNewShader->EntryPoint.c_str());
-						m_OnShaderRecompiledEvent.Broadcast(pOldShader, pNewShader);
-						m_Shaders.remove_if([pOldShader](const std::unique_ptr<Shader>& pS) { return pS.get() == pOldShader; });
-					}
-					else
-					{
-						E_LOG(Warning, "Failed to reload shader: \"%s\"", dependency.c_str());
-					}
-				}
-				for (auto library : objectMap.Libraries)
-				{
-					ShaderLibrary* pOldLibrary = library.second;
-					ShaderLibrary* pNewLibrary = GetLibrary(dependency.c_str(), pOldLibrary->Defines, true);
-					if (pNewLibrary)
-					{
-						E_LOG(Info, "Reloaded library: \"%s\"", dependency.c_str());
-						m_OnLibraryRecompiledEvent.Broadcast(pOldLibrary, pNewLibrary);
-						m_Libraries.remove_if([pOldLibrary](const std::unique_ptr<ShaderLibrary>& pS) { return pS.get() == pOldLibrary; });
-					}
-					else
-					{
-						E_LOG(Warning, "Failed to reload library: \"%s\"", dependency.c_str());
-					}
-				}
+				ReloadJob& job = jobs.emplace_back();
+				job.Path = dependency;
+				job.pOldShader = shader.second;
+			}
+			for (auto library : objectMapIt->second.Libraries)
+			{
+				ReloadJob& job = jobs.emplace_back();
+				job.Path = dependency;
+				job.pOldLibrary = library.second;
+			}
+		}
+	}
+
+	if (jobs.empty())
+	{
+		return;
+	}
+
+	// Compile all in parallel
+	TaskContext context;
+	TaskQueue::ExecuteMany([&](TaskDistributeArgs args)
+		{
+			ReloadJob& job = jobs[args.JobIndex];
+			if (job.pOldShader)
+			{
+				job.pNewShader = GetShader(job.Path.c_str(), job.pOldShader->Type, job.pOldShader->EntryPoint.c_str(), job.pOldShader->Defines, true);
+			}
+			else
+			{
+				job.pNewLibrary = GetLibrary(job.Path.c_str(), job.pOldLibrary->Defines, true);
+			}
+		}, context, (uint32)jobs.size(), 1);
+	TaskQueue::Join(context);
+
+	// Notify and release the old objects on the calling thread
+	for (const ReloadJob& job : jobs)
+	{
+		if (job.pOldShader)
+		{
+			Shader* pOldShader = job.pOldShader;
+			if (job.pNewShader)
+			{
+				E_LOG(Info, "Reloaded shader: \"%s - %s\"", job.Path.c_str(), job.pNewShader->EntryPoint.c_str());
+				m_OnShaderRecompiledEvent.Broadcast(pOldShader, job.pNewShader);
+				m_Shaders.remove_if([pOldShader](const std::unique_ptr<Shader>& pS) { return pS.get() == pOldShader; });
+			}
+			else
+			{
+				E_LOG(Warning, "Failed to reload shader: \"%s\"", job.Path.c_str());
+			}
+		}
+		else
+		{
+			ShaderLibrary* pOldLibrary = job.pOldLibrary;
+			if (job.pNewLibrary)
+			{
+				E_LOG(Info, "Reloaded library: \"%s\"", job.Path.c_str());
+				m_OnLibraryRecompiledEvent.Broadcast(pOldLibrary, job.pNewLibrary);
+				m_Libraries.remove_if([pOldLibrary](const std::unique_ptr<ShaderLibrary>& pS) { return pS.get() == pOldLibrary; });
+			}
+			else
+			{
+				E_LOG(Warning, "Failed to reload library: \"%s\"", job.Path.c_str());
 			}
 		}
 	}
@@ -475,22 +538,24 @@ ShaderManager::~ShaderManager()
 
 void ShaderManager::ConditionallyReloadShaders()
 {
-	if (m_pFileWatcher)
+	std::vector<FileEvent> changes;
+	if (m_pFileWatcher && m_pFileWatcher->GetChanges(changes))
 	{
-		FileEvent fileEvent;
-		while (m_pFileWatcher->GetNextChange(fileEvent))
+		std::vector<std::string> modifiedFiles;
+		for (const FileEvent& fileEvent : changes)
 		{
 			switch (fileEvent.EventType)
 			{
 			case FileEvent::Type::Modified:
-				RecompileFromFileChange(fileEvent.Path);
-				break;
 			case FileEvent::Type::Added:
+				// Saving through a temporary file shows up as Added
+				modifiedFiles.push_back(fileEvent.Path);
 				break;
 			case FileEvent::Type::Removed:
 				break;
 			}
 		}
+		RecompileFromFileChanges(modifiedFiles);
 	}
 }
 
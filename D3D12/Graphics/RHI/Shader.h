@@ -1,4 +1,5 @@
 #pragma once
+#include "Core/Utils.h"
 
 class FileWatcher;
 
@@ -84,13 +85,14 @@ private:
 struct ShaderLibrary
 {
 	ShaderLibrary(const ShaderBlob& shaderBlob, const Span<ShaderDefine>& defines)
-		: pByteCode(shaderBlob), Defines(defines.Copy())
+		: pByteCode(shaderBlob), Defines(defines.Copy()), ByteCodeHash(Utils::HashBytes(shaderBlob->GetBufferPointer(), shaderBlob->GetBufferSize()))
 	{}
 
 	D3D12_SHADER_BYTECODE GetByteCode() const { return { pByteCode->GetBufferPointer(), pByteCode->GetBufferSize() }; };
 
 	ShaderBlob pByteCode;
 	std::vector<ShaderDefine> Defines;
+	uint64 ByteCodeHash;
 };
 
 struct Shader : public ShaderLibrary
@@ -124,7 +126,7 @@ private:
 
 	ShaderStringHash GetEntryPointHash(const char* pEntryPoint, const Span<ShaderDefine>& defines);
 
-	void RecompileFromFileChange(const std::string& filePath);
+	void RecompileFromFileChanges(const std::vector<std::string>& filePaths);
 
 	std::vector<std::string> m_IncludeDirs;
 
@@ -0,0 +1,571 @@
+#include "stdafx.h"
+#include "RayQuery.h"
+#include "Mesh.h"
+#include "SceneView.h"
+#include "Core/TaskQueue.h"
+#include <immintrin.h>
+#include <chrono>
+
+namespace RayQuery
+{
+	static constexpr uint32 gNumBins = 16;
+	static constexpr uint32 gMaxLeafSize = 4;
+	// Cost of a node visit relative to intersecting a single triangle
+	static constexpr float gTraversalCost = 1.0f;
+	// Keeps the reciprocal finite for axis aligned rays, so the slab test never computes 0 * inf
+	static constexpr float gMinDirection = 1.0e-20f;
+
+	static float SafeReciprocal(float value)
+	{
+		if (fabs(value) < gMinDirection)
+			return value < 0.0f ? -1.0f / gMinDirection : 1.0f / gMinDirection;
+		return 1.0f / value;
+	}
+
+	static __m128 Select(__m128 mask, __m128 a, __m128 b)
+	{
+		return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+	}
+
+	// Returns the mask of rays which enter the box before their current hit distance.
+	// The entry distance of the rays that miss is FLT_MAX.
+	static int IntersectBox(const RayPacket& rays, const float* pMin, const float* pMax, __m128 maxDistance, __m128& outNear)
+	{
+		__m128 tNear = _mm_setzero_ps();
+		__m128 tFar = maxDistance;
+		for (uint32 i = 0; i < 3; ++i)
+		{
+			const __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(pMin[i]), rays.Origin[i]), rays.InvDirection[i]);
+			const __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(pMax[i]), rays.Origin[i]), rays.InvDirection[i]);
+			tNear = _mm_max_ps(tNear, _mm_min_ps(t0, t1));
+			tFar = _mm_min_ps(tFar, _mm_max_ps(t0, t1));
+		}
+		const __m128 hit = _mm_cmple_ps(tNear, tFar);
+		outNear = Select(hit, tNear, _mm_set1_ps(FLT_MAX));
+		return _mm_movemask_ps(hit);
+	}
+
+	static float GetClosestDistance(__m128 distances)
+	{
+		distances = _mm_min_ps(distances, _mm_shuffle_ps(distances, distances, _MM_SHUFFLE(2, 3, 0, 1)));
+		distances = _mm_min_ps(distances, _mm_shuffle_ps(distances, distances, _MM_SHUFFLE(1, 0, 3, 2)));
+		return _mm_cvtss_f32(distances);
+	}
+
+	static __m128 Dot(const __m128 a[3], const __m128 b[3])
+	{
+		return _mm_add_ps(_mm_add_ps(_mm_mul_ps(a[0], b[0]), _mm_mul_ps(a[1], b[1])), _mm_mul_ps(a[2], b[2]));
+	}
+
+	static void Cross(const __m128 a[3], const __m128 b[3], __m128 out[3])
+	{
+		out[0] = _mm_sub_ps(_mm_mul_ps(a[1], b[2]), _mm_mul_ps(a[2], b[1]));
+		out[1] = _mm_sub_ps(_mm_mul_ps(a[2], b[0]), _mm_mul_ps(a[0], b[2]));
+		out[2] = _mm_sub_ps(_mm_mul_ps(a[0], b[1]), _mm_mul_ps(a[1], b[0]));
+	}
+
+	static void Splat(const Vector3& v, __m128 out[3])
+	{
+		out[0] = _mm_set1_ps(v.x);
+		out[1] = _mm_set1_ps(v.y);
+		out[2] = _mm_set1_ps(v.z);
+	}
+
+	void CreatePacket(const Ray* pRays, uint32 numRays, float maxDistance, RayPacket& outRays, PacketHit& outHits)
+	{
+		check(numRays > 0 && numRays <= 4);
+		alignas(16) float origin[3][4]{};
+		alignas(16) float direction[3][4]{};
+		alignas(16) float invDirection[3][4]{};
+		alignas(16) float distance[4];
+		for (uint32 lane = 0; lane < 4; ++lane)
+		{
+			const Ray& ray = pRays[Math::Min(lane, numRays - 1)];
+			const float* pOrigin = &ray.position.x;
+			const float* pDirection = &ray.direction.x;
+			for (uint32 i = 0; i < 3; ++i)
+			{
+				origin[i][lane] = pOrigin[i];
+				direction[i][lane] = pDirection[i];
+				invDirection[i][lane] = SafeReciprocal(pDirection[i]);
+			}
+			distance[lane] = lane < numRays ? maxDistance : -1.0f;
+		}
+		for (uint32 i = 0; i < 3; ++i)
+		{
+			outRays.Origin[i] = _mm_load_ps(origin[i]);
+			outRays.Direction[i] = _mm_load_ps(direction[i]);
+			outRays.InvDirection[i] = _mm_load_ps(invDirection[i]);
+		}
+		outHits.Distance = _mm_load_ps(distance);
+		outHits.U = _mm_setzero_ps();
+		outHits.V = _mm_setzero_ps();
+		outHits.PrimitiveID = _mm_set1_epi32(-1);
+	}
+
+	// Min/max bounds of the build, cheaper to grow than a center/extents box
+	struct BuildBounds
+	{
+		float Min[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+		float Max[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+		void Grow(const float* pPoint)
+		{
+			for (uint32 i = 0; i < 3; ++i)
+			{
+				Min[i] = Math::Min(Min[i], pPoint[i]);
+				Max[i] = Math::Max(Max[i], pPoint[i]);
+			}
+		}
+
+		void Grow(const BuildBounds& other)
+		{
+			for (uint32 i = 0; i < 3; ++i)
+			{
+				Min[i] = Math::Min(Min[i], other.Min[i]);
+				Max[i] = Math::Max(Max[i], other.Max[i]);
+			}
+		}
+
+		float SurfaceArea() const
+		{
+			if (Min[0] > Max[0])
+				return 0.0f;
+			float x = Max[0] - Min[0];
+			float y = Max[1] - Min[1];
+			float z = Max[2] - Min[2];
+			return 2.0f * (x * y + y * z + z * x);
+		}
+	};
+
+	void TriangleBVH::Build(const Span<Vector3>& positions, const Span<uint32>& indices)
+	{
+		const uint32 numTriangles = indices.GetSize() / 3;
+		m_Nodes.clear();
+		m_Triangles.resize(numTriangles);
+		m_PrimitiveIDs.resize(numTriangles);
+		if (numTriangles == 0)
+			return;
+
+		// Triangles are partitioned by value so the build streams through memory
+		struct BuildItem
+		{
+			BuildBounds Bounds;
+			float Centroid[3];
+			uint32 Index;
+		};
+		std::vector<BuildItem> items(numTriangles);
+		for (uint32 i = 0; i < numTriangles; ++i)
+		{
+			BuildItem& item = items[i];
+			for (uint32 vertex = 0; vertex < 3; ++vertex)
+			{
+				item.Bounds.Grow(&positions[indices[i * 3 + vertex]].x);
+			}
+			for (uint32 axis = 0; axis < 3; ++axis)
+			{
+				item.Centroid[axis] = (item.Bounds.Min[axis] + item.Bounds.Max[axis]) * 0.5f;
+			}
+			item.Index = i;
+		}
+
+		m_Nodes.reserve(2 * numTriangles);
+		m_Nodes.emplace_back();
+
+		struct BuildTask
+		{
+			uint32 NodeIndex;
+			uint32 FirstItem;
+			uint32 NumItems;
+			uint32 Depth;
+		};
+		std::vector<BuildTask> tasks;
+		tasks.push_back({ 0, 0, numTriangles, 0 });
+
+		while (!tasks.empty())
+		{
+			const BuildTask task = tasks.back();
+			tasks.pop_back();
+
+			BuildBounds nodeBounds;
+			BuildBounds centroidBounds;
+			for (uint32 i = task.FirstItem; i < task.FirstItem + task.NumItems; ++i)
+			{
+				nodeBounds.Grow(items[i].Bounds);
+				centroidBounds.Grow(items[i].Centroid);
+			}
+
+			Node& node = m_Nodes[task.NodeIndex];
+			node.Min = Vector3(nodeBounds.Min);
+			node.Max = Vector3(nodeBounds.Max);
+
+			// Find the cheapest split plane over the centroid bins of the longest axis
+			uint32 axis = 0;
+			for (uint32 i = 1; i < 3; ++i)
+			{
+				if (centroidBounds.Max[i] - centroidBounds.Min[i] > centroidBounds.Max[axis] - centroidBounds.Min[axis])
+					axis = i;
+			}
+			const float minCentroid = centroidBounds.Min[axis];
+			const float extent = centroidBounds.Max[axis] - minCentroid;
+
+			float bestCost = FLT_MAX;
+			uint32 bestSplit = 0;
+			const bool canSplit = task.NumItems > 1 && task.Depth + 1 < MaxDepth;
+			if (canSplit && extent > 0.0f)
+			{
+				BuildBounds binBounds[gNumBins];
+				uint32 binCounts[gNumBins]{};
+				const float scale = gNumBins / extent;
+				for (uint32 i = task.FirstItem; i < task.FirstItem + task.NumItems; ++i)
+				{
+					uint32 bin = Math::Min(gNumBins - 1, (uint32)((items[i].Centroid[axis] - minCentroid) * scale));
+					binBounds[bin].Grow(items[i].Bounds);
+					++binCounts[bin];
+				}
+
+				// Sweep from the right to get the cost of the right side of each plane
+				float rightCosts[gNumBins];
+				BuildBounds rightBounds;
+				uint32 rightCount = 0;
+				for (uint32 bin = gNumBins - 1; bin > 0; --bin)
+				{
+					rightBounds.Grow(binBounds[bin]);
+					rightCount += binCounts[bin];
+					rightCosts[bin] = rightCount * rightBounds.SurfaceArea();
+				}
+
+				BuildBounds leftBounds;
+				uint32 leftCount = 0;
+				for (uint32 split = 1; split < gNumBins; ++split)
+				{
+					leftBounds.Grow(binBounds[split - 1]);
+					leftCount += binCounts[split - 1];
+					if (leftCount == 0 || leftCount == task.NumItems)
+						continue;
+					float cost = leftCount * leftBounds.SurfaceArea() + rightCosts[split];
+					if (cost < bestCost)
+					{
+						bestCost = cost;
+						bestSplit = split;
+					}
+				}
+			}
+
+			const float nodeArea = nodeBounds.SurfaceArea();
+			const bool foundSplit = bestCost < FLT_MAX;
+			const bool makeLeaf = !canSplit
+				|| (task.NumItems <= gMaxLeafSize && (!foundSplit || gTraversalCost * nodeArea + bestCost >= task.NumItems * nodeArea));
+
+			if (makeLeaf)
+			{
+				node.ChildOrFirstTriangle = task.FirstItem;
+				node.NumTriangles = task.NumItems;
+				continue;
+			}
+
+			uint32 numLeft;
+			if (foundSplit)
+			{
+				const float scale = gNumBins / extent;
+				auto itemsBegin = items.begin() + task.FirstItem;
+				auto itemsMid = std::partition(itemsBegin, itemsBegin + task.NumItems, [&](const BuildItem& item)
+					{
+						return Math::Min(gNumBins - 1, (uint32)((item.Centroid[axis] - minCentroid) * scale)) < bestSplit;
+					});
+				numLeft = (uint32)(itemsMid - itemsBegin);
+			}
+			else
+			{
+				// All centroids are in the same spot, split in the middle
+				numLeft = task.NumItems / 2;
+			}
+
+			const uint32 firstChild = (uint32)m_Nodes.size();
+			node.ChildOrFirstTriangle = firstChild;
+			node.NumTriangles = 0;
+			m_Nodes.emplace_back();
+			m_Nodes.emplace_back();
+
+			tasks.push_back({ firstChild, task.FirstItem, numLeft, task.Depth + 1 });
+			tasks.push_back({ firstChild + 1, task.FirstItem + numLeft, task.NumItems - numLeft, task.Depth + 1 });
+		}
+
+		for (uint32 i = 0; i < numTriangles; ++i)
+		{
+			const uint32 primitiveID = items[i].Index;
+			const Vector3& v0 = positions[indices[primitiveID * 3 + 0]];
+			const Vector3& v1 = positions[indices[primitiveID * 3 + 1]];
+			const Vector3& v2 = positions[indices[primitiveID * 3 + 2]];
+			m_Triangles[i] = { v0, v1 - v0, v2 - v0 };
+			m_PrimitiveIDs[i] = primitiveID;
+		}
+	}
+
+	uint32 TriangleBVH::Intersect(const RayPacket& rays, PacketHit& hits) const
+	{
+		if (m_Nodes.empty())
+			return 0;
+
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 epsilon = _mm_set1_ps(1.0e-12f);
+		const __m128 signMask = _mm_set1_ps(-0.0f);
+
+		// Nodes are pushed with the distance at which the rays enter them,
+		// so they can be skipped once all rays found a closer hit in the meantime
+		struct StackEntry
+		{
+			__m128 Near;
+			uint32 NodeIndex;
+		};
+		uint32 updatedMask = 0;
+		StackEntry stack[MaxDepth + 1];
+		uint32 stackSize = 0;
+
+		__m128 rootNear;
+		if (!IntersectBox(rays, &m_Nodes[0].Min.x, &m_Nodes[0].Max.x, hits.Distance, rootNear))
+			return 0;
+		stack[stackSize++] = { rootNear, 0 };
+
+		while (stackSize > 0)
+		{
+			const StackEntry& entry = stack[--stackSize];
+			if (_mm_movemask_ps(_mm_cmple_ps(entry.Near, hits.Distance)) == 0)
+				continue;
+			const Node& node = m_Nodes[entry.NodeIndex];
+
+			if (node.NumTriangles > 0)
+			{
+				// Moller-Trumbore, one triangle against the 4 rays
+				for (uint32 i = node.ChildOrFirstTriangle; i < node.ChildOrFirstTriangle + node.NumTriangles; ++i)
+				{
+					const Triangle& triangle = m_Triangles[i];
+					__m128 v0[3], edge1[3], edge2[3];
+					Splat(triangle.V0, v0);
+					Splat(triangle.Edge1, edge1);
+					Splat(triangle.Edge2, edge2);
+
+					__m128 p[3];
+					Cross(rays.Direction, edge2, p);
+					const __m128 det = Dot(edge1, p);
+					const __m128 invDet = _mm_div_ps(one, det);
+
+					const __m128 s[3] = { _mm_sub_ps(rays.Origin[0], v0[0]), _mm_sub_ps(rays.Origin[1], v0[1]), _mm_sub_ps(rays.Origin[2], v0[2]) };
+					const __m128 u = _mm_mul_ps(Dot(s, p), invDet);
+					__m128 q[3];
+					Cross(s, edge1, q);
+					const __m128 v = _mm_mul_ps(Dot(rays.Direction, q), invDet);
+					const __m128 t = _mm_mul_ps(Dot(edge2, q), invDet);
+
+					__m128 hit = _mm_cmpgt_ps(_mm_andnot_ps(signMask, det), epsilon);
+					hit = _mm_and_ps(hit, _mm_cmpge_ps(u, zero));
+					hit = _mm_and_ps(hit, _mm_cmpge_ps(v, zero));
+					hit = _mm_and_ps(hit, _mm_cmple_ps(_mm_add_ps(u, v), one));
+					hit = _mm_and_ps(hit, _mm_cmpgt_ps(t, zero));
+					hit = _mm_and_ps(hit, _mm_cmplt_ps(t, hits.Distance));
+
+					const int hitMask = _mm_movemask_ps(hit);
+					if (hitMask == 0)
+						continue;
+
+					updatedMask |= hitMask;
+					hits.Distance = Select(hit, t, hits.Distance);
+					hits.U = Select(hit, u, hits.U);
+					hits.V = Select(hit, v, hits.V);
+					hits.PrimitiveID = _mm_castps_si128(Select(hit, _mm_castsi128_ps(_mm_set1_epi32((int)m_PrimitiveIDs[i])), _mm_castsi128_ps(hits.PrimitiveID)));
+				}
+			}
+			else
+			{
+				const uint32 left = node.ChildOrFirstTriangle;
+				const uint32 right = left + 1;
+				__m128 leftNear, rightNear;
+				const int leftMask = IntersectBox(rays, &m_Nodes[left].Min.x, &m_Nodes[left].Max.x, hits.Distance, leftNear);
+				const int rightMask = IntersectBox(rays, &m_Nodes[right].Min.x, &m_Nodes[right].Max.x, hits.Distance, rightNear);
+
+				if (leftMask && rightMask)
+				{
+					// Visit the closest child first so the other one is more likely to get culled
+					if (GetClosestDistance(leftNear) <= GetClosestDistance(rightNear))
+					{
+						stack[stackSize++] = { rightNear, right };
+						stack[stackSize++] = { leftNear, left };
+					}
+					else
+					{
+						stack[stackSize++] = { leftNear, left };
+						stack[stackSize++] = { rightNear, right };
+					}
+				}
+				else if (leftMask)
+				{
+					stack[stackSize++] = { leftNear, left };
+				}
+				else if (rightMask)
+				{
+					stack[stackSize++] = { rightNear, right };
+				}
+			}
+		}
+		return updatedMask;
+	}
+
+	static void IntersectPacket(const SceneView& view, const Ray* pRays, uint32 numRays, float maxDistance, Hit* pOutHits)
+	{
+		RayPacket rays;
+		PacketHit hits;
+		CreatePacket(pRays, numRays, maxDistance, rays, hits);
+		uint32 instanceIDs[4] = { ~0u, ~0u, ~0u, ~0u };
+
+		view.BVH.QueryClosest([&](const BoundingBox& bounds)
+			{
+				const Vector3 boxMin = Vector3(bounds.Center) - Vector3(bounds.Extents);
+				const Vector3 boxMax = Vector3(bounds.Center) + Vector3(bounds.Extents);
+				__m128 tNear;
+				const int mask = IntersectBox(rays, &boxMin.x, &boxMax.x, hits.Distance, tNear);
+				return mask ? GetClosestDistance(tNear) : -1.0f;
+			},
+			[&](uint32 batchIndex)
+			{
+				const Batch& batch = view.Batches[batchIndex];
+				const TriangleBVH& bvh = batch.pMesh->BVH;
+				if (bvh.IsEmpty())
+					return;
+
+				// The direction isn't normalized after the transform so distances stay in world space units
+				const Matrix worldToObject = batch.WorldMatrix.Invert();
+				RayPacket localRays;
+				for (uint32 i = 0; i < 3; ++i)
+				{
+					const __m128 row0 = _mm_set1_ps(worldToObject.m[0][i]);
+					const __m128 row1 = _mm_set1_ps(worldToObject.m[1][i]);
+					const __m128 row2 = _mm_set1_ps(worldToObject.m[2][i]);
+					localRays.Origin[i] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(rays.Origin[0], row0), _mm_mul_ps(rays.Origin[1], row1)),
+						_mm_add_ps(_mm_mul_ps(rays.Origin[2], row2), _mm_set1_ps(worldToObject.m[3][i])));
+					localRays.Direction[i] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(rays.Direction[0], row0), _mm_mul_ps(rays.Direction[1], row1)), _mm_mul_ps(rays.Direction[2], row2));
+				}
+				alignas(16) float direction[4];
+				for (uint32 i = 0; i < 3; ++i)
+				{
+					_mm_store_ps(direction, localRays.Direction[i]);
+					for (float& value : direction)
+					{
+						value = SafeReciprocal(value);
+					}
+					localRays.InvDirection[i] = _mm_load_ps(direction);
+				}
+
+				uint32 updatedMask = bvh.Intersect(localRays, hits);
+				while (updatedMask)
+				{
+					instanceIDs[_tzcnt_u32(updatedMask)] = batch.InstanceID;
+					updatedMask &= updatedMask - 1;
+				}
+			});
+
+		alignas(16) float distances[4], u[4], v[4];
+		alignas(16) uint32 primitiveIDs[4];
+		_mm_store_ps(distances, hits.Distance);
+		_mm_store_ps(u, hits.U);
+		_mm_store_ps(v, hits.V);
+		_mm_store_si128((__m128i*)primitiveIDs, hits.PrimitiveID);
+		for (uint32 lane = 0; lane < numRays; ++lane)
+		{
+			Hit& hit = pOutHits[lane];
+			hit = Hit();
+			if (instanceIDs[lane] != ~0u)
+			{
+				hit.Distance = distances[lane];
+				hit.InstanceID = instanceIDs[lane];
+				hit.PrimitiveID = primitiveIDs[lane];
+				hit.Barycentrics = Vector2(u[lane], v[lane]);
+			}
+		}
+	}
+
+	Hit Intersect(const SceneView& view, const Ray& ray, float maxDistance)
+	{
+		Hit hit;
+		IntersectPacket(view, &ray, 1, maxDistance, &hit);
+		return hit;
+	}
+
+	void Intersect(const SceneView& view, const Span<Ray>& rays, Hit* pOutHits, float maxDistance)
+	{
+		for (uint32 i = 0; i < rays.GetSize(); i += 4)
+		{
+			IntersectPacket(view, rays.GetData() + i, Math::Min(4u, rays.GetSize() - i), maxDistance, pOutHits + i);
+		}
+	}
+
+	void Benchmark(const SceneView& view, uint32 width, uint32 height)
+	{
+		using Clock = std::chrono::high_resolution_clock;
+
+		if (!view.View.Perspective)
+		{
+			E_LOG(Warning, "Ray query benchmark needs a perspective view");
+			return;
+		}
+
+		// Primary rays, with pixels in 2x2 quads so each packet is coherent
+		const Matrix& projection = view.View.Projection;
+		std::vector<Ray> rays(width * height);
+		for (uint32 y = 0; y < height; ++y)
+		{
+			for (uint32 x = 0; x < width; ++x)
+			{
+				const uint32 quad = (y / 2) * (width / 2) + (x / 2);
+				const uint32 index = quad * 4 + (y % 2) * 2 + (x % 2);
+				if (index >= rays.size())
+					continue;
+				const Vector2 ndc((x + 0.5f) / width * 2.0f - 1.0f, 1.0f - (y + 0.5f) / height * 2.0f);
+				Vector3 direction = Vector3::TransformNormal(Vector3(ndc.x / projection._11, ndc.y / projection._22, 1.0f), view.View.ViewInverse);
+				direction.Normalize();
+				rays[index] = Ray(view.View.Position, direction);
+			}
+		}
+
+		std::vector<Hit> hits(rays.size());
+		constexpr uint32 raysPerTask = 1024;
+		const uint32 numTasks = ((uint32)rays.size() + raysPerTask - 1) / raysPerTask;
+
+		auto Trace = [&](bool packets)
+		{
+			const Clock::time_point start = Clock::now();
+			TaskContext context;
+			TaskQueue::ExecuteMany([&](TaskDistributeArgs args)
+				{
+					const uint32 first = args.JobIndex * raysPerTask;
+					const uint32 count = Math::Min(raysPerTask, (uint32)rays.size() - first);
+					if (packets)
+					{
+						Intersect(view, Span<Ray>(rays.data() + first, count), hits.data() + first);
+					}
+					else
+					{
+						for (uint32 i = first; i < first + count; ++i)
+						{
+							hits[i] = Intersect(view, rays[i]);
+						}
+					}
+				}, context, numTasks, 1);
+			TaskQueue::Join(context);
+			return std::chrono::duration<float>(Clock::now() - start).count();
+		};
+
+		const float singleTime = Trace(false);
+		const float packetTime = Trace(true);
+
+		uint32 numHits = 0;
+		for (const Hit& hit : hits)
+		{
+			numHits += hit.IsHit();
+		}
+
+		E_LOG(Info, "Ray query: %dx%d primary rays, %.1f%% hit", width, height, 100.0f * numHits / Math::Max<size_t>(rays.size(), 1));
+		E_LOG(Info, "\tSingle rays: %.2f ms (%.2f Mrays/s)", singleTime * 1000.0f, rays.size() / singleTime / 1.0e6f);
+		E_LOG(Info, "\tPackets of 4: %.2f ms (%.2f Mrays/s)", packetTime * 1000.0f, rays.size() / packetTime / 1.0e6f);
+	}
+}
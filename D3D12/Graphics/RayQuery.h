@@ -0,0 +1,97 @@
+#pragma once
+#include <emmintrin.h>
+
+struct SceneView;
+
+/*
+	CPU ray queries against the scene geometry, for mouse picking and gameplay style queries.
+	Two levels: the scene BVH over the batches, and a triangle BVH per submesh in object space
+	which rays are transformed into with the inverse of the instance transform.
+	Rays are traced in packets of 4 with SSE, a single ray is a packet with one active lane.
+	All geometry is treated as opaque and double sided, alpha masks are ignored.
+*/
+namespace RayQuery
+{
+	struct Hit
+	{
+		// Along the ray, in units of the ray direction
+		float Distance = FLT_MAX;
+		uint32 InstanceID = ~0u;
+		// Triangle index in LOD 0 of the submesh
+		uint32 PrimitiveID = ~0u;
+		// Weights of the second and third vertex of the triangle
+		Vector2 Barycentrics;
+
+		bool IsHit() const { return InstanceID != ~0u; }
+	};
+
+	// 4 rays in SoA layout
+	struct RayPacket
+	{
+		__m128 Origin[3];
+		__m128 Direction[3];
+		__m128 InvDirection[3];
+	};
+
+	struct PacketHit
+	{
+		// Closest hit so far, FLT_MAX when nothing is hit. Negative for inactive lanes so they never hit.
+		__m128 Distance;
+		__m128 U;
+		__m128 V;
+		__m128i PrimitiveID;
+	};
+
+	// Creates a packet of up to 4 rays. Lanes without a ray are inactive.
+	void CreatePacket(const Ray* pRays, uint32 numRays, float maxDistance, RayPacket& outRays, PacketHit& outHits);
+
+	// Binned SAH tree over the triangles of a mesh
+	class TriangleBVH
+	{
+	public:
+		void Build(const Span<Vector3>& positions, const Span<uint32>& indices);
+
+		// Finds the closest hit of each ray that is closer than its current hit.
+		// Returns a mask of the lanes of which the hit was updated.
+		uint32 Intersect(const RayPacket& rays, PacketHit& hits) const;
+
+		bool IsEmpty() const { return m_Nodes.empty(); }
+		uint32 GetNumTriangles() const { return (uint32)m_Triangles.size(); }
+		uint32 GetNumNodes() const { return (uint32)m_Nodes.size(); }
+
+	private:
+		static constexpr uint32 MaxDepth = 64;
+
+		struct Node
+		{
+			Vector3 Min;
+			// First child for interior nodes, the second child follows it. First triangle for leaves.
+			uint32 ChildOrFirstTriangle;
+			Vector3 Max;
+			// 0 for interior nodes
+			uint32 NumTriangles;
+		};
+
+		// Stored in the form the intersection test needs
+		struct Triangle
+		{
+			Vector3 V0;
+			Vector3 Edge1;
+			Vector3 Edge2;
+		};
+
+		std::vector<Node> m_Nodes;
+		// In leaf order
+		std::vector<Triangle> m_Triangles;
+		std::vector<uint32> m_PrimitiveIDs;
+	};
+
+	// Closest hit of a single ray
+	Hit Intersect(const SceneView& view, const Ray& ray, float maxDistance = FLT_MAX);
+
+	// Closest hits of many rays, traced in packets of 4. Coherent rays trace faster.
+	void Intersect(const SceneView& view, const Span<Ray>& rays, Hit* pOutHits, float maxDistance = FLT_MAX);
+
+	// Traces a primary ray per pixel from the view, as single rays and as packets, and logs the rays per second
+	void Benchmark(const SceneView& view, uint32 width = 1024, uint32 height = 1024);
+}
@@ -0,0 +1,453 @@
+#include "stdafx.h"
+#include "SceneBVH.h"
+#include "SceneView.h"
+#include "Core/ConsoleVariables.h"
+#include <chrono>
+
+namespace Tweakables
+{
+	ConsoleCommand<int> gBenchmarkSceneBVH("BenchmarkSceneBVH", [](int numBatches) { SceneBVH::Benchmark(numBatches); });
+}
+
+static constexpr uint32 gNumBins = 16;
+static constexpr uint32 gMaxLeafSize = 4;
+// Cost of a node visit relative to testing a single item
+static constexpr float gTraversalCost = 1.0f;
+// Rebuild when refitting made the tree this much more expensive than when it was built
+static constexpr float gRebuildCostRatio = 1.5f;
+
+// Min/max bounds, cheaper to grow than a center/extents box
+struct BuildBounds
+{
+	float Min[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+	float Max[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+	BuildBounds() = default;
+
+	BuildBounds(const BoundingBox& box)
+	{
+		Min[0] = box.Center.x - box.Extents.x;
+		Min[1] = box.Center.y - box.Extents.y;
+		Min[2] = box.Center.z - box.Extents.z;
+		Max[0] = box.Center.x + box.Extents.x;
+		Max[1] = box.Center.y + box.Extents.y;
+		Max[2] = box.Center.z + box.Extents.z;
+	}
+
+	void Grow(const float* pPoint)
+	{
+		for (uint32 i = 0; i < 3; ++i)
+		{
+			Min[i] = Math::Min(Min[i], pPoint[i]);
+			Max[i] = Math::Max(Max[i], pPoint[i]);
+		}
+	}
+
+	void Grow(const BuildBounds& other)
+	{
+		for (uint32 i = 0; i < 3; ++i)
+		{
+			Min[i] = Math::Min(Min[i], other.Min[i]);
+			Max[i] = Math::Max(Max[i], other.Max[i]);
+		}
+	}
+
+	float SurfaceArea() const
+	{
+		if (Min[0] > Max[0])
+			return 0.0f;
+		float x = Max[0] - Min[0];
+		float y = Max[1] - Min[1];
+		float z = Max[2] - Min[2];
+		return 2.0f * (x * y + y * z + z * x);
+	}
+
+	BoundingBox ToBoundingBox() const
+	{
+		BoundingBox box;
+		box.Center = Vector3(Max[0] + Min[0], Max[1] + Min[1], Max[2] + Min[2]) * 0.5f;
+		box.Extents = Vector3(Max[0] - Min[0], Max[1] - Min[1], Max[2] - Min[2]) * 0.5f;
+		return box;
+	}
+};
+
+static float SurfaceArea(const BoundingBox& box)
+{
+	return 8.0f * (box.Extents.x * box.Extents.y + box.Extents.y * box.Extents.z + box.Extents.z * box.Extents.x);
+}
+
+void SceneBVH::Build(const Span<Batch>& batches)
+{
+	const uint32 numItems = batches.GetSize();
+	m_Nodes.clear();
+	m_Parents.clear();
+	m_Items.resize(numItems);
+	m_ItemBounds.resize(numItems);
+	m_ItemRadii.resize(numItems);
+	m_ItemLeaf.resize(numItems);
+	m_DirtyNodes.Resize(0);
+	m_BuildCost = 0;
+	m_Cost = 0;
+	if (numItems == 0)
+		return;
+
+	// Items are partitioned by value so the build streams through memory
+	struct BuildItem
+	{
+		BuildBounds Bounds;
+		float Centroid[3];
+		uint32 Index;
+	};
+	std::vector<BuildItem> items(numItems);
+	for (uint32 i = 0; i < numItems; ++i)
+	{
+		const BoundingBox& box = batches[i].Bounds;
+		items[i].Bounds = BuildBounds(box);
+		items[i].Centroid[0] = box.Center.x;
+		items[i].Centroid[1] = box.Center.y;
+		items[i].Centroid[2] = box.Center.z;
+		items[i].Index = i;
+	}
+
+	m_Nodes.reserve(2 * numItems);
+	m_Parents.reserve(2 * numItems);
+	m_Nodes.emplace_back();
+	m_Parents.push_back(~0u);
+
+	struct BuildTask
+	{
+		uint32 NodeIndex;
+		uint32 FirstItem;
+		uint32 NumItems;
+		uint32 Depth;
+	};
+	std::vector<BuildTask> tasks;
+	tasks.push_back({ 0, 0, numItems, 0 });
+
+	while (!tasks.empty())
+	{
+		const BuildTask task = tasks.back();
+		tasks.pop_back();
+
+		BuildBounds nodeBounds;
+		BuildBounds centroidBounds;
+		for (uint32 i = task.FirstItem; i < task.FirstItem + task.NumItems; ++i)
+		{
+			nodeBounds.Grow(items[i].Bounds);
+			centroidBounds.Grow(items[i].Centroid);
+		}
+
+		Node& node = m_Nodes[task.NodeIndex];
+		node.Bounds = nodeBounds.ToBoundingBox();
+
+		// Find the cheapest split plane over the centroid bins of the longest axis
+		uint32 axis = 0;
+		for (uint32 i = 1; i < 3; ++i)
+		{
+			if (centroidBounds.Max[i] - centroidBounds.Min[i] > centroidBounds.Max[axis] - centroidBounds.Min[axis])
+				axis = i;
+		}
+		const float minCentroid = centroidBounds.Min[axis];
+		const float extent = centroidBounds.Max[axis] - minCentroid;
+
+		float bestCost = FLT_MAX;
+		uint32 bestSplit = 0;
+		const bool canSplit = task.NumItems > 1 && task.Depth + 1 < MaxDepth;
+		if (canSplit && extent > 0.0f)
+		{
+			BuildBounds binBounds[gNumBins];
+			uint32 binCounts[gNumBins]{};
+			const float scale = gNumBins / extent;
+			for (uint32 i = task.FirstItem; i < task.FirstItem + task.NumItems; ++i)
+			{
+				uint32 bin = Math::Min(gNumBins - 1, (uint32)((items[i].Centroid[axis] - minCentroid) * scale));
+				binBounds[bin].Grow(items[i].Bounds);
+				++binCounts[bin];
+			}
+
+			// Sweep from the right to get the cost of the right side of each plane
+			float rightCosts[gNumBins];
+			BuildBounds rightBounds;
+			uint32 rightCount = 0;
+			for (uint32 bin = gNumBins - 1; bin > 0; --bin)
+			{
+				rightBounds.Grow(binBounds[bin]);
+				rightCount += binCounts[bin];
+				rightCosts[bin] = rightCount * rightBounds.SurfaceArea();
+			}
+
+			BuildBounds leftBounds;
+			uint32 leftCount = 0;
+			for (uint32 split = 1; split < gNumBins; ++split)
+			{
+				leftBounds.Grow(binBounds[split - 1]);
+				leftCount += binCounts[split - 1];
+				if (leftCount == 0 || leftCount == task.NumItems)
+					continue;
+				float cost = leftCount * leftBounds.SurfaceArea() + rightCosts[split];
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					bestSplit = split;
+				}
+			}
+		}
+
+		const float nodeArea = nodeBounds.SurfaceArea();
+		const bool foundSplit = bestCost < FLT_MAX;
+		const bool makeLeaf = !canSplit
+			|| (task.NumItems <= gMaxLeafSize && (!foundSplit || gTraversalCost * nodeArea + bestCost >= task.NumItems * nodeArea));
+
+		if (makeLeaf)
+		{
+			node.ChildOrFirstItem = task.FirstItem;
+			node.NumItems = task.NumItems;
+			continue;
+		}
+
+		uint32 numLeft;
+		if (foundSplit)
+		{
+			const float scale = gNumBins / extent;
+			auto itemsBegin = items.begin() + task.FirstItem;
+			auto itemsMid = std::partition(itemsBegin, itemsBegin + task.NumItems, [&](const BuildItem& item)
+				{
+					return Math::Min(gNumBins - 1, (uint32)((item.Centroid[axis] - minCentroid) * scale)) < bestSplit;
+				});
+			numLeft = (uint32)(itemsMid - itemsBegin);
+		}
+		else
+		{
+			// All centroids are in the same spot, split in the middle
+			numLeft = task.NumItems / 2;
+		}
+
+		const uint32 firstChild = (uint32)m_Nodes.size();
+		node.ChildOrFirstItem = firstChild;
+		node.NumItems = 0;
+		m_Nodes.emplace_back();
+		m_Nodes.emplace_back();
+		m_Parents.push_back(task.NodeIndex);
+		m_Parents.push_back(task.NodeIndex);
+
+		tasks.push_back({ firstChild, task.FirstItem, numLeft, task.Depth + 1 });
+		tasks.push_back({ firstChild + 1, task.FirstItem + numLeft, task.NumItems - numLeft, task.Depth + 1 });
+	}
+
+	for (uint32 i = 0; i < numItems; ++i)
+	{
+		m_Items[i] = items[i].Index;
+	}
+
+	// Children are always stored after their parent, so going back to front updates children first
+	for (uint32 nodeIndex = (uint32)m_Nodes.size(); nodeIndex > 0; --nodeIndex)
+	{
+		const Node& node = m_Nodes[nodeIndex - 1];
+		for (uint32 i = node.ChildOrFirstItem; i < node.ChildOrFirstItem + node.NumItems; ++i)
+		{
+			m_ItemLeaf[m_Items[i]] = nodeIndex - 1;
+		}
+		UpdateNodeBounds(nodeIndex - 1, batches);
+		m_BuildCost += GetNodeCost(node);
+	}
+	m_Cost = m_BuildCost;
+}
+
+bool SceneBVH::Refit(const Span<Batch>& batches, const Span<uint32>& movedBatches)
+{
+	check(batches.GetSize() == (uint32)m_ItemLeaf.size());
+
+	// Collect the leaves of the moved batches and all their parents
+	m_DirtyNodes.Resize((uint32)m_Nodes.size());
+	for (uint32 batchIndex : movedBatches)
+	{
+		uint32 nodeIndex = m_ItemLeaf[batchIndex];
+		while (nodeIndex != ~0u && !m_DirtyNodes.GetBit(nodeIndex))
+		{
+			m_DirtyNodes.SetBit(nodeIndex);
+			nodeIndex = m_Parents[nodeIndex];
+		}
+	}
+
+	m_DirtyNodeList.clear();
+	for (uint32 nodeIndex : m_DirtyNodes)
+	{
+		m_DirtyNodeList.push_back(nodeIndex);
+	}
+	m_DirtyNodes.ClearAll();
+
+	// Children are always stored after their parent, so going back to front updates children first
+	for (auto it = m_DirtyNodeList.rbegin(); it != m_DirtyNodeList.rend(); ++it)
+	{
+		const Node& node = m_Nodes[*it];
+		m_Cost -= GetNodeCost(node);
+		UpdateNodeBounds(*it, batches);
+		m_Cost += GetNodeCost(node);
+	}
+
+	return m_Cost <= gRebuildCostRatio * m_BuildCost;
+}
+
+float SceneBVH::GetNodeCost(const Node& node) const
+{
+	return SurfaceArea(node.Bounds) * (node.NumItems > 0 ? node.NumItems : gTraversalCost);
+}
+
+void SceneBVH::UpdateNodeBounds(uint32 nodeIndex, const Span<Batch>& batches)
+{
+	Node& node = m_Nodes[nodeIndex];
+	BuildBounds bounds;
+	if (node.NumItems > 0)
+	{
+		node.MaxItemRadius = 0.0f;
+		for (uint32 i = node.ChildOrFirstItem; i < node.ChildOrFirstItem + node.NumItems; ++i)
+		{
+			const Batch& batch = batches[m_Items[i]];
+			m_ItemBounds[i] = batch.Bounds;
+			m_ItemRadii[i] = batch.Radius;
+			bounds.Grow(BuildBounds(batch.Bounds));
+			node.MaxItemRadius = Math::Max(node.MaxItemRadius, batch.Radius);
+		}
+	}
+	else
+	{
+		const Node& left = m_Nodes[node.ChildOrFirstItem];
+		const Node& right = m_Nodes[node.ChildOrFirstItem + 1];
+		bounds = BuildBounds(left.Bounds);
+		bounds.Grow(BuildBounds(right.Bounds));
+		node.MaxItemRadius = Math::Max(left.MaxItemRadius, right.MaxItemRadius);
+	}
+	node.Bounds = bounds.ToBoundingBox();
+}
+
+void SceneBVH::Benchmark(uint32 numBatches)
+{
+	using Clock = std::chrono::high_resolution_clock;
+
+	numBatches = Math::Max(numBatches, 1u);
+
+	// Flat scene, a few kilometers wide, with small objects
+	std::vector<Batch> batches(numBatches);
+	for (uint32 i = 0; i < numBatches; ++i)
+	{
+		Batch& batch = batches[i];
+		batch.InstanceID = i;
+		batch.pMesh = nullptr;
+		batch.pMaterial = nullptr;
+		batch.Bounds.Center = Vector3(Math::RandomRange(-2000.0f, 2000.0f), Math::RandomRange(-100.0f, 100.0f), Math::RandomRange(-2000.0f, 2000.0f));
+		batch.Bounds.Extents = Vector3(Math::RandomRange(0.25f, 4.0f), Math::RandomRange(0.25f, 4.0f), Math::RandomRange(0.25f, 4.0f));
+		batch.Radius = Vector3(batch.Bounds.Extents).Length();
+	}
+
+	auto TimeMS = [](const auto& operation)
+	{
+		const Clock::time_point start = Clock::now();
+		operation();
+		return std::chrono::duration<float, std::milli>(Clock::now() - start).count();
+	};
+
+	E_LOG(Info, "SceneBVH: %d batches", numBatches);
+
+	SceneBVH bvh;
+	const float buildTime = TimeMS([&]() { bvh.Build(batches); });
+	E_LOG(Info, "\tBuild: %.2f ms, %d nodes", buildTime, bvh.GetNumNodes());
+
+	bool isValid = true;
+	std::vector<uint32> linearResult;
+	std::vector<uint32> bvhResult;
+	auto Compare = [&](const char* pName, float linearTime, float bvhTime)
+	{
+		std::sort(bvhResult.begin(), bvhResult.end());
+		if (linearResult != bvhResult)
+		{
+			E_LOG(Error, "SceneBVH: %s visits %d batches, the linear loop %d", pName, (uint32)bvhResult.size(), (uint32)linearResult.size());
+			isValid = false;
+		}
+		E_LOG(Info, "\t%-16s linear %8.2f ms, BVH %8.2f ms (%d batches)", pName, linearTime, bvhTime, (uint32)linearResult.size());
+	};
+
+	auto CompareCull = [&](const char* pName, const auto& volume)
+	{
+		const float linearTime = TimeMS([&]()
+			{
+				linearResult.clear();
+				for (uint32 i = 0; i < numBatches; ++i)
+				{
+					if (volume.Contains(batches[i].Bounds) != DirectX::DISJOINT)
+						linearResult.push_back(i);
+				}
+			});
+		const float bvhTime = TimeMS([&]()
+			{
+				bvhResult.clear();
+				bvh.Cull(volume, [&](uint32 batchIndex) { bvhResult.push_back(batchIndex); });
+			});
+		Compare(pName, linearTime, bvhTime);
+	};
+
+	// Camera above the scene, looking at the horizon
+	const Vector3 cameraPosition(0, 10, 0);
+	const Matrix view = Math::CreateLookToMatrix(cameraPosition, Vector3(0.6f, -0.1f, 0.8f), Vector3::Up);
+	const BoundingFrustum frustum = Math::CreateBoundingFrustum(Math::CreatePerspectiveMatrix(Math::PI_DIV_2, 16.0f / 9.0f, 1000.0f, 0.1f), view);
+
+	// Shadow cascade around the camera
+	OrientedBoundingBox cascade;
+	cascade.Center = Vector3(100, 0, 100);
+	cascade.Extents = Vector3(150, 200, 150);
+	cascade.Orientation = Quaternion::CreateFromYawPitchRoll(0.6f, 0.8f, 0.0f);
+
+	CompareCull("Camera frustum", frustum);
+	CompareCull("Cascade OBB", cascade);
+
+	// Same test as the TLAS instance selection
+	auto IsSmall = [&](float radius, float distance)
+	{
+		return tanf(radius / distance) < 0.01f && distance > radius;
+	};
+	auto TestSize = [&](const BoundingBox& bounds, float maxRadius)
+	{
+		Vector3 offset = Vector3(bounds.Center) - cameraPosition;
+		Vector3 outside(
+			Math::Max(0.0f, fabsf(offset.x) - bounds.Extents.x),
+			Math::Max(0.0f, fabsf(offset.y) - bounds.Extents.y),
+			Math::Max(0.0f, fabsf(offset.z) - bounds.Extents.z));
+		return IsSmall(maxRadius, outside.Length()) ? DirectX::DISJOINT : DirectX::INTERSECTS;
+	};
+	const float linearSizeTime = TimeMS([&]()
+		{
+			linearResult.clear();
+			for (uint32 i = 0; i < numBatches; ++i)
+			{
+				if (!IsSmall(batches[i].Radius, Vector3::Distance(batches[i].Bounds.Center, cameraPosition)))
+					linearResult.push_back(i);
+			}
+		});
+	const float bvhSizeTime = TimeMS([&]()
+		{
+			bvhResult.clear();
+			bvh.Query(TestSize, [&](uint32 batchIndex)
+				{
+					if (!IsSmall(batches[batchIndex].Radius, Vector3::Distance(batches[batchIndex].Bounds.Center, cameraPosition)))
+						bvhResult.push_back(batchIndex);
+				});
+		});
+	Compare("Small objects", linearSizeTime, bvhSizeTime);
+
+	// Move 1% of the batches a bit and refit
+	std::vector<uint32> movedBatches;
+	for (uint32 i = 0; i < numBatches; i += 100)
+	{
+		batches[i].Bounds.Center.x += Math::RandomRange(-2.0f, 2.0f);
+		batches[i].Bounds.Center.z += Math::RandomRange(-2.0f, 2.0f);
+		movedBatches.push_back(i);
+	}
+	bool keepTree = true;
+	const float refitTime = TimeMS([&]() { keepTree = bvh.Refit(batches, movedBatches); });
+	E_LOG(Info, "\tRefit of %d moved batches: %.2f ms, rebuild requested: %s", (uint32)movedBatches.size(), refitTime, keepTree ? "no" : "yes");
+	CompareCull("Frustum (refit)", frustum);
+
+	if (isValid)
+	{
+		E_LOG(Info, "\tAll queries match the linear loops");
+	}
+}
@@ -0,0 +1,166 @@
+#pragma once
+#include "Core/DynamicBitField.h"
+
+struct Batch;
+
+/*
+	Bounding volume hierarchy over the batches of a scene view.
+	Built with a binned SAH and refit in place when only instances moved.
+	Queries reject or accept whole subtrees so their cost scales with what's visible instead of the scene size.
+*/
+class SceneBVH
+{
+public:
+	// Builds the tree over the bounds of the batches. Items are referred to by batch index.
+	void Build(const Span<Batch>& batches);
+
+	// Updates the bounds of the moved batches and their parents. The batches must be the same as the ones the tree was built with.
+	// Returns false when the tree has degraded enough to be worth a rebuild.
+	bool Refit(const Span<Batch>& batches, const Span<uint32>& movedBatches);
+
+	// Calls 'visit' with the batch index of each batch that isn't rejected by 'test'.
+	// 'test' is called on nodes and batches with their bounds and the largest batch radius they hold.
+	// It returns a DirectX::ContainmentType, everything below a contained node is visited without further tests.
+	template<typename TTest, typename TVisit>
+	void Query(TTest&& test, TVisit&& visit) const
+	{
+		if (m_Nodes.empty())
+			return;
+
+		constexpr uint32 ContainedFlag = 1u << 31u;
+		uint32 stack[MaxDepth + 1];
+		uint32 stackSize = 0;
+		stack[stackSize++] = 0;
+
+		while (stackSize > 0)
+		{
+			uint32 nodeIndex = stack[--stackSize];
+			bool contained = (nodeIndex & ContainedFlag) != 0;
+			nodeIndex &= ~ContainedFlag;
+			const Node& node = m_Nodes[nodeIndex];
+
+			if (!contained)
+			{
+				DirectX::ContainmentType containment = test(node.Bounds, node.MaxItemRadius);
+				if (containment == DirectX::DISJOINT)
+					continue;
+				contained = containment == DirectX::CONTAINS;
+			}
+
+			if (node.NumItems > 0)
+			{
+				for (uint32 i = node.ChildOrFirstItem; i < node.ChildOrFirstItem + node.NumItems; ++i)
+				{
+					if (contained || test(m_ItemBounds[i], m_ItemRadii[i]) != DirectX::DISJOINT)
+					{
+						visit(m_Items[i]);
+					}
+				}
+			}
+			else
+			{
+				const uint32 flag = contained ? ContainedFlag : 0;
+				stack[stackSize++] = (node.ChildOrFirstItem + 1) | flag;
+				stack[stackSize++] = node.ChildOrFirstItem | flag;
+			}
+		}
+	}
+
+	// Calls 'visit' with the batch index of each batch that isn't rejected by 'test', closest first, for closest hit queries.
+	// 'test' is called on nodes and batches with their bounds. It returns the distance at which the query enters the bounds,
+	// negative when it misses. It is meant to reject bounds beyond the closest hit found by 'visit' so far.
+	template<typename TTest, typename TVisit>
+	void QueryClosest(TTest&& test, TVisit&& visit) const
+	{
+		if (m_Nodes.empty() || test(m_Nodes[0].Bounds) < 0.0f)
+			return;
+
+		uint32 stack[MaxDepth + 1];
+		uint32 stackSize = 0;
+		stack[stackSize++] = 0;
+
+		while (stackSize > 0)
+		{
+			const Node& node = m_Nodes[stack[--stackSize]];
+			if (node.NumItems > 0)
+			{
+				for (uint32 i = node.ChildOrFirstItem; i < node.ChildOrFirstItem + node.NumItems; ++i)
+				{
+					if (test(m_ItemBounds[i]) >= 0.0f)
+					{
+						visit(m_Items[i]);
+					}
+				}
+			}
+			else
+			{
+				const uint32 left = node.ChildOrFirstItem;
+				const uint32 right = left + 1;
+				const float leftDistance = test(m_Nodes[left].Bounds);
+				const float rightDistance = test(m_Nodes[right].Bounds);
+				if (leftDistance >= 0.0f && rightDistance >= 0.0f)
+				{
+					// Push the farthest first so the closest is visited first
+					const bool leftFirst = leftDistance <= rightDistance;
+					stack[stackSize++] = leftFirst ? right : left;
+					stack[stackSize++] = leftFirst ? left : right;
+				}
+				else if (leftDistance >= 0.0f)
+				{
+					stack[stackSize++] = left;
+				}
+				else if (rightDistance >= 0.0f)
+				{
+					stack[stackSize++] = right;
+				}
+			}
+		}
+	}
+
+	// Visits the batches intersecting the volume. Works with any DirectX bounding volume.
+	template<typename TVolume, typename TVisit>
+	void Cull(const TVolume& volume, TVisit&& visit) const
+	{
+		Query([&](const BoundingBox& bounds, float) { return volume.Contains(bounds); }, visit);
+	}
+
+	bool IsEmpty() const { return m_Nodes.empty(); }
+	const BoundingBox& GetBounds() const { check(!IsEmpty()); return m_Nodes[0].Bounds; }
+	uint32 GetNumNodes() const { return (uint32)m_Nodes.size(); }
+
+	// Times the build, refit and queries over random batches and checks the query results against linear loops
+	static void Benchmark(uint32 numBatches);
+
+private:
+	static constexpr uint32 MaxDepth = 64;
+
+	struct Node
+	{
+		BoundingBox Bounds;
+		// First child for interior nodes, the second child follows it. First item for leaves.
+		uint32 ChildOrFirstItem;
+		// 0 for interior nodes
+		uint32 NumItems;
+		// Largest bounding sphere radius of the batches below the node
+		float MaxItemRadius;
+	};
+
+	float GetNodeCost(const Node& node) const;
+	void UpdateNodeBounds(uint32 nodeIndex, const Span<Batch>& batches);
+
+	std::vector<Node> m_Nodes;
+	std::vector<uint32> m_Parents;
+	// Batch index, bounds and radius of the items, in leaf order
+	std::vector<uint32> m_Items;
+	std::vector<BoundingBox> m_ItemBounds;
+	std::vector<float> m_ItemRadii;
+	// Leaf of each batch
+	std::vector<uint32> m_ItemLeaf;
+
+	DynamicBitField m_DirtyNodes;
+	std::vector<uint32> m_DirtyNodeList;
+
+	// SAH cost at build time and after the refits since
+	float m_BuildCost = 0;
+	float m_Cost = 0;
+};
@@ -12,11 +12,184 @@
 #include "Core/ConsoleVariables.h"
 #include "Content/Image.h"
 #include "Profiler.h"
+#include <chrono>
 
 namespace Tweakables
 {
 	extern ConsoleVariable<int> g_SsrSamples;
 	extern ConsoleVariable<bool> g_EnableDDGI;
+	extern ConsoleVariable<float> g_LODErrorThreshold;
+	extern ConsoleVariable<bool> g_ClusterLOD;
+
+	ConsoleCommand<int> gBenchmarkDrawSort("BenchmarkDrawSort", [](int numDraws) { Renderer::BenchmarkDrawSort(numDraws); });
+	ConsoleCommand<int> gBenchmarkInstanceTable("BenchmarkInstanceTable", [](int numOperations) { check(World::ValidateInstanceTable()); World::BenchmarkInstanceTable(numOperations); });
+}
+
+SlotHandle World::AddInstance(Mesh* pMesh, const SubMeshInstance& instance)
+{
+	SlotHandle handle = InstanceSlots.Allocate();
+	if (handle.Index >= Instances.size())
+	{
+		Instances.resize(handle.Index + 1);
+	}
+	WorldInstance& worldInstance = Instances[handle.Index];
+	worldInstance.pMesh = pMesh;
+	worldInstance.MeshIndex = instance.MeshIndex;
+	worldInstance.MaterialId = instance.MaterialId;
+	worldInstance.Transform = instance.Transform;
+	worldInstance.TransformPrev = instance.Transform;
+	return handle;
+}
+
+void World::RemoveInstance(const SlotHandle& handle)
+{
+	// The slot of a stale handle may hold another instance by now
+	if (!InstanceSlots.IsValid(handle))
+	{
+		return;
+	}
+	InstanceSlots.Release(handle);
+	WorldInstance& instance = Instances[handle.Index];
+	if (!instance.IsDynamic)
+	{
+		instance.pMesh->GetMesh(instance.MeshIndex).Bounds.Transform(RemovedBounds.emplace_back(), instance.Transform);
+	}
+	instance = WorldInstance();
+}
+
+WorldInstance* World::GetInstance(const SlotHandle& handle)
+{
+	return InstanceSlots.IsValid(handle) ? &Instances[handle.Index] : nullptr;
+}
+
+void World::SetDynamic(uint32 instanceID, bool isDynamic)
+{
+	check(InstanceSlots.IsAllocated(instanceID));
+	WorldInstance& instance = Instances[instanceID];
+	if (instance.IsDynamic == isDynamic)
+	{
+		return;
+	}
+	instance.IsDynamic = isDynamic;
+	if (isDynamic)
+	{
+		// Leaves the static geometry, invalidate where it was at the previous scene upload
+		if (!instance.IsDirty)
+		{
+			instance.pMesh->GetMesh(instance.MeshIndex).Bounds.Transform(RemovedBounds.emplace_back(), instance.TransformPrev);
+		}
+	}
+	else
+	{
+		// Joins the static geometry, the scene upload invalidates where it is now
+		instance.IsDirty = true;
+	}
+}
+
+void World::AddMesh(std::unique_ptr<Mesh>&& pMesh)
+{
+	for (const SubMeshInstance& instance : pMesh->GetMeshInstances())
+	{
+		AddInstance(pMesh.get(), instance);
+	}
+	Meshes.push_back(std::move(pMesh));
+	MeshesDirty = true;
+}
+
+void World::ClearMeshes()
+{
+	for (uint32 i = 0; i < (uint32)Instances.size(); ++i)
+	{
+		WorldInstance& instance = Instances[i];
+		if (InstanceSlots.IsAllocated(i) && !instance.IsDynamic)
+		{
+			instance.pMesh->GetMesh(instance.MeshIndex).Bounds.Transform(RemovedBounds.emplace_back(), instance.Transform);
+		}
+		instance = WorldInstance();
+	}
+	InstanceSlots.ReleaseAll();
+	Meshes.clear();
+	MeshesDirty = true;
+}
+
+bool World::ValidateInstanceTable()
+{
+	bool isValid = true;
+	auto Check = [&](bool condition, const char* pDescription)
+	{
+		if (!condition)
+		{
+			E_LOG(Error, "Instance table: %s", pDescription);
+			isValid = false;
+		}
+	};
+
+	// Dynamic instances don't look up the bounds of their mesh when removed
+	World world;
+	auto AddDynamic = [&]()
+	{
+		SlotHandle handle = world.AddInstance(nullptr, SubMeshInstance{ 0, 0, Matrix::Identity });
+		world.SetDynamic(handle.Index, true);
+		return handle;
+	};
+
+	const SlotHandle a = AddDynamic();
+	const SlotHandle b = AddDynamic();
+	Check(a.Index == 0 && b.Index == 1, "Slots are not handed out in order");
+
+	world.RemoveInstance(a);
+	Check(world.GetInstance(a) == nullptr, "Removed instance is still accessible");
+	Check(world.GetInstance(b) != nullptr, "Removing an instance affected another one");
+
+	const SlotHandle c = AddDynamic();
+	Check(c.Index == a.Index, "Released slot is not reused");
+	Check(c.Generation != a.Generation, "Reused slot has the generation of the released one");
+	Check(world.GetInstance(a) == nullptr, "Stale handle gives access to the instance in its slot");
+
+	world.RemoveInstance(a);
+	Check(world.GetInstance(c) != nullptr && world.Instances[c.Index].IsDynamic, "Removing a stale handle removed the instance in its slot");
+	Check(world.InstanceSlots.GetNumAllocated() == 2, "Removing a stale handle changed the number of instances");
+
+	world.ClearMeshes();
+	Check(world.GetInstance(b) == nullptr && world.GetInstance(c) == nullptr, "Instances are accessible after ClearMeshes");
+	Check(world.InstanceSlots.GetNumAllocated() == 0, "Slots are allocated after ClearMeshes");
+
+	const SlotHandle d = AddDynamic();
+	Check(d.Index < 2 && world.InstanceSlots.GetCapacity() == 2, "Slots are not reused after ClearMeshes");
+	Check(d != b && d != c, "Handle after ClearMeshes matches one from before");
+	return isValid;
+}
+
+void World::BenchmarkInstanceTable(uint32 numOperations)
+{
+	using Clock = std::chrono::high_resolution_clock;
+
+	World world;
+	std::vector<SlotHandle> handles;
+	handles.reserve(numOperations);
+	const SubMeshInstance instance{ 0, 0, Matrix::Identity };
+
+	const Clock::time_point start = Clock::now();
+	for (uint32 i = 0; i < numOperations; ++i)
+	{
+		if (handles.empty() || Math::RandomRange(0, 1) == 0)
+		{
+			SlotHandle handle = world.AddInstance(nullptr, instance);
+			world.SetDynamic(handle.Index, true);
+			handles.push_back(handle);
+		}
+		else
+		{
+			const uint32 index = (uint32)Math::RandomRange(0, (int)handles.size() - 1);
+			world.RemoveInstance(handles[index]);
+			std::swap(handles[index], handles.back());
+			handles.pop_back();
+		}
+	}
+	const float milliseconds = std::chrono::duration<float, std::milli>(Clock::now() - start).count();
+
+	E_LOG(Info, "Instance table: %d random adds and removes in %.3f ms (%.1f ns each)", numOperations, milliseconds, milliseconds * 1e6f / Math::Max(numOperations, 1u));
+	E_LOG(Info, "\tLive instances: %d, slots: %d", world.InstanceSlots.GetNumAllocated(), world.InstanceSlots.GetCapacity());
 }
 
 namespace Renderer
@@ -83,7 +256,7 @@ namespace Renderer
 		parameters.FoV = view.FoV;
 
 		parameters.FrameIndex = pView->FrameIndex;
-		parameters.NumInstances = (uint32)pView->Batches.size();
+		parameters.NumInstances = pView->NumInstances;
 		parameters.SsrSamples = Tweakables::g_SsrSamples.Get();
 		parameters.LightCount = pView->NumLights;
 
@@ -107,101 +280,336 @@ namespace Renderer
 		parameters.FontDataIndex = pView->DebugRenderData.FontDataSRV;
 		parameters.DebugRenderDataIndex = pView->DebugRenderData.RenderDataUAV;
 
+		parameters.LODErrorThreshold = Tweakables::g_LODErrorThreshold;
+		parameters.UseClusterLOD = Tweakables::g_ClusterLOD;
+
 		return parameters;
 	}
 
+	uint32 SelectLOD(const SubMesh& mesh, const Matrix& worldMatrix, const ViewTransform& view, float errorThreshold)
+	{
+		if (mesh.LODs.size() <= 1)
+			return 0;
+
+		// Must match SelectLOD in MeshletCull.hlsl
+		float scale = sqrtf(Math::Max(Vector3(worldMatrix._11, worldMatrix._12, worldMatrix._13).LengthSquared(),
+			Math::Max(Vector3(worldMatrix._21, worldMatrix._22, worldMatrix._23).LengthSquared(), Vector3(worldMatrix._31, worldMatrix._32, worldMatrix._33).LengthSquared())));
+		float pixelsPerUnit = view.Viewport.GetHeight() * 0.5f * view.Projection._22 * scale;
+		if (view.Perspective)
+		{
+			Vector3 center = Vector3::Transform(mesh.Bounds.Center, worldMatrix);
+			float radius = Vector3(mesh.Bounds.Extents).Length() * scale;
+			pixelsPerUnit /= Math::Max(Vector3::Distance(center, view.Position) - radius, view.NearPlane);
+		}
+
+		uint32 lod = 0;
+		while (lod + 1 < (uint32)mesh.LODs.size() && mesh.LODs[lod + 1].Error * pixelsPerUnit <= errorThreshold)
+		{
+			++lod;
+		}
+		return lod;
+	}
+
+	// Scene buffer elements written this frame, in increasing index order
+	template<typename T>
+	struct DirtyElements
+	{
+		std::vector<uint32> Indices;
+		std::vector<T> Data;
+
+		T& Add(uint32 index)
+		{
+			check(Indices.empty() || index > Indices.back());
+			Indices.push_back(index);
+			return Data.emplace_back();
+		}
+	};
+
+	// Grows the buffer to hold 'numElements' and uploads the dirty elements.
+	// Consecutive elements form a range, all ranges share a single upload allocation and are scattered with a copy each.
+	// Returns the number of uploaded bytes.
+	template<typename T>
+	static uint64 UploadDirtyElements(CommandContext& context, const DirtyElements<T>& elements, uint32 numElements, const char* pName, RefCountPtr<Buffer>& pTarget)
+	{
+		constexpr uint32 stride = sizeof(T);
+		if (!pTarget || numElements > pTarget->GetNumElements())
+		{
+			// Grow with some slack and keep the contents, so adding elements doesn't re-upload the whole buffer
+			const uint32 desiredElements = Math::AlignUp(Math::Max(1u, numElements + numElements / 2), 8u);
+			RefCountPtr<Buffer> pNewTarget = context.GetParent()->CreateBuffer(BufferDesc::CreateStructured(desiredElements, stride, BufferFlag::ShaderResource), pName);
+			if (pTarget)
+			{
+				context.CopyBuffer(pTarget, pNewTarget, pTarget->GetSize(), 0, 0);
+			}
+			pTarget = pNewTarget;
+		}
+
+		if (elements.Indices.empty())
+			return 0;
+
+		const uint64 dirtySize = (uint64)elements.Data.size() * stride;
+		DynamicAllocation allocation = context.AllocateTransientMemory(dirtySize);
+		memcpy(allocation.pMappedMemory, elements.Data.data(), dirtySize);
+
+		uint32 rangeBegin = 0;
+		for (uint32 i = 1; i <= (uint32)elements.Indices.size(); ++i)
+		{
+			if (i < (uint32)elements.Indices.size() && elements.Indices[i] == elements.Indices[i - 1] + 1)
+				continue;
+
+			const uint64 size = (uint64)(i - rangeBegin) * stride;
+			context.CopyBuffer(allocation.pBackingResource, pTarget, size, allocation.Offset + (uint64)rangeBegin * stride, (uint64)elements.Indices[rangeBegin] * stride);
+			rangeBegin = i;
+		}
+		return dirtySize;
+	}
+
+	static void GetMeshData(const Mesh& mesh, const SubMesh& subMesh, ShaderInterop::MeshData& outMesh)
+	{
+		outMesh.BufferIndex = mesh.GetData()->GetSRVIndex();
+		outMesh.IndexByteSize = subMesh.IndicesLocation.Stride();
+		outMesh.IndicesOffset = (uint32)subMesh.IndicesLocation.OffsetFromStart;
+		outMesh.PositionsOffset = (uint32)subMesh.PositionStreamLocation.OffsetFromStart;
+		outMesh.NormalsOffset = (uint32)subMesh.NormalStreamLocation.OffsetFromStart;
+		outMesh.ColorsOffset = (uint32)subMesh.ColorsStreamLocation.OffsetFromStart;
+		outMesh.UVsOffset = (uint32)subMesh.UVStreamLocation.OffsetFromStart;
+
+		outMesh.MeshletOffset = subMesh.MeshletsLocation;
+		outMesh.MeshletVertexOffset = subMesh.MeshletVerticesLocation;
+		outMesh.MeshletTriangleOffset = subMesh.MeshletTrianglesLocation;
+		outMesh.MeshletBoundsOffset = subMesh.MeshletBoundsLocation;
+		outMesh.MeshletCount = subMesh.NumMeshlets;
+
+		outMesh.BoundsOrigin = subMesh.Bounds.Center;
+		outMesh.BoundsExtents = subMesh.Bounds.Extents;
+		outMesh.LODCount = Math::Min((uint32)subMesh.LODs.size(), (uint32)ShaderInterop::MESH_MAX_LODS);
+		for (uint32 lodIndex = 0; lodIndex < outMesh.LODCount; ++lodIndex)
+		{
+			const SubMeshLOD& lod = subMesh.LODs[lodIndex];
+			outMesh.LODs[lodIndex].MeshletStart = lod.MeshletStart;
+			outMesh.LODs[lodIndex].MeshletCount = lod.NumMeshlets;
+			outMesh.LODs[lodIndex].Error = lod.Error;
+		}
+
+		outMesh.ClusterCount = subMesh.NumClusters;
+		outMesh.ClusterLODBoundsOffset = subMesh.ClusterLODBoundsLocation;
+		outMesh.UVOffset = subMesh.UVOffset;
+		outMesh.UVScale = subMesh.UVScale;
+	}
+
+	static void GetMaterialData(const Material& material, ShaderInterop::MaterialData& outMaterial)
+	{
+		outMaterial.Diffuse = material.pDiffuseTexture ? material.pDiffuseTexture->GetSRVIndex() : -1;
+		outMaterial.Normal = material.pNormalTexture ? material.pNormalTexture->GetSRVIndex() : -1;
+		outMaterial.RoughnessMetalness = material.pRoughnessMetalnessTexture ? material.pRoughnessMetalnessTexture->GetSRVIndex() : -1;
+		outMaterial.Emissive = material.pEmissiveTexture ? material.pEmissiveTexture->GetSRVIndex() : -1;
+		outMaterial.BaseColorFactor = material.BaseColorFactor;
+		outMaterial.MetalnessFactor = material.MetalnessFactor;
+		outMaterial.RoughnessFactor = material.RoughnessFactor;
+		outMaterial.EmissiveFactor = material.EmissiveFactor;
+		outMaterial.AlphaCutoff = material.AlphaCutoff;
+	}
+
+	static void GetLightData(const Light& light, ShaderInterop::Light& outLight)
+	{
+		outLight.Position = light.Position;
+		outLight.Direction = Vector3::Transform(Vector3::Forward, light.Rotation);
+		outLight.SpotlightAngles.x = cos(light.PenumbraAngleDegrees * Math::DegreesToRadians / 2.0f);
+		outLight.SpotlightAngles.y = cos(light.UmbraAngleDegrees * Math::DegreesToRadians / 2.0f);
+		outLight.Color = Math::Pack_RGBA8_UNORM(light.Colour);
+		outLight.Intensity = light.Intensity;
+		outLight.Range = light.Range;
+		outLight.ShadowMapIndex = light.CastShadows && light.ShadowMaps.size() ? light.ShadowMaps[0]->GetSRVIndex() : DescriptorHandle::InvalidHeapIndex;
+		outLight.MaskTexture = light.pLightTexture ? light.pLightTexture->GetSRVIndex() : DescriptorHandle::InvalidHeapIndex;
+		outLight.MatrixIndex = light.MatrixIndex;
+		outLight.InvShadowSize = 1.0f / light.ShadowMapSize;
+		outLight.IsEnabled = light.Intensity > 0 ? 1 : 0;
+		outLight.IsVolumetric = light.VolumetricLighting;
+		outLight.CastShadows = light.ShadowMaps.size() && light.CastShadows;
+		outLight.IsPoint = light.Type == LightType::Point;
+		outLight.IsSpot = light.Type == LightType::Spot;
+		outLight.IsDirectional = light.Type == LightType::Directional;
+	}
+
 	void UploadSceneData(CommandContext& context, SceneView* pView, World* pWorld)
 	{
 		GPU_PROFILE_SCOPE("Upload Scene Data", &context);
 
-		std::vector<ShaderInterop::MaterialData> materials;
-		materials.reserve(128);
-		std::vector<ShaderInterop::MeshData> meshes;
-		meshes.reserve(128);
-		std::vector<ShaderInterop::InstanceData> meshInstances;
-		meshInstances.reserve(pView->Batches.size());
-		std::vector<Batch> sceneBatches;
-		sceneBatches.reserve(pView->Batches.size());
-		uint32 instanceID = 0;
+		SceneUploadCache& cache = pView->UploadCache;
+		DirtyElements<ShaderInterop::MeshData> meshes;
+		DirtyElements<ShaderInterop::MaterialData> materials;
+
+		// Meshes are only added or removed while loading, all submeshes and materials are written then.
+		// Instances of meshes which moved within the buffers are written again as well.
+		const bool meshesDirty = pWorld->MeshesDirty;
+		std::unordered_set<const Mesh*> relocatedMeshes;
+		if (meshesDirty)
+		{
+			std::unordered_map<const Mesh*, SceneUploadCache::MeshOffsets> offsets;
+			uint32 numMeshes = 0;
+			uint32 numMaterials = 0;
+			for (const auto& pMesh : pWorld->Meshes)
+			{
+				const SceneUploadCache::MeshOffsets meshOffsets{ numMeshes, numMaterials };
+				offsets[pMesh.get()] = meshOffsets;
+				numMeshes += (uint32)pMesh->GetMeshCount();
+				numMaterials += pMesh->GetMaterials().GetSize();
+
+				auto it = cache.Offsets.find(pMesh.get());
+				if (it == cache.Offsets.end() || it->second.Meshes != meshOffsets.Meshes || it->second.Materials != meshOffsets.Materials)
+				{
+					relocatedMeshes.insert(pMesh.get());
+				}
+			}
+			cache.Offsets.swap(offsets);
+			cache.NumMeshes = numMeshes;
+			cache.NumMaterials = numMaterials;
+			pWorld->MeshesDirty = false;
+		}
 
 		for (const auto& pMesh : pWorld->Meshes)
 		{
-			for (const SubMeshInstance& node : pMesh->GetMeshInstances())
+			const SceneUploadCache::MeshOffsets& offsets = cache.Offsets.at(pMesh.get());
+			if (meshesDirty)
 			{
-				SubMesh& parentMesh = pMesh->GetMesh(node.MeshIndex);
-				const Material& meshMaterial = pMesh->GetMaterial(parentMesh.MaterialId);
+				for (int i = 0; i < pMesh->GetMeshCount(); ++i)
+				{
+					GetMeshData(*pMesh, pMesh->GetMesh(i), meshes.Add(offsets.Meshes + i));
+				}
+			}
 
-				auto GetBlendMode = [](MaterialAlphaMode mode) {
-					switch (mode)
-					{
-					case MaterialAlphaMode::Blend: return Batch::Blending::AlphaBlend;
-					case MaterialAlphaMode::Opaque: return Batch::Blending::Opaque;
-					case MaterialAlphaMode::Masked: return Batch::Blending::AlphaMask;
-					}
-					return Batch::Blending::Opaque;
-				};
-
-				Batch& batch = sceneBatches.emplace_back();
-				batch.InstanceID = instanceID;
-				batch.pMesh = &parentMesh;
-				batch.BlendMode = GetBlendMode(meshMaterial.AlphaMode);
-				batch.WorldMatrix = node.Transform;
-				parentMesh.Bounds.Transform(batch.Bounds, batch.WorldMatrix);
-				batch.Radius = Vector3(batch.Bounds.Extents).Length();
-
-				ShaderInterop::InstanceData& meshInstance = meshInstances.emplace_back();
+			for (int i = 0; i < (int)pMesh->GetMaterials().GetSize(); ++i)
+			{
+				Material& material = pMesh->GetMaterial(i);
+				if (material.IsDirty || meshesDirty)
+				{
+					GetMaterialData(material, materials.Add(offsets.Materials + i));
+					material.IsDirty = false;
+				}
+			}
+		}
+
+		auto GetBlendMode = [](MaterialAlphaMode mode) {
+			switch (mode)
+			{
+			case MaterialAlphaMode::Blend: return Batch::Blending::AlphaBlend;
+			case MaterialAlphaMode::Opaque: return Batch::Blending::Opaque;
+			case MaterialAlphaMode::Masked: return Batch::Blending::AlphaMask;
+			}
+			return Batch::Blending::Opaque;
+		};
+
+		// Instances are uploaded to their slot, free slots are marked with an invalid mesh
+		const uint32 numInstances = pWorld->InstanceSlots.GetCapacity();
+		DirtyElements<ShaderInterop::InstanceData> meshInstances;
+		std::vector<Batch> sceneBatches;
+		sceneBatches.reserve(pWorld->InstanceSlots.GetNumAllocated());
+		std::vector<uint32> movedBatches;
+		// The BVH can only be refit when the batches are for the same instances as last time
+		bool canRefitBVH = pView->Batches.size() == pWorld->InstanceSlots.GetNumAllocated();
+
+		pView->DynamicInstances.Resize(numInstances);
+		pView->DynamicInstances.ClearAll();
+		pView->StaticChanges.swap(pWorld->RemovedBounds);
+		pWorld->RemovedBounds.clear();
+		cache.MovedInstances.Resize(numInstances);
+
+		for (uint32 instanceID = 0; instanceID < numInstances; ++instanceID)
+		{
+			WorldInstance& instance = pWorld->Instances[instanceID];
+			if (!pWorld->InstanceSlots.IsAllocated(instanceID))
+			{
+				if (instance.IsDirty)
+				{
+					ShaderInterop::InstanceData& meshInstance = meshInstances.Add(instanceID);
+					meshInstance = {};
+					meshInstance.ID = instanceID;
+					meshInstance.MeshIndex = ~0u;
+					meshInstance.MaterialIndex = ~0u;
+					instance.IsDirty = false;
+				}
+				cache.MovedInstances.ClearBit(instanceID);
+				continue;
+			}
+
+			SubMesh& parentMesh = instance.pMesh->GetMesh(instance.MeshIndex);
+			const Material& meshMaterial = instance.pMesh->GetMaterial(instance.MaterialId);
+
+			const uint32 batchIndex = (uint32)sceneBatches.size();
+			Batch& batch = sceneBatches.emplace_back();
+			batch.InstanceID = instanceID;
+			canRefitBVH = canRefitBVH && pView->Batches[batchIndex].InstanceID == instanceID;
+			batch.pMesh = &parentMesh;
+			batch.pMaterial = &meshMaterial;
+			batch.BlendMode = GetBlendMode(meshMaterial.AlphaMode);
+			batch.WorldMatrix = instance.Transform;
+			parentMesh.Bounds.Transform(batch.Bounds, batch.WorldMatrix);
+			batch.Radius = Vector3(batch.Bounds.Extents).Length();
+			batch.LOD = SelectLOD(parentMesh, batch.WorldMatrix, pView->View, Tweakables::g_LODErrorThreshold);
+
+			const bool hasMoved = instance.Transform != instance.TransformPrev;
+			if (instance.IsDirty || hasMoved || cache.MovedInstances.GetBit(instanceID) || (!relocatedMeshes.empty() && relocatedMeshes.count(instance.pMesh) > 0))
+			{
+				const SceneUploadCache::MeshOffsets& offsets = cache.Offsets.at(instance.pMesh);
+				ShaderInterop::InstanceData& meshInstance = meshInstances.Add(instanceID);
 				meshInstance.ID = instanceID;
-				meshInstance.MeshIndex = (uint32)meshes.size() + node.MeshIndex;
-				meshInstance.MaterialIndex = (uint32)materials.size() + parentMesh.MaterialId;
-				meshInstance.LocalToWorld = node.Transform;
-				meshInstance.LocalToWorldPrev = node.Transform; //#todo
+				meshInstance.MeshIndex = offsets.Meshes + instance.MeshIndex;
+				meshInstance.MaterialIndex = offsets.Materials + instance.MaterialId;
+				meshInstance.LocalToWorld = instance.Transform;
+				meshInstance.LocalToWorldPrev = instance.TransformPrev;
 				meshInstance.LocalBoundsOrigin = parentMesh.Bounds.Center;
 				meshInstance.LocalBoundsExtents = parentMesh.Bounds.Extents;
-
-				++instanceID;
+			}
+			if (hasMoved)
+			{
+				cache.MovedInstances.SetBit(instanceID);
+			}
+			else
+			{
+				cache.MovedInstances.ClearBit(instanceID);
 			}
 
-			for (const SubMesh& subMesh : pMesh->GetMeshes())
+			if (instance.IsDirty || hasMoved)
 			{
-				ShaderInterop::MeshData& mesh = meshes.emplace_back();
-				mesh.BufferIndex = pMesh->GetData()->GetSRVIndex();
-				mesh.IndexByteSize = subMesh.IndicesLocation.Stride();
-				mesh.IndicesOffset = (uint32)subMesh.IndicesLocation.OffsetFromStart;
-				mesh.PositionsOffset = (uint32)subMesh.PositionStreamLocation.OffsetFromStart;
-				mesh.NormalsOffset = (uint32)subMesh.NormalStreamLocation.OffsetFromStart;
-				mesh.ColorsOffset = (uint32)subMesh.ColorsStreamLocation.OffsetFromStart;
-				mesh.UVsOffset = (uint32)subMesh.UVStreamLocation.OffsetFromStart;
-
-				mesh.MeshletOffset = subMesh.MeshletsLocation;
-				mesh.MeshletVertexOffset = subMesh.MeshletVerticesLocation;
-				mesh.MeshletTriangleOffset = subMesh.MeshletTrianglesLocation;
-				mesh.MeshletBoundsOffset = subMesh.MeshletBoundsLocation;
-				mesh.MeshletCount = subMesh.NumMeshlets;
+				movedBatches.push_back(batchIndex);
 			}
 
-			for (const Material& material : pMesh->GetMaterials())
+			if (instance.IsDynamic)
+			{
+				pView->DynamicInstances.SetBit(instanceID);
+			}
+			else if (instance.IsDirty || hasMoved)
 			{
-				ShaderInterop::MaterialData& materialData = materials.emplace_back();
-				materialData.Diffuse = material.pDiffuseTexture ? material.pDiffuseTexture->GetSRVIndex() : -1;
-				materialData.Normal = material.pNormalTexture ? material.pNormalTexture->GetSRVIndex() : -1;
-				materialData.RoughnessMetalness = material.pRoughnessMetalnessTexture ? material.pRoughnessMetalnessTexture->GetSRVIndex() : -1;
-				materialData.Emissive = material.pEmissiveTexture ? material.pEmissiveTexture->GetSRVIndex() : -1;
-				materialData.BaseColorFactor = material.BaseColorFactor;
-				materialData.MetalnessFactor = material.MetalnessFactor;
-				materialData.RoughnessFactor = material.RoughnessFactor;
-				materialData.EmissiveFactor = material.EmissiveFactor;
-				materialData.AlphaCutoff = material.AlphaCutoff;
+				// Both where it was and where it is now are invalidated
+				pView->StaticChanges.push_back(batch.Bounds);
+				if (!instance.IsDirty)
+				{
+					parentMesh.Bounds.Transform(pView->StaticChanges.emplace_back(), instance.TransformPrev);
+				}
 			}
+
+			instance.IsDirty = false;
+			instance.TransformPrev = instance.Transform;
 		}
 		sceneBatches.swap(pView->Batches);
+		pView->NumInstances = numInstances;
 
-		std::vector<ShaderInterop::DDGIVolume> ddgiVolumes;
+		{
+			PROFILE_SCOPE("Update Scene BVH");
+			if (!canRefitBVH || !pView->BVH.Refit(pView->Batches, movedBatches))
+			{
+				pView->BVH.Build(pView->Batches);
+			}
+		}
+
+		// There are only a few volumes and the history textures they point to are swapped every frame, so they're always written
+		DirtyElements<ShaderInterop::DDGIVolume> ddgiVolumes;
 		if (Tweakables::g_EnableDDGI)
 		{
-			ddgiVolumes.reserve(pWorld->DDGIVolumes.size());
-			for (DDGIVolume& ddgiVolume : pWorld->DDGIVolumes)
+			for (uint32 i = 0; i < (uint32)pWorld->DDGIVolumes.size(); ++i)
 			{
-				ShaderInterop::DDGIVolume& ddgi = ddgiVolumes.emplace_back();
+				const DDGIVolume& ddgiVolume = pWorld->DDGIVolumes[i];
+				ShaderInterop::DDGIVolume& ddgi = ddgiVolumes.Add(i);
 				ddgi.BoundsMin = ddgiVolume.Origin - ddgiVolume.Extents;
 				ddgi.ProbeSize = 2 * ddgiVolume.Extents / (Vector3((float)ddgiVolume.NumProbes.x, (float)ddgiVolume.NumProbes.y, (float)ddgiVolume.NumProbes.z) - Vector3::One);
 				ddgi.ProbeVolumeDimensions = Vector3u(ddgiVolume.NumProbes.x, ddgiVolume.NumProbes.y, ddgiVolume.NumProbes.z);
@@ -213,73 +621,77 @@ namespace Renderer
 				ddgi.MaxRaysPerProbe = ddgiVolume.MaxNumRays;
 			}
 		}
-		pView->NumDDGIVolumes = (uint32)ddgiVolumes.size();
-
-		std::vector<ShaderInterop::Light> lightData;
-		lightData.reserve(pWorld->Lights.size());
-		for (const Light& light : pWorld->Lights)
-		{
-			ShaderInterop::Light& data = lightData.emplace_back();
-			data.Position = light.Position;
-			data.Direction = Vector3::Transform(Vector3::Forward, light.Rotation);
-			data.SpotlightAngles.x = cos(light.PenumbraAngleDegrees * Math::DegreesToRadians / 2.0f);
-			data.SpotlightAngles.y = cos(light.UmbraAngleDegrees * Math::DegreesToRadians / 2.0f);
-			data.Color = Math::Pack_RGBA8_UNORM(light.Colour);
-			data.Intensity = light.Intensity;
-			data.Range = light.Range;
-			data.ShadowMapIndex = light.CastShadows && light.ShadowMaps.size() ? light.ShadowMaps[0]->GetSRVIndex() : DescriptorHandle::InvalidHeapIndex;
-			data.MaskTexture = light.pLightTexture ? light.pLightTexture->GetSRVIndex() : DescriptorHandle::InvalidHeapIndex;
-			data.MatrixIndex = light.MatrixIndex;
-			data.InvShadowSize = 1.0f / light.ShadowMapSize;
-			data.IsEnabled = light.Intensity > 0 ? 1 : 0;
-			data.IsVolumetric = light.VolumetricLighting;
-			data.CastShadows = light.ShadowMaps.size() && light.CastShadows;
-			data.IsPoint = light.Type == LightType::Point;
-			data.IsSpot = light.Type == LightType::Spot;
-			data.IsDirectional = light.Type == LightType::Directional;
-		}
-		pView->NumLights = (uint32)pWorld->Lights.size();
+		pView->NumDDGIVolumes = (uint32)ddgiVolumes.Data.size();
 
-		GraphicsDevice* pDevice = context.GetParent();
-		auto CopyBufferData = [&](uint32 numElements, uint32 stride, const char* pName, const void* pSource, RefCountPtr<Buffer>& pTarget)
+		// Removing lights shifts the ones after it, so a different count writes all of them
+		DirtyElements<ShaderInterop::Light> lightData;
+		const uint32 numLights = (uint32)pWorld->Lights.size();
+		const bool allLightsDirty = numLights != cache.NumLights;
+		for (uint32 i = 0; i < numLights; ++i)
 		{
-			uint32 desiredElements = Math::AlignUp(Math::Max(1u, numElements), 8u);
-			if (!pTarget || desiredElements > pTarget->GetNumElements())
+			Light& light = pWorld->Lights[i];
+			if (light.IsDirty || allLightsDirty)
 			{
-				pTarget = pDevice->CreateBuffer(BufferDesc::CreateStructured(desiredElements, stride, BufferFlag::ShaderResource), pName);
+				GetLightData(light, lightData.Add(i));
+				light.IsDirty = false;
 			}
-			context.WriteBuffer(pTarget, pSource, numElements * stride);
-		};
-
-		CopyBufferData((uint32)ddgiVolumes.size(), sizeof(ShaderInterop::DDGIVolume), "DDGI Volumes", ddgiVolumes.data(), pView->pDDGIVolumesBuffer);
-		CopyBufferData((uint32)meshes.size(), sizeof(ShaderInterop::MeshData), "Meshes", meshes.data(), pView->pMeshBuffer);
-		CopyBufferData((uint32)meshInstances.size(), sizeof(ShaderInterop::InstanceData), "Instances", meshInstances.data(), pView->pInstanceBuffer);
-		CopyBufferData((uint32)materials.size(), sizeof(ShaderInterop::MaterialData), "Materials", materials.data(), pView->pMaterialBuffer);
-		CopyBufferData((uint32)lightData.size(), sizeof(ShaderInterop::Light), "Lights", lightData.data(), pView->pLightBuffer);
+		}
+		cache.NumLights = numLights;
+		pView->NumLights = numLights;
+
+		uint64 uploadedBytes = 0;
+		uploadedBytes += UploadDirtyElements(context, ddgiVolumes, (uint32)ddgiVolumes.Data.size(), "DDGI Volumes", pView->pDDGIVolumesBuffer);
+		uploadedBytes += UploadDirtyElements(context, meshes, cache.NumMeshes, "Meshes", pView->pMeshBuffer);
+		uploadedBytes += UploadDirtyElements(context, meshInstances, numInstances, "Instances", pView->pInstanceBuffer);
+		uploadedBytes += UploadDirtyElements(context, materials, cache.NumMaterials, "Materials", pView->pMaterialBuffer);
+		uploadedBytes += UploadDirtyElements(context, lightData, numLights, "Lights", pView->pLightBuffer);
+		PROFILE_COUNTER("Scene Upload (bytes)", uploadedBytes);
 	}
 
-	void DrawScene(CommandContext& context, const SceneView* pView, const VisibilityMask& visibility, Batch::Blending blendModes)
+	// Sort key: | 63..62 blend mode | 61..30 view distance | 29..0 batch index |
+	// Non-blended batches are drawn front to back for early depth rejection, blended batches back to front.
+	static uint64 GetDrawSortKey(const Batch& batch, uint32 batchIndex, const Vector3& viewPosition)
 	{
-		std::vector<const Batch*> meshes;
-		meshes.reserve(pView->Batches.size());
-		for (const Batch& b : pView->Batches)
+		// Positive floats keep their order when compared as integers
+		float distance = Vector3::DistanceSquared(batch.Bounds.Center, viewPosition);
+		uint32 depthKey;
+		memcpy(&depthKey, &distance, sizeof(uint32));
+		uint64 blendKey = 0;
+		if (batch.BlendMode == Batch::Blending::AlphaMask)
 		{
-			if (EnumHasAnyFlags(b.BlendMode, blendModes) && visibility.GetBit(b.InstanceID))
-			{
-				meshes.push_back(&b);
-			}
+			blendKey = 1;
+		}
+		else if (batch.BlendMode == Batch::Blending::AlphaBlend)
+		{
+			blendKey = 2;
+			depthKey = ~depthKey;
 		}
+		return (blendKey << 62) | ((uint64)depthKey << 30) | batchIndex;
+	}
 
-		auto CompareSort = [pView, blendModes](const Batch* a, const Batch* b)
+	void DrawScene(CommandContext& context, const SceneView* pView, const VisibilityMask& visibility, Batch::Blending blendModes, const ViewTransform* pLODView)
+	{
+		// The keys of each thread are kept around so drawing doesn't allocate
+		static thread_local std::vector<uint64> sortKeys;
+		static thread_local std::vector<uint64> sortScratch;
+
+		const uint32 numBatches = (uint32)pView->Batches.size();
+		check(numBatches < (1u << 30));
+		sortKeys.clear();
+		for (uint32 i = 0; i < numBatches; ++i)
 		{
-			float aDist = Vector3::DistanceSquared(a->Bounds.Center, pView->View.Position);
-			float bDist = Vector3::DistanceSquared(b->Bounds.Center, pView->View.Position);
-			return EnumHasAnyFlags(blendModes, Batch::Blending::AlphaBlend) ? bDist < aDist : aDist < bDist;
-		};
-		std::sort(meshes.begin(), meshes.end(), CompareSort);
+			const Batch& b = pView->Batches[i];
+			if (!EnumHasAnyFlags(b.BlendMode, blendModes) || !visibility.GetBit(b.InstanceID))
+				continue;
+
+			sortKeys.push_back(GetDrawSortKey(b, i, pView->View.Position));
+		}
+		sortScratch.resize(sortKeys.size());
+		Utils::RadixSort(sortKeys.data(), sortScratch.data(), (uint32)sortKeys.size());
 
-		for (const Batch* b : meshes)
+		for (uint64 key : sortKeys)
 		{
+			const Batch* b = &pView->Batches[key & ((1u << 30) - 1)];
 			context.SetRootConstants(0, b->InstanceID);
 			if (context.GetCurrentPSO()->GetType() == PipelineStateType::Mesh)
 			{
@@ -287,11 +699,96 @@ namespace Renderer
 			}
 			else
 			{
-				context.SetIndexBuffer(b->pMesh->IndicesLocation);
-				context.DrawIndexedInstanced(b->pMesh->IndicesLocation.Elements, 0, 1, 0, 0);
+				const uint32 lod = pLODView ? SelectLOD(*b->pMesh, b->WorldMatrix, *pLODView, Tweakables::g_LODErrorThreshold) : b->LOD;
+				const IndexBufferView& indices = b->pMesh->LODs[lod].IndicesLocation;
+				context.SetIndexBuffer(indices);
+				context.DrawIndexedInstanced(indices.Elements, 0, 1, 0, 0);
 			}
 		}
 	}
+
+	void BenchmarkDrawSort(uint32 numDraws, uint32 iterations)
+	{
+		using Clock = std::chrono::high_resolution_clock;
+
+		numDraws = Math::Clamp(numDraws, 1u, (1u << 30) - 1);
+		iterations = Math::Max(iterations, 1u);
+		std::vector<Batch> batches(numDraws);
+		for (Batch& batch : batches)
+		{
+			batch.Bounds.Center = Vector3(Math::RandomRange(-500.0f, 500.0f), Math::RandomRange(-50.0f, 50.0f), Math::RandomRange(-500.0f, 500.0f));
+			const int blendMode = Math::RandomRange(0, 9);
+			batch.BlendMode = blendMode < 7 ? Batch::Blending::Opaque : (blendMode < 9 ? Batch::Blending::AlphaMask : Batch::Blending::AlphaBlend);
+		}
+		const Vector3 viewPosition(10, 5, -20);
+
+		// What DrawScene did before it used sort keys: collect pointers and sort them by distance, once per pass
+		std::vector<const Batch*> sortedBatches;
+		const Clock::time_point compareStart = Clock::now();
+		for (uint32 iteration = 0; iteration < iterations; ++iteration)
+		{
+			for (Batch::Blending blendModes : { Batch::Blending::Opaque | Batch::Blending::AlphaMask, Batch::Blending::AlphaBlend })
+			{
+				std::vector<const Batch*> meshes;
+				meshes.reserve(batches.size());
+				for (const Batch& b : batches)
+				{
+					if (EnumHasAnyFlags(b.BlendMode, blendModes))
+					{
+						meshes.push_back(&b);
+					}
+				}
+				std::sort(meshes.begin(), meshes.end(), [&](const Batch* a, const Batch* b)
+					{
+						float aDist = Vector3::DistanceSquared(a->Bounds.Center, viewPosition);
+						float bDist = Vector3::DistanceSquared(b->Bounds.Center, viewPosition);
+						return EnumHasAnyFlags(blendModes, Batch::Blending::AlphaBlend) ? bDist < aDist : aDist < bDist;
+					});
+				sortedBatches.swap(meshes);
+			}
+		}
+		const float compareMilliseconds = std::chrono::duration<float, std::milli>(Clock::now() - compareStart).count() / iterations;
+
+		std::vector<uint64> keys;
+		std::vector<uint64> scratch;
+		const Clock::time_point radixStart = Clock::now();
+		for (uint32 iteration = 0; iteration < iterations; ++iteration)
+		{
+			for (Batch::Blending blendModes : { Batch::Blending::Opaque | Batch::Blending::AlphaMask, Batch::Blending::AlphaBlend })
+			{
+				keys.clear();
+				for (uint32 i = 0; i < numDraws; ++i)
+				{
+					if (EnumHasAnyFlags(batches[i].BlendMode, blendModes))
+					{
+						keys.push_back(GetDrawSortKey(batches[i], i, viewPosition));
+					}
+				}
+				scratch.resize(keys.size());
+				Utils::RadixSort(keys.data(), scratch.data(), (uint32)keys.size());
+			}
+		}
+		const float radixMilliseconds = std::chrono::duration<float, std::milli>(Clock::now() - radixStart).count() / iterations;
+
+		// The last pass sorted the blended batches. Both must be back to front.
+		bool isValid = keys.size() == sortedBatches.size();
+		for (uint32 i = 0; isValid && i < (uint32)keys.size(); ++i)
+		{
+			const Batch& batch = batches[keys[i] & ((1u << 30) - 1)];
+			isValid = Vector3::DistanceSquared(batch.Bounds.Center, viewPosition) == Vector3::DistanceSquared(sortedBatches[i]->Bounds.Center, viewPosition);
+		}
+		std::vector<uint64> expectedKeys(keys);
+		std::sort(expectedKeys.begin(), expectedKeys.end());
+		isValid &= expectedKeys == keys;
+
+		E_LOG(Info, "Draw sort: %d draws, %d iterations", numDraws, iterations);
+		E_LOG(Info, "\tPointer sort by distance: %.3f ms", compareMilliseconds);
+		E_LOG(Info, "\tSort keys and radix sort: %.3f ms", radixMilliseconds);
+		if (!isValid)
+		{
+			E_LOG(Error, "Draw sort: the radix sorted order doesn't match the comparison sort");
+		}
+	}
 }
 
 namespace GraphicsCommon
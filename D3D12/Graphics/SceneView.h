@@ -1,5 +1,7 @@
 #pragma once
-#include "Core/BitField.h"
+#include "Core/DynamicBitField.h"
+#include "Core/SlotAllocator.h"
+#include "SceneBVH.h"
 #include "ShaderInterop.h"
 #include "AccelerationStructure.h"
 #include "RenderGraph/RenderGraphDefinitions.h"
@@ -15,13 +17,51 @@ class CommandSignature;
 class GraphicsDevice;
 class Image;
 struct SubMesh;
+struct SubMeshInstance;
+struct Material;
 struct Light;
 
+// A submesh placed in the world.
+// Its slot in the instance table is its instance ID, which stays the same for as long as it lives.
+struct WorldInstance
+{
+	Mesh* pMesh = nullptr;
+	int MeshIndex = 0;
+	int MaterialId = 0;
+	Matrix Transform;
+	Matrix TransformPrev;		// Transform at the previous scene upload, for motion vectors
+	bool IsDynamic = false;		// Expected to move, kept out of cached shadow maps
+	bool IsDirty = true;		// Added or changed since the previous scene upload
+};
+
 struct World
 {
 	std::vector<Light> Lights;
 	std::vector<std::unique_ptr<Mesh>> Meshes;
 	std::vector<DDGIVolume> DDGIVolumes;
+
+	// Indexed by slot, free slots have no mesh
+	std::vector<WorldInstance> Instances;
+	SlotAllocator InstanceSlots;
+	// World space bounds of the static instances removed since the previous scene upload
+	std::vector<BoundingBox> RemovedBounds;
+	// Meshes were added or removed since the previous scene upload
+	bool MeshesDirty = true;
+
+	SlotHandle AddInstance(Mesh* pMesh, const SubMeshInstance& instance);
+	void RemoveInstance(const SlotHandle& handle);
+	WorldInstance* GetInstance(const SlotHandle& handle);
+	// Dynamic instances are left out of cached shadow maps and drawn over them every frame
+	void SetDynamic(uint32 instanceID, bool isDynamic);
+
+	// Adds the mesh together with all its instances
+	void AddMesh(std::unique_ptr<Mesh>&& pMesh);
+	void ClearMeshes();
+
+	// Checks slot reuse, stale handles and ClearMeshes on instances without a mesh. Returns false on failure.
+	static bool ValidateInstanceTable();
+	// Times random adds and removes of instances and logs the result
+	static void BenchmarkInstanceTable(uint32 numOperations);
 };
 
 struct ViewTransform
@@ -58,13 +98,15 @@ struct Batch
 	uint32 InstanceID;
 	Blending BlendMode = Blending::Opaque;
 	SubMesh* pMesh;
+	const Material* pMaterial;
 	Matrix WorldMatrix;
 	BoundingBox Bounds;
 	float Radius;
+	uint32 LOD = 0;
 };
 DECLARE_BITMASK_TYPE(Batch::Blending)
 
-using VisibilityMask = BitField<8192>;
+using VisibilityMask = DynamicBitField;
 
 struct ShadowView
 {
@@ -74,17 +116,43 @@ struct ShadowView
 	OrientedBoundingBox OrtographicFrustum;
 	BoundingFrustum PerspectiveFrustum;
 	VisibilityMask Visibility;
+	// Projection, position and resolution of the shadow map, the LODs drawn into it are selected for this view
+	ViewTransform View;
+};
+
+// Persistent layout of the scene buffers, so an upload only has to write the elements that changed
+struct SceneUploadCache
+{
+	struct MeshOffsets
+	{
+		uint32 Meshes;
+		uint32 Materials;
+	};
+	// The submeshes and materials of all meshes are stored back to back
+	std::unordered_map<const Mesh*, MeshOffsets> Offsets;
+	uint32 NumMeshes = 0;
+	uint32 NumMaterials = 0;
+	uint32 NumLights = 0;
+	// Instances which moved in the previous upload. They are written again once they stop, to update their previous transform.
+	VisibilityMask MovedInstances;
 };
 
 struct SceneView
 {
 	std::vector<Batch> Batches;
+	// Hierarchy over the bounds of Batches, used for culling and ray queries
+	SceneBVH BVH;
 	RefCountPtr<Buffer> pLightBuffer;
 	RefCountPtr<Buffer> pMaterialBuffer;
 	RefCountPtr<Buffer> pMeshBuffer;
 	RefCountPtr<Buffer> pInstanceBuffer;
 	RefCountPtr<Buffer> pDDGIVolumesBuffer;
 	uint32 NumDDGIVolumes = 0;
+	uint32 NumInstances = 0;
+	VisibilityMask DynamicInstances;
+	// World space bounds of the static geometry which changed in the last scene upload
+	std::vector<BoundingBox> StaticChanges;
+	SceneUploadCache UploadCache;
 	RefCountPtr<Texture> pSky;
 	int FrameIndex = 0;
 	Vector2u HZBDimensions;
@@ -116,10 +184,17 @@ struct SceneTextures
 
 namespace Renderer
 {
-	void DrawScene(CommandContext& context, const SceneView* pView, const VisibilityMask& visibility, Batch::Blending blendModes);
+	// Draws with the LODs selected for 'pLODView' when given, otherwise with the LODs selected for the main view
+	void DrawScene(CommandContext& context, const SceneView* pView, const VisibilityMask& visibility, Batch::Blending blendModes, const ViewTransform* pLODView = nullptr);
 	void DrawScene(CommandContext& context, const SceneView* pView, Batch::Blending blendModes);
 	ShaderInterop::ViewUniforms GetViewUniforms(const SceneView* pView, Texture* pTarget = nullptr);
 	void UploadSceneData(CommandContext& context, SceneView* pView, World* pWorld);
+
+	// Returns the coarsest LOD of which the simplification error projects to less than 'errorThreshold' pixels
+	uint32 SelectLOD(const SubMesh& mesh, const Matrix& worldMatrix, const ViewTransform& view, float errorThreshold);
+
+	// Times the draw order of random batches with the sort keys of DrawScene against a comparison sort, and checks the orders match
+	void BenchmarkDrawSort(uint32 numDraws, uint32 iterations = 10);
 }
 
 enum class DefaultTexture
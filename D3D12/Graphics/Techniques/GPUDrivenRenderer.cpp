@@ -127,7 +127,7 @@ void GPUDrivenRenderer::CullAndRasterize(RGGraph& graph, const SceneView* pView,
 					});
 
 				if(isFirstPhase)
-					context.Dispatch(ComputeUtils::GetNumThreadGroups((uint32)pView->Batches.size(), 64));
+					context.Dispatch(ComputeUtils::GetNumThreadGroups(pView->NumInstances, 64));
 				else
 					context.ExecuteIndirect(GraphicsCommon::pIndirectDispatchSignature, 1, pDispatchBuffer->Get());
 			});
@@ -192,7 +192,7 @@ void GPUDrivenRenderer::Render(RGGraph& graph, const SceneView* pView, const Ras
 	{
 		numMeshlets += b.pMesh->NumMeshlets;
 	}
-	check(pView->Batches.size() <= maxNumInstances);
+	check(pView->NumInstances <= maxNumInstances);
 	check(numMeshlets <= maxNumMeshlets);
 #endif
 
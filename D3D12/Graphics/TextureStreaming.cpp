@@ -0,0 +1,532 @@
+#include "stdafx.h"
+#include "TextureStreaming.h"
+#include "Graphics/RHI/Graphics.h"
+#include "Graphics/RHI/Texture.h"
+#include "Graphics/RHI/CommandContext.h"
+#include "Content/Image.h"
+#include "Core/ConsoleVariables.h"
+#include "Graphics/SceneView.h"
+#include "Graphics/Mesh.h"
+#include "Graphics/Profiler.h"
+#include <random>
+
+namespace Tweakables
+{
+	ConsoleVariable g_TextureStreamingBudgetMB("r.TextureStreaming.BudgetMB", 512);
+	ConsoleVariable g_TextureStreamingStreamInMB("r.TextureStreaming.StreamInPerFrameMB", 32);
+	ConsoleVariable g_TextureStreamingMipBias("r.TextureStreaming.MipBias", 0.0f);
+	ConsoleCommand<int, int> gSimulateTextureResidency("r.TextureStreaming.Simulate", [](int numTextures, int budgetMB) { TextureResidencyPolicy::Simulate(numTextures, budgetMB, 2000, 4); });
+}
+
+// Largest dimension of the top mip of the mip tail
+static constexpr uint32 gMipTailSize = 128;
+
+// Textures that were replaced are kept alive until the GPU is done with them
+static constexpr uint32 gRetireFrames = 4;
+
+static uint32 ComputeTailMip(uint32 width, uint32 height, ResourceFormat format, uint32 numMips)
+{
+	const FormatInfo& info = RHI::GetFormatInfo(format);
+	uint32 tailMip = 0;
+	while (tailMip + 1 < numMips && Math::Max(width >> tailMip, height >> tailMip) > gMipTailSize)
+	{
+		// The top mip of a block compressed texture must be a multiple of the block size
+		const uint32 nextWidth = width >> (tailMip + 1);
+		const uint32 nextHeight = height >> (tailMip + 1);
+		if (info.IsBC && (nextWidth == 0 || nextHeight == 0 || nextWidth % info.BlockSize != 0 || nextHeight % info.BlockSize != 0))
+		{
+			break;
+		}
+		++tailMip;
+	}
+	return tailMip;
+}
+
+uint64 StreamingTextureState::GetSize(uint32 firstMip) const
+{
+	return RHI::GetTextureByteSize(Format, Math::Max(1u, Width >> firstMip), Math::Max(1u, Height >> firstMip), 1, NumMips - firstMip);
+}
+
+TextureResidencyPolicy::Stats TextureResidencyPolicy::Update(Span<StreamingTextureState> textures, uint64 frame, uint64 budget, uint64 maxStreamInBytes, std::vector<Change>& outChanges)
+{
+	Stats stats;
+
+	// Textures being streamed in already count with their pending size
+	uint64 usedBytes = 0;
+	std::vector<uint32> loads;
+	std::vector<uint32> evictions;
+	for (uint32 i = 0; i < textures.GetSize(); ++i)
+	{
+		const StreamingTextureState& texture = textures[i];
+		if (texture.NumMips == 0)
+		{
+			continue;
+		}
+		usedBytes += texture.GetSize(Math::Min(texture.ResidentMip, texture.PendingMip));
+		if (texture.IsIdle())
+		{
+			if (texture.LastRequestFrame == frame && texture.RequestedMip < texture.ResidentMip)
+			{
+				loads.push_back(i);
+			}
+			evictions.push_back(i);
+		}
+	}
+
+	// Biggest deficit first
+	std::sort(loads.begin(), loads.end(), [&](uint32 a, uint32 b)
+		{
+			return textures[a].ResidentMip - textures[a].RequestedMip > textures[b].ResidentMip - textures[b].RequestedMip;
+		});
+	// Least recently requested first
+	std::sort(evictions.begin(), evictions.end(), [&](uint32 a, uint32 b)
+		{
+			return textures[a].LastRequestFrame < textures[b].LastRequestFrame;
+		});
+
+	size_t evictionIndex = 0;
+	auto EvictUntilFits = [&](uint64 requiredBytes)
+	{
+		while (usedBytes + requiredBytes > budget && evictionIndex < evictions.size())
+		{
+			const uint32 index = evictions[evictionIndex++];
+			StreamingTextureState& texture = textures[index];
+			// Textures in view keep what they need
+			const uint32 floorMip = texture.LastRequestFrame == frame ? texture.RequestedMip : texture.TailMip;
+			if (floorMip > texture.ResidentMip)
+			{
+				const uint64 freedBytes = texture.GetSize(texture.ResidentMip) - texture.GetSize(floorMip);
+				usedBytes -= freedBytes;
+				stats.StreamedOutBytes += freedBytes;
+				outChanges.push_back({ index, floorMip, texture.ResidentMip });
+				texture.ResidentMip = floorMip;
+				texture.PendingMip = floorMip;
+			}
+		}
+		return usedBytes + requiredBytes <= budget;
+	};
+
+	uint64 streamedInBytes = 0;
+	for (uint32 index : loads)
+	{
+		if (streamedInBytes >= maxStreamInBytes)
+		{
+			break;
+		}
+
+		StreamingTextureState& texture = textures[index];
+		const uint64 currentSize = texture.GetSize(texture.ResidentMip);
+
+		// Settle for less detail if the requested mip doesn't fit
+		uint32 targetMip = texture.RequestedMip;
+		while (targetMip < texture.ResidentMip && !EvictUntilFits(texture.GetSize(targetMip) - currentSize))
+		{
+			++targetMip;
+		}
+
+		if (targetMip < texture.ResidentMip)
+		{
+			const uint64 requiredBytes = texture.GetSize(targetMip) - currentSize;
+			usedBytes += requiredBytes;
+			streamedInBytes += requiredBytes;
+			stats.StreamedInBytes += requiredBytes;
+			texture.PendingMip = targetMip;
+			outChanges.push_back({ index, targetMip, texture.ResidentMip });
+		}
+	}
+
+	// The budget may have shrunk
+	EvictUntilFits(0);
+
+	for (const StreamingTextureState& texture : textures)
+	{
+		if (texture.NumMips > 0 && texture.LastRequestFrame == frame && texture.ResidentMip > texture.RequestedMip)
+		{
+			++stats.NumDeficitTextures;
+		}
+	}
+	stats.ResidentBytes = usedBytes;
+	return stats;
+}
+
+void TextureResidencyPolicy::GetMipCopies(const Change& change, uint32 numMips, std::vector<MipCopy>& outCopies)
+{
+	outCopies.clear();
+	for (uint32 mip = Math::Max(change.FirstMip, change.PreviousMip); mip < numMips; ++mip)
+	{
+		outCopies.push_back({ mip - change.PreviousMip, mip - change.FirstMip });
+	}
+}
+
+void TextureResidencyPolicy::Simulate(uint32 numTextures, uint32 budgetMB, uint32 numFrames, uint32 streamLatency)
+{
+	// Textures are placed along a line and the camera moves back and forth over it.
+	// Each texture requests a mip based on its distance to the camera.
+	std::mt19937 random(0);
+	std::uniform_real_distribution<float> positionDistribution(0.0f, 1000.0f);
+
+	std::vector<StreamingTextureState> textures(numTextures);
+	std::vector<float> positions(numTextures);
+	for (uint32 i = 0; i < numTextures; ++i)
+	{
+		StreamingTextureState& texture = textures[i];
+		texture.Width = 256u << (random() % 5);
+		texture.Height = texture.Width;
+		texture.Format = i % 2 == 0 ? ResourceFormat::BC1_UNORM : ResourceFormat::BC7_UNORM;
+		texture.NumMips = (uint32)log2f((float)texture.Width) + 1;
+		texture.TailMip = ComputeTailMip(texture.Width, texture.Height, texture.Format, texture.NumMips);
+		texture.ResidentMip = texture.TailMip;
+		texture.PendingMip = texture.TailMip;
+		texture.RequestedMip = texture.TailMip;
+		positions[i] = positionDistribution(random);
+	}
+
+	struct InFlightLoad
+	{
+		uint32 TextureIndex;
+		uint64 CompletionFrame;
+	};
+	std::vector<InFlightLoad> inFlight;
+
+	// First mip of the texture that would be on the GPU, to validate the copies made when it is recreated
+	std::vector<uint32> gpuFirstMips(numTextures);
+	for (uint32 i = 0; i < numTextures; ++i)
+	{
+		gpuFirstMips[i] = textures[i].TailMip;
+	}
+	std::vector<MipCopy> copies;
+	uint64 numInvalidCopies = 0;
+	auto RecreateTexture = [&](const Change& change)
+	{
+		const StreamingTextureState& texture = textures[change.TextureIndex];
+		const uint32 gpuFirstMip = gpuFirstMips[change.TextureIndex];
+		numInvalidCopies += change.PreviousMip != gpuFirstMip;
+		GetMipCopies(change, texture.NumMips, copies);
+		for (const MipCopy& copy : copies)
+		{
+			// Source and target must be the same mip and exist in their texture
+			const bool isValid = gpuFirstMip + copy.SourceSubresource == change.FirstMip + copy.TargetSubresource
+				&& copy.SourceSubresource < texture.NumMips - gpuFirstMip
+				&& copy.TargetSubresource < texture.NumMips - change.FirstMip;
+			numInvalidCopies += !isValid;
+		}
+		gpuFirstMips[change.TextureIndex] = change.FirstMip;
+	};
+
+	TextureResidencyPolicy policy;
+	std::vector<Change> changes;
+	const uint64 budget = (uint64)budgetMB * 1024 * 1024;
+	const uint64 maxStreamInBytes = 32 * 1024 * 1024;
+	constexpr float viewDistance = 200.0f;
+	constexpr float screenSizeAtUnitDistance = 2000.0f;
+
+	uint64 peakResidentBytes = 0;
+	double totalResidentBytes = 0;
+	uint64 totalStreamedInBytes = 0;
+	uint64 totalStreamedOutBytes = 0;
+	uint64 numRequests = 0;
+	uint64 numSatisfied = 0;
+	uint64 totalMipDeficit = 0;
+
+	for (uint64 frame = 1; frame <= numFrames; ++frame)
+	{
+		for (auto it = inFlight.begin(); it != inFlight.end();)
+		{
+			if (it->CompletionFrame <= frame)
+			{
+				StreamingTextureState& texture = textures[it->TextureIndex];
+				RecreateTexture({ it->TextureIndex, texture.PendingMip, texture.ResidentMip });
+				texture.ResidentMip = texture.PendingMip;
+				it = inFlight.erase(it);
+			}
+			else
+			{
+				++it;
+			}
+		}
+
+		const float cameraPosition = 500.0f + 500.0f * sinf(frame * 0.005f);
+		for (uint32 i = 0; i < numTextures; ++i)
+		{
+			StreamingTextureState& texture = textures[i];
+			texture.RequestedMip = texture.TailMip;
+			const float distance = fabsf(positions[i] - cameraPosition);
+			if (distance < viewDistance)
+			{
+				const float screenSize = screenSizeAtUnitDistance / Math::Max(distance, 1.0f);
+				const int mip = (int)floorf(log2f(Math::Max(texture.Width / screenSize, 1.0f)));
+				texture.RequestedMip = (uint32)Math::Clamp(mip, 0, (int)texture.TailMip);
+				texture.LastRequestFrame = frame;
+			}
+		}
+
+		changes.clear();
+		Stats stats = policy.Update(textures, frame, budget, maxStreamInBytes, changes);
+		for (const Change& change : changes)
+		{
+			if (change.FirstMip > change.PreviousMip)
+			{
+				RecreateTexture(change);
+			}
+			else
+			{
+				inFlight.push_back({ change.TextureIndex, frame + streamLatency });
+			}
+		}
+
+		peakResidentBytes = Math::Max(peakResidentBytes, stats.ResidentBytes);
+		totalResidentBytes += (double)stats.ResidentBytes;
+		totalStreamedInBytes += stats.StreamedInBytes;
+		totalStreamedOutBytes += stats.StreamedOutBytes;
+		for (const StreamingTextureState& texture : textures)
+		{
+			if (texture.LastRequestFrame == frame)
+			{
+				++numRequests;
+				numSatisfied += texture.ResidentMip <= texture.RequestedMip;
+				totalMipDeficit += texture.ResidentMip > texture.RequestedMip ? texture.ResidentMip - texture.RequestedMip : 0;
+			}
+		}
+	}
+
+	E_LOG(Info, "Texture residency simulation: %d textures, %d frames, budget %s, latency %d frames", numTextures, numFrames, Math::PrettyPrintDataSize(budget).c_str(), streamLatency);
+	E_LOG(Info, "\tResident: peak %s, average %s", Math::PrettyPrintDataSize(peakResidentBytes).c_str(), Math::PrettyPrintDataSize((uint64)(totalResidentBytes / numFrames)).c_str());
+	E_LOG(Info, "\tStreamed in %s, streamed out %s", Math::PrettyPrintDataSize(totalStreamedInBytes).c_str(), Math::PrettyPrintDataSize(totalStreamedOutBytes).c_str());
+	E_LOG(Info, "\tRequests satisfied: %.1f%%, average mip deficit: %.2f", 100.0f * numSatisfied / Math::Max<uint64>(1, numRequests), (float)totalMipDeficit / Math::Max<uint64>(1, numRequests));
+	if (numInvalidCopies > 0)
+	{
+		E_LOG(Error, "\t%d mip copies between textures with a different first mip", (uint32)numInvalidCopies);
+	}
+}
+
+TextureStreamer::TextureStreamer(GraphicsDevice* pDevice)
+	: m_pDevice(pDevice)
+{
+}
+
+TextureStreamer::~TextureStreamer()
+{
+	TaskQueue::Join(m_LoadContext);
+}
+
+static void UploadMips(CommandContext& context, Texture* pTexture, const Image& image, uint32 imageFirstMip, uint32 numMips)
+{
+	std::vector<D3D12_SUBRESOURCE_DATA> subResourceData(numMips);
+	for (uint32 i = 0; i < numMips; ++i)
+	{
+		D3D12_SUBRESOURCE_DATA& data = subResourceData[i];
+		data.pData = image.GetData(imageFirstMip + i);
+		data.RowPitch = RHI::GetRowPitch(image.GetFormat(), image.GetWidth(), imageFirstMip + i);
+		data.SlicePitch = RHI::GetSlicePitch(image.GetFormat(), image.GetWidth(), image.GetHeight(), imageFirstMip + i);
+	}
+	context.WriteTexture(pTexture, subResourceData, 0);
+}
+
+uint32 TextureStreamer::Register(CommandContext& context, const Image& image, const std::string& cachePath, bool sRGB, const char* pName, StreamingTextureChangedDelegate&& onChanged)
+{
+	uint32 handle;
+	if (!m_FreeHandles.empty())
+	{
+		handle = m_FreeHandles.back();
+		m_FreeHandles.pop_back();
+	}
+	else
+	{
+		handle = (uint32)m_Textures.size();
+		m_Textures.emplace_back();
+		m_States.emplace_back();
+	}
+
+	m_Textures[handle] = std::make_unique<StreamingTexture>();
+	StreamingTexture& texture = *m_Textures[handle];
+	texture.Name = pName;
+	texture.CachePath = cachePath;
+	texture.sRGB = sRGB;
+	texture.OnChanged = std::move(onChanged);
+
+	StreamingTextureState& state = m_States[handle];
+	state = StreamingTextureState();
+	state.Width = image.GetWidth();
+	state.Height = image.GetHeight();
+	state.Format = image.GetFormat();
+	state.NumMips = image.GetMipLevels();
+	state.TailMip = ComputeTailMip(state.Width, state.Height, state.Format, state.NumMips);
+	state.ResidentMip = state.TailMip;
+	state.PendingMip = state.TailMip;
+	state.RequestedMip = state.TailMip;
+
+	TextureDesc desc = TextureDesc::Create2D(Math::Max(1u, state.Width >> state.TailMip), Math::Max(1u, state.Height >> state.TailMip), state.Format, sRGB ? TextureFlag::sRGB : TextureFlag::None, 1, state.NumMips - state.TailMip);
+	texture.pTexture = m_pDevice->CreateTexture(desc, pName);
+	context.InsertResourceBarrier(texture.pTexture, D3D12_RESOURCE_STATE_COPY_DEST);
+	UploadMips(context, texture.pTexture, image, state.TailMip, desc.Mips);
+	context.InsertResourceBarrier(texture.pTexture, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+
+	m_TextureToHandle[texture.pTexture] = handle;
+	texture.OnChanged.ExecuteIfBound(texture.pTexture);
+	return handle;
+}
+
+void TextureStreamer::Unregister(uint32 handle)
+{
+	// Loads reference the texture
+	TaskQueue::Join(m_LoadContext);
+
+	StreamingTexture& texture = *m_Textures[handle];
+	m_TextureToHandle.erase(texture.pTexture);
+	m_RetiredTextures.push_back({ m_Frame, texture.pTexture });
+	m_Textures[handle].reset();
+	m_States[handle] = StreamingTextureState();
+	m_FreeHandles.push_back(handle);
+}
+
+void TextureStreamer::RequestMip(const Texture* pTexture, float screenSize)
+{
+	if (!pTexture)
+	{
+		return;
+	}
+	auto it = m_TextureToHandle.find(pTexture);
+	if (it == m_TextureToHandle.end())
+	{
+		return;
+	}
+
+	// Assumes the texture is mapped once over the object
+	StreamingTextureState& state = m_States[it->second];
+	const float texelsPerPixel = Math::Max(state.Width, state.Height) / Math::Max(screenSize, 1.0f);
+	const int mip = (int)floorf(log2f(Math::Max(texelsPerPixel, 1.0f)) + Tweakables::g_TextureStreamingMipBias.Get());
+	state.RequestedMip = Math::Min(state.RequestedMip, (uint32)Math::Clamp(mip, 0, (int)state.TailMip));
+	state.LastRequestFrame = m_Frame;
+}
+
+void TextureStreamer::Update(CommandContext& context, const SceneView& view)
+{
+	PROFILE_SCOPE("Texture Streaming");
+
+	++m_Frame;
+
+	while (!m_RetiredTextures.empty() && m_RetiredTextures.front().first + gRetireFrames < m_Frame)
+	{
+		m_RetiredTextures.pop_front();
+	}
+
+	// Estimate the required mips from the screen size of the visible batches
+	for (StreamingTextureState& state : m_States)
+	{
+		state.RequestedMip = state.TailMip;
+	}
+
+	const float viewportHeight = view.View.Viewport.GetHeight();
+	const float perspectiveScale = viewportHeight / (2.0f * tanf(view.View.FoV * 0.5f));
+	for (const Batch& batch : view.Batches)
+	{
+		if (!view.VisibilityMask.GetBit(batch.InstanceID))
+		{
+			continue;
+		}
+
+		float screenSize = 0;
+		if (view.View.Perspective)
+		{
+			const float distance = Math::Max(Vector3::Distance(view.View.Position, batch.Bounds.Center) - batch.Radius, 0.01f);
+			screenSize = 2.0f * batch.Radius * perspectiveScale / distance;
+		}
+		else
+		{
+			screenSize = 2.0f * batch.Radius / view.View.OrthographicSize * viewportHeight;
+		}
+
+		const Material& material = *batch.pMaterial;
+		RequestMip(material.pDiffuseTexture, screenSize);
+		RequestMip(material.pNormalTexture, screenSize);
+		RequestMip(material.pRoughnessMetalnessTexture, screenSize);
+		RequestMip(material.pEmissiveTexture, screenSize);
+	}
+
+	// Swap in textures of which the mips finished loading
+	for (uint32 handle = 0; handle < (uint32)m_Textures.size(); ++handle)
+	{
+		StreamingTexture* pTexture = m_Textures[handle].get();
+		StreamingTextureState& state = m_States[handle];
+		if (pTexture && !state.IsIdle() && pTexture->LoadDone)
+		{
+			pTexture->LoadDone = false;
+			if (pTexture->LoadSucceeded)
+			{
+				Recreate(context, { handle, state.PendingMip, state.ResidentMip }, pTexture->pLoadedMips.get());
+				state.ResidentMip = state.PendingMip;
+			}
+			else
+			{
+				E_LOG(Warning, "Failed to stream mips of '%s' from '%s'", pTexture->Name.c_str(), pTexture->CachePath.c_str());
+				state.PendingMip = state.ResidentMip;
+			}
+			pTexture->pLoadedMips.reset();
+		}
+	}
+
+	const uint64 budget = (uint64)Tweakables::g_TextureStreamingBudgetMB.GetInt() * 1024 * 1024;
+	const uint64 maxStreamInBytes = (uint64)Tweakables::g_TextureStreamingStreamInMB.GetInt() * 1024 * 1024;
+	m_Changes.clear();
+	m_Stats = m_Policy.Update(m_States, m_Frame, budget, maxStreamInBytes, m_Changes);
+
+	for (const TextureResidencyPolicy::Change& change : m_Changes)
+	{
+		if (change.FirstMip > change.PreviousMip)
+		{
+			// Stream out, the remaining mips are already on the GPU
+			Recreate(context, change, nullptr);
+		}
+		else
+		{
+			StreamingTexture* pTexture = m_Textures[change.TextureIndex].get();
+			TaskQueue::Execute([pTexture, firstMip = change.FirstMip, numMips = change.PreviousMip - change.FirstMip](int)
+				{
+					pTexture->pLoadedMips = std::make_unique<Image>();
+					pTexture->LoadSucceeded = pTexture->pLoadedMips->LoadDDSMips(pTexture->CachePath.c_str(), firstMip, numMips);
+					pTexture->LoadDone = true;
+				}, m_LoadContext);
+		}
+	}
+}
+
+void TextureStreamer::Recreate(CommandContext& context, const TextureResidencyPolicy::Change& change, const Image* pNewMips)
+{
+	StreamingTexture& texture = *m_Textures[change.TextureIndex];
+	const StreamingTextureState& state = m_States[change.TextureIndex];
+	Texture* pOldTexture = texture.pTexture;
+	const uint32 firstMip = change.FirstMip;
+	check(pOldTexture->GetMipLevels() == state.NumMips - change.PreviousMip);
+	check(pOldTexture->GetWidth() == Math::Max(1u, state.Width >> change.PreviousMip));
+
+	TextureDesc desc = TextureDesc::Create2D(Math::Max(1u, state.Width >> firstMip), Math::Max(1u, state.Height >> firstMip), state.Format, texture.sRGB ? TextureFlag::sRGB : TextureFlag::None, 1, state.NumMips - firstMip);
+	RefCountPtr<Texture> pNewTexture = m_pDevice->CreateTexture(desc, texture.Name.c_str());
+	context.InsertResourceBarrier(pNewTexture, D3D12_RESOURCE_STATE_COPY_DEST);
+	context.InsertResourceBarrier(pOldTexture, D3D12_RESOURCE_STATE_COPY_SOURCE);
+
+	if (pNewMips)
+	{
+		check(firstMip + pNewMips->GetMipLevels() == change.PreviousMip);
+		UploadMips(context, pNewTexture, *pNewMips, 0, pNewMips->GetMipLevels());
+	}
+
+	// Copy the mips that stay resident. Full subresource copies so small block compressed mips need no box.
+	context.FlushResourceBarriers();
+	TextureResidencyPolicy::GetMipCopies(change, state.NumMips, m_MipCopies);
+	for (const TextureResidencyPolicy::MipCopy& copy : m_MipCopies)
+	{
+		check(Math::Max(1u, pOldTexture->GetWidth() >> copy.SourceSubresource) == Math::Max(1u, desc.Width >> copy.TargetSubresource));
+		CD3DX12_TEXTURE_COPY_LOCATION sourceLocation(pOldTexture->GetResource(), copy.SourceSubresource);
+		CD3DX12_TEXTURE_COPY_LOCATION targetLocation(pNewTexture->GetResource(), copy.TargetSubresource);
+		context.GetCommandList()->CopyTextureRegion(&targetLocation, 0, 0, 0, &sourceLocation, nullptr);
+	}
+
+	context.InsertResourceBarrier(pNewTexture, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+	context.InsertResourceBarrier(pOldTexture, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+
+	m_TextureToHandle.erase(pOldTexture);
+	m_TextureToHandle[pNewTexture] = change.TextureIndex;
+	m_RetiredTextures.push_back({ m_Frame, texture.pTexture });
+	texture.pTexture = pNewTexture;
+	texture.OnChanged.ExecuteIfBound(pNewTexture);
+}
@@ -0,0 +1,127 @@
+#pragma once
+#include "Graphics/RHI/RHI.h"
+#include "Core/TaskQueue.h"
+
+class GraphicsDevice;
+class CommandContext;
+class Texture;
+class Image;
+struct SceneView;
+
+// CPU side residency state of a streamed texture. Mip indices refer to the full mip chain.
+struct StreamingTextureState
+{
+	uint32 Width = 0;
+	uint32 Height = 0;
+	ResourceFormat Format = ResourceFormat::Unknown;
+	uint32 NumMips = 0;			// 0 for unused slots
+	uint32 TailMip = 0;			// First mip of the tail that is always resident
+	uint32 ResidentMip = 0;		// First resident mip
+	uint32 PendingMip = 0;		// First mip being streamed in. Same as ResidentMip when idle
+	uint32 RequestedMip = 0;	// First mip requested this frame
+	uint64 LastRequestFrame = 0;
+
+	bool IsIdle() const { return PendingMip == ResidentMip; }
+	uint64 GetSize(uint32 firstMip) const;
+};
+
+/*
+	Decides which mips of which textures should be resident within a memory budget.
+	Textures that need more detail are streamed in, biggest mip deficit first.
+	Memory is freed from the least recently requested textures, down to their mip tail when not in view
+	or down to their requested mip when they are in view but have more detail than needed.
+	Contains no GPU code so it can be simulated on the CPU.
+*/
+class TextureResidencyPolicy
+{
+public:
+	struct Change
+	{
+		uint32 TextureIndex;
+		uint32 FirstMip;
+		uint32 PreviousMip;		// First resident mip before the change
+	};
+
+	// Subresource copy from the old texture to the one recreated for a change
+	struct MipCopy
+	{
+		uint32 SourceSubresource;
+		uint32 TargetSubresource;
+	};
+
+	struct Stats
+	{
+		uint64 ResidentBytes = 0;
+		uint64 StreamedInBytes = 0;
+		uint64 StreamedOutBytes = 0;
+		uint32 NumDeficitTextures = 0;
+	};
+
+	// Updates the pending and resident mips of the textures and returns the changes to apply.
+	// Stream ins only set the pending mip, the caller sets the resident mip once the data is there.
+	Stats Update(Span<StreamingTextureState> textures, uint64 frame, uint64 budget, uint64 maxStreamInBytes, std::vector<Change>& outChanges);
+
+	// Mips that are resident both before and after a change are copied over from the old texture, the others are uploaded.
+	// Subresources are relative to the first resident mip of each texture.
+	static void GetMipCopies(const Change& change, uint32 numMips, std::vector<MipCopy>& outCopies);
+
+	// Runs the policy on a synthetic scene and logs how it behaves
+	static void Simulate(uint32 numTextures, uint32 budgetMB, uint32 numFrames, uint32 streamLatency);
+};
+
+DECLARE_DELEGATE(StreamingTextureChangedDelegate, Texture*);
+
+/*
+	Streams texture mips in and out based on the screen size of the visible batches.
+	Only the mip tail is loaded up front. Higher mips are read from the cooked DDS texture cache
+	on the task queue, the texture is then recreated with the new mip range and the
+	owner is notified through a delegate so it can update its references.
+*/
+class TextureStreamer
+{
+public:
+	TextureStreamer(GraphicsDevice* pDevice);
+	~TextureStreamer();
+
+	// Takes an image with its full mip chain, uploads its mip tail and returns a handle.
+	// The delegate is called with the new texture every time the resident mips change.
+	uint32 Register(CommandContext& context, const Image& image, const std::string& cachePath, bool sRGB, const char* pName, StreamingTextureChangedDelegate&& onChanged);
+	void Unregister(uint32 handle);
+
+	void Update(CommandContext& context, const SceneView& view);
+
+	const TextureResidencyPolicy::Stats& GetStats() const { return m_Stats; }
+
+private:
+	struct StreamingTexture
+	{
+		std::string Name;
+		std::string CachePath;
+		bool sRGB = false;
+		RefCountPtr<Texture> pTexture;
+		StreamingTextureChangedDelegate OnChanged;
+
+		std::atomic<bool> LoadDone = false;
+		bool LoadSucceeded = false;
+		std::unique_ptr<Image> pLoadedMips;
+	};
+
+	void RequestMip(const Texture* pTexture, float screenSize);
+
+	// Recreates the texture with the first mip of the change as top mip, keeping mips that are resident in both
+	void Recreate(CommandContext& context, const TextureResidencyPolicy::Change& change, const Image* pNewMips);
+
+	GraphicsDevice* m_pDevice;
+	std::vector<std::unique_ptr<StreamingTexture>> m_Textures;
+	std::vector<StreamingTextureState> m_States;
+	std::vector<uint32> m_FreeHandles;
+	std::unordered_map<const Texture*, uint32> m_TextureToHandle;
+	std::deque<std::pair<uint64, RefCountPtr<Texture>>> m_RetiredTextures;
+
+	TextureResidencyPolicy m_Policy;
+	TextureResidencyPolicy::Stats m_Stats;
+	std::vector<TextureResidencyPolicy::Change> m_Changes;
+	std::vector<TextureResidencyPolicy::MipCopy> m_MipCopies;
+	uint64 m_Frame = 1;
+	TaskContext m_LoadContext;
+};
@@ -270,6 +270,80 @@ namespace Math
 		);
 	}
 
+	inline float Decode_R16_SNORM(uint16 value)
+	{
+		return Max((int16)value / 32767.0f, -1.0f);
+	}
+
+	inline Vector4 Unpack_RGBA16_SNORM(const Vector2u& v)
+	{
+		return Vector4(Decode_R16_SNORM((uint16)v.x), Decode_R16_SNORM((uint16)(v.x >> 16u)), Decode_R16_SNORM((uint16)v.y), Decode_R16_SNORM((uint16)(v.y >> 16u)));
+	}
+
+	inline uint32 Pack_RG16_UNORM(const Vector2& v)
+	{
+		return
+			((uint32)roundf(Clamp(v.x, 0.0f, 1.0f) * 65535.0f) << 0) |
+			((uint32)roundf(Clamp(v.y, 0.0f, 1.0f) * 65535.0f) << 16);
+	}
+
+	inline Vector2 Unpack_RG16_UNORM(uint32 v)
+	{
+		constexpr float rcp_65535 = 1.0f / 65535.0f;
+		return Vector2((float)(v & 0xFFFF) * rcp_65535, (float)(v >> 16) * rcp_65535);
+	}
+
+	inline Vector2 EncodeNormalOctahedron(const Vector3& n)
+	{
+		Vector2 p = Vector2(n.x, n.y) * (1.0f / (fabs(n.x) + fabs(n.y) + fabs(n.z)));
+		if (n.z < 0.0f)
+		{
+			p = Vector2((1.0f - fabs(p.y)) * (p.x >= 0.0f ? 1.0f : -1.0f), (1.0f - fabs(p.x)) * (p.y >= 0.0f ? 1.0f : -1.0f));
+		}
+		return p;
+	}
+
+	inline Vector3 DecodeNormalOctahedron(const Vector2& p)
+	{
+		Vector3 n(p.x, p.y, 1.0f - fabs(p.x) - fabs(p.y));
+		if (n.z < 0.0f)
+		{
+			n = Vector3((1.0f - fabs(p.y)) * (p.x >= 0.0f ? 1.0f : -1.0f), (1.0f - fabs(p.x)) * (p.y >= 0.0f ? 1.0f : -1.0f), n.z);
+		}
+		n.Normalize();
+		return n;
+	}
+
+	// Octahedron encoded unit vector in 2x15 bits with a sign in the top bit
+	inline uint32 Pack_OCT15_SIGN(const Vector3& n, float sign)
+	{
+		Vector2 p = EncodeNormalOctahedron(n);
+		return
+			((int32)roundf(Clamp(p.x, -1.0f, 1.0f) * 16383.0f) & 0x7FFF) << 0 |
+			((int32)roundf(Clamp(p.y, -1.0f, 1.0f) * 16383.0f) & 0x7FFF) << 15 |
+			(sign < 0.0f ? 1u : 0u) << 31;
+	}
+
+	inline Vector3 Unpack_OCT15_SIGN(uint32 v, float& outSign)
+	{
+		int32 signedV = (int32)v;
+		Vector2 p(
+			Max(((signedV << 17) >> 17) / 16383.0f, -1.0f),
+			Max(((signedV << 2) >> 17) / 16383.0f, -1.0f));
+		outSign = (v >> 31) ? -1.0f : 1.0f;
+		return DecodeNormalOctahedron(p);
+	}
+
+	// Branchless orthonormal basis around a unit vector [Duff et al. 2017]
+	inline void GetOrthonormalBasis(const Vector3& n, Vector3& outB1, Vector3& outB2)
+	{
+		float sign = n.z >= 0.0f ? 1.0f : -1.0f;
+		float a = -1.0f / (sign + n.z);
+		float b = n.x * n.y * a;
+		outB1 = Vector3(1.0f + sign * n.x * n.x * a, sign * b, -sign * n.x);
+		outB2 = Vector3(b, sign + n.y * n.y * a, -n.y);
+	}
+
 	constexpr inline uint32 DivideAndRoundUp(uint32 nominator, uint32 denominator)
 	{
 		return (nominator + denominator - 1) / denominator;
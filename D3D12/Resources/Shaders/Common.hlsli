@@ -393,3 +393,30 @@ uint DivideAndRoundUp(uint x, uint y)
 {
 	return (x + y - 1) / y;
 }
+
+/*
+	Vertex streams as quantized by Mesh::Load.
+	Positions are RGBA16_SNORM relative to the bounds of the mesh, W holds the tangent angle around the normal.
+	Normals are octahedron encoded with the tangent sign in the top bit.
+	UVs are RG16_UNORM relative to the UV range of the mesh.
+*/
+float3 GetVertexPosition(MeshData mesh, uint vertexId)
+{
+	float3 position = Unpack_RGBA16_SNORM(BufferLoad<uint2>(mesh.BufferIndex, vertexId, mesh.PositionsOffset)).xyz;
+	return mesh.BoundsOrigin + position * mesh.BoundsExtents;
+}
+
+float2 GetVertexUV(MeshData mesh, uint vertexId)
+{
+	float2 uv = Unpack_RG16_UNORM(BufferLoad<uint>(mesh.BufferIndex, vertexId, mesh.UVsOffset));
+	return mesh.UVOffset + uv * mesh.UVScale;
+}
+
+void GetVertexNormal(MeshData mesh, uint vertexId, out float3 normal, out float4 tangent)
+{
+	normal = Unpack_OCT15_SIGN(BufferLoad<uint>(mesh.BufferIndex, vertexId, mesh.NormalsOffset), tangent.w);
+	float tangentAngle = Unpack_RGBA16_SNORM(BufferLoad<uint2>(mesh.BufferIndex, vertexId, mesh.PositionsOffset)).w * PI;
+	float3 b1, b2;
+	GetOrthonormalBasis(normal, b1, b2);
+	tangent.xyz = cos(tangentAngle) * b1 + sin(tangentAngle) * b2;
+}
@@ -110,15 +110,16 @@ LightResult DoLight(float3 specularColor, float R, float3 diffuseColor, float3 N
 InterpolantsVSToPS FetchVertexAttributes(MeshData mesh, float4x4 world, uint vertexId)
 {
 	InterpolantsVSToPS result;
-	float3 Position = Unpack_RGBA16_SNORM(BufferLoad<uint2>(mesh.BufferIndex, vertexId, mesh.PositionsOffset)).xyz;
+	float3 Position = GetVertexPosition(mesh, vertexId);
 	result.PositionWS = mul(float4(Position, 1.0f), world).xyz;
 	result.Position = mul(float4(result.PositionWS, 1.0f), cView.ViewProjection);
 
-	result.UV = Unpack_RG16_FLOAT(BufferLoad<uint>(mesh.BufferIndex, vertexId, mesh.UVsOffset));
+	result.UV = GetVertexUV(mesh, vertexId);
 
-	uint2 normalData = BufferLoad<uint2>(mesh.BufferIndex, vertexId, mesh.NormalsOffset);
-	result.Normal = normalize(mul(Unpack_RGB10A2_SNORM(normalData.x).xyz, (float3x3)world));
-	float4 tangent = Unpack_RGB10A2_SNORM(normalData.y);
+	float3 normal;
+	float4 tangent;
+	GetVertexNormal(mesh, vertexId, normal, tangent);
+	result.Normal = normalize(mul(normal, (float3x3)world));
 	result.Tangent = float4(normalize(mul(tangent.xyz, (float3x3)world)), tangent.w);
 
 	result.Color = 0xFFFFFFFF;
@@ -7,6 +7,7 @@
 static const int MAX_SHADOW_CASTERS = 32;
 static const int MESHLET_MAX_TRIANGLES = 124;
 static const int MESHLET_MAX_VERTICES = 64;
+static const int MESH_MAX_LODS = 4;
 
 // Per material shader data
 struct MaterialData
@@ -22,6 +23,14 @@ struct MaterialData
 	float AlphaCutoff;
 };
 
+struct MeshLOD
+{
+	uint MeshletStart;
+	uint MeshletCount;
+	float Error;			// Object space simplification error
+	PAD;
+};
+
 struct MeshData
 {
 	uint BufferIndex;
@@ -36,7 +45,23 @@ struct MeshData
 	uint MeshletVertexOffset;
 	uint MeshletTriangleOffset;
 	uint MeshletBoundsOffset;
-	uint MeshletCount;
+	uint MeshletCount;		// Meshlets of LOD 0
+
+	float3 BoundsOrigin;
+	uint LODCount;
+	float3 BoundsExtents;
+	PAD;
+	MeshLOD LODs[MESH_MAX_LODS];
+
+	// Cluster hierarchy. Clusters are the meshlets [0, ClusterCount)
+	uint ClusterCount;
+	uint ClusterLODBoundsOffset;
+
+	// UVs are quantized relative to this range
+	float2 UVOffset;
+	float2 UVScale;
+	PAD;
+	PAD;
 };
 
 struct Meshlet
@@ -56,8 +81,24 @@ struct Meshlet
 
 	struct Bounds
 	{
-		float3 Center;
+		float3 Center;				// AABB
 		float3 Extents;
+		float3 SphereCenter;		// Bounding sphere
+		float SphereRadius;
+		float3 ConeApex;			// Normal cone for backface culling
+		uint ConeAxisAndCutoff;		// RGBA8_SNORM. xyz: axis, w: cos(angle/2)
+	};
+
+	// Cluster hierarchy LOD selection. A cluster is part of the cut when its own error is small enough
+	// and the error of the group it gets simplified into isn't.
+	struct LODBounds
+	{
+		float3 Center;				// Bounds of the group this cluster was simplified from
+		float Radius;
+		float3 ParentCenter;		// Bounds of the group this cluster is simplified into
+		float ParentRadius;
+		float Error;				// Object space error
+		float ParentError;			// FLT_MAX for root clusters
 	};
 };
 
@@ -162,4 +203,7 @@ struct ViewUniforms
 
 	uint DebugRenderDataIndex;
 	uint FontDataIndex;
+
+	float LODErrorThreshold;	// Max screen space error of a mesh LOD in pixels
+	uint UseClusterLOD;
 };
@@ -91,6 +91,52 @@ InstanceData GetInstanceForThread(uint threadID)
 #endif
 }
 
+float GetMaxScale(float4x4 localToWorld)
+{
+	return sqrt(max(dot(localToWorld[0].xyz, localToWorld[0].xyz), max(dot(localToWorld[1].xyz, localToWorld[1].xyz), dot(localToWorld[2].xyz, localToWorld[2].xyz))));
+}
+
+// Returns the size in pixels of an object space error, seen from the closest point of the sphere
+float ProjectError(float3 center, float radius, float error, float4x4 localToWorld, float scale)
+{
+	float projectedError = error * scale * cView.ViewportDimensions.y * 0.5f * cView.Projection[1][1];
+	bool isPerspective = cView.Projection[3][3] == 0;
+	if(isPerspective)
+	{
+		float3 centerWS = mul(float4(center, 1), localToWorld).xyz;
+		projectedError /= max(distance(centerWS, cView.ViewLocation) - radius * scale, cView.NearZ);
+	}
+	return projectedError;
+}
+
+// Returns the coarsest LOD of which the simplification error projects to less than the error threshold in pixels.
+// Must match Renderer::SelectLOD on the CPU.
+MeshLOD SelectLOD(MeshData mesh, InstanceData instance)
+{
+	float scale = GetMaxScale(instance.LocalToWorld);
+	float radius = length(mesh.BoundsExtents);
+	uint lod = 0;
+	while(lod + 1 < mesh.LODCount && ProjectError(mesh.BoundsOrigin, radius, mesh.LODs[lod + 1].Error, instance.LocalToWorld, scale) <= cView.LODErrorThreshold)
+	{
+		++lod;
+	}
+	return mesh.LODs[lod];
+}
+
+bool UseClusterLOD(MeshData mesh)
+{
+	return cView.UseClusterLOD && mesh.ClusterCount > 0;
+}
+
+// Must match ClusterLOD::IsInCut on the CPU
+bool IsInClusterCut(Meshlet::LODBounds lodBounds, float4x4 localToWorld)
+{
+	float scale = GetMaxScale(localToWorld);
+	float error = ProjectError(lodBounds.Center, lodBounds.Radius, lodBounds.Error, localToWorld, scale);
+	float parentError = lodBounds.ParentError >= FLT_MAX ? FLT_MAX : ProjectError(lodBounds.ParentCenter, lodBounds.ParentRadius, lodBounds.ParentError, localToWorld, scale);
+	return error <= cView.LODErrorThreshold && parentError > cView.LODErrorThreshold;
+}
+
 [numthreads(NUM_CULL_INSTANCES_THREADS, 1, 1)]
 void CullInstancesCS(uint threadID : SV_DispatchThreadID)
 {
@@ -99,6 +145,9 @@ void CullInstancesCS(uint threadID : SV_DispatchThreadID)
         return;
 
     InstanceData instance = GetInstanceForThread(threadID);
+	// Free slots of the instance table
+	if(instance.MeshIndex == INVALID_HANDLE)
+		return;
     MeshData mesh = GetMesh(instance.MeshIndex);
 
 	FrustumCullData cullData = FrustumCull(instance.LocalBoundsOrigin, instance.LocalBoundsExtents, instance.LocalToWorld, cView.ViewProjection);
@@ -127,11 +176,24 @@ void CullInstancesCS(uint threadID : SV_DispatchThreadID)
 	// If instance is visible and wasn't occluded in the previous frame, submit it
     if(isVisible && !wasOccluded)
     {
+		// With the cluster hierarchy, all clusters are candidates and the cut is selected per cluster
+		MeshLOD lod;
+		if(UseClusterLOD(mesh))
+		{
+			lod.MeshletStart = 0;
+			lod.MeshletCount = mesh.ClusterCount;
+		}
+		else
+		{
+			lod = SelectLOD(mesh, instance);
+		}
+
 		// Limit meshlet count to how large our buffer is
 		uint globalMeshletIndex;
-        InterlockedAdd_Varying_WaveOps(uCounter_MeshletCandidates, COUNTER_TOTAL_MESHLETS, mesh.MeshletCount, globalMeshletIndex);
-		uint clampedNumMeshlets = min(globalMeshletIndex + mesh.MeshletCount, MAX_NUM_MESHLETS);
-		uint numMeshletsToAdd = max(clampedNumMeshlets - globalMeshletIndex, 0);
+        InterlockedAdd_Varying_WaveOps(uCounter_MeshletCandidates, COUNTER_TOTAL_MESHLETS, lod.MeshletCount, globalMeshletIndex);
+		uint clampedNumMeshlets = min(globalMeshletIndex + lod.MeshletCount, MAX_NUM_MESHLETS);
+		// The counter keeps going past the limit, the subtraction would wrap around
+		uint numMeshletsToAdd = globalMeshletIndex < clampedNumMeshlets ? clampedNumMeshlets - globalMeshletIndex : 0;
 
 		uint elementOffset;
 		InterlockedAdd_Varying_WaveOps(uCounter_MeshletCandidates, MeshletCounterIndex, numMeshletsToAdd, elementOffset);
@@ -141,7 +203,7 @@ void CullInstancesCS(uint threadID : SV_DispatchThreadID)
 		{
 			MeshletCandidate meshlet;
 			meshlet.InstanceID = instance.ID;
-			meshlet.MeshletIndex = i;
+			meshlet.MeshletIndex = lod.MeshletStart + i;
 			uMeshletCandidates[meshletCandidateOffset + elementOffset + i] = meshlet;
 		}
     }
@@ -172,6 +234,39 @@ void BuildInstanceCullIndirectArgs()
     uDispatchArguments[0] = args;
 }
 
+// Culls meshlets of which all triangles face away from the view
+bool IsBackfacing(Meshlet::Bounds bounds, float4x4 localToWorld)
+{
+	float4 cone = Unpack_RGBA8_SNORM(bounds.ConeAxisAndCutoff);
+	// A cutoff of 1 means the triangles face too many directions
+	if(cone.w >= 1.0f)
+		return false;
+
+	// Assumes uniform scale. A non-uniform scale would need the inverse transpose for the axis.
+	float3 axis = normalize(mul(cone.xyz, (float3x3)localToWorld));
+
+	// Orthographic views look along the view forward axis
+	bool isPerspective = cView.Projection[3][3] == 0;
+	if(!isPerspective)
+		return dot(cView.ViewInverse[2].xyz, axis) >= cone.w;
+
+	// The cone is in the glTF winding while the triangles are drawn clockwise, which matches when the transform mirrors
+	// like the Z flip of the glTF import does.
+	if(determinant((float3x3)localToWorld) < 0)
+	{
+		float3 apex = mul(float4(bounds.ConeApex, 1), localToWorld).xyz;
+		return dot(normalize(apex - cView.ViewLocation), axis) >= cone.w;
+	}
+
+	// Without a mirror the rasterizer keeps the other side. The apex is only valid for the cone it was computed for,
+	// so the flipped cone is tested against the bounding sphere instead.
+	axis = -axis;
+	float3 center = mul(float4(bounds.SphereCenter, 1), localToWorld).xyz;
+	float radius = bounds.SphereRadius * GetMaxScale(localToWorld);
+	float3 toCenter = center - cView.ViewLocation;
+	return dot(toCenter, axis) >= cone.w * length(toCenter) + radius;
+}
+
 struct PayloadData
 {
 	uint CandidateIndices[NUM_AS_THREADS];
@@ -192,7 +287,12 @@ void CullAndDrawMeshletsAS(uint threadID : SV_DispatchThreadID)
 		MeshData mesh = GetMesh(instance.MeshIndex);
 		Meshlet::Bounds bounds = BufferLoad<Meshlet::Bounds>(mesh.BufferIndex, candidate.MeshletIndex, mesh.MeshletBoundsOffset);
 		FrustumCullData cullData = FrustumCull(bounds.Center, bounds.Extents, instance.LocalToWorld, cView.ViewProjection);
-		bool isVisible = cullData.IsVisible;
+		bool isVisible = cullData.IsVisible && !IsBackfacing(bounds, instance.LocalToWorld);
+		if(isVisible && UseClusterLOD(mesh))
+		{
+			Meshlet::LODBounds lodBounds = BufferLoad<Meshlet::LODBounds>(mesh.BufferIndex, candidate.MeshletIndex, mesh.ClusterLODBoundsOffset);
+			isVisible = IsInClusterCut(lodBounds, instance.LocalToWorld);
+		}
 		bool wasOccluded = false;
 
 		if(isVisible)
@@ -254,12 +354,12 @@ struct VertexAttribute
 VertexAttribute FetchVertexAttributes(MeshData mesh, float4x4 world, uint vertexId)
 {
 	VertexAttribute result = (VertexAttribute)0;
-	float3 position = Unpack_RGBA16_SNORM(BufferLoad<uint2>(mesh.BufferIndex, vertexId, mesh.PositionsOffset)).xyz;
+	float3 position = GetVertexPosition(mesh, vertexId);
 	float3 positionWS = mul(float4(position, 1.0f), world).xyz;
 	result.Position = mul(float4(positionWS, 1.0f), cView.ViewProjection);
 #if ALPHA_MASK
 	if(mesh.UVsOffset != 0xFFFFFFFF)
-		result.UV = Unpack_RG16_FLOAT(BufferLoad<uint>(mesh.BufferIndex, vertexId, mesh.UVsOffset));
+		result.UV = GetVertexUV(mesh, vertexId);
 #endif
 	return result;
 }
@@ -330,11 +430,14 @@ void PSMain(
 [numthreads(1, 1, 1)]
 void PrintStatsCS()
 {
-	uint numInstances = cView.NumInstances;
+	uint numInstances = 0;
 	uint numMeshlets = 0;
-	for(uint i = 0; i < numInstances; ++i)
+	for(uint i = 0; i < cView.NumInstances; ++i)
 	{
 		InstanceData instance = GetInstance(i);
+		if(instance.MeshIndex == INVALID_HANDLE)
+			continue;
+		++numInstances;
 		MeshData mesh = GetMesh(instance.MeshIndex);
 		numMeshlets += mesh.MeshletCount;
 	}
@@ -114,4 +114,28 @@ float4 Unpack_RGB10A2_SNORM(uint value)
 		((sValue << 2) >> 22) * scaleXYZ,
 		((sValue << 0) >> 30) * 1.0f
 	);
-}
\ No newline at end of file
+}
+
+float2 Unpack_RG16_UNORM(uint value)
+{
+	return float2(value & 0xFFFF, value >> 16) / 65535.0f;
+}
+
+// Octahedron encoded unit vector in 2x15 bits with a sign in the top bit
+float3 Unpack_OCT15_SIGN(uint value, out float sign)
+{
+	int sValue = int(value);
+	float2 p = float2((sValue << 17) >> 17, (sValue << 2) >> 17) / 16383.0f;
+	sign = (value >> 31) ? -1.0f : 1.0f;
+	return DecodeNormalOctahedron(max(p, -1.0f));
+}
+
+// Branchless orthonormal basis around a unit vector [Duff et al. 2017]
+void GetOrthonormalBasis(float3 n, out float3 b1, out float3 b2)
+{
+	float s = n.z >= 0.0f ? 1.0f : -1.0f;
+	float a = -1.0f / (s + n.z);
+	float b = n.x * n.y * a;
+	b1 = float3(1.0f + s * n.x * n.x * a, s * b, -s * n.x);
+	b2 = float3(b, s + n.y * n.y * a, -n.y);
+}
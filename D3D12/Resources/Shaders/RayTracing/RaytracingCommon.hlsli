@@ -28,11 +28,13 @@ VertexAttribute GetVertexAttributes(InstanceData instance, float2 attribBarycent
 	for(int i = 0; i < 3; ++i)
 	{
 		uint vertexId = indices[i];
-		positions[i] = Unpack_RGBA16_SNORM(BufferLoad<uint2>(mesh.BufferIndex, vertexId, mesh.PositionsOffset)).xyz;
-		outData.UV += Unpack_RG16_FLOAT(BufferLoad<uint>(mesh.BufferIndex, vertexId, mesh.UVsOffset)) * barycentrics[i];
-		uint2 normalData = BufferLoad<uint2>(mesh.BufferIndex, vertexId, mesh.NormalsOffset);
-		outData.Normal += Unpack_RGB10A2_SNORM(normalData.x).xyz * barycentrics[i];
-		outData.Tangent += Unpack_RGB10A2_SNORM(normalData.y) * barycentrics[i];
+		positions[i] = GetVertexPosition(mesh, vertexId);
+		outData.UV += GetVertexUV(mesh, vertexId) * barycentrics[i];
+		float3 normal;
+		float4 tangent;
+		GetVertexNormal(mesh, vertexId, normal, tangent);
+		outData.Normal += normal * barycentrics[i];
+		outData.Tangent += tangent * barycentrics[i];
 		if(mesh.ColorsOffset != ~0u)
 			outData.Color = BufferLoad<uint>(mesh.BufferIndex, vertexId, mesh.ColorsOffset);
 		else
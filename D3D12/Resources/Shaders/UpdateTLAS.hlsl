@@ -11,6 +11,8 @@ struct BLASInstance
 	D3D12_GPU_VIRTUAL_ADDRESS AccelerationStructure;
 	uint InstanceID;
 	uint Flags;
+	uint Slot;
+	uint Padding;
 };
 
 ConstantBuffer<PassParameters> cPass : register(b0);
@@ -31,6 +33,6 @@ void UpdateTLASCS(uint threadID : SV_DispatchThreadID)
 		output.AccelerationStructure = blasDesc.AccelerationStructure;
 		InstanceData instance = GetInstance(blasDesc.InstanceID);
 		output.Transform = (float3x4)transpose(instance.LocalToWorld);
-		uOutputInstances[threadID] = output;
+		uOutputInstances[blasDesc.Slot] = output;
 	}
 }
@@ -96,12 +96,10 @@ VisBufferVertexAttribute GetVertexAttributes(float2 screenUV, InstanceData insta
 	for(uint i = 0; i < 3; ++i)
 	{
 		uint vertexId = indices[i];
-		float3 position = Unpack_RGBA16_SNORM(BufferLoad<uint2>(mesh.BufferIndex, vertexId, mesh.PositionsOffset)).xyz;
+		float3 position = GetVertexPosition(mesh, vertexId);
 		positions[i] = mul(float4(position, 1), instance.LocalToWorld).xyz;
-        vertices[i].UV = Unpack_RG16_FLOAT(BufferLoad<uint>(mesh.BufferIndex, vertexId, mesh.UVsOffset));
-        uint2 normalData = BufferLoad<uint2>(mesh.BufferIndex, vertexId, mesh.NormalsOffset);
-        vertices[i].Normal = Unpack_RGB10A2_SNORM(normalData.x).xyz;
-        vertices[i].Tangent = Unpack_RGB10A2_SNORM(normalData.y);
+        vertices[i].UV = GetVertexUV(mesh, vertexId);
+        GetVertexNormal(mesh, vertexId, vertices[i].Normal, vertices[i].Tangent);
 		if(mesh.ColorsOffset != ~0u)
 			vertices[i].Color = BufferLoad<uint>(mesh.BufferIndex, vertexId, mesh.ColorsOffset);
 		else